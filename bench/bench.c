@@ -0,0 +1,578 @@
+/*> Description ******************************************************************************************************/
+/**
+* @brief Benchmarks creating, printing and freeing directory trees. Generates synthetic trees of different shapes,
+*        then reports the time of each phase, entries per second, peak memory and the number of system calls of each
+*        phase. Results are appended as JSON lines, so runs of different commits can be compared.
+* @file bench.c
+*/
+
+/*> Includes *********************************************************************************************************/
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ptrace.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "directory_tree.h"
+#include "output_writer.h"
+#include "string_util.h"
+#include "work_pool.h"
+
+/*> Defines **********************************************************************************************************/
+#define DEFAULT_ROOT "/dev/shm/tree_bench"
+#define DEFAULT_OUTPUT "bench_results.jsonl"
+#define DEFAULT_REPEAT_COUNT 5
+#define MAX_REPEAT_COUNT 100
+#define PHASE_COUNT 3
+#define PATH_CAPACITY 4096
+
+/*> Type Declarations ************************************************************************************************/
+/**
+ * @brief The shape of a generated tree. Every directory above the last level has the same number of directories and
+ *        files, directories on the last level only have files.
+ * @param name The name of the tree, also the name of its directory in the root.
+ * @param level_count The number of levels of directories below the base.
+ * @param directories_per_directory The number of child directories of a directory above the last level.
+ * @param files_per_directory The number of files of every directory.
+ */
+typedef struct Tree_Shape
+{
+  char* name;
+  int level_count;
+  int directories_per_directory;
+  int files_per_directory;
+} Tree_Shape;
+
+/**
+ * @brief The settings of a benchmark run.
+ * @param root The directory the trees are generated in, preferably on tmpfs.
+ * @param output The file the results are appended to.
+ * @param label The label of the results, e.g. the commit.
+ * @param repeat_count The number of times each tree is created, printed and freed. The median is reported.
+ * @param options How the trees are read.
+ */
+typedef struct Bench_Settings
+{
+  char* root;
+  char* output;
+  char* label;
+  int repeat_count;
+  Directory_Tree_Options options;
+} Bench_Settings;
+
+/**
+ * @brief The measurements of one tree.
+ * @param entry_count The number of nodes of the tree.
+ * @param seconds The median time of creating, printing and freeing the tree.
+ * @param syscall_counts The number of system calls of creating, printing and freeing the tree.
+ * @param peak_rss_kb The peak resident memory of the process measuring the times, in kilobytes.
+ */
+typedef struct Bench_Result
+{
+  size_t entry_count;
+  double seconds[PHASE_COUNT];
+  long syscall_counts[PHASE_COUNT];
+  long peak_rss_kb;
+} Bench_Result;
+
+/*> Global Constant Definitions **************************************************************************************/
+
+/*> Global Variable Definitions **************************************************************************************/
+
+/*> Local Constant Definitions ***************************************************************************************/
+static const Tree_Shape TREE_SHAPES[] = 
+{
+  {"wide", 2, 64, 16},
+  {"deep", 400, 1, 4},
+  {"small_files", 1, 100, 1000},
+  {"huge_directory", 0, 0, 200000},
+};
+
+static const char* PHASE_NAMES[PHASE_COUNT] = {"create", "print", "free"};
+
+static const char* USAGE_STRING = 
+  "usage: bench_tree [--root <dir>] [--output <file>] [--label <text>] [--repeat <n>] [-j <n>] [--uring]\n";
+
+/*> Local Variable Definitions ***************************************************************************************/
+
+/*> Local Function Declarations **************************************************************************************/
+int main(int argument_count, char* argument_array[]);
+
+static bool parse_bench_arguments(int argument_count, char* argument_array[], Bench_Settings* settings_p);
+
+static void make_directory(char* path);
+
+static void create_file(char* path);
+
+static void generate_level(char* path, size_t path_length, const Tree_Shape* shape_p, int level);
+
+static void generate_tree(char* root, const Tree_Shape* shape_p, char* path);
+
+static double get_seconds(void);
+
+static int compare_doubles(const void* value1_p, const void* value2_p);
+
+static void mark_phase(void);
+
+static void run_phases(char* path, Directory_Tree_Options* options_p, double* seconds, size_t* entry_count_p);
+
+static void measure_times(char* path, Bench_Settings* settings_p, Bench_Result* result_p);
+
+static void count_syscalls(char* path, Bench_Settings* settings_p, Bench_Result* result_p);
+
+static void report_result(FILE* output_p, Bench_Settings* settings_p, const Tree_Shape* shape_p, Bench_Result* result_p);
+
+/*> Local Function Definitions ***************************************************************************************/
+/**
+ * @brief Parses the arguments of the benchmark.
+ * @param argument_count [in] The number of arguments.
+ * @param argument_array [in] The arguments.
+ * @param settings_p [out] The settings of the run.
+ * @return True if the arguments could be parsed, false otherwise.
+ */
+static bool parse_bench_arguments(int argument_count, char* argument_array[], Bench_Settings* settings_p)
+{
+  settings_p->root = DEFAULT_ROOT;
+  settings_p->output = DEFAULT_OUTPUT;
+  settings_p->label = "";
+  settings_p->repeat_count = DEFAULT_REPEAT_COUNT;
+  memset(&settings_p->options, 0, sizeof(settings_p->options));
+  settings_p->options.depth = INT32_MAX;
+  settings_p->options.thread_count = 1;
+
+  for (int i = 1; i < argument_count; i++)
+  {
+    char* argument = argument_array[i];
+    bool has_value = i + 1 < argument_count;
+    if (strings_are_equal(argument, "--uring"))
+    {
+      settings_p->options.use_uring = true;
+    }
+    else if (!has_value)
+    {
+      return false;
+    }
+    else if (strings_are_equal(argument, "--root"))
+    {
+      settings_p->root = argument_array[++i];
+    }
+    else if (strings_are_equal(argument, "--output"))
+    {
+      settings_p->output = argument_array[++i];
+    }
+    else if (strings_are_equal(argument, "--label"))
+    {
+      settings_p->label = argument_array[++i];
+    }
+    else if (strings_are_equal(argument, "--repeat") && is_numeric_string(argument_array[i + 1]))
+    {
+      settings_p->repeat_count = atoi(argument_array[++i]);
+      if (settings_p->repeat_count < 1 || settings_p->repeat_count > MAX_REPEAT_COUNT)
+      {
+        return false;
+      }
+    }
+    else if (strings_are_equal(argument, "-j") && is_numeric_string(argument_array[i + 1]))
+    {
+      settings_p->options.thread_count = atoi(argument_array[++i]);
+      if (settings_p->options.thread_count < 1 || settings_p->options.thread_count > MAX_WORKER_COUNT)
+      {
+        return false;
+      }
+    }
+    else
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+/**
+ * @brief Creates a directory, if it does not exist yet.
+ * @param path [in] The path of the directory.
+ */
+static void make_directory(char* path)
+{
+  if (mkdir(path, 0755) != 0 && errno != EEXIST)
+  {
+    printf("Could not create the directory: %s\n", path);
+    exit(1);
+  }
+}
+
+/**
+ * @brief Creates an empty file, if it does not exist yet.
+ * @param path [in] The path of the file.
+ */
+static void create_file(char* path)
+{
+  int fd = open(path, O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+  if (fd < 0)
+  {
+    printf("Could not create the file: %s\n", path);
+    exit(1);
+  }
+  close(fd);
+}
+
+/**
+ * @brief Generates the files and directories of one directory of a tree, and everything below it.
+ * @param path [in/out] The path of the directory, PATH_CAPACITY long. Names are appended to it and removed again.
+ * @param path_length [in] The length of path.
+ * @param shape_p [in] The shape of the tree.
+ * @param level [in] The level of the directory, 0 for the base.
+ */
+static void generate_level(char* path, size_t path_length, const Tree_Shape* shape_p, int level)
+{
+  for (int i = 0; i < shape_p->files_per_directory; i++)
+  {
+    snprintf(path + path_length, PATH_CAPACITY - path_length, "/f%06d", i);
+    create_file(path);
+  }
+
+  if (level < shape_p->level_count)
+  {
+    for (int i = 0; i < shape_p->directories_per_directory; i++)
+    {
+      int name_length = snprintf(path + path_length, PATH_CAPACITY - path_length, "/d%04d", i);
+      make_directory(path);
+      generate_level(path, path_length + name_length, shape_p, level + 1);
+    }
+  }
+
+  path[path_length] = '\0';
+}
+
+/**
+ * @brief Generates a tree, unless it was completely generated by an earlier run. The same shape always gives the
+ *        same tree.
+ * @param root [in] The directory the tree is generated in.
+ * @param shape_p [in] The shape of the tree.
+ * @param path [out] The path of the tree, PATH_CAPACITY long.
+ */
+static void generate_tree(char* root, const Tree_Shape* shape_p, char* path)
+{
+  char marker_path[PATH_CAPACITY];
+  snprintf(marker_path, sizeof(marker_path), "%s/%s.complete", root, shape_p->name);
+  snprintf(path, PATH_CAPACITY, "%s/%s", root, shape_p->name);
+
+  struct stat file_info = {0};
+  if (stat(marker_path, &file_info) == 0)
+  {
+    return;
+  }
+
+  /* An interrupted generation is completed, since existing files and directories are kept. */
+  printf("Generating %s...\n", path);
+  fflush(stdout);
+  make_directory(root);
+  make_directory(path);
+  generate_level(path, strlen(path), shape_p, 0);
+  create_file(marker_path);
+}
+
+/**
+ * @brief Gets the time of a monotonic clock.
+ * @return The time in seconds.
+ */
+static double get_seconds(void)
+{
+  struct timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return (double) time.tv_sec + (double) time.tv_nsec / 1e9;
+}
+
+/**
+ * @brief Compares two doubles for qsort.
+ * @param value1_p [in] The first double.
+ * @param value2_p [in] The second double.
+ * @return Negative, zero or positive if the first double is smaller, equal or larger.
+ */
+static int compare_doubles(const void* value1_p, const void* value2_p)
+{
+  double value1 = *(const double*) value1_p;
+  double value2 = *(const double*) value2_p;
+  return (value1 > value2) - (value1 < value2);
+}
+
+/**
+ * @brief Marks the start of the next phase for the process counting system calls. getpid is used as the mark, since
+ *        the tree code never calls it.
+ */
+static void mark_phase(void)
+{
+  syscall(SYS_getpid);
+}
+
+/**
+ * @brief Creates, prints and frees a tree once. The tree is printed to /dev/null.
+ * @param path [in] The base path of the tree.
+ * @param options_p [in] How the tree is read.
+ * @param seconds [out] The time of each phase, PHASE_COUNT long.
+ * @param entry_count_p [out] The number of nodes of the tree.
+ */
+static void run_phases(char* path, Directory_Tree_Options* options_p, double* seconds, size_t* entry_count_p)
+{
+  int null_fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+  Output_Writer writer;
+  output_writer_init(&writer, null_fd, false);
+
+  mark_phase();
+  double start_time = get_seconds();
+  Directory_Tree* dir_tree = create_directory_tree(path, options_p);
+  double create_time = get_seconds();
+
+  mark_phase();
+  print_directory_tree(dir_tree, options_p->output_format, &writer);
+  output_writer_flush(&writer);
+  double print_time = get_seconds();
+
+  Directory_Tree_Memory_Usage usage = {0};
+  get_directory_tree_memory_usage(dir_tree, &usage);
+  *entry_count_p = usage.node_count;
+
+  mark_phase();
+  free_directory_tree(dir_tree);
+  double free_time = get_seconds();
+  mark_phase();
+
+  seconds[0] = create_time - start_time;
+  seconds[1] = print_time - create_time;
+  seconds[2] = free_time - print_time;
+
+  output_writer_free(&writer);
+  close(null_fd);
+}
+
+/**
+ * @brief Measures the median time of each phase in a child process, so its peak memory is that of the tree alone.
+ * @param path [in] The base path of the tree.
+ * @param settings_p [in] The settings of the run.
+ * @param result_p [out] The entry count, times and peak memory are set.
+ */
+static void measure_times(char* path, Bench_Settings* settings_p, Bench_Result* result_p)
+{
+  /* The child flushes stdout when it sets up its writer, so pending output must not be copied into it. */
+  fflush(stdout);
+
+  int pipe_fds[2];
+  if (pipe(pipe_fds) != 0)
+  {
+    printf("Could not create a pipe.\n");
+    exit(1);
+  }
+
+  pid_t pid = fork();
+  if (pid == 0)
+  {
+    close(pipe_fds[0]);
+    Bench_Result child_result = {0};
+    double seconds[PHASE_COUNT][MAX_REPEAT_COUNT];
+    for (int i = 0; i < settings_p->repeat_count; i++)
+    {
+      double repeat_seconds[PHASE_COUNT];
+      run_phases(path, &settings_p->options, repeat_seconds, &child_result.entry_count);
+      for (int phase = 0; phase < PHASE_COUNT; phase++)
+      {
+        seconds[phase][i] = repeat_seconds[phase];
+      }
+    }
+
+    for (int phase = 0; phase < PHASE_COUNT; phase++)
+    {
+      qsort(seconds[phase], settings_p->repeat_count, sizeof(double), compare_doubles);
+      child_result.seconds[phase] = seconds[phase][settings_p->repeat_count / 2];
+    }
+
+    ssize_t written = write(pipe_fds[1], &child_result, sizeof(child_result));
+    _exit(written == sizeof(child_result) ? 0 : 1);
+  }
+
+  close(pipe_fds[1]);
+  ssize_t length = read(pipe_fds[0], result_p, sizeof(Bench_Result));
+  close(pipe_fds[0]);
+
+  int status = 0;
+  struct rusage usage = {0};
+  if (pid < 0 || wait4(pid, &status, 0, &usage) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0 ||
+      length != sizeof(Bench_Result))
+  {
+    printf("Could not measure the tree: %s\n", path);
+    exit(1);
+  }
+  result_p->peak_rss_kb = usage.ru_maxrss;
+}
+
+/**
+ * @brief Counts the system calls of each phase by tracing a child process, including the threads it starts. Tracing
+ *        slows the child down a lot, so it is done apart from measuring the times.
+ * @param path [in] The base path of the tree.
+ * @param settings_p [in] The settings of the run.
+ * @param result_p [out] The system call counts are set.
+ */
+static void count_syscalls(char* path, Bench_Settings* settings_p, Bench_Result* result_p)
+{
+  fflush(stdout);
+  pid_t pid = fork();
+  if (pid == 0)
+  {
+    ptrace(PTRACE_TRACEME, 0, NULL, NULL);
+    raise(SIGSTOP);
+    double seconds[PHASE_COUNT];
+    size_t entry_count = 0;
+    run_phases(path, &settings_p->options, seconds, &entry_count);
+    _exit(0);
+  }
+
+  int status = 0;
+  if (pid < 0 || waitpid(pid, &status, 0) < 0 || !WIFSTOPPED(status))
+  {
+    printf("Could not trace the tree: %s\n", path);
+    exit(1);
+  }
+  ptrace(PTRACE_SETOPTIONS, pid, NULL, PTRACE_O_TRACESYSGOOD | PTRACE_O_TRACECLONE | PTRACE_O_EXITKILL);
+  ptrace(PTRACE_SYSCALL, pid, NULL, NULL);
+
+  /* Phase 0 is before the first mark, so the counts of phase i are stored at i - 1. */
+  int phase = 0;
+  memset(result_p->syscall_counts, 0, sizeof(result_p->syscall_counts));
+  while (true)
+  {
+    pid_t stopped_pid = waitpid(-1, &status, __WALL);
+    if (stopped_pid < 0)
+    {
+      break;
+    }
+    if (WIFEXITED(status) || WIFSIGNALED(status))
+    {
+      if (stopped_pid == pid)
+      {
+        break;
+      }
+      continue;
+    }
+
+    int signal_number = 0;
+    if (WSTOPSIG(status) == (SIGTRAP | 0x80))
+    {
+      struct __ptrace_syscall_info info = {0};
+      ptrace(PTRACE_GET_SYSCALL_INFO, stopped_pid, (void*) sizeof(info), &info);
+      if (info.op == PTRACE_SYSCALL_INFO_ENTRY)
+      {
+        if (info.entry.nr == SYS_getpid)
+        {
+          phase++;
+        }
+        else if (phase >= 1 && phase <= PHASE_COUNT)
+        {
+          result_p->syscall_counts[phase - 1]++;
+        }
+      }
+    }
+    else if (WSTOPSIG(status) != SIGTRAP && WSTOPSIG(status) != SIGSTOP)
+    {
+      /* Other signals are passed on, events and the first stop of new threads are not. */
+      signal_number = WSTOPSIG(status);
+    }
+    ptrace(PTRACE_SYSCALL, stopped_pid, NULL, (void*) (intptr_t) signal_number);
+  }
+}
+
+/**
+ * @brief Prints the result of one tree, and appends it to the output file as one JSON object per line.
+ * @param output_p [in/out] The output file.
+ * @param settings_p [in] The settings of the run.
+ * @param shape_p [in] The shape of the tree.
+ * @param result_p [in] The result.
+ */
+static void report_result(FILE* output_p, Bench_Settings* settings_p, const Tree_Shape* shape_p, Bench_Result* result_p)
+{
+  double entries_per_second = result_p->seconds[0] > 0 ? result_p->entry_count / result_p->seconds[0] : 0;
+
+  printf("%-16s %9zu %10.4f %10.4f %10.4f %12.0f %10ld %9ld %9ld %9ld\n",
+         shape_p->name,
+         result_p->entry_count,
+         result_p->seconds[0],
+         result_p->seconds[1],
+         result_p->seconds[2],
+         entries_per_second,
+         result_p->peak_rss_kb,
+         result_p->syscall_counts[0],
+         result_p->syscall_counts[1],
+         result_p->syscall_counts[2]);
+
+  fprintf(output_p, "{\"label\": \"%s\", \"tree\": \"%s\", \"threads\": %d, \"uring\": %s, \"entries\": %zu, ",
+          settings_p->label,
+          shape_p->name,
+          settings_p->options.thread_count,
+          settings_p->options.use_uring ? "true" : "false",
+          result_p->entry_count);
+  for (int phase = 0; phase < PHASE_COUNT; phase++)
+  {
+    fprintf(output_p, "\"%s_seconds\": %.6f, ", PHASE_NAMES[phase], result_p->seconds[phase]);
+  }
+  for (int phase = 0; phase < PHASE_COUNT; phase++)
+  {
+    fprintf(output_p, "\"%s_syscalls\": %ld, ", PHASE_NAMES[phase], result_p->syscall_counts[phase]);
+  }
+  fprintf(output_p, "\"entries_per_second\": %.0f, \"peak_rss_kb\": %ld}\n", 
+          entries_per_second, 
+          result_p->peak_rss_kb);
+}
+
+/*> Global Function Definitions **************************************************************************************/
+/**
+* @brief Main function of the benchmark.
+* @param argument_count [in] Number of input arguments.
+* @param argument_array [in] Array containing input arguments.
+* @return The return code of the program. 0 means the benchmark finished correctly.
+*/
+int main(int argument_count, char* argument_array[])
+{
+  Bench_Settings settings;
+  if (!parse_bench_arguments(argument_count, argument_array, &settings))
+  {
+    printf("%s", USAGE_STRING);
+    return 1;
+  }
+
+  FILE* output_p = fopen(settings.output, "a");
+  if (output_p == NULL)
+  {
+    printf("Could not open the output file: %s\n", settings.output);
+    return 1;
+  }
+
+  char paths[sizeof(TREE_SHAPES) / sizeof(TREE_SHAPES[0])][PATH_CAPACITY];
+  for (size_t i = 0; i < sizeof(TREE_SHAPES) / sizeof(TREE_SHAPES[0]); i++)
+  {
+    generate_tree(settings.root, &TREE_SHAPES[i], paths[i]);
+  }
+
+  printf("%-16s %9s %10s %10s %10s %12s %10s %9s %9s %9s\n",
+         "tree", "entries", "create s", "print s", "free s", "entries/s", "peak KB", "create #", "print #", "free #");
+  for (size_t i = 0; i < sizeof(TREE_SHAPES) / sizeof(TREE_SHAPES[0]); i++)
+  {
+    Bench_Result result = {0};
+    measure_times(paths[i], &settings, &result);
+    count_syscalls(paths[i], &settings, &result);
+    report_result(output_p, &settings, &TREE_SHAPES[i], &result);
+  }
+
+  fclose(output_p);
+  printf("Results appended to %s\n", settings.output);
+  return 0;
+}
@@ -0,0 +1,195 @@
+/*> Description ******************************************************************************************************/
+/**
+* @brief Defines the bump allocator used for Directory_Tree nodes.
+* @file arena.c
+*/
+
+/*> Includes *********************************************************************************************************/
+#include <stdalign.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "walk_stats.h"
+
+/*> Defines **********************************************************************************************************/
+#define ARENA_ALIGNMENT alignof(void*)
+
+/*> Type Declarations ************************************************************************************************/
+
+/*> Global Constant Definitions **************************************************************************************/
+
+/*> Global Variable Definitions **************************************************************************************/
+
+/*> Local Constant Definitions ***************************************************************************************/
+
+/*> Local Variable Definitions ***************************************************************************************/
+
+/*> Local Function Declarations **************************************************************************************/
+static size_t align_size(size_t size, size_t alignment);
+
+static Arena_Block* add_block(Arena* arena_p, size_t minimum_size);
+
+static void* allocate(Arena* arena_p, size_t size, size_t alignment);
+
+/*> Local Function Definitions ***************************************************************************************/
+/**
+ * @brief Rounds a size up to a multiple of an alignment.
+ * @param size [in] The size to round up.
+ * @param alignment [in] The alignment, must be a power of two.
+ * @return The aligned size.
+ */
+static size_t align_size(size_t size, size_t alignment)
+{
+  return (size + alignment - 1) & ~(alignment - 1);
+}
+
+/**
+ * @brief Allocates a new block and makes it the head of the arena.
+ * @param arena_p [in/out] The arena to add the block to.
+ * @param minimum_size [in] The minimum number of usable bytes of the block.
+ * @return The new block.
+ */
+static Arena_Block* add_block(Arena* arena_p, size_t minimum_size)
+{
+  size_t size = minimum_size > ARENA_BLOCK_SIZE ? minimum_size : ARENA_BLOCK_SIZE;
+  uint64_t start_ns = walk_stats_start();
+  Arena_Block* block_p = (Arena_Block*) malloc(sizeof(Arena_Block) + size);
+  walk_stats_stop(WALK_STAT_ALLOCATE, start_ns, 1);
+  if (block_p == NULL)
+  {
+    printf("Could not allocate memory for the directory tree.\n");
+    exit(1);
+  }
+
+  block_p->next = arena_p->head;
+  block_p->size = size;
+  block_p->used = 0;
+  arena_p->head = block_p;
+  arena_p->bytes_reserved += sizeof(Arena_Block) + size;
+  return block_p;
+}
+
+/**
+ * @brief Allocates memory from the head block of the arena, adding a new block if it does not fit.
+ * @param arena_p [in/out] The arena to allocate from.
+ * @param size [in] The number of bytes to allocate.
+ * @param alignment [in] The alignment of the returned memory, must be a power of two.
+ * @return Pointer to the allocated memory.
+ */
+static void* allocate(Arena* arena_p, size_t size, size_t alignment)
+{
+  Arena_Block* block_p = arena_p->head;
+  size_t offset = block_p == NULL ? 0 : align_size(block_p->used, alignment);
+  if (block_p == NULL || offset > block_p->size || block_p->size - offset < size)
+  {
+    block_p = add_block(arena_p, size);
+    offset = 0;
+  }
+
+  void* memory_p = block_p->data + offset;
+  arena_p->bytes_used += offset + size - block_p->used;
+  block_p->used = offset + size;
+  return memory_p;
+}
+
+/*> Global Function Definitions **************************************************************************************/
+/**
+ * @brief Initializes an empty arena. No memory is allocated until the first allocation.
+ * @param arena_p [out] The arena to initialize.
+ */
+void arena_init(Arena* arena_p)
+{
+  arena_p->head = NULL;
+  arena_p->bytes_used = 0;
+  arena_p->bytes_reserved = 0;
+}
+
+/**
+ * @brief Allocates memory from the arena. The memory is aligned for pointers and integers.
+ * @param arena_p [in/out] The arena to allocate from.
+ * @param size [in] The number of bytes to allocate.
+ * @return Pointer to the allocated memory. Exits the program if no memory could be allocated.
+ */
+void* arena_allocate(Arena* arena_p, size_t size)
+{
+  return allocate(arena_p, size, ARENA_ALIGNMENT);
+}
+
+/**
+ * @brief Allocates room for a string in the arena.
+ * @param arena_p [in/out] The arena to allocate from.
+ * @param length [in] The length of the string, not counting the null terminator.
+ * @return Pointer to length + 1 bytes of memory.
+ */
+char* arena_allocate_string(Arena* arena_p, size_t length)
+{
+  /* Strings need no alignment, so they are packed tightly between the nodes. */
+  return (char*) allocate(arena_p, length + 1, 1);
+}
+
+/**
+ * @brief Copies a string into the arena.
+ * @param arena_p [in/out] The arena to allocate from.
+ * @param str [in] The string to copy, does not need to be null terminated.
+ * @param length [in] The number of characters to copy.
+ * @return The null terminated copy of the string.
+ */
+char* arena_copy_string(Arena* arena_p, const char* str, size_t length)
+{
+  char* copy = arena_allocate_string(arena_p, length);
+  memcpy(copy, str, length);
+  copy[length] = '\0';
+  return copy;
+}
+
+/**
+ * @brief Moves all memory of one arena to another, so it is freed together with the other arena. Used to combine
+ *        arenas filled by different threads.
+ * @param destination_p [in/out] The arena that takes over the memory.
+ * @param source_p [in/out] The arena whose memory is moved. It is left empty and can be reused.
+ */
+void arena_merge(Arena* destination_p, Arena* source_p)
+{
+  if (source_p->head == NULL)
+  {
+    return;
+  }
+
+  if (destination_p->head == NULL)
+  {
+    destination_p->head = source_p->head;
+  }
+  else
+  {
+    /* Keep the head of the destination first, so it keeps allocating from its partly filled block. */
+    Arena_Block* tail_p = source_p->head;
+    while (tail_p->next != NULL)
+    {
+      tail_p = tail_p->next;
+    }
+    tail_p->next = destination_p->head->next;
+    destination_p->head->next = source_p->head;
+  }
+
+  destination_p->bytes_used += source_p->bytes_used;
+  destination_p->bytes_reserved += source_p->bytes_reserved;
+  arena_init(source_p);
+}
+
+/**
+ * @brief Frees all memory allocated from the arena.
+ * @param arena_p [in/out] The arena to free. It is left empty and can be reused.
+ */
+void arena_free(Arena* arena_p)
+{
+  Arena_Block* block_p = arena_p->head;
+  while (block_p != NULL)
+  {
+    Arena_Block* next_p = block_p->next;
+    free(block_p);
+    block_p = next_p;
+  }
+  arena_init(arena_p);
+}
@@ -0,0 +1,384 @@
+/*> Description ******************************************************************************************************/
+/**
+* @brief Defines the hash of file contents, XXH64 computed from a buffer or from a file read or mapped in windows.
+* @file content_hash.c
+*/
+
+/*> Includes *********************************************************************************************************/
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "content_hash.h"
+
+/*> Defines **********************************************************************************************************/
+#define PRIME64_1 0x9E3779B185EBCA87ULL
+#define PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define PRIME64_3 0x165667B19E3779F9ULL
+#define PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define PRIME64_5 0x27D4EB2F165667C5ULL
+#define MAP_THRESHOLD (256 * 1024)
+#define MAP_WINDOW_SIZE (64 * 1024 * 1024)
+
+/*> Type Declarations ************************************************************************************************/
+
+/*> Global Constant Definitions **************************************************************************************/
+
+/*> Global Variable Definitions **************************************************************************************/
+
+/*> Local Constant Definitions ***************************************************************************************/
+
+/*> Local Variable Definitions ***************************************************************************************/
+
+/*> Local Function Declarations **************************************************************************************/
+static uint64_t rotate_left(uint64_t value, int bits);
+
+static uint64_t read_64(const unsigned char* bytes);
+
+static uint32_t read_32(const unsigned char* bytes);
+
+static uint64_t mix_lane(uint64_t accumulator, uint64_t input);
+
+static uint64_t merge_lane(uint64_t hash, uint64_t accumulator);
+
+static const unsigned char* mix_stripes(Content_Hasher* hasher_p, const unsigned char* data, const unsigned char* end);
+
+static bool hash_mapped_file(int fd, uint64_t size, Content_Hasher* hasher_p);
+
+static bool hash_read_file(int fd, char* buffer, size_t buffer_size, Content_Hasher* hasher_p);
+
+/*> Local Function Definitions ***************************************************************************************/
+/**
+ * @brief Rotates the bits of a value to the left.
+ * @param value [in] The value.
+ * @param bits [in] The number of bits to rotate by, in the range (0, 64).
+ * @return The rotated value.
+ */
+static uint64_t rotate_left(uint64_t value, int bits)
+{
+  return (value << bits) | (value >> (64 - bits));
+}
+
+/**
+ * @brief Reads 8 bytes as a little endian number, so hashes are the same on hosts of either byte order.
+ * @param bytes [in] The bytes, not necessarily aligned.
+ * @return The number.
+ */
+static uint64_t read_64(const unsigned char* bytes)
+{
+  uint64_t value;
+  memcpy(&value, bytes, sizeof(value));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  value = __builtin_bswap64(value);
+#endif
+  return value;
+}
+
+/**
+ * @brief Reads 4 bytes as a little endian number.
+ * @param bytes [in] The bytes, not necessarily aligned.
+ * @return The number.
+ */
+static uint32_t read_32(const unsigned char* bytes)
+{
+  uint32_t value;
+  memcpy(&value, bytes, sizeof(value));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  value = __builtin_bswap32(value);
+#endif
+  return value;
+}
+
+/**
+ * @brief Mixes 8 bytes of input into one lane.
+ * @param accumulator [in] The lane.
+ * @param input [in] The input.
+ * @return The new value of the lane.
+ */
+static uint64_t mix_lane(uint64_t accumulator, uint64_t input)
+{
+  accumulator += input * PRIME64_2;
+  accumulator = rotate_left(accumulator, 31);
+  return accumulator * PRIME64_1;
+}
+
+/**
+ * @brief Merges a lane into the hash once all stripes are mixed.
+ * @param hash [in] The hash so far.
+ * @param accumulator [in] The lane.
+ * @return The new hash.
+ */
+static uint64_t merge_lane(uint64_t hash, uint64_t accumulator)
+{
+  hash ^= mix_lane(0, accumulator);
+  return hash * PRIME64_1 + PRIME64_4;
+}
+
+/**
+ * @brief Mixes the whole stripes of data into the lanes of a hasher.
+ * @param hasher_p [in/out] The hasher.
+ * @param data [in] The data.
+ * @param end [in] The end of the data.
+ * @return Where the bytes that do not fill a whole stripe start.
+ */
+static const unsigned char* mix_stripes(Content_Hasher* hasher_p, const unsigned char* data, const unsigned char* end)
+{
+  /* The lanes are kept in locals, so the compiler keeps them in registers for the whole loop. */
+  uint64_t lane_1 = hasher_p->accumulators[0];
+  uint64_t lane_2 = hasher_p->accumulators[1];
+  uint64_t lane_3 = hasher_p->accumulators[2];
+  uint64_t lane_4 = hasher_p->accumulators[3];
+  while (end - data >= CONTENT_HASH_STRIPE_SIZE)
+  {
+    lane_1 = mix_lane(lane_1, read_64(data));
+    lane_2 = mix_lane(lane_2, read_64(data + 8));
+    lane_3 = mix_lane(lane_3, read_64(data + 16));
+    lane_4 = mix_lane(lane_4, read_64(data + 24));
+    data += CONTENT_HASH_STRIPE_SIZE;
+  }
+  hasher_p->accumulators[0] = lane_1;
+  hasher_p->accumulators[1] = lane_2;
+  hasher_p->accumulators[2] = lane_3;
+  hasher_p->accumulators[3] = lane_4;
+  return data;
+}
+
+/**
+ * @brief Hashes a large regular file by mapping it a window at a time, so it is not copied into a buffer. A file
+ *        truncated by another process while it is mapped is not supported, it is expected to stay unchanged while
+ *        the tree is hashed.
+ * @param fd [in] The open file.
+ * @param size [in] The size of the file.
+ * @param hasher_p [in/out] The hasher the contents are added to.
+ * @return False if the file could not be mapped, then nothing was added and it can still be read.
+ */
+static bool hash_mapped_file(int fd, uint64_t size, Content_Hasher* hasher_p)
+{
+  for (uint64_t offset = 0; offset < size; offset += MAP_WINDOW_SIZE)
+  {
+    size_t window_size = size - offset < MAP_WINDOW_SIZE ? (size_t) (size - offset) : MAP_WINDOW_SIZE;
+    void* window = mmap(NULL, window_size, PROT_READ, MAP_PRIVATE, fd, (off_t) offset);
+    if (window == MAP_FAILED)
+    {
+      if (offset > 0)
+      {
+        /* Continue with reads where the mapped windows stopped. */
+        return lseek(fd, (off_t) offset, SEEK_SET) >= 0;
+      }
+      return false;
+    }
+    madvise(window, window_size, MADV_SEQUENTIAL);
+    content_hasher_update(hasher_p, window, window_size);
+    munmap(window, window_size);
+  }
+  return true;
+}
+
+/**
+ * @brief Hashes a file by reading it a buffer at a time, from its current offset to its end.
+ * @param fd [in] The open file.
+ * @param buffer [in] The buffer the file is read into.
+ * @param buffer_size [in] The size of the buffer.
+ * @param hasher_p [in/out] The hasher the contents are added to.
+ * @return False if the file could not be read.
+ */
+static bool hash_read_file(int fd, char* buffer, size_t buffer_size, Content_Hasher* hasher_p)
+{
+  while (true)
+  {
+    ssize_t length = read(fd, buffer, buffer_size);
+    if (length == 0)
+    {
+      return true;
+    }
+    if (length < 0)
+    {
+      return false;
+    }
+    content_hasher_update(hasher_p, buffer, (size_t) length);
+  }
+}
+
+/*> Global Function Definitions **************************************************************************************/
+/**
+ * @brief Starts a hash computed from data given in parts.
+ * @param hasher_p [out] The hasher.
+ * @param seed [in] The seed, hashes with different seeds are unrelated.
+ */
+void content_hasher_init(Content_Hasher* hasher_p, uint64_t seed)
+{
+  hasher_p->accumulators[0] = seed + PRIME64_1 + PRIME64_2;
+  hasher_p->accumulators[1] = seed + PRIME64_2;
+  hasher_p->accumulators[2] = seed;
+  hasher_p->accumulators[3] = seed - PRIME64_1;
+  hasher_p->seed = seed;
+  hasher_p->total_length = 0;
+  hasher_p->stripe_length = 0;
+}
+
+/**
+ * @brief Adds the next part of the data to a hash.
+ * @param hasher_p [in/out] The hasher.
+ * @param data [in] The part.
+ * @param length [in] The length of the part.
+ */
+void content_hasher_update(Content_Hasher* hasher_p, const void* data, size_t length)
+{
+  const unsigned char* bytes = (const unsigned char*) data;
+  const unsigned char* end = bytes + length;
+  hasher_p->total_length += length;
+
+  /* A stripe started by an earlier part is completed first. */
+  if (hasher_p->stripe_length > 0)
+  {
+    size_t missing = CONTENT_HASH_STRIPE_SIZE - hasher_p->stripe_length;
+    if (length < missing)
+    {
+      memcpy(hasher_p->stripe + hasher_p->stripe_length, bytes, length);
+      hasher_p->stripe_length += length;
+      return;
+    }
+    memcpy(hasher_p->stripe + hasher_p->stripe_length, bytes, missing);
+    mix_stripes(hasher_p, hasher_p->stripe, hasher_p->stripe + CONTENT_HASH_STRIPE_SIZE);
+    bytes += missing;
+    hasher_p->stripe_length = 0;
+  }
+
+  bytes = mix_stripes(hasher_p, bytes, end);
+  memcpy(hasher_p->stripe, bytes, (size_t) (end - bytes));
+  hasher_p->stripe_length = (size_t) (end - bytes);
+}
+
+/**
+ * @brief Finishes a hash. The hasher is not changed, so more parts can still be added.
+ * @param hasher_p [in] The hasher.
+ * @return The hash of all parts added so far.
+ */
+uint64_t content_hasher_digest(Content_Hasher* hasher_p)
+{
+  uint64_t hash;
+  if (hasher_p->total_length >= CONTENT_HASH_STRIPE_SIZE)
+  {
+    uint64_t* lanes = hasher_p->accumulators;
+    hash = rotate_left(lanes[0], 1) + rotate_left(lanes[1], 7) + rotate_left(lanes[2], 12) + rotate_left(lanes[3], 18);
+    for (int i = 0; i < 4; i++)
+    {
+      hash = merge_lane(hash, lanes[i]);
+    }
+  }
+  else
+  {
+    hash = hasher_p->seed + PRIME64_5;
+  }
+  hash += hasher_p->total_length;
+
+  const unsigned char* bytes = hasher_p->stripe;
+  const unsigned char* end = bytes + hasher_p->stripe_length;
+  while (end - bytes >= 8)
+  {
+    hash ^= mix_lane(0, read_64(bytes));
+    hash = rotate_left(hash, 27) * PRIME64_1 + PRIME64_4;
+    bytes += 8;
+  }
+  if (end - bytes >= 4)
+  {
+    hash ^= (uint64_t) read_32(bytes) * PRIME64_1;
+    hash = rotate_left(hash, 23) * PRIME64_2 + PRIME64_3;
+    bytes += 4;
+  }
+  while (bytes < end)
+  {
+    hash ^= *bytes * PRIME64_5;
+    hash = rotate_left(hash, 11) * PRIME64_1;
+    bytes++;
+  }
+
+  /* Every bit of the input affects every bit of the hash. */
+  hash ^= hash >> 33;
+  hash *= PRIME64_2;
+  hash ^= hash >> 29;
+  hash *= PRIME64_3;
+  hash ^= hash >> 32;
+  return hash;
+}
+
+/**
+ * @brief Hashes data in one call.
+ * @param data [in] The data.
+ * @param length [in] The length of the data.
+ * @param seed [in] The seed, hashes with different seeds are unrelated.
+ * @return The hash.
+ */
+uint64_t content_hash(const void* data, size_t length, uint64_t seed)
+{
+  Content_Hasher hasher;
+  content_hasher_init(&hasher, seed);
+  content_hasher_update(&hasher, data, length);
+  return content_hasher_digest(&hasher);
+}
+
+/**
+ * @brief Hashes the contents of a file. Regular files are read, or mapped if they are large. A link that is not
+ *        followed is hashed by the path it holds, and other special files, e.g. pipes and devices, by their kind
+ *        only, without opening them.
+ * @param directory_fd [in] The open directory of the file, or AT_FDCWD.
+ * @param name [in] The name of the file in the directory, or its path.
+ * @param follow_links [in] True if links are hashed by what they point to. A broken link is still hashed by its path.
+ * @param buffer [in] A buffer files are read into, at least PATH_MAX long.
+ * @param buffer_size [in] The size of the buffer.
+ * @param hash_p [out] The hash of the file.
+ * @return False if the file could not be read, e.g. because it is gone or not readable.
+ */
+bool content_hash_file(int directory_fd, 
+                       const char* name, 
+                       bool follow_links, 
+                       char* buffer, 
+                       size_t buffer_size, 
+                       uint64_t* hash_p)
+{
+  struct stat file_info;
+  if (fstatat(directory_fd, name, &file_info, follow_links ? 0 : AT_SYMLINK_NOFOLLOW) != 0 &&
+      (!follow_links || fstatat(directory_fd, name, &file_info, AT_SYMLINK_NOFOLLOW) != 0))
+  {
+    return false;
+  }
+
+  if (S_ISLNK(file_info.st_mode))
+  {
+    ssize_t length = readlinkat(directory_fd, name, buffer, buffer_size);
+    if (length < 0)
+    {
+      return false;
+    }
+    *hash_p = content_hash(buffer, (size_t) length, CONTENT_HASH_LINK_SEED);
+    return true;
+  }
+  if (!S_ISREG(file_info.st_mode))
+  {
+    *hash_p = content_hash(NULL, 0, CONTENT_HASH_SPECIAL_SEED);
+    return true;
+  }
+
+  int fd = openat(directory_fd, name, O_RDONLY | O_CLOEXEC | (follow_links ? 0 : O_NOFOLLOW));
+  if (fd < 0)
+  {
+    return false;
+  }
+
+  /* Mapping costs more than copying for small files, so only large files are mapped. */
+  Content_Hasher hasher;
+  content_hasher_init(&hasher, CONTENT_HASH_FILE_SEED);
+  bool is_hashed = file_info.st_size >= MAP_THRESHOLD && hash_mapped_file(fd, (uint64_t) file_info.st_size, &hasher);
+  if (!is_hashed)
+  {
+    is_hashed = hash_read_file(fd, buffer, buffer_size, &hasher);
+  }
+  close(fd);
+
+  *hash_p = content_hasher_digest(&hasher);
+  return is_hashed;
+}
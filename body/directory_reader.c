@@ -0,0 +1,117 @@
+/*> Description ******************************************************************************************************/
+/**
+* @brief Defines the directory reader. Entries are read with getdents64 straight into a large buffer, instead of the
+*        small internal buffer readdir uses, so big directories are read with few system calls.
+* @file directory_reader.c
+*/
+
+/*> Includes *********************************************************************************************************/
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "directory_reader.h"
+#include "walk_stats.h"
+
+/*> Defines **********************************************************************************************************/
+
+/*> Type Declarations ************************************************************************************************/
+
+/*> Global Constant Definitions **************************************************************************************/
+
+/*> Global Variable Definitions **************************************************************************************/
+
+/*> Local Constant Definitions ***************************************************************************************/
+
+/*> Local Variable Definitions ***************************************************************************************/
+
+/*> Local Function Declarations **************************************************************************************/
+static bool is_dot_entry(char* name);
+
+/*> Local Function Definitions ***************************************************************************************/
+/**
+ * @brief Checks if a name is "." or "..".
+ * @param name [in] The name to check.
+ * @return True if the name is "." or "..", false otherwise.
+ */
+static bool is_dot_entry(char* name)
+{
+  return name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'));
+}
+
+/*> Global Function Definitions **************************************************************************************/
+/**
+ * @brief Prepares a reader for an open directory. The reader does not take ownership of the fd or the buffer.
+ * @param reader_p [out] The reader to initialize.
+ * @param fd [in] The open directory.
+ * @param buffer [in] The buffer records are read into. It can be reused for the next directory once this one is read.
+ * @param buffer_size [in] The size of the buffer.
+ */
+void directory_reader_init(Directory_Reader* reader_p, int fd, char* buffer, size_t buffer_size)
+{
+  reader_p->fd = fd;
+  reader_p->buffer = buffer;
+  reader_p->buffer_size = buffer_size;
+  reader_p->position = 0;
+  reader_p->length = 0;
+  reader_p->error = 0;
+  reader_p->offset = 0;
+}
+
+/**
+ * @brief Reads the next entry of the directory. The "." and ".." entries are skipped.
+ * @param reader_p [in/out] The reader.
+ * @param entry_p [out] The entry read. Its name is only valid until the next call.
+ * @return True if an entry was read, false at the end of the directory or if reading failed, see error.
+ */
+bool directory_reader_next(Directory_Reader* reader_p, Directory_Entry* entry_p)
+{
+  while (true)
+  {
+    if (reader_p->position >= reader_p->length)
+    {
+      uint64_t start_ns = walk_stats_start();
+      ssize_t length = getdents64(reader_p->fd, reader_p->buffer, reader_p->buffer_size);
+      walk_stats_stop(WALK_STAT_READ, start_ns, 1);
+      if (length <= 0)
+      {
+        reader_p->error = length < 0 ? errno : 0;
+        return false;
+      }
+      reader_p->length = (size_t) length;
+      reader_p->position = 0;
+    }
+
+    struct dirent64* record_p = (struct dirent64*) (reader_p->buffer + reader_p->position);
+    reader_p->position += record_p->d_reclen;
+    reader_p->offset = record_p->d_off;
+
+    if (!is_dot_entry(record_p->d_name))
+    {
+      entry_p->name = record_p->d_name;
+      entry_p->type = record_p->d_type;
+      return true;
+    }
+  }
+}
+
+/**
+ * @brief Continues reading a directory that was closed, with the directory opened again. The records left in the
+ *        buffer when it was closed are read again, so the buffer does not need to be kept meanwhile.
+ * @param reader_p [in/out] The reader.
+ * @param fd [in] The directory, opened again.
+ * @param buffer [in] The buffer records are read into, at least as large as the buffer the reader was initialized with.
+ * @return True if the directory could be positioned after the last entry read, false otherwise.
+ */
+bool directory_reader_reopen(Directory_Reader* reader_p, int fd, char* buffer)
+{
+  reader_p->fd = fd;
+  reader_p->buffer = buffer;
+  reader_p->position = 0;
+  reader_p->length = 0;
+  return lseek(fd, (off_t) reader_p->offset, SEEK_SET) == (off_t) reader_p->offset;
+}
@@ -0,0 +1,546 @@
+/*> Description ******************************************************************************************************/
+/**
+* @brief Defines the sorting of the children of a directory.
+* @file directory_sort.c
+*/
+
+/*> Includes *********************************************************************************************************/
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "directory_sort.h"
+#include "directory_tree.h"
+
+/*> Defines **********************************************************************************************************/
+#define NAME_KEY_LENGTH 8
+#define INSERTION_SORT_THRESHOLD 16
+#define INITIAL_SORTER_CAPACITY 256
+
+/*> Type Declarations ************************************************************************************************/
+
+/*> Global Constant Definitions **************************************************************************************/
+
+/*> Global Variable Definitions **************************************************************************************/
+
+/*> Local Constant Definitions ***************************************************************************************/
+
+/*> Local Variable Definitions ***************************************************************************************/
+
+/*> Local Function Declarations **************************************************************************************/
+static bool is_digit(unsigned char c);
+
+static size_t get_name_length(Directory_Tree* node);
+
+static uint64_t get_name_key(Directory_Tree* node, bool is_natural);
+
+static int compare_names(Directory_Tree* node1, Directory_Tree* node2, size_t offset);
+
+static int compare_natural_names(Directory_Tree* node1, Directory_Tree* node2);
+
+static int compare_sort_keys(Sort_Order order, Sort_Key* key1_p, Sort_Key* key2_p);
+
+static void swap_sort_keys(Sort_Key* key1_p, Sort_Key* key2_p);
+
+static void insertion_sort(Sort_Order order, Sort_Key* keys, int count);
+
+static void sift_down(Sort_Order order, Sort_Key* keys, int root, int count);
+
+static void heap_sort(Sort_Order order, Sort_Key* keys, int count);
+
+static int partition(Sort_Order order, Sort_Key* keys, int count);
+
+static void intro_sort(Sort_Order order, Sort_Key* keys, int count, int depth_limit);
+
+static void reserve_capacity(Node_Sorter* sorter_p, int count);
+
+/*> Local Function Definitions ***************************************************************************************/
+/**
+ * @brief Checks if a character is a decimal digit.
+ * @param c [in] The character.
+ * @return True if it is a digit, false otherwise.
+ */
+static bool is_digit(unsigned char c)
+{
+  return c >= '0' && c <= '9';
+}
+
+/**
+ * @brief Gets the length of the name of a node.
+ * @param node [in] The node.
+ * @return The length of the name.
+ */
+static size_t get_name_length(Directory_Tree* node)
+{
+  return (size_t) node->file_name_length;
+}
+
+/**
+ * @brief Packs the first bytes of a name into an integer, so comparing keys orders names like comparing the names.
+ *        For natural order, the first number in the name is packed as '0', its number of digits without leading
+ *        zeros, and its first digits, which orders numbers by value as far as the key reaches.
+ * @param node [in] The node.
+ * @param is_natural [in] True if the key is for natural order.
+ * @return The key, ties have to be decided by comparing the whole names.
+ */
+static uint64_t get_name_key(Directory_Tree* node, bool is_natural)
+{
+  const unsigned char* name = (const unsigned char*) node->file_name;
+  size_t name_length = get_name_length(node);
+  unsigned char bytes[NAME_KEY_LENGTH] = {0};
+
+  size_t i = 0;
+  size_t key_length = 0;
+  while (i < name_length && key_length < NAME_KEY_LENGTH)
+  {
+    if (is_natural && is_digit(name[i]))
+    {
+      while (i < name_length && name[i] == '0')
+      {
+        i++;
+      }
+      size_t number_end = i;
+      while (number_end < name_length && is_digit(name[number_end]))
+      {
+        number_end++;
+      }
+      size_t digit_count = number_end - i;
+
+      bytes[key_length++] = '0';
+      if (key_length < NAME_KEY_LENGTH)
+      {
+        bytes[key_length++] = (unsigned char) (digit_count < UINT8_MAX ? digit_count : UINT8_MAX);
+      }
+      while (i < number_end && key_length < NAME_KEY_LENGTH)
+      {
+        bytes[key_length++] = name[i++];
+      }
+      break;
+    }
+    bytes[key_length++] = name[i++];
+  }
+
+  uint64_t key = 0;
+  for (size_t j = 0; j < NAME_KEY_LENGTH; j++)
+  {
+    key = (key << 8) | bytes[j];
+  }
+  return key;
+}
+
+/**
+ * @brief Compares two names byte by byte.
+ * @param node1 [in] The first node.
+ * @param node2 [in] The second node.
+ * @param offset [in] The number of leading bytes known to be equal, if both names are at least as long.
+ * @return Negative if the first name comes first, positive if the second does, 0 if they are equal.
+ */
+static int compare_names(Directory_Tree* node1, Directory_Tree* node2, size_t offset)
+{
+  size_t length1 = get_name_length(node1);
+  size_t length2 = get_name_length(node2);
+  size_t common_length = length1 < length2 ? length1 : length2;
+  if (offset > common_length)
+  {
+    offset = common_length;
+  }
+
+  int result = memcmp(node1->file_name + offset, node2->file_name + offset, common_length - offset);
+  if (result != 0)
+  {
+    return result;
+  }
+  return length1 < length2 ? -1 : (length1 > length2 ? 1 : 0);
+}
+
+/**
+ * @brief Compares two names in natural order, where runs of digits are compared by their number, so "file2" comes
+ *        before "file10". Names that only differ in leading zeros are ordered byte by byte.
+ * @param node1 [in] The first node.
+ * @param node2 [in] The second node.
+ * @return Negative if the first name comes first, positive if the second does, 0 if they are equal.
+ */
+static int compare_natural_names(Directory_Tree* node1, Directory_Tree* node2)
+{
+  const unsigned char* name1 = (const unsigned char*) node1->file_name;
+  const unsigned char* name2 = (const unsigned char*) node2->file_name;
+  size_t length1 = get_name_length(node1);
+  size_t length2 = get_name_length(node2);
+
+  /* Equal leading bytes compare equal, so the comparison starts where the names differ, or at the start of the number
+     they differ in. */
+  size_t common_length = 0;
+  while (common_length < length1 && common_length < length2 && name1[common_length] == name2[common_length])
+  {
+    common_length++;
+  }
+  while (common_length > 0 && is_digit(name1[common_length - 1]))
+  {
+    common_length--;
+  }
+
+  size_t i = common_length;
+  size_t j = common_length;
+  while (i < length1 && j < length2)
+  {
+    if (is_digit(name1[i]) && is_digit(name2[j]))
+    {
+      while (i < length1 && name1[i] == '0')
+      {
+        i++;
+      }
+      while (j < length2 && name2[j] == '0')
+      {
+        j++;
+      }
+      size_t number_start1 = i;
+      size_t number_start2 = j;
+      while (i < length1 && is_digit(name1[i]))
+      {
+        i++;
+      }
+      while (j < length2 && is_digit(name2[j]))
+      {
+        j++;
+      }
+
+      /* Without leading zeros, the longer number is the larger one. */
+      size_t number_length1 = i - number_start1;
+      size_t number_length2 = j - number_start2;
+      if (number_length1 != number_length2)
+      {
+        return number_length1 < number_length2 ? -1 : 1;
+      }
+      int result = memcmp(name1 + number_start1, name2 + number_start2, number_length1);
+      if (result != 0)
+      {
+        return result;
+      }
+      continue;
+    }
+
+    if (name1[i] != name2[j])
+    {
+      return name1[i] < name2[j] ? -1 : 1;
+    }
+    i++;
+    j++;
+  }
+
+  size_t rest1 = length1 - i;
+  size_t rest2 = length2 - j;
+  if (rest1 != rest2)
+  {
+    return rest1 < rest2 ? -1 : 1;
+  }
+  return compare_names(node1, node2, 0);
+}
+
+/**
+ * @brief Compares two sort keys, deciding ties of the key by the names.
+ * @param order [in] The order sorted in.
+ * @param key1_p [in] The first key.
+ * @param key2_p [in] The second key.
+ * @return Negative if the first node comes first, positive if the second does, 0 if they are equal.
+ */
+static int compare_sort_keys(Sort_Order order, Sort_Key* key1_p, Sort_Key* key2_p)
+{
+  if (key1_p->key != key2_p->key)
+  {
+    return key1_p->key < key2_p->key ? -1 : 1;
+  }
+
+  switch (order)
+  {
+    case SORT_NAME:
+      return compare_names(key1_p->node, key2_p->node, NAME_KEY_LENGTH);
+    case SORT_NATURAL:
+      return compare_natural_names(key1_p->node, key2_p->node);
+    default:
+      return compare_names(key1_p->node, key2_p->node, 0);
+  }
+}
+
+/**
+ * @brief Swaps two sort keys.
+ * @param key1_p [in/out] The first key.
+ * @param key2_p [in/out] The second key.
+ */
+static void swap_sort_keys(Sort_Key* key1_p, Sort_Key* key2_p)
+{
+  Sort_Key key = *key1_p;
+  *key1_p = *key2_p;
+  *key2_p = key;
+}
+
+/**
+ * @brief Sorts a few keys by insertion.
+ * @param order [in] The order to sort in.
+ * @param keys [in/out] The keys.
+ * @param count [in] The number of keys.
+ */
+static void insertion_sort(Sort_Order order, Sort_Key* keys, int count)
+{
+  for (int i = 1; i < count; i++)
+  {
+    Sort_Key key = keys[i];
+    int j = i;
+    while (j > 0 && compare_sort_keys(order, &key, &keys[j - 1]) < 0)
+    {
+      keys[j] = keys[j - 1];
+      j--;
+    }
+    keys[j] = key;
+  }
+}
+
+/**
+ * @brief Moves a key down a heap until its children are not larger.
+ * @param order [in] The order to sort in.
+ * @param keys [in/out] The heap.
+ * @param root [in] The index of the key to move down.
+ * @param count [in] The number of keys in the heap.
+ */
+static void sift_down(Sort_Order order, Sort_Key* keys, int root, int count)
+{
+  while (2 * root + 1 < count)
+  {
+    int child = 2 * root + 1;
+    if (child + 1 < count && compare_sort_keys(order, &keys[child], &keys[child + 1]) < 0)
+    {
+      child++;
+    }
+    if (compare_sort_keys(order, &keys[root], &keys[child]) >= 0)
+    {
+      return;
+    }
+    swap_sort_keys(&keys[root], &keys[child]);
+    root = child;
+  }
+}
+
+/**
+ * @brief Sorts keys with heap sort, used when quick sort keeps picking bad pivots.
+ * @param order [in] The order to sort in.
+ * @param keys [in/out] The keys.
+ * @param count [in] The number of keys.
+ */
+static void heap_sort(Sort_Order order, Sort_Key* keys, int count)
+{
+  for (int i = count / 2 - 1; i >= 0; i--)
+  {
+    sift_down(order, keys, i, count);
+  }
+  for (int i = count - 1; i > 0; i--)
+  {
+    swap_sort_keys(&keys[0], &keys[i]);
+    sift_down(order, keys, 0, i);
+  }
+}
+
+/**
+ * @brief Partitions keys around the median of the first, middle and last key.
+ * @param order [in] The order to sort in.
+ * @param keys [in/out] The keys, at least 3.
+ * @param count [in] The number of keys.
+ * @return The index of the last key of the lower part. Both parts are not empty.
+ */
+static int partition(Sort_Order order, Sort_Key* keys, int count)
+{
+  int middle = (count - 1) / 2;
+  if (compare_sort_keys(order, &keys[middle], &keys[0]) < 0)
+  {
+    swap_sort_keys(&keys[middle], &keys[0]);
+  }
+  if (compare_sort_keys(order, &keys[count - 1], &keys[middle]) < 0)
+  {
+    swap_sort_keys(&keys[count - 1], &keys[middle]);
+    if (compare_sort_keys(order, &keys[middle], &keys[0]) < 0)
+    {
+      swap_sort_keys(&keys[middle], &keys[0]);
+    }
+  }
+
+  Sort_Key pivot = keys[middle];
+  int i = -1;
+  int j = count;
+  while (true)
+  {
+    do
+    {
+      i++;
+    } while (compare_sort_keys(order, &keys[i], &pivot) < 0);
+    do
+    {
+      j--;
+    } while (compare_sort_keys(order, &keys[j], &pivot) > 0);
+
+    if (i >= j)
+    {
+      return j;
+    }
+    swap_sort_keys(&keys[i], &keys[j]);
+  }
+}
+
+/**
+ * @brief Sorts keys in place with quick sort, falling back to heap sort if the recursion gets too deep, and to
+ *        insertion sort for short ranges.
+ * @param order [in] The order to sort in.
+ * @param keys [in/out] The keys.
+ * @param count [in] The number of keys.
+ * @param depth_limit [in] The number of partitions left before falling back to heap sort.
+ */
+static void intro_sort(Sort_Order order, Sort_Key* keys, int count, int depth_limit)
+{
+  while (count > INSERTION_SORT_THRESHOLD)
+  {
+    if (depth_limit == 0)
+    {
+      heap_sort(order, keys, count);
+      return;
+    }
+    depth_limit--;
+
+    /* Recursing into the smaller part keeps the stack logarithmic. */
+    int lower_count = partition(order, keys, count) + 1;
+    if (lower_count < count - lower_count)
+    {
+      intro_sort(order, keys, lower_count, depth_limit);
+      keys += lower_count;
+      count -= lower_count;
+    }
+    else
+    {
+      intro_sort(order, keys + lower_count, count - lower_count, depth_limit);
+      count = lower_count;
+    }
+  }
+  insertion_sort(order, keys, count);
+}
+
+/**
+ * @brief Makes sure the buffers of a sorter have room for a number of nodes.
+ * @param sorter_p [in/out] The sorter.
+ * @param count [in] The number of nodes.
+ */
+static void reserve_capacity(Node_Sorter* sorter_p, int count)
+{
+  if (count <= sorter_p->capacity)
+  {
+    return;
+  }
+
+  int capacity = sorter_p->capacity == 0 ? INITIAL_SORTER_CAPACITY : sorter_p->capacity;
+  while (capacity < count)
+  {
+    capacity *= 2;
+  }
+  free(sorter_p->keys);
+  free(sorter_p->values);
+  sorter_p->keys = (Sort_Key*) malloc(capacity * sizeof(Sort_Key));
+  sorter_p->values = (uint64_t*) malloc(capacity * sizeof(uint64_t));
+  if (sorter_p->keys == NULL || sorter_p->values == NULL)
+  {
+    printf("Could not allocate memory for sorting.\n");
+    exit(1);
+  }
+  sorter_p->capacity = capacity;
+}
+
+/*> Global Function Definitions **************************************************************************************/
+/**
+ * @brief Initializes a sorter, without allocating its buffers yet.
+ * @param sorter_p [out] The sorter.
+ * @param order [in] The order to sort in.
+ */
+void node_sorter_init(Node_Sorter* sorter_p, Sort_Order order)
+{
+  sorter_p->order = order;
+  sorter_p->keys = NULL;
+  sorter_p->values = NULL;
+  sorter_p->capacity = 0;
+}
+
+/**
+ * @brief Gets the buffer for the values of the nodes about to be sorted by size or time.
+ * @param sorter_p [in/out] The sorter.
+ * @param count [in] The number of nodes.
+ * @return The values, count long. Only valid until the next call.
+ */
+uint64_t* node_sorter_values(Node_Sorter* sorter_p, int count)
+{
+  reserve_capacity(sorter_p, count);
+  return sorter_p->values;
+}
+
+/**
+ * @brief Sorts nodes in the order of the sorter. Ties are ordered by name, so the order does not depend on the order
+ *        the nodes were read in.
+ * @param sorter_p [in/out] The sorter.
+ * @param nodes [in/out] The nodes to sort.
+ * @param count [in] The number of nodes.
+ * @param values [in] For size and time orders the value of every node, from node_sorter_values. NULL otherwise.
+ */
+void node_sorter_sort(Node_Sorter* sorter_p, Directory_Tree** nodes, int count, uint64_t* values)
+{
+  if (sorter_p->order == SORT_NONE || count < 2)
+  {
+    return;
+  }
+
+  reserve_capacity(sorter_p, count);
+  Sort_Key* keys = sorter_p->keys;
+  bool is_natural = sorter_p->order == SORT_NATURAL;
+  for (int i = 0; i < count; i++)
+  {
+    keys[i].key = values == NULL ? get_name_key(nodes[i], is_natural) : values[i];
+    keys[i].node = nodes[i];
+  }
+
+  int depth_limit = 0;
+  for (int remaining = count; remaining > 1; remaining /= 2)
+  {
+    depth_limit += 2;
+  }
+  intro_sort(sorter_p->order, keys, count, depth_limit);
+
+  for (int i = 0; i < count; i++)
+  {
+    nodes[i] = keys[i].node;
+  }
+}
+
+/**
+ * @brief Frees the buffers of a sorter.
+ * @param sorter_p [in/out] The sorter.
+ */
+void node_sorter_free(Node_Sorter* sorter_p)
+{
+  free(sorter_p->keys);
+  free(sorter_p->values);
+  node_sorter_init(sorter_p, sorter_p->order);
+}
+
+/**
+ * @brief Converts a size to a value that sorts the largest size first.
+ * @param size [in] The size in bytes.
+ * @return The value.
+ */
+uint64_t size_sort_value(uint64_t size)
+{
+  return UINT64_MAX - size;
+}
+
+/**
+ * @brief Converts a time to a value that sorts the newest time first.
+ * @param time_ns [in] The time in nanoseconds since the epoch, may be negative.
+ * @return The value.
+ */
+uint64_t time_sort_value(int64_t time_ns)
+{
+  /* Flipping the sign bit orders negative times before positive ones as unsigned integers. */
+  return UINT64_MAX - ((uint64_t) time_ns ^ (1ULL << 63));
+}
@@ -6,239 +6,4495 @@
 
 /*> Includes *********************************************************************************************************/
 #include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <time.h>
 #include <unistd.h>
 
+#include "arena.h"
+#include "content_hash.h"
+#include "directory_reader.h"
+#include "directory_sort.h"
 #include "directory_tree.h"
+#include "frame_stack.h"
+#include "inode_set.h"
+#include "name_matcher.h"
+#include "output_writer.h"
+#include "path_filter.h"
+#include "snapshot.h"
+#include "string_pool.h"
 #include "string_util.h"
+#include "uring.h"
+#include "walk_stats.h"
+#include "work_pool.h"
 
 /*> Defines **********************************************************************************************************/
+#define INITIAL_PENDING_CHILDREN_CAPACITY 256
+#define INITIAL_URING_REQUEST_CAPACITY 64
+#define URING_OPEN_WINDOW_SIZE 8
+#define INITIAL_PRINTER_MAX_LEVEL 32
+#define NANOSECONDS_PER_SECOND 1000000000LL
+#define NANOSECONDS_PER_MILLISECOND 1000000LL
+#define BYTES_PER_BLOCK 512
+#define USAGE_SUFFIX_CAPACITY 96
+#define RECORD_FIELDS_CAPACITY 256
+#define USAGE_SUBTREES_PER_THREAD 4
+#define MAX_OPEN_DIRECTORY_FRAMES 32
+#define REFERENCE_SUFFIX "  [already listed]"
+#define OMITTED_NAME "..."
+#define OMITTED_SUFFIX_CAPACITY 32
+#define HASH_SUFFIX_CAPACITY 24
+#define HASH_TASK_CHILD_COUNT 64
+#define HASH_DIRECTORY_SEED 0x64697265ULL
+#define HASH_ENTRY_FILE_SEED 0x66696C65ULL
+#define HASH_ENTRY_DIRECTORY_SEED 0x6469726EULL
+#define HASH_ENTRY_REFERENCE_SEED 0x72656665ULL
+#define HASH_ENTRY_UNREADABLE_SEED 0x756E7265ULL
 
 /*> Type Declarations ************************************************************************************************/
+/**
+ * @brief The base node of a tree together with the arena all nodes of the tree are allocated from.
+ * @param node The base node. Must be the first member, so a Directory_Tree* to the base can be cast to this type.
+ * @param arena The arena holding every node, string and children array of the tree, including this struct.
+ * @param node_count The number of nodes in the tree.
+ * @param lazy_builder_p The builder reading the directories of a lazy tree when their children are first asked for,
+ *                       NULL if the tree was read at once. Kept for the life of the tree, so names stay interned
+ *                       across directories.
+ * @param lazy_scope_p The scope of the base of a lazy tree, NULL if there is no filter.
+ */
+typedef struct Base_Directory_Tree
+{
+  Directory_Tree node;
+  Arena arena;
+  size_t node_count;
+  struct Tree_Builder* lazy_builder_p;
+  Ignore_Scope* lazy_scope_p;
+} Base_Directory_Tree;
+
+/**
+ * @brief State used while creating a tree. When the tree is created by several threads, each thread has its own.
+ * @param arena_p The arena new nodes are allocated from.
+ * @param node_count The number of nodes created.
+ * @param pending_children Stack of created children whose parent has not been fully read yet. Children of a
+ *                         directory are moved to an exactly sized array in the arena once the directory is read.
+ * @param pending_count The number of nodes on the pending_children stack.
+ * @param pending_capacity The number of nodes pending_children has room for.
+ * @param read_buffer The buffer directories are read into, DIRECTORY_READER_BUFFER_SIZE long. Reused for every
+ *                    directory, since a directory is fully read before any of its children.
+ * @param has_uring True if lookups and opens are batched through uring.
+ * @param uring The io_uring instance of this builder, only set up if has_uring.
+ * @param uring_requests The lookups of the directory being read, batched once the directory is read.
+ * @param uring_request_count The number of requests in uring_requests.
+ * @param uring_request_capacity The number of requests uring_requests has room for.
+ * @param base_depth The depth of the base of the tree, to know the level of a node from its depth.
+ * @param child_limit The most children a read directory keeps, in the order they are sorted in. The rest are counted
+ *                    in its omitted_count. 0 for no limit.
+ * @param record_usage True if the disk usage of every node is looked up.
+ * @param record_hashes True if every node is hashed once the tree is read, so every directory is read.
+ * @param follow_links True if symbolic links to directories are read like directories.
+ * @param visited_p The directories read so far, or NULL if links are not followed. A directory found in it again is
+ *                  a reference and is not read.
+ * @param snapshot_p The snapshot unchanged directories are taken from when the tree records stamps, or NULL.
+ * @param start_time_ns The time the tree was started to be read. Directories modified less than a second before it
+ *                      get no stamp, since a change in the same timestamp tick would go unnoticed.
+ * @param filter_p The filter of the files left out, or NULL if every file is kept.
+ * @param scope_p The .gitignore patterns of the directory being read and the directories above it. Set to the scope
+ *                of a directory once it is read, so it applies to the directories below it, and restored by the
+ *                caller afterwards.
+ * @param sorter The sorter of the children of every read directory.
+ * @param names The pool the names of the created nodes are interned in.
+ * @param path The path of a node, rebuilt from its parents when a directory has to be opened or looked up by path.
+ * @param frames The stack of Directory_Frame of the directories being read, so deep trees do not recurse.
+ */
+typedef struct Tree_Builder
+{
+  Arena* arena_p;
+  size_t node_count;
+  Directory_Tree** pending_children;
+  int pending_count;
+  int pending_capacity;
+  char* read_buffer;
+  bool has_uring;
+  Uring uring;
+  Uring_Request* uring_requests;
+  int uring_request_count;
+  int uring_request_capacity;
+  int base_depth;
+  int child_limit;
+  bool record_usage;
+  bool record_hashes;
+  bool follow_links;
+  Inode_Set* visited_p;
+  Snapshot* snapshot_p;
+  int64_t start_time_ns;
+  Path_Filter* filter_p;
+  Ignore_Scope* scope_p;
+  Node_Sorter sorter;
+  String_Pool names;
+  String_Buffer path;
+  Frame_Stack frames;
+} Tree_Builder;
+
+/**
+ * @brief A directory on the stack of a tree being created, whose child directories are read one after another.
+ * @param dir_tree The Directory_Tree node of the directory, its children are already read.
+ * @param fd The open directory, or -1 while it is closed to keep the number of open directories bounded.
+ * @param device The device of the directory, recorded when it is closed to check it is the same once reopened.
+ * @param inode The inode of the directory, recorded when it is closed.
+ * @param scope_p The .gitignore patterns that apply to the children of the directory.
+ * @param child_index The index of the next child to look at.
+ * @param window The indexes of the opened child directories waiting to be read. With io_uring a window of them is
+ *               opened at once.
+ * @param window_fds The fds of the child directories in window.
+ * @param window_index The index in window of the next child directory to read.
+ * @param window_count The number of child directories in window.
+ */
+typedef struct Directory_Frame
+{
+  Directory_Tree* dir_tree;
+  int fd;
+  uint64_t device;
+  uint64_t inode;
+  Ignore_Scope* scope_p;
+  int child_index;
+  int window[URING_OPEN_WINDOW_SIZE];
+  int window_fds[URING_OPEN_WINDOW_SIZE];
+  int window_index;
+  int window_count;
+} Directory_Frame;
+
+/**
+ * @brief A directory on the stack of a tree being created with a snapshot, whose child directories are added one
+ *        after another.
+ * @param dir_tree The Directory_Tree node of the directory, its children are already added.
+ * @param cached_p The snapshot node of the directory, or NULL if it is not in the snapshot.
+ * @param is_copied True if the children were copied from the snapshot, so they match its nodes by index.
+ * @param slots The table finding the child directories in the snapshot by name, NULL if they are copied or there
+ *              are none.
+ * @param mask The number of slots minus one.
+ * @param child_index The index of the next child to look at.
+ * @param parent_scope_p The scope of the builder before the directory was read, restored once it is done.
+ * @param scope_p The .gitignore patterns that apply to the children of the directory.
+ * @param fd The open directory, the stamps of its child directories are read relative to it. -1 if it is not open,
+ *           because its children were copied and it was not needed yet, or to keep the number of open directories
+ *           bounded.
+ * @param stamp The stamp of the directory, its identity is checked when it is reopened.
+ */
+typedef struct Cached_Directory_Frame
+{
+  Directory_Tree* dir_tree;
+  Snapshot_Node* cached_p;
+  bool is_copied;
+  uint32_t* slots;
+  size_t mask;
+  int child_index;
+  Ignore_Scope* parent_scope_p;
+  Ignore_Scope* scope_p;
+  int fd;
+  Directory_Stamp stamp;
+} Cached_Directory_Frame;
+
+/**
+ * @brief A directory to read in parallel or breadth first, together with the .gitignore patterns that apply to it.
+ * @param dir_tree The Directory_Tree node of the directory.
+ * @param scope_p The scope of the parent directory.
+ * @param parallel_builder_p The context of the tree the directory belongs to when it is read in parallel, NULL when
+ *                           it is read breadth first.
+ */
+typedef struct Directory_Task
+{
+  Directory_Tree* dir_tree;
+  Ignore_Scope* scope_p;
+  struct Parallel_Tree_Builder* parallel_builder_p;
+} Directory_Task;
+
+/**
+ * @brief The state shared by the trees of several base paths created at the same time on one pool.
+ * @param mutex Protects is_read of the trees, and is held while waiting on read_condition.
+ * @param read_condition Signaled when the last directory of a tree is read.
+ */
+typedef struct Tree_Set_Builder
+{
+  pthread_mutex_t mutex;
+  pthread_cond_t read_condition;
+} Tree_Set_Builder;
+
+/**
+ * @brief The context shared by the threads creating a tree in parallel.
+ * @param builders One Tree_Builder per worker thread.
+ * @param arenas One arena per worker thread, merged into the arena of the base once the tree is created.
+ * @param use_uring True if the workers should batch lookups through io_uring.
+ * @param pending_count The number of directory tasks of the tree pushed and not finished yet.
+ * @param set_p The set the tree is created in with others, NULL if it is created on its own pool.
+ * @param is_read True once the last directory task of a tree in a set finished.
+ */
+typedef struct Parallel_Tree_Builder
+{
+  Tree_Builder builders[MAX_WORKER_COUNT];
+  Arena arenas[MAX_WORKER_COUNT];
+  bool use_uring;
+  atomic_int pending_count;
+  Tree_Set_Builder* set_p;
+  bool is_read;
+} Parallel_Tree_Builder;
+
+/**
+ * @brief The context shared by the threads summing up disk usage in parallel.
+ * @param inode_set_p The hard linked files counted so far.
+ * @param sort_by_size True if the children of every directory are sorted by size once they are summed.
+ * @param sorters One sorter per worker thread.
+ */
+typedef struct Usage_Summer
+{
+  Inode_Set* inode_set_p;
+  bool sort_by_size;
+  Node_Sorter sorters[MAX_WORKER_COUNT];
+} Usage_Summer;
+
+/**
+ * @brief A directory on the stack of a tree whose usage is being summed up.
+ * @param dir_tree The node of the directory.
+ * @param child_index The index of the next child to sum up.
+ */
+typedef struct Usage_Frame
+{
+  Directory_Tree* dir_tree;
+  int child_index;
+} Usage_Frame;
+
+/**
+ * @brief A range of the children of a directory whose files are hashed by one task. Large directories are split in
+ *        several tasks, so their files are hashed by several threads.
+ * @param dir_tree The node of the directory.
+ * @param first_child The index of the first child of the range.
+ * @param end_child The index after the last child of the range.
+ */
+typedef struct Hash_Task
+{
+  Directory_Tree* dir_tree;
+  int first_child;
+  int end_child;
+} Hash_Task;
+
+/**
+ * @brief The context shared by the threads hashing the files of a tree.
+ * @param follow_links True if links are hashed by what they point to.
+ * @param paths One buffer per worker thread the path of a directory is rebuilt in.
+ * @param buffers One buffer per worker thread files are read into, CONTENT_HASH_BUFFER_SIZE long.
+ */
+typedef struct Tree_Hasher
+{
+  bool follow_links;
+  String_Buffer paths[MAX_WORKER_COUNT];
+  char* buffers[MAX_WORKER_COUNT];
+} Tree_Hasher;
+
+/**
+ * @brief State used while printing a tree.
+ * @param writer_p The writer the lines are written to.
+ * @param prefixes Spaces followed by "|- ", precomputed so a line is written as prefix, name and newline. The prefix
+ *                 of a line at a level is the last 2 * level + 3 characters.
+ * @param max_level The deepest level prefixes has room for.
+ * @param format How the tree is printed.
+ * @param escaped_name The name of the record being printed, escaped for JSON. Only used for names that need escaping.
+ * @param needs_separator True if a JSON object was printed at the current level, so the next one needs a comma.
+ * @param frames The stack of Print_Frame of the directories whose children are being printed.
+ */
+typedef struct Tree_Printer
+{
+  Output_Writer* writer_p;
+  char* prefixes;
+  int max_level;
+  Output_Format format;
+  String_Buffer escaped_name;
+  bool needs_separator;
+  Frame_Stack frames;
+} Tree_Printer;
+
+/**
+ * @brief A directory on the stack of a tree being printed.
+ * @param dir_tree The node of the directory, NULL when printing a snapshot.
+ * @param node_index The index of the snapshot node of the directory when printing a snapshot.
+ * @param depth How far down from the directory to print, only used for snapshots.
+ * @param child_index The index of the next child to print.
+ * @param path_length The length of the path before the name of the directory was appended.
+ */
+typedef struct Print_Frame
+{
+  Directory_Tree* dir_tree;
+  uint32_t node_index;
+  int depth;
+  int child_index;
+  size_t path_length;
+} Print_Frame;
+
+/**
+ * @brief State used while printing the entries of a walked tree whose names match a pattern, with the directories
+ *        above them. A directory is only printed once an entry below it matches, so the directories being walked
+ *        are kept until then.
+ * @param printer The printer the matches and the directories above them are printed with.
+ * @param matcher_p The pattern the names are matched against.
+ * @param ancestors The stack of Find_Frame of the directories being walked, the base first.
+ * @param printed_count The number of directories at the bottom of ancestors that were printed. The directories above
+ *                      a printed one are printed too, so they are always the bottom of the stack.
+ * @param is_leaf_printed True if the entry without children being walked was printed, so its record is ended.
+ */
+typedef struct Tree_Finder
+{
+  Tree_Printer printer;
+  Name_Matcher* matcher_p;
+  Frame_Stack ancestors;
+  int printed_count;
+  bool is_leaf_printed;
+} Tree_Finder;
+
+/**
+ * @brief A directory on the stack of a tree being searched.
+ * @param path_length The length of the path of the directory, including its trailing '/'.
+ * @param name_offset Where the name of the directory starts in its path.
+ * @param level The level of the directory, 0 for the base.
+ */
+typedef struct Find_Frame
+{
+  size_t path_length;
+  size_t name_offset;
+  int level;
+} Find_Frame;
+
+/**
+ * @brief State used while walking a tree as it is read.
+ * @param visitor_p The callbacks the entries are passed to.
+ * @param path The path of the entry being visited, directories end with '/'.
+ * @param frames The stack of Walk_Frame of the directories being read.
+ * @param first_open_frame The index of the shallowest frame whose directory is open. The frames above it are open,
+ *                         the ones below it are closed.
+ * @param read_buffers The read buffers not used by an open frame, DIRECTORY_READER_BUFFER_SIZE long. A buffer is
+ *                     allocated when no unused one is left, and only the pages a directory fills are touched.
+ * @param read_buffer_count The number of buffers in read_buffers.
+ * @param filter_p The filter of the files left out, or NULL if every file is kept.
+ * @param scope_arena The arena the .gitignore patterns are allocated from.
+ * @param follow_links True if symbolic links to directories are walked like directories.
+ * @param visited_p The directories walked so far, or NULL if links are not followed.
+ */
+typedef struct Tree_Walker
+{
+  Directory_Visitor* visitor_p;
+  String_Buffer path;
+  Frame_Stack frames;
+  int first_open_frame;
+  char* read_buffers[MAX_OPEN_DIRECTORY_FRAMES + 1];
+  int read_buffer_count;
+  Path_Filter* filter_p;
+  Arena scope_arena;
+  bool follow_links;
+  Inode_Set* visited_p;
+} Tree_Walker;
+
+/**
+ * @brief A directory on the stack of a tree being walked, which is read while its children are visited.
+ * @param entry The entry of the directory, passed to the leave callback once its children are visited.
+ * @param reader The reader of the directory. Its fd is -1 and it has no buffer while the directory is closed to keep
+ *               the number of open directories bounded.
+ * @param device The device of the directory, recorded when it is closed to check it is the same once reopened.
+ * @param inode The inode of the directory, recorded when it is closed.
+ * @param scope_p The .gitignore patterns that apply to the children of the directory.
+ * @param depth The depth of the tree from the directory.
+ */
+typedef struct Walk_Frame
+{
+  Visited_Entry entry;
+  Directory_Reader reader;
+  uint64_t device;
+  uint64_t inode;
+  Ignore_Scope* scope_p;
+  int depth;
+} Walk_Frame;
+
+/*> Global Constant Definitions **************************************************************************************/
+
+/*> Global Variable Definitions **************************************************************************************/
+
+/*> Local Constant Definitions ***************************************************************************************/
+
+/*> Local Variable Definitions ***************************************************************************************/
+
+/*> Local Function Declarations **************************************************************************************/
+static bool is_directory(char* path_string);
+
+static bool path_exists(char* path_string);
+
+static bool is_directory_entry(int directory_fd, Directory_Entry* entry_p, bool follow_links);
+
+static int open_directory_fd(int directory_fd, char* name);
+
+static int open_directory_at(int directory_fd, char* file_name, char* path_string);
+
+static int open_parent_directory(int child_fd, uint64_t device, uint64_t inode);
+
+static void get_directory_identity(int directory_fd, uint64_t* device_p, uint64_t* inode_p);
+
+static void exit_with_path(const char* message, Directory_Tree* dir_tree);
+
+static void* allocate_or_exit(size_t size);
+
+static void init_tree_builder(Tree_Builder* builder_p, Arena* arena_p, Directory_Tree_Options* options_p);
+
+static void free_tree_builder(Tree_Builder* builder_p);
+
+static void push_pending_child(Tree_Builder* builder_p, Directory_Tree* child);
+
+static void move_pending_children(Tree_Builder* builder_p, Directory_Tree* dir_tree, int first_child_index);
+
+static char* build_node_path(Tree_Builder* builder_p, Directory_Tree* dir_tree);
+
+static int open_node_directory(Tree_Builder* builder_p, int directory_fd, Directory_Tree* dir_tree);
+
+static void add_uring_request(Tree_Builder* builder_p, Directory_Tree* child);
+
+static Directory_Tree* create_child_node(Tree_Builder* builder_p, 
+                                         char* file_name, 
+                                         bool child_is_directory, 
+                                         Directory_Tree* parent);
+
+static Directory_Usage* allocate_usage(Tree_Builder* builder_p, Directory_Tree* dir_tree);
+
+static void set_usage_from_stat(Directory_Usage* usage_p, struct stat* file_info_p);
+
+static void set_usage_from_statx(Directory_Usage* usage_p, struct statx* file_info_p);
+
+static Directory_Tree* create_child_node_with_usage(Tree_Builder* builder_p, 
+                                                    int directory_fd, 
+                                                    Directory_Entry* entry_p, 
+                                                    Directory_Tree* parent);
+
+static bool should_read_children(Tree_Builder* builder_p, Directory_Tree* dir_tree);
+
+static void filter_pending_children(Tree_Builder* builder_p, 
+                                    Directory_Tree* dir_tree, 
+                                    int directory_fd, 
+                                    int first_child_index);
+
+static void lookup_sort_values(Tree_Builder* builder_p, 
+                               int directory_fd, 
+                               Directory_Tree** children, 
+                               int count, 
+                               Sort_Order order, 
+                               uint64_t* values);
+
+static void sort_children(Tree_Builder* builder_p, 
+                          Node_Sorter* sorter_p, 
+                          int directory_fd, 
+                          Directory_Tree** children, 
+                          int count);
+
+static void read_directory_children(Tree_Builder* builder_p, Directory_Tree* dir_tree, int directory_fd);
+
+static void open_child_directories(Tree_Builder* builder_p, 
+                                   int directory_fd, 
+                                   Directory_Tree* children[], 
+                                   int count, 
+                                   int* fds);
+
+static void push_directory_frame(Tree_Builder* builder_p, Directory_Tree* dir_tree, int directory_fd);
+
+static void fill_directory_window(Tree_Builder* builder_p, Directory_Frame* frame_p);
+
+static void close_directory_frame(Directory_Frame* frame_p);
+
+static void reopen_directory_frame(Tree_Builder* builder_p, Directory_Frame* frame_p, int child_fd);
+
+static bool visit_directory(Tree_Builder* builder_p, Directory_Tree* dir_tree, int directory_fd);
+
+static void add_directory_tree_children(Tree_Builder* builder_p, Directory_Tree* dir_tree, int directory_fd);
+
+static bool budget_is_spent(Directory_Tree_Options* options_p, size_t entry_count, int64_t deadline_ns);
+
+static void add_directory_tree_children_budgeted(Tree_Builder* builder_p, 
+                                                 Directory_Tree* dir_tree, 
+                                                 Directory_Tree_Options* options_p);
+
+static int64_t get_time_ns(struct timespec* time_p);
+
+static void read_directory_stamp(int directory_fd, char* name, Directory_Tree* dir_tree, Directory_Stamp* stamp_p);
+
+static bool stamps_are_equal(Directory_Stamp* stamp1_p, Directory_Stamp* stamp2_p);
+
+static void copy_cached_children(Tree_Builder* builder_p, Directory_Tree* dir_tree, Snapshot_Node* cached_p);
+
+static uint32_t* index_cached_directories(Snapshot* snapshot_p, Snapshot_Node* cached_p, size_t* mask_p);
+
+static uint32_t find_cached_directory(Snapshot* snapshot_p, uint32_t* slots, size_t mask, Directory_Tree* child);
+
+static void push_cached_directory_frame(Tree_Builder* builder_p, 
+                                        Frame_Stack* frames_p, 
+                                        int parent_fd, 
+                                        Directory_Tree* dir_tree, 
+                                        uint32_t cached_index);
+
+static void add_directory_tree_children_cached(Tree_Builder* builder_p, Directory_Tree* dir_tree, uint32_t cached_index);
+
+static void push_directory_task(Work_Pool* pool_p, 
+                                int worker_index, 
+                                Parallel_Tree_Builder* parallel_builder_p, 
+                                Directory_Tree* dir_tree);
+
+static void read_directory_task(Work_Pool* pool_p, int worker_index, void* task_p);
+
+static Parallel_Tree_Builder* create_parallel_tree_builder(int thread_count, 
+                                                           Directory_Tree_Options* options_p, 
+                                                           Ignore_Scope* scope_p);
+
+static void merge_parallel_tree_builder(Base_Directory_Tree* base_p, 
+                                        Parallel_Tree_Builder* parallel_builder_p, 
+                                        int thread_count);
+
+static void add_directory_tree_children_parallel(Base_Directory_Tree* base_p, 
+                                                Directory_Tree_Options* options_p, 
+                                                Ignore_Scope* scope_p);
+
+static Base_Directory_Tree* create_base_node(char* base_path_string, int depth);
+
+static Base_Directory_Tree* start_directory_tree(char* base_path_string, 
+                                                 Directory_Tree_Options* options_p, 
+                                                 Ignore_Scope** scope_pp);
+
+static bool should_read_base(Directory_Tree* dir_tree, Directory_Tree_Options* options_p);
+
+static void finish_directory_tree(Base_Directory_Tree* base_p, Directory_Tree_Options* options_p);
+
+static void finish_tree_in_set(Base_Directory_Tree* base_p, 
+                               Parallel_Tree_Builder* parallel_builder_p, 
+                               int thread_count, 
+                               Directory_Tree_Options* options_p);
+
+static bool has_children_usage(Directory_Tree* dir_tree);
+
+static void sort_children_by_usage(Directory_Tree* dir_tree, Node_Sorter* sorter_p);
+
+static void add_children_usage(Directory_Tree* dir_tree, Inode_Set* inode_set_p, Node_Sorter* sorter_p);
+
+static void sum_directory_usage(Directory_Tree* dir_tree, Inode_Set* inode_set_p, Node_Sorter* sorter_p);
+
+static void sum_directory_usage_task(Work_Pool* pool_p, int worker_index, void* dir_tree_p);
+
+static void sum_directory_usage_parallel(Directory_Tree* dir_tree, 
+                                         int thread_count, 
+                                         Inode_Set* inode_set_p, 
+                                         bool sort_by_size);
+
+static void hash_task_files(Tree_Hasher* hasher_p, int worker_index, Hash_Task* task_p);
+
+static void hash_files_task(Work_Pool* pool_p, int worker_index, void* task_p);
+
+static void fold_directory_hash(Directory_Tree* dir_tree);
+
+static void hash_directory_tree(Base_Directory_Tree* base_p, int thread_count, bool follow_links);
+
+static int format_usage(Directory_Tree* dir_tree, char* suffix);
+
+static void init_tree_printer(Tree_Printer* printer_p, Output_Format format, Output_Writer* writer_p);
+
+static void set_printer_max_level(Tree_Printer* printer_p, int max_level);
+
+static void free_tree_printer(Tree_Printer* printer_p);
+
+static void print_line(Tree_Printer* printer_p, 
+                       char* name, 
+                       size_t name_length, 
+                       char* suffix, 
+                       size_t suffix_length, 
+                       int level, 
+                       bool is_base);
+
+static int format_record_fields(Tree_Printer* printer_p, 
+                                int level, 
+                                bool is_directory, 
+                                bool has_children, 
+                                bool is_reference, 
+                                Directory_Usage* usage_p, 
+                                uint64_t* hash_p, 
+                                int omitted_count, 
+                                char* fields);
+
+static void print_record(Tree_Printer* printer_p, 
+                         char* path, 
+                         size_t path_length, 
+                         size_t name_offset, 
+                         int level, 
+                         bool is_directory, 
+                         bool has_children, 
+                         bool is_reference, 
+                         Directory_Usage* usage_p, 
+                         uint64_t* hash_p, 
+                         int omitted_count);
+
+static void print_record_end(Tree_Printer* printer_p, bool has_children);
+
+static void print_omitted_line(Tree_Printer* printer_p, int omitted_count, int level);
+
+static bool print_node(Tree_Printer* printer_p, Directory_Tree* dir_tree, String_Buffer* path_p, int level);
+
+static void print_nodes(Tree_Printer* printer_p, Directory_Tree* dir_tree, String_Buffer* path_p);
+
+static bool print_snapshot_node(Tree_Printer* printer_p, 
+                                Snapshot* snapshot_p, 
+                                String_Buffer* path_p, 
+                                uint32_t node_index, 
+                                int depth, 
+                                int level);
+
+static void print_snapshot_nodes(Tree_Printer* printer_p, 
+                                 Snapshot* snapshot_p, 
+                                 String_Buffer* path_p, 
+                                 uint32_t node_index, 
+                                 int depth);
+
+static Visit_Result print_visited_entry(Visited_Entry* entry_p, void* printer_p);
+
+static Visit_Result print_visited_entry_end(Visited_Entry* entry_p, void* printer_p);
+
+static void print_found_ancestors(Tree_Finder* finder_p, char* path);
+
+static Visit_Result find_visited_entry(Visited_Entry* entry_p, void* finder_p);
+
+static Visit_Result find_visited_entry_end(Visited_Entry* entry_p, void* finder_p);
+
+static char* get_walk_read_buffer(Tree_Walker* walker_p);
+
+static Visit_Result enter_walk_entry(Tree_Walker* walker_p, Visited_Entry* entry_p);
+
+static bool leave_walk_entry(Tree_Walker* walker_p, Visited_Entry* entry_p);
+
+static void push_walk_frame(Tree_Walker* walker_p, 
+                            Visited_Entry* entry_p, 
+                            int directory_fd, 
+                            Ignore_Scope* scope_p, 
+                            int depth);
+
+static void close_walk_frame(Tree_Walker* walker_p, Walk_Frame* frame_p);
+
+static void reopen_walk_frame(Tree_Walker* walker_p, Walk_Frame* frame_p, int child_fd);
+
+static bool visit_walk_directory(Tree_Walker* walker_p, int directory_fd);
+
+static bool walk_entries(Tree_Walker* walker_p, Visited_Entry* base_p, Ignore_Scope* scope_p, int depth);
+
+static void copy_node_records(Arena* arena_p, Directory_Tree* dir_tree);
+
+/*> Local Function Definitions ***************************************************************************************/
+/**
+ * @brief Checks if path is to a directory.
+ * @param path_string [in] Path to check.¨
+ * @return True if path goes to a directory, false otherwise.
+ */
+static bool is_directory(char* path_string)
+{
+  struct stat file_info = {0};
+  uint64_t start_ns = walk_stats_start();
+  stat(path_string, &file_info);
+  walk_stats_stop(WALK_STAT_LOOKUP, start_ns, 1);
+  return S_ISDIR(file_info.st_mode);
+}
+
+/**
+ * @brief Checks if the path leads to a real file or directory.
+ * @param path_string [in] Path to check.
+ * @return True if the path exists, false otherwise.
+ */
+static bool path_exists(char* path_string)
+{
+  uint64_t start_ns = walk_stats_start();
+  bool exists = access(path_string, F_OK) == 0;
+  walk_stats_stop(WALK_STAT_LOOKUP, start_ns, 1);
+  return exists;
+}
+
+/**
+ * @brief Checks if a directory entry is a directory. The type is taken from the entry, and only looked up relative to
+ *        the open directory when the file system does not report it, or it is a link that is followed.
+ * @param directory_fd [in] The open directory the entry was read from.
+ * @param entry_p [in] The entry to check.
+ * @param follow_links [in] True if a link to a directory counts as a directory, false if links are files.
+ * @return True if the entry is a directory or a followed link to one, false otherwise.
+ */
+static bool is_directory_entry(int directory_fd, Directory_Entry* entry_p, bool follow_links)
+{
+  if (entry_p->type == DT_LNK && !follow_links)
+  {
+    return false;
+  }
+  if (entry_p->type != DT_UNKNOWN && entry_p->type != DT_LNK)
+  {
+    return entry_p->type == DT_DIR;
+  }
+
+  /* A link that can not be followed, e.g. a broken link, is shown as a file. */
+  struct stat file_info = {0};
+  uint64_t start_ns = walk_stats_start();
+  int result = fstatat(directory_fd, entry_p->name, &file_info, follow_links ? 0 : AT_SYMLINK_NOFOLLOW);
+  walk_stats_stop(WALK_STAT_LOOKUP, start_ns, 1);
+  return result == 0 && S_ISDIR(file_info.st_mode);
+}
+
+/**
+ * @brief Opens a directory. Paths longer than PATH_MAX, which the kernel refuses, are opened a part at a time, each
+ *        part relative to the directory opened before it.
+ * @param directory_fd [in] The open parent directory, or AT_FDCWD to open a path.
+ * @param name [in] The name of the directory in the parent directory, or its path. The path is split in place while
+ *             it is opened, and restored before returning.
+ * @return The fd of the opened directory, or -1 if it could not be opened.
+ */
+static int open_directory_fd(int directory_fd, char* name)
+{
+  int flags = O_RDONLY | O_DIRECTORY | O_CLOEXEC;
+  size_t length = strlen(name);
+  if (length < PATH_MAX)
+  {
+    return openat(directory_fd, name, flags);
+  }
+
+  int part_fd = directory_fd;
+  size_t start = 0;
+  while (length - start >= PATH_MAX)
+  {
+    size_t end = start + PATH_MAX - 1;
+    while (end > start && name[end] != '/')
+    {
+      end--;
+    }
+
+    int next_fd = -1;
+    if (end > start)
+    {
+      name[end] = '\0';
+      next_fd = openat(part_fd, name + start, flags);
+      name[end] = '/';
+    }
+    if (part_fd != directory_fd)
+    {
+      close(part_fd);
+    }
+    if (next_fd < 0)
+    {
+      return -1;
+    }
+    part_fd = next_fd;
+    start = end + 1;
+  }
+
+  /* A path ending with '/' may be split at it, then the last part opened is the directory. */
+  if (start == length)
+  {
+    return part_fd;
+  }
+  int fd = openat(part_fd, name + start, flags);
+  if (part_fd != directory_fd)
+  {
+    close(part_fd);
+  }
+  return fd;
+}
+
+/**
+ * @brief Opens a directory relative to an open parent directory, so the kernel does not resolve the whole path again.
+ * @param directory_fd [in] The open parent directory, or AT_FDCWD to open a path.
+ * @param file_name [in] The name of the directory in the parent directory.
+ * @param path_string [in] The full path of the directory, only used in the error message.
+ * @return The fd of the opened directory. Exits the program if the directory could not be opened.
+ */
+static int open_directory_at(int directory_fd, char* file_name, char* path_string)
+{
+  uint64_t start_ns = walk_stats_start();
+  int child_fd = open_directory_fd(directory_fd, file_name);
+  walk_stats_stop(WALK_STAT_OPEN, start_ns, 1);
+  if (child_fd < 0)
+  {
+    printf("Could not open the directory: %s\n", path_string);
+    exit(1);
+  }
+  return child_fd;
+}
+
+/**
+ * @brief Opens the parent of an open directory through its "..", which is only the parent it was opened from if it
+ *        was not reached through a link, so the identity of the parent is checked.
+ * @param child_fd [in] The open directory.
+ * @param device [in] The device of the parent it was opened from.
+ * @param inode [in] The inode of the parent it was opened from.
+ * @return The fd of the opened parent, or -1 if it could not be opened or is another directory.
+ */
+static int open_parent_directory(int child_fd, uint64_t device, uint64_t inode)
+{
+  int fd = openat(child_fd, "..", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd < 0)
+  {
+    return -1;
+  }
+
+  struct stat file_info;
+  if (fstat(fd, &file_info) != 0 || file_info.st_dev != device || file_info.st_ino != inode)
+  {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+/**
+ * @brief Gets the device and inode of an open directory, before it is closed to be reopened later.
+ * @param directory_fd [in] The open directory.
+ * @param device_p [out] The device, 0 if it could not be looked up.
+ * @param inode_p [out] The inode, 0 if it could not be looked up.
+ */
+static void get_directory_identity(int directory_fd, uint64_t* device_p, uint64_t* inode_p)
+{
+  struct stat file_info = {0};
+  fstat(directory_fd, &file_info);
+  *device_p = file_info.st_dev;
+  *inode_p = file_info.st_ino;
+}
+
+/**
+ * @brief Prints an error message with the path of a node and exits the program.
+ * @param message [in] The message, printed before the path.
+ * @param dir_tree [in] The node.
+ */
+static void exit_with_path(const char* message, Directory_Tree* dir_tree)
+{
+  String_Buffer path;
+  string_buffer_init(&path);
+  append_directory_tree_path(dir_tree, &path);
+  printf("%s%s\n", message, path.string);
+  exit(1);
+}
+
+/**
+ * @brief Allocates memory, exiting the program if it fails.
+ * @param size [in] The number of bytes to allocate.
+ * @return The allocated memory.
+ */
+static void* allocate_or_exit(size_t size)
+{
+  uint64_t start_ns = walk_stats_start();
+  void* memory_p = malloc(size);
+  walk_stats_stop(WALK_STAT_ALLOCATE, start_ns, 1);
+  if (memory_p == NULL)
+  {
+    printf("Could not allocate memory for the directory tree.\n");
+    exit(1);
+  }
+  return memory_p;
+}
+
+/**
+ * @brief Initializes the state used for creating a tree.
+ * @param builder_p [out] The state to initialize.
+ * @param arena_p [in] The arena new nodes are allocated from.
+ * @param options_p [in] How the tree is read, e.g. if lookups and opens should be batched through io_uring.
+ */
+static void init_tree_builder(Tree_Builder* builder_p, Arena* arena_p, Directory_Tree_Options* options_p)
+{
+  builder_p->arena_p = arena_p;
+  builder_p->node_count = 0;
+  builder_p->pending_count = 0;
+  builder_p->pending_capacity = INITIAL_PENDING_CHILDREN_CAPACITY;
+  builder_p->pending_children = (Directory_Tree**) allocate_or_exit(builder_p->pending_capacity * 
+                                                                    sizeof(Directory_Tree*));
+  builder_p->read_buffer = (char*) allocate_or_exit(DIRECTORY_READER_BUFFER_SIZE);
+
+  /* Without io_uring support the builder silently falls back to synchronous lookups and opens. */
+  builder_p->has_uring = options_p->use_uring && uring_init(&builder_p->uring);
+  builder_p->uring_requests = NULL;
+  builder_p->uring_request_count = 0;
+  builder_p->uring_request_capacity = 0;
+  if (builder_p->has_uring)
+  {
+    builder_p->uring_request_capacity = INITIAL_URING_REQUEST_CAPACITY;
+    builder_p->uring_requests = (Uring_Request*) allocate_or_exit(builder_p->uring_request_capacity *
+                                                                  sizeof(Uring_Request));
+  }
+
+  builder_p->base_depth = options_p->depth;
+  builder_p->child_limit = 0;
+  builder_p->record_usage = options_p->record_usage;
+  builder_p->record_hashes = options_p->record_hashes;
+  builder_p->follow_links = options_p->follow_links;
+  builder_p->visited_p = NULL;
+  builder_p->snapshot_p = NULL;
+  builder_p->start_time_ns = 0;
+  builder_p->filter_p = options_p->filter_p;
+  builder_p->scope_p = NULL;
+  node_sorter_init(&builder_p->sorter, options_p->sort_order);
+  string_pool_init(&builder_p->names, arena_p);
+  string_buffer_init(&builder_p->path);
+  frame_stack_init(&builder_p->frames, sizeof(Directory_Frame));
+}
+
+/**
+ * @brief Frees the memory used while creating a tree. The nodes stay in the arena.
+ * @param builder_p [in/out] The state to free.
+ */
+static void free_tree_builder(Tree_Builder* builder_p)
+{
+  free(builder_p->pending_children);
+  free(builder_p->read_buffer);
+  node_sorter_free(&builder_p->sorter);
+  string_pool_free(&builder_p->names);
+  string_buffer_free(&builder_p->path);
+  frame_stack_free(&builder_p->frames);
+  if (builder_p->has_uring)
+  {
+    uring_free(&builder_p->uring);
+    free(builder_p->uring_requests);
+  }
+}
+
+/**
+ * @brief Pushes a created child onto the stack of children pending to be moved to their parent.
+ * @param builder_p [in/out] The state of the tree being created.
+ * @param child [in] The child to push.
+ */
+static void push_pending_child(Tree_Builder* builder_p, Directory_Tree* child)
+{
+  if (builder_p->pending_count == builder_p->pending_capacity)
+  {
+    builder_p->pending_capacity *= 2;
+    uint64_t start_ns = walk_stats_start();
+    builder_p->pending_children = (Directory_Tree**) realloc(builder_p->pending_children,
+                                                             builder_p->pending_capacity * sizeof(Directory_Tree*));
+    walk_stats_stop(WALK_STAT_ALLOCATE, start_ns, 1);
+    if (builder_p->pending_children == NULL)
+    {
+      printf("Could not allocate memory for the directory tree.\n");
+      exit(1);
+    }
+  }
+
+  builder_p->pending_children[builder_p->pending_count] = child;
+  builder_p->pending_count++;
+}
+
+/**
+ * @brief Moves the children on top of the pending stack to an exactly sized children array of their parent.
+ * @param builder_p [in/out] The state of the tree being created.
+ * @param dir_tree [in/out] The parent of the children.
+ * @param first_child_index [in] The index in the pending stack of the first child.
+ */
+static void move_pending_children(Tree_Builder* builder_p, Directory_Tree* dir_tree, int first_child_index)
+{
+  int children_count = builder_p->pending_count - first_child_index;
+  dir_tree->children = (Directory_Tree**) arena_allocate(builder_p->arena_p, children_count * sizeof(Directory_Tree*));
+  memcpy(dir_tree->children,
+         &builder_p->pending_children[first_child_index],
+         children_count * sizeof(Directory_Tree*));
+  dir_tree->children_count = children_count;
+  builder_p->pending_count = first_child_index;
+}
+
+/**
+ * @brief Rebuilds the path of a node in the path buffer of a builder.
+ * @param builder_p [in/out] The state of the tree being created.
+ * @param dir_tree [in] The node.
+ * @return The path, valid until the path buffer is used again.
+ */
+static char* build_node_path(Tree_Builder* builder_p, Directory_Tree* dir_tree)
+{
+  string_buffer_truncate(&builder_p->path, 0);
+  append_directory_tree_path(dir_tree, &builder_p->path);
+  return builder_p->path.string;
+}
+
+/**
+ * @brief Opens the directory of a node. Relative to an open parent only the name is resolved, otherwise the path of
+ *        the node is rebuilt and opened.
+ * @param builder_p [in/out] The state of the tree being created.
+ * @param directory_fd [in] The open parent directory, or AT_FDCWD to open the path of the node.
+ * @param dir_tree [in] The node of the directory.
+ * @return The fd of the opened directory. Exits the program if the directory could not be opened.
+ */
+static int open_node_directory(Tree_Builder* builder_p, int directory_fd, Directory_Tree* dir_tree)
+{
+  char* name = directory_fd == AT_FDCWD ? build_node_path(builder_p, dir_tree) : dir_tree->file_name;
+  uint64_t start_ns = walk_stats_start();
+  int child_fd = open_directory_fd(directory_fd, name);
+  walk_stats_stop(WALK_STAT_OPEN, start_ns, 1);
+  if (child_fd < 0)
+  {
+    exit_with_path("Could not open the directory: ", dir_tree);
+  }
+  return child_fd;
+}
+
+/**
+ * @brief Queues a lookup of the type of a child, run in a batch once its directory has been read.
+ * @param builder_p [in/out] The state of the tree being created.
+ * @param child [in] The child to look up.
+ */
+static void add_uring_request(Tree_Builder* builder_p, Directory_Tree* child)
+{
+  if (builder_p->uring_request_count == builder_p->uring_request_capacity)
+  {
+    builder_p->uring_request_capacity *= 2;
+    builder_p->uring_requests = (Uring_Request*) realloc(builder_p->uring_requests,
+                                                         builder_p->uring_request_capacity * sizeof(Uring_Request));
+    if (builder_p->uring_requests == NULL)
+    {
+      printf("Could not allocate memory for the directory tree.\n");
+      exit(1);
+    }
+  }
+
+  Uring_Request* request_p = &builder_p->uring_requests[builder_p->uring_request_count];
+  request_p->name = child->file_name;
+  request_p->data_p = child;
+  builder_p->uring_request_count++;
+}
+
+/**
+ * @brief Creates a Directory Tree node for a file in the parent directory, without reading its children.
+ * @param builder_p [in/out] The state of the tree being created.
+ * @param file_name [in] The name of the file in the parent directory.
+ * @param child_is_directory [in] True if the file is a directory.
+ * @param parent [in] The Directory Tree node of the parent directory.
+ * @return The new node.
+ */
+static Directory_Tree* create_child_node(Tree_Builder* builder_p, 
+                                         char* file_name, 
+                                         bool child_is_directory, 
+                                         Directory_Tree* parent)
+{
+  size_t file_name_length = strlen(file_name);
+
+  Directory_Tree* new_dir_tree = (Directory_Tree*) arena_allocate(builder_p->arena_p, sizeof(Directory_Tree));
+  new_dir_tree->depth = parent->depth - 1;
+  new_dir_tree->omitted_count = 0;
+  new_dir_tree->is_directory = child_is_directory; 
+  new_dir_tree->is_base = false;
+  new_dir_tree->is_reference = false;
+  new_dir_tree->parent = parent;
+  new_dir_tree->file_name = string_pool_intern(&builder_p->names, file_name, file_name_length);
+  new_dir_tree->file_name_length = (int) file_name_length;
+  new_dir_tree->children = NULL;
+  new_dir_tree->children_count = 0;
+  new_dir_tree->stamp_p = NULL;
+  new_dir_tree->usage_p = NULL;
+  new_dir_tree->hash_p = NULL;
+  builder_p->node_count++;
+  walk_stats_count_entry(builder_p->base_depth - new_dir_tree->depth);
+
+  return new_dir_tree;
+}
+
+/**
+ * @brief Allocates the disk usage of a node, with all sizes 0.
+ * @param builder_p [in/out] The state of the tree being created.
+ * @param dir_tree [in/out] The node.
+ * @return The usage of the node.
+ */
+static Directory_Usage* allocate_usage(Tree_Builder* builder_p, Directory_Tree* dir_tree)
+{
+  dir_tree->usage_p = (Directory_Usage*) arena_allocate(builder_p->arena_p, sizeof(Directory_Usage));
+  memset(dir_tree->usage_p, 0, sizeof(Directory_Usage));
+  return dir_tree->usage_p;
+}
+
+/**
+ * @brief Sets the disk usage of a file from stat.
+ * @param usage_p [out] The usage of the file.
+ * @param file_info_p [in] The result of stat or lstat on the file.
+ */
+static void set_usage_from_stat(Directory_Usage* usage_p, struct stat* file_info_p)
+{
+  bool file_is_directory = S_ISDIR(file_info_p->st_mode);
+  usage_p->apparent_size = (uint64_t) file_info_p->st_size;
+  usage_p->allocated_size = (uint64_t) file_info_p->st_blocks * BYTES_PER_BLOCK;
+  usage_p->file_count = file_is_directory ? 0 : 1;
+  usage_p->device = (uint64_t) file_info_p->st_dev;
+  usage_p->inode = (uint64_t) file_info_p->st_ino;
+  usage_p->modification_time_ns = get_time_ns(&file_info_p->st_mtim);
+  usage_p->is_hard_link = !file_is_directory && file_info_p->st_nlink > 1;
+  usage_p->is_symbolic_link = S_ISLNK(file_info_p->st_mode);
+}
+
+/**
+ * @brief Sets the disk usage of a file from statx.
+ * @param usage_p [out] The usage of the file.
+ * @param file_info_p [in] The result of statx on the file.
+ */
+static void set_usage_from_statx(Directory_Usage* usage_p, struct statx* file_info_p)
+{
+  bool file_is_directory = S_ISDIR(file_info_p->stx_mode);
+  usage_p->apparent_size = file_info_p->stx_size;
+  usage_p->allocated_size = file_info_p->stx_blocks * BYTES_PER_BLOCK;
+  usage_p->file_count = file_is_directory ? 0 : 1;
+  usage_p->device = (uint64_t) makedev(file_info_p->stx_dev_major, file_info_p->stx_dev_minor);
+  usage_p->inode = file_info_p->stx_ino;
+  usage_p->modification_time_ns = (int64_t) file_info_p->stx_mtime.tv_sec * NANOSECONDS_PER_SECOND + 
+                                  file_info_p->stx_mtime.tv_nsec;
+  usage_p->is_hard_link = !file_is_directory && file_info_p->stx_nlink > 1;
+  usage_p->is_symbolic_link = S_ISLNK(file_info_p->stx_mode);
+}
+
+/**
+ * @brief Creates a Directory Tree node for a file in the parent directory together with its disk usage. Every entry
+ *        is looked up, and links are looked up themselves, so their own size is counted.
+ * @param builder_p [in/out] The state of the tree being created.
+ * @param directory_fd [in] The open parent directory.
+ * @param entry_p [in] The entry of the file.
+ * @param parent [in] The Directory Tree node of the parent directory.
+ * @return The new node.
+ */
+static Directory_Tree* create_child_node_with_usage(Tree_Builder* builder_p, 
+                                                    int directory_fd, 
+                                                    Directory_Entry* entry_p, 
+                                                    Directory_Tree* parent)
+{
+  /* A followed link gets the usage of what it points to, a broken one its own. */
+  struct stat file_info = {0};
+  uint64_t start_ns = walk_stats_start();
+  bool file_exists = (builder_p->follow_links && fstatat(directory_fd, entry_p->name, &file_info, 0) == 0) || 
+                     fstatat(directory_fd, entry_p->name, &file_info, AT_SYMLINK_NOFOLLOW) == 0;
+  walk_stats_stop(WALK_STAT_LOOKUP, start_ns, 1);
+  bool child_is_directory = file_exists && S_ISDIR(file_info.st_mode);
+
+  Directory_Tree* child = create_child_node(builder_p, entry_p->name, child_is_directory, parent);
+  Directory_Usage* usage_p = allocate_usage(builder_p, child);
+  if (file_exists)
+  {
+    set_usage_from_stat(usage_p, &file_info);
+  }
+  return child;
+}
+
+/**
+ * @brief Checks if the children of a directory should be read.
+ * @param builder_p [in] The state of the tree being created.
+ * @param dir_tree [in] The node.
+ * @return True if the node is a directory above the depth of the tree, or its size or hash includes its children.
+ */
+static bool should_read_children(Tree_Builder* builder_p, Directory_Tree* dir_tree)
+{
+  if (!dir_tree->is_directory)
+  {
+    return false;
+  }
+  if (dir_tree->depth > 0)
+  {
+    return true;
+  }
+
+  /* Sizes and hashes include everything below a directory, even below the printed depth. Links are only directories
+     when they are followed, and then no directory is read twice, so link cycles are not read forever. */
+  return (builder_p->record_usage && dir_tree->usage_p != NULL) || builder_p->record_hashes;
+}
+
+/**
+ * @brief Removes the children left out by the filter from the top of the pending stack. If the directory has a
+ *        .gitignore file, its patterns become the scope of the builder first.
+ * @param builder_p [in/out] The state of the tree being created.
+ * @param dir_tree [in] The Directory_Tree node of the directory the children were read from.
+ * @param directory_fd [in] The opened directory.
+ * @param first_child_index [in] The index in the pending stack of the first child.
+ */
+static void filter_pending_children(Tree_Builder* builder_p, 
+                                    Directory_Tree* dir_tree, 
+                                    int directory_fd, 
+                                    int first_child_index)
+{
+  Directory_Tree** children = builder_p->pending_children;
+  String_Buffer* path_p = &builder_p->path;
+  build_node_path(builder_p, dir_tree);
+  size_t directory_path_length = path_p->length;
+
+  /* The entries were just read, so a .gitignore file is only opened where there is one. */
+  if (builder_p->filter_p->use_gitignore)
+  {
+    for (int i = first_child_index; i < builder_p->pending_count; i++)
+    {
+      if (!children[i]->is_directory && strings_are_equal(children[i]->file_name, GITIGNORE_FILE_NAME))
+      {
+        builder_p->scope_p = ignore_scope_load(builder_p->arena_p, 
+                                               builder_p->scope_p, 
+                                               directory_fd, 
+                                               directory_path_length);
+        break;
+      }
+    }
+  }
+
+  /* Patterns with a '/' are matched against the path, so the path of every child is built after the path of the
+     directory. */
+  int kept_count = first_child_index;
+  for (int i = first_child_index; i < builder_p->pending_count; i++)
+  {
+    Directory_Tree* child = children[i];
+    string_buffer_truncate(path_p, directory_path_length);
+    string_buffer_append(path_p, child->file_name, child->file_name_length);
+    if (path_filter_excludes(builder_p->filter_p, 
+                             builder_p->scope_p, 
+                             path_p->string, 
+                             directory_path_length, 
+                             path_p->length, 
+                             child->is_directory))
+    {
+      /* The node stays unused in the arena, but the directory is never opened. */
+      builder_p->node_count--;
+      continue;
+    }
+    children[kept_count] = child;
+    kept_count++;
+  }
+  builder_p->pending_count = kept_count;
+}
+
+/**
+ * @brief Looks up the sizes or modification times children are sorted by. Links are looked up themselves.
+ * @param builder_p [in/out] The state of the tree being created, to batch the lookups through io_uring. May be NULL.
+ * @param directory_fd [in] The open directory of the children, or AT_FDCWD to look them up by path.
+ * @param children [in] The children, of the same directory.
+ * @param count [in] The number of children.
+ * @param order [in] SORT_SIZE or SORT_MODIFICATION_TIME.
+ * @param values [out] The value of every child to sort by, count long. Children that could not be looked up sort
+ *               last.
+ */
+static void lookup_sort_values(Tree_Builder* builder_p, 
+                               int directory_fd, 
+                               Directory_Tree** children, 
+                               int count, 
+                               Sort_Order order, 
+                               uint64_t* values)
+{
+  if (builder_p != NULL && builder_p->has_uring && directory_fd != AT_FDCWD)
+  {
+    for (int i = 0; i < count; i++)
+    {
+      add_uring_request(builder_p, children[i]);
+    }
+    uint64_t start_ns = walk_stats_start();
+    uring_statx_batch(&builder_p->uring, directory_fd, builder_p->uring_requests, count, AT_SYMLINK_NOFOLLOW);
+    walk_stats_stop(WALK_STAT_LOOKUP, start_ns, count);
+    for (int i = 0; i < count; i++)
+    {
+      Uring_Request* request_p = &builder_p->uring_requests[i];
+      struct statx* file_info_p = &request_p->info;
+      values[i] = UINT64_MAX;
+      if (request_p->result == 0)
+      {
+        values[i] = order == SORT_SIZE ? 
+                    size_sort_value(file_info_p->stx_size) : 
+                    time_sort_value(file_info_p->stx_mtime.tv_sec * NANOSECONDS_PER_SECOND + 
+                                    file_info_p->stx_mtime.tv_nsec);
+      }
+    }
+    builder_p->uring_request_count = 0;
+  }
+  else
+  {
+    /* Without an open directory, the children are looked up by the path of the directory followed by their name. */
+    String_Buffer path;
+    size_t directory_path_length = 0;
+    if (directory_fd == AT_FDCWD)
+    {
+      string_buffer_init(&path);
+      append_directory_tree_path(children[0]->parent, &path);
+      directory_path_length = path.length;
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+      struct stat file_info = {0};
+      char* name = children[i]->file_name;
+      if (directory_fd == AT_FDCWD)
+      {
+        string_buffer_truncate(&path, directory_path_length);
+        string_buffer_append(&path, children[i]->file_name, children[i]->file_name_length);
+        name = path.string;
+      }
+      uint64_t start_ns = walk_stats_start();
+      int result = fstatat(directory_fd, name, &file_info, AT_SYMLINK_NOFOLLOW);
+      walk_stats_stop(WALK_STAT_LOOKUP, start_ns, 1);
+      values[i] = UINT64_MAX;
+      if (result == 0)
+      {
+        values[i] = order == SORT_SIZE ? 
+                    size_sort_value((uint64_t) file_info.st_size) : 
+                    time_sort_value(get_time_ns(&file_info.st_mtim));
+      }
+    }
+
+    if (directory_fd == AT_FDCWD)
+    {
+      string_buffer_free(&path);
+    }
+  }
+}
+
+/**
+ * @brief Sorts the children of a directory in the order of a sorter. Sorting by size with disk usage is left to
+ *        summing up the usage, since the sizes of directories are only known then.
+ * @param builder_p [in/out] The state of the tree being created, to batch lookups through io_uring. May be NULL.
+ * @param sorter_p [in/out] The sorter.
+ * @param directory_fd [in] The open directory of the children, or AT_FDCWD to look them up by path.
+ * @param children [in/out] The children.
+ * @param count [in] The number of children.
+ */
+static void sort_children(Tree_Builder* builder_p, 
+                          Node_Sorter* sorter_p, 
+                          int directory_fd, 
+                          Directory_Tree** children, 
+                          int count)
+{
+  if (sorter_p->order == SORT_NONE || count < 2)
+  {
+    return;
+  }
+
+  uint64_t* values = NULL;
+  if (sorter_p->order == SORT_SIZE || sorter_p->order == SORT_MODIFICATION_TIME)
+  {
+    if (sorter_p->order == SORT_SIZE && children[0]->usage_p != NULL)
+    {
+      return;
+    }
+    values = node_sorter_values(sorter_p, count);
+    lookup_sort_values(builder_p, directory_fd, children, count, sorter_p->order, values);
+  }
+  node_sorter_sort(sorter_p, children, count, values);
+}
+
+/**
+ * @brief Reads a directory and adds all its files and directories as children to its Directory_Tree node, without
+ *        reading the children directories.
+ * @param builder_p [in/out] The state of the tree being created.
+ * @param dir_tree [in/out] The Directory_Tree node of the directory to read.
+ * @param directory_fd [in] The opened directory.
+ */
+static void read_directory_children(Tree_Builder* builder_p, Directory_Tree* dir_tree, int directory_fd)
+{
+  int first_child_index = builder_p->pending_count;
+
+  Directory_Reader reader;
+  Directory_Entry entry;
+  directory_reader_init(&reader, directory_fd, builder_p->read_buffer, DIRECTORY_READER_BUFFER_SIZE);
+  while (directory_reader_next(&reader, &entry))
+  {
+    Directory_Tree* child;
+    if (builder_p->has_uring && (builder_p->record_usage || entry.type == DT_UNKNOWN || entry.type == DT_LNK))
+    {
+      child = create_child_node(builder_p, entry.name, false, dir_tree);
+      add_uring_request(builder_p, child);
+    }
+    else if (builder_p->record_usage)
+    {
+      child = create_child_node_with_usage(builder_p, directory_fd, &entry, dir_tree);
+    }
+    else
+    {
+      bool child_is_directory = is_directory_entry(directory_fd, &entry, builder_p->follow_links);
+      child = create_child_node(builder_p, entry.name, child_is_directory, dir_tree);
+    }
+    push_pending_child(builder_p, child);
+  }
+
+  if (reader.error != 0)
+  {
+    exit_with_path("Could not read the directory: ", dir_tree);
+  }
+
+  /* Look up all entries without a known type at once, they complete in any order. With usage every entry is looked
+     up. Links are looked up themselves unless they are followed. */
+  if (builder_p->uring_request_count > 0)
+  {
+    uint64_t start_ns = walk_stats_start();
+    uring_statx_batch(&builder_p->uring, 
+                      directory_fd, 
+                      builder_p->uring_requests, 
+                      builder_p->uring_request_count, 
+                      builder_p->follow_links ? 0 : AT_SYMLINK_NOFOLLOW);
+    walk_stats_stop(WALK_STAT_LOOKUP, start_ns, builder_p->uring_request_count);
+    for (int i = 0; i < builder_p->uring_request_count; i++)
+    {
+      Uring_Request* request_p = &builder_p->uring_requests[i];
+      Directory_Tree* child = (Directory_Tree*) request_p->data_p;
+      bool child_is_directory = request_p->result == 0 && S_ISDIR(request_p->info.stx_mode);
+      if (builder_p->record_usage)
+      {
+        Directory_Usage* usage_p = allocate_usage(builder_p, child);
+        if (request_p->result == 0)
+        {
+          set_usage_from_statx(usage_p, &request_p->info);
+        }
+        else if (builder_p->follow_links)
+        {
+          /* A broken link can not be followed, so it gets its own usage. */
+          struct stat file_info = {0};
+          if (fstatat(directory_fd, child->file_name, &file_info, AT_SYMLINK_NOFOLLOW) == 0)
+          {
+            set_usage_from_stat(usage_p, &file_info);
+          }
+        }
+      }
+      child->is_directory = child_is_directory;
+    }
+    builder_p->uring_request_count = 0;
+  }
+
+  if (builder_p->filter_p != NULL)
+  {
+    filter_pending_children(builder_p, dir_tree, directory_fd, first_child_index);
+  }
+
+  /* Without a sort order, children keep the order they were read in. */
+  sort_children(builder_p, 
+                &builder_p->sorter, 
+                directory_fd, 
+                &builder_p->pending_children[first_child_index], 
+                builder_p->pending_count - first_child_index);
+
+  /* The left out children stay in the arena, but are no longer counted or part of the tree. */
+  int child_count = builder_p->pending_count - first_child_index;
+  if (builder_p->child_limit > 0 && child_count > builder_p->child_limit)
+  {
+    dir_tree->omitted_count = child_count - builder_p->child_limit;
+    builder_p->pending_count = first_child_index + builder_p->child_limit;
+    builder_p->node_count -= dir_tree->omitted_count;
+  }
+  move_pending_children(builder_p, dir_tree, first_child_index);
+}
+
+/**
+ * @brief Opens child directories of an open directory. With io_uring the opens are submitted as one batch.
+ * @param builder_p [in/out] The state of the tree being created.
+ * @param directory_fd [in] The open parent directory.
+ * @param children [in] The child directories to open.
+ * @param count [in] The number of child directories.
+ * @param fds [out] The fds of the opened directories, count long. Exits the program if one could not be opened.
+ */
+static void open_child_directories(Tree_Builder* builder_p, 
+                                   int directory_fd, 
+                                   Directory_Tree* children[], 
+                                   int count, 
+                                   int* fds)
+{
+  if (!builder_p->has_uring || count < 2)
+  {
+    for (int i = 0; i < count; i++)
+    {
+      fds[i] = open_node_directory(builder_p, directory_fd, children[i]);
+    }
+    return;
+  }
+
+  Uring_Request requests[URING_OPEN_WINDOW_SIZE];
+  for (int i = 0; i < count; i++)
+  {
+    requests[i].name = children[i]->file_name;
+  }
+
+  uint64_t start_ns = walk_stats_start();
+  uring_openat_batch(&builder_p->uring, directory_fd, requests, count, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  walk_stats_stop(WALK_STAT_OPEN, start_ns, count);
+
+  for (int i = 0; i < count; i++)
+  {
+    if (requests[i].result < 0)
+    {
+      exit_with_path("Could not open the directory: ", children[i]);
+    }
+    fds[i] = requests[i].result;
+  }
+}
+
+/**
+ * @brief Pushes a read directory onto the stack of the builder, so its child directories are read next. If too many
+ *        directories are open, the shallowest open one is closed.
+ * @param builder_p [in/out] The state of the tree being created. Its scope is the scope of the directory.
+ * @param dir_tree [in] The Directory_Tree node of the directory, its children are already read.
+ * @param directory_fd [in] The opened directory, closed once its child directories are read.
+ */
+static void push_directory_frame(Tree_Builder* builder_p, Directory_Tree* dir_tree, int directory_fd)
+{
+  Directory_Frame* frame_p = (Directory_Frame*) frame_stack_push(&builder_p->frames);
+  frame_p->dir_tree = dir_tree;
+  frame_p->fd = directory_fd;
+  frame_p->scope_p = builder_p->scope_p;
+  frame_p->child_index = 0;
+  frame_p->window_index = 0;
+  frame_p->window_count = 0;
+}
+
+/**
+ * @brief Opens the next child directories of the directory on top of the stack that have to be read. With io_uring a
+ *        window of them is opened as one batch, without it only one, right before it is read.
+ * @param builder_p [in/out] The state of the tree being created.
+ * @param frame_p [in/out] The frame of the open directory, whose window is empty. It stays empty if every child
+ *                directory was read.
+ */
+static void fill_directory_window(Tree_Builder* builder_p, Directory_Frame* frame_p)
+{
+  int window_size = builder_p->has_uring ? URING_OPEN_WINDOW_SIZE : 1;
+  Directory_Tree* dir_tree = frame_p->dir_tree;
+  Directory_Tree* window[URING_OPEN_WINDOW_SIZE];
+  int window_count = 0;
+  while (frame_p->child_index < dir_tree->children_count && window_count < window_size)
+  {
+    Directory_Tree* child = dir_tree->children[frame_p->child_index];
+    if (should_read_children(builder_p, child))
+    {
+      frame_p->window[window_count] = frame_p->child_index;
+      window[window_count] = child;
+      window_count++;
+    }
+    frame_p->child_index++;
+  }
+
+  open_child_directories(builder_p, frame_p->fd, window, window_count, frame_p->window_fds);
+  frame_p->window_index = 0;
+  frame_p->window_count = window_count;
+}
+
+/**
+ * @brief Closes the directory of a frame deep below the top of the stack, and the child directories it opened ahead.
+ *        They are opened again when the frame is back on top.
+ * @param frame_p [in/out] The frame of the open directory.
+ */
+static void close_directory_frame(Directory_Frame* frame_p)
+{
+  get_directory_identity(frame_p->fd, &frame_p->device, &frame_p->inode);
+  close(frame_p->fd);
+  frame_p->fd = -1;
+
+  if (frame_p->window_index < frame_p->window_count)
+  {
+    frame_p->child_index = frame_p->window[frame_p->window_index];
+    for (int i = frame_p->window_index; i < frame_p->window_count; i++)
+    {
+      close(frame_p->window_fds[i]);
+    }
+  }
+  frame_p->window_index = 0;
+  frame_p->window_count = 0;
+}
+
+/**
+ * @brief Opens the directory of a closed frame again, once its last read child directory is done.
+ * @param builder_p [in/out] The state of the tree being created.
+ * @param frame_p [in/out] The frame of the closed directory.
+ * @param child_fd [in] The open child directory that was read last.
+ */
+static void reopen_directory_frame(Tree_Builder* builder_p, Directory_Frame* frame_p, int child_fd)
+{
+  /* Going up through ".." does not resolve the path again. A child reached through a link has another parent, then
+     the path is opened. */
+  frame_p->fd = open_parent_directory(child_fd, frame_p->device, frame_p->inode);
+  if (frame_p->fd < 0)
+  {
+    frame_p->fd = open_node_directory(builder_p, AT_FDCWD, frame_p->dir_tree);
+  }
+}
+
+/**
+ * @brief Records a directory about to be read while links are followed, so every directory is only read once. A
+ *        directory that was already read, e.g. reached again through a link to a directory above it, becomes a
+ *        reference instead.
+ * @param builder_p [in/out] The state of the tree being created.
+ * @param dir_tree [in/out] The Directory_Tree node of the directory.
+ * @param directory_fd [in] The opened directory.
+ * @return True if the directory should be read, false if it is a reference.
+ */
+static bool visit_directory(Tree_Builder* builder_p, Directory_Tree* dir_tree, int directory_fd)
+{
+  if (builder_p->visited_p == NULL)
+  {
+    return true;
+  }
+
+  struct stat file_info = {0};
+  uint64_t start_ns = walk_stats_start();
+  int result = fstat(directory_fd, &file_info);
+  walk_stats_stop(WALK_STAT_LOOKUP, start_ns, 1);
+  if (result != 0 || inode_set_insert(builder_p->visited_p, file_info.st_dev, file_info.st_ino))
+  {
+    return true;
+  }
+
+  dir_tree->is_reference = true;
+  dir_tree->depth = 0;
+  return false;
+}
+
+/**
+ * @brief Reads a directory and all directories below it, adding their files and directories as children. The
+ *        directories are read depth first from a stack on the heap, so deep trees neither recurse on the C stack nor
+ *        keep a directory open per level: only the MAX_OPEN_DIRECTORY_FRAMES deepest directories of the stack are
+ *        open, the ones above are closed and reopened when their children are done.
+ * @param builder_p [in/out] The state of the tree being created.
+ * @param dir_tree [in/out] The Directory_Tree node of the directory to read.
+ * @param directory_fd [in] The opened directory, it is closed when the directory and its children have been read.
+ */
+static void add_directory_tree_children(Tree_Builder* builder_p, Directory_Tree* dir_tree, int directory_fd)
+{
+  Ignore_Scope* parent_scope_p = builder_p->scope_p;
+  Frame_Stack* frames_p = &builder_p->frames;
+  int bottom_frame = frames_p->count;
+  int first_open_frame = bottom_frame;
+
+  if (!visit_directory(builder_p, dir_tree, directory_fd))
+  {
+    close(directory_fd);
+    return;
+  }
+  read_directory_children(builder_p, dir_tree, directory_fd);
+  push_directory_frame(builder_p, dir_tree, directory_fd);
+  while (frames_p->count > bottom_frame)
+  {
+    Directory_Frame* frame_p = (Directory_Frame*) frame_stack_top(frames_p);
+    if (frame_p->window_index == frame_p->window_count)
+    {
+      fill_directory_window(builder_p, frame_p);
+    }
+
+    if (frame_p->window_count == 0)
+    {
+      frame_stack_pop(frames_p);
+      if (frames_p->count > bottom_frame && frames_p->count - 1 < first_open_frame)
+      {
+        first_open_frame = frames_p->count - 1;
+        reopen_directory_frame(builder_p, (Directory_Frame*) frame_stack_top(frames_p), frame_p->fd);
+      }
+      close(frame_p->fd);
+      continue;
+    }
+
+    Directory_Tree* child = frame_p->dir_tree->children[frame_p->window[frame_p->window_index]];
+    int child_fd = frame_p->window_fds[frame_p->window_index];
+    frame_p->window_index++;
+    if (!visit_directory(builder_p, child, child_fd))
+    {
+      close(child_fd);
+      continue;
+    }
+    builder_p->scope_p = frame_p->scope_p;
+    read_directory_children(builder_p, child, child_fd);
+    push_directory_frame(builder_p, child, child_fd);
+
+    if (frames_p->count - first_open_frame > MAX_OPEN_DIRECTORY_FRAMES)
+    {
+      close_directory_frame((Directory_Frame*) frame_stack_at(frames_p, first_open_frame));
+      first_open_frame++;
+    }
+  }
+
+  builder_p->scope_p = parent_scope_p;
+}
+
+/**
+ * @brief Checks if a budget of a tree read breadth first is spent, so no further directory is read.
+ * @param options_p [in] How the tree is read, with its budgets.
+ * @param entry_count [in] The number of entries kept so far, below the base.
+ * @param deadline_ns [in] The monotonic time the tree has to be read by, 0 for no time limit.
+ * @return True if the entries or the time are used up.
+ */
+static bool budget_is_spent(Directory_Tree_Options* options_p, size_t entry_count, int64_t deadline_ns)
+{
+  if (options_p->max_entries > 0 && entry_count >= options_p->max_entries)
+  {
+    return true;
+  }
+  if (deadline_ns == 0)
+  {
+    return false;
+  }
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return get_time_ns(&now) >= deadline_ns;
+}
+
+/**
+ * @brief Reads a directory and the directories below it breadth first, so the shallow levels are filled before any
+ *        deeper one, within the entry and time budgets of the options. Once a budget is spent no further directory is
+ *        read, and the directories still waiting get an omitted_count of -1. Every directory is opened by its path,
+ *        since its parent was closed long before it is read.
+ * @param builder_p [in/out] The state of the tree being created, its scope is the scope of the directory.
+ * @param dir_tree [in/out] The Directory_Tree node of the directory to read.
+ * @param options_p [in] How the tree is read, with its budgets.
+ */
+static void add_directory_tree_children_budgeted(Tree_Builder* builder_p, 
+                                                 Directory_Tree* dir_tree, 
+                                                 Directory_Tree_Options* options_p)
+{
+  int64_t deadline_ns = 0;
+  if (options_p->time_budget_ms > 0)
+  {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    deadline_ns = get_time_ns(&now) + options_p->time_budget_ms * NANOSECONDS_PER_MILLISECOND;
+  }
+
+  /* The queue is a frame stack read from its bottom, the directories before head are done. */
+  Ignore_Scope* parent_scope_p = builder_p->scope_p;
+  Frame_Stack queue;
+  frame_stack_init(&queue, sizeof(Directory_Task));
+  Directory_Task* task_p = (Directory_Task*) frame_stack_push(&queue);
+  task_p->dir_tree = dir_tree;
+  task_p->scope_p = builder_p->scope_p;
+  task_p->parallel_builder_p = NULL;
+  size_t entry_count = 0;
+  for (int head = 0; head < queue.count; head++)
+  {
+    Directory_Task task = *(Directory_Task*) frame_stack_at(&queue, head);
+    if (head > 0 && budget_is_spent(options_p, entry_count, deadline_ns))
+    {
+      for (int i = head; i < queue.count; i++)
+      {
+        ((Directory_Task*) frame_stack_at(&queue, i))->dir_tree->omitted_count = -1;
+      }
+      break;
+    }
+
+    int directory_fd = open_node_directory(builder_p, AT_FDCWD, task.dir_tree);
+    if (!visit_directory(builder_p, task.dir_tree, directory_fd))
+    {
+      close(directory_fd);
+      continue;
+    }
+
+    /* The last directory read within the entry budget keeps only the entries left in it. */
+    builder_p->child_limit = options_p->per_directory_limit;
+    if (options_p->max_entries > 0)
+    {
+      size_t entries_left = options_p->max_entries - entry_count;
+      if (builder_p->child_limit == 0 || entries_left < (size_t) builder_p->child_limit)
+      {
+        builder_p->child_limit = (int) entries_left;
+      }
+    }
+    builder_p->scope_p = task.scope_p;
+    read_directory_children(builder_p, task.dir_tree, directory_fd);
+    close(directory_fd);
+    entry_count += task.dir_tree->children_count;
+
+    for (int i = 0; i < task.dir_tree->children_count; i++)
+    {
+      Directory_Tree* child = task.dir_tree->children[i];
+      if (should_read_children(builder_p, child))
+      {
+        task_p = (Directory_Task*) frame_stack_push(&queue);
+        task_p->dir_tree = child;
+        task_p->scope_p = builder_p->scope_p;
+        task_p->parallel_builder_p = NULL;
+      }
+    }
+  }
+
+  frame_stack_free(&queue);
+  builder_p->child_limit = 0;
+  builder_p->scope_p = parent_scope_p;
+}
+
+/**
+ * @brief Converts a time to nanoseconds.
+ * @param time_p [in] The time.
+ * @return The time in nanoseconds.
+ */
+static int64_t get_time_ns(struct timespec* time_p)
+{
+  return (int64_t) time_p->tv_sec * NANOSECONDS_PER_SECOND + time_p->tv_nsec;
+}
+
+/**
+ * @brief Reads the stamp of a directory.
+ * @param directory_fd [in] The open parent directory, or AT_FDCWD for the base.
+ * @param name [in] The name of the directory in the parent directory, or its path for the base.
+ * @param dir_tree [in] The node of the directory, only used in the error message.
+ * @param stamp_p [out] The stamp of the directory. Exits the program if the directory can not be found.
+ */
+static void read_directory_stamp(int directory_fd, char* name, Directory_Tree* dir_tree, Directory_Stamp* stamp_p)
+{
+  struct stat file_info = {0};
+  uint64_t start_ns = walk_stats_start();
+  int result = fstatat(directory_fd, name, &file_info, 0);
+  walk_stats_stop(WALK_STAT_LOOKUP, start_ns, 1);
+  if (result != 0)
+  {
+    exit_with_path("Could not open the directory: ", dir_tree);
+  }
+
+  stamp_p->device = file_info.st_dev;
+  stamp_p->inode = file_info.st_ino;
+  stamp_p->modification_time_ns = get_time_ns(&file_info.st_mtim);
+  stamp_p->change_time_ns = get_time_ns(&file_info.st_ctim);
+}
+
+/**
+ * @brief Checks if two directory stamps are equal.
+ * @param stamp1_p [in] First stamp.
+ * @param stamp2_p [in] Second stamp.
+ * @return True if the stamps are of the same directory with the same times, false otherwise.
+ */
+static bool stamps_are_equal(Directory_Stamp* stamp1_p, Directory_Stamp* stamp2_p)
+{
+  return stamp1_p->device == stamp2_p->device &&
+         stamp1_p->inode == stamp2_p->inode &&
+         stamp1_p->modification_time_ns == stamp2_p->modification_time_ns &&
+         stamp1_p->change_time_ns == stamp2_p->change_time_ns;
+}
+
+/**
+ * @brief Adds the children of an unchanged directory from the snapshot, without reading the directory.
+ * @param builder_p [in/out] The state of the tree being created.
+ * @param dir_tree [in/out] The Directory_Tree node of the directory.
+ * @param cached_p [in] The snapshot node of the directory.
+ */
+static void copy_cached_children(Tree_Builder* builder_p, Directory_Tree* dir_tree, Snapshot_Node* cached_p)
+{
+  int first_child_index = builder_p->pending_count;
+  for (uint32_t i = 0; i < cached_p->children_count; i++)
+  {
+    Snapshot_Node* child_p = &builder_p->snapshot_p->nodes[cached_p->first_child + i];
+    Directory_Tree* child = create_child_node(builder_p, 
+                                              snapshot_node_name(builder_p->snapshot_p, child_p), 
+                                              (child_p->flags & SNAPSHOT_DIRECTORY) != 0, 
+                                              dir_tree);
+    push_pending_child(builder_p, child);
+  }
+  move_pending_children(builder_p, dir_tree, first_child_index);
+}
+
+/**
+ * @brief Creates a hash table of the child directories of a snapshot node, to find them by name.
+ * @param snapshot_p [in] The snapshot.
+ * @param cached_p [in] The snapshot node whose children are indexed.
+ * @param mask_p [out] The number of slots of the table minus one.
+ * @return The slots of the table, holding node indexes or SNAPSHOT_NO_INDEX. Must be freed by the caller.
+ */
+static uint32_t* index_cached_directories(Snapshot* snapshot_p, Snapshot_Node* cached_p, size_t* mask_p)
+{
+  /* Keep the table at most half full, so probe sequences stay short. */
+  size_t slot_count = 16;
+  while (slot_count < 2 * (size_t) cached_p->children_count)
+  {
+    slot_count *= 2;
+  }
+  uint32_t* slots = (uint32_t*) allocate_or_exit(slot_count * sizeof(uint32_t));
+  memset(slots, 0xff, slot_count * sizeof(uint32_t));
+
+  size_t mask = slot_count - 1;
+  for (uint32_t i = 0; i < cached_p->children_count; i++)
+  {
+    uint32_t child_index = cached_p->first_child + i;
+    Snapshot_Node* child_p = &snapshot_p->nodes[child_index];
+    if ((child_p->flags & SNAPSHOT_DIRECTORY) == 0)
+    {
+      continue;
+    }
+
+    size_t slot = hash_string(snapshot_node_name(snapshot_p, child_p), child_p->name_length) & mask;
+    while (slots[slot] != SNAPSHOT_NO_INDEX)
+    {
+      slot = (slot + 1) & mask;
+    }
+    slots[slot] = child_index;
+  }
+
+  *mask_p = mask;
+  return slots;
+}
+
+/**
+ * @brief Finds the snapshot node of a child directory in a table made by index_cached_directories.
+ * @param snapshot_p [in] The snapshot.
+ * @param slots [in] The slots of the table.
+ * @param mask [in] The number of slots of the table minus one.
+ * @param child [in] The child directory.
+ * @return The index of the snapshot node, or SNAPSHOT_NO_INDEX if the directory is not in the snapshot.
+ */
+static uint32_t find_cached_directory(Snapshot* snapshot_p, uint32_t* slots, size_t mask, Directory_Tree* child)
+{
+  size_t name_length = child->file_name_length;
+  size_t slot = hash_string(child->file_name, name_length) & mask;
+  while (slots[slot] != SNAPSHOT_NO_INDEX)
+  {
+    Snapshot_Node* child_p = &snapshot_p->nodes[slots[slot]];
+    if (child_p->name_length == name_length &&
+        memcmp(snapshot_node_name(snapshot_p, child_p), child->file_name, name_length) == 0)
+    {
+      return slots[slot];
+    }
+    slot = (slot + 1) & mask;
+  }
+  return SNAPSHOT_NO_INDEX;
+}
+
+/**
+ * @brief Adds the children of a directory, recording its stamp, and pushes it onto a stack so its child directories
+ *        are added next. If the stamp is unchanged since the snapshot, the children are taken from the snapshot,
+ *        otherwise the directory is read. If too many directories are open, the deepest open one that is not among
+ *        the MAX_OPEN_DIRECTORY_FRAMES frames on top of the stack is closed.
+ * @param builder_p [in/out] The state of the tree being created. Its scope becomes the scope of the directory.
+ * @param frames_p [in/out] The stack of Cached_Directory_Frame.
+ * @param parent_fd [in] The open parent directory, or AT_FDCWD for the base.
+ * @param dir_tree [in/out] The Directory_Tree node of the directory.
+ * @param cached_index [in] The index of the directory in the snapshot, or SNAPSHOT_NO_INDEX if it is not in it.
+ */
+static void push_cached_directory_frame(Tree_Builder* builder_p, 
+                                        Frame_Stack* frames_p, 
+                                        int parent_fd, 
+                                        Directory_Tree* dir_tree, 
+                                        uint32_t cached_index)
+{
+  Snapshot* snapshot_p = builder_p->snapshot_p;
+  Cached_Directory_Frame* frame_p = (Cached_Directory_Frame*) frame_stack_push(frames_p);
+  frame_p->dir_tree = dir_tree;
+  frame_p->cached_p = NULL;
+  frame_p->slots = NULL;
+  frame_p->mask = 0;
+  frame_p->child_index = 0;
+  frame_p->parent_scope_p = builder_p->scope_p;
+  frame_p->fd = -1;
+
+  /* A directory whose children are corrupt in the snapshot is read as if it was not in it. */
+  if (cached_index != SNAPSHOT_NO_INDEX && snapshot_children_are_valid(snapshot_p, cached_index))
+  {
+    frame_p->cached_p = &snapshot_p->nodes[cached_index];
+  }
+
+  char* name = parent_fd == AT_FDCWD ? build_node_path(builder_p, dir_tree) : dir_tree->file_name;
+  Directory_Stamp* stamp_p = &frame_p->stamp;
+  read_directory_stamp(parent_fd, name, dir_tree, stamp_p);
+
+  Snapshot_Node* cached_p = frame_p->cached_p;
+  frame_p->is_copied = cached_p != NULL && 
+                       (cached_p->flags & SNAPSHOT_CHILDREN_READ) != 0 && 
+                       stamps_are_equal(&cached_p->stamp, stamp_p);
+  if (frame_p->is_copied)
+  {
+    copy_cached_children(builder_p, dir_tree, cached_p);
+  }
+  else
+  {
+    /* A reference has no children to reuse, so it gets no stamp and is left without children. */
+    frame_p->fd = open_node_directory(builder_p, parent_fd, dir_tree);
+    if (visit_directory(builder_p, dir_tree, frame_p->fd))
+    {
+      read_directory_children(builder_p, dir_tree, frame_p->fd);
+    }
+
+    /* The entries may have moved, so the unchanged child directories are found in the snapshot by name. */
+    if (cached_p != NULL && cached_p->children_count > 0 && !dir_tree->is_reference)
+    {
+      frame_p->slots = index_cached_directories(snapshot_p, cached_p, &frame_p->mask);
+    }
+  }
+  frame_p->scope_p = builder_p->scope_p;
+
+  if (!dir_tree->is_reference && 
+      stamp_p->modification_time_ns + NANOSECONDS_PER_SECOND <= builder_p->start_time_ns &&
+      stamp_p->change_time_ns + NANOSECONDS_PER_SECOND <= builder_p->start_time_ns)
+  {
+    dir_tree->stamp_p = (Directory_Stamp*) arena_allocate(builder_p->arena_p, sizeof(Directory_Stamp));
+    *dir_tree->stamp_p = *stamp_p;
+  }
+
+  if (frames_p->count > MAX_OPEN_DIRECTORY_FRAMES)
+  {
+    int closed_index = frames_p->count - 1 - MAX_OPEN_DIRECTORY_FRAMES;
+    Cached_Directory_Frame* closed_p = (Cached_Directory_Frame*) frame_stack_at(frames_p, closed_index);
+    if (closed_p->fd >= 0)
+    {
+      close(closed_p->fd);
+      closed_p->fd = -1;
+    }
+  }
+}
+
+/**
+ * @brief Adds the children of a directory and all directories below it, recording their stamps. Directories whose
+ *        stamp is unchanged since the snapshot are taken from the snapshot, others are read. The directories are
+ *        added depth first from a stack on the heap, so deep trees do not recurse on the C stack, and the stamps are
+ *        read relative to the open parent directory, so deep paths are not resolved again for every directory.
+ * @param builder_p [in/out] The state of the tree being created.
+ * @param dir_tree [in/out] The Directory_Tree node of the directory.
+ * @param cached_index [in] The index of the directory in the snapshot, or SNAPSHOT_NO_INDEX if it is not in it.
+ */
+static void add_directory_tree_children_cached(Tree_Builder* builder_p, Directory_Tree* dir_tree, uint32_t cached_index)
+{
+  Snapshot* snapshot_p = builder_p->snapshot_p;
+  Frame_Stack frames;
+  frame_stack_init(&frames, sizeof(Cached_Directory_Frame));
+  push_cached_directory_frame(builder_p, &frames, AT_FDCWD, dir_tree, cached_index);
+
+  while (frames.count > 0)
+  {
+    Cached_Directory_Frame* frame_p = (Cached_Directory_Frame*) frame_stack_top(&frames);
+    Directory_Tree* parent = frame_p->dir_tree;
+    while (frame_p->child_index < parent->children_count && 
+           !should_read_children(builder_p, parent->children[frame_p->child_index]))
+    {
+      frame_p->child_index++;
+    }
+
+    if (frame_p->child_index == parent->children_count)
+    {
+      /* Sorted last, since copied children are matched to the snapshot by index. */
+      if (frame_p->is_copied)
+      {
+        sort_children(builder_p, &builder_p->sorter, AT_FDCWD, parent->children, parent->children_count);
+      }
+      free(frame_p->slots);
+      builder_p->scope_p = frame_p->parent_scope_p;
+      frame_stack_pop(&frames);
+
+      /* A closed parent is reopened through "..", checked to be the same directory, before the child is closed. */
+      Cached_Directory_Frame* top_p = frames.count > 0 ? (Cached_Directory_Frame*) frame_stack_top(&frames) : NULL;
+      if (top_p != NULL && top_p->fd < 0 && frame_p->fd >= 0)
+      {
+        top_p->fd = open_parent_directory(frame_p->fd, top_p->stamp.device, top_p->stamp.inode);
+      }
+      if (frame_p->fd >= 0)
+      {
+        close(frame_p->fd);
+      }
+      continue;
+    }
+
+    int child_index = frame_p->child_index;
+    Directory_Tree* child = parent->children[child_index];
+    frame_p->child_index++;
+
+    uint32_t child_cached_index = SNAPSHOT_NO_INDEX;
+    if (frame_p->is_copied)
+    {
+      child_cached_index = frame_p->cached_p->first_child + (uint32_t) child_index;
+    }
+    else if (frame_p->slots != NULL)
+    {
+      child_cached_index = find_cached_directory(snapshot_p, frame_p->slots, frame_p->mask, child);
+    }
+    /* Copied directories are opened once a child directory needs its stamp read, relative to their parent if it is
+       still open. */
+    if (frame_p->fd < 0)
+    {
+      Cached_Directory_Frame* above_p = NULL;
+      if (frames.count > 1)
+      {
+        above_p = (Cached_Directory_Frame*) frame_stack_at(&frames, frames.count - 2);
+      }
+      int above_fd = above_p != NULL && above_p->fd >= 0 ? above_p->fd : AT_FDCWD;
+      frame_p->fd = open_node_directory(builder_p, above_fd, parent);
+    }
+    builder_p->scope_p = frame_p->scope_p;
+    push_cached_directory_frame(builder_p, &frames, frame_p->fd, child, child_cached_index);
+  }
+
+  frame_stack_free(&frames);
+}
+
+/**
+ * @brief Pushes a task reading a directory, which inherits the current scope of the builder.
+ * @param pool_p [in/out] The pool running the tasks.
+ * @param worker_index [in] The index of the worker pushing the task.
+ * @param parallel_builder_p [in/out] The context of the tree, the task is allocated from the arena of the worker.
+ * @param dir_tree [in] The Directory_Tree node of the directory to read.
+ */
+static void push_directory_task(Work_Pool* pool_p, 
+                                int worker_index, 
+                                Parallel_Tree_Builder* parallel_builder_p, 
+                                Directory_Tree* dir_tree)
+{
+  Tree_Builder* builder_p = &parallel_builder_p->builders[worker_index];
+  Directory_Task* task_p = (Directory_Task*) arena_allocate(builder_p->arena_p, sizeof(Directory_Task));
+  task_p->dir_tree = dir_tree;
+  task_p->scope_p = builder_p->scope_p;
+  task_p->parallel_builder_p = parallel_builder_p;
+  atomic_fetch_add(&parallel_builder_p->pending_count, 1);
+  work_pool_push(pool_p, worker_index, read_directory_task, task_p);
+}
+
+/**
+ * @brief Task reading one directory of a tree created in parallel. Creates the children of the directory, then pushes
+ *        one task per child directory but the last, so the subtrees are read by whichever worker is idle. The last
+ *        child directory is read by the task itself, opened relative to the open directory, so a long chain of single
+ *        directories is not opened again and again by its ever longer path.
+ * @param pool_p [in/out] The pool running the task.
+ * @param worker_index [in] The index of the worker running the task.
+ * @param task_p [in] The Directory_Task of the directory to read. The tree it belongs to is told once its last task
+ *               finished, if it is created in a set.
+ */
+static void read_directory_task(Work_Pool* pool_p, int worker_index, void* task_p)
+{
+  Parallel_Tree_Builder* parallel_builder_p = ((Directory_Task*) task_p)->parallel_builder_p;
+  Tree_Builder* builder_p = &parallel_builder_p->builders[worker_index];
+  Directory_Tree* dir_tree = ((Directory_Task*) task_p)->dir_tree;
+  builder_p->scope_p = ((Directory_Task*) task_p)->scope_p;
+
+  /* Parent directories may already be closed by other workers, so the directory is opened by its path, rebuilt from
+     its parents. Entries are still checked relative to the opened directory. */
+  int directory_fd = open_node_directory(builder_p, AT_FDCWD, dir_tree);
+  while (dir_tree != NULL)
+  {
+    read_directory_children(builder_p, dir_tree, directory_fd);
+
+    Directory_Tree* next = NULL;
+    for (int i = 0; i < dir_tree->children_count; i++)
+    {
+      Directory_Tree* child = dir_tree->children[i];
+      if (should_read_children(builder_p, child))
+      {
+        if (next != NULL)
+        {
+          push_directory_task(pool_p, worker_index, parallel_builder_p, next);
+        }
+        next = child;
+      }
+    }
+
+    int next_fd = next == NULL ? -1 : open_node_directory(builder_p, directory_fd, next);
+    close(directory_fd);
+    directory_fd = next_fd;
+    dir_tree = next;
+  }
+
+  /* Nothing of the tree is touched once its last task is done, the thread waiting for it may free it right away. */
+  Tree_Set_Builder* set_p = parallel_builder_p->set_p;
+  if (atomic_fetch_sub(&parallel_builder_p->pending_count, 1) == 1 && set_p != NULL)
+  {
+    pthread_mutex_lock(&set_p->mutex);
+    parallel_builder_p->is_read = true;
+    pthread_cond_broadcast(&set_p->read_condition);
+    pthread_mutex_unlock(&set_p->mutex);
+  }
+}
+
+/**
+ * @brief Allocates the context of a tree read in parallel, with a Tree_Builder and an arena per worker thread.
+ * @param thread_count [in] The number of worker threads.
+ * @param options_p [in] How the tree is read.
+ * @param scope_p [in] The scope of the base, NULL if there is no filter. The base can be pushed by any worker.
+ * @return The context, freed by merge_parallel_tree_builder.
+ */
+static Parallel_Tree_Builder* create_parallel_tree_builder(int thread_count, 
+                                                           Directory_Tree_Options* options_p, 
+                                                           Ignore_Scope* scope_p)
+{
+  Parallel_Tree_Builder* parallel_builder_p = (Parallel_Tree_Builder*) allocate_or_exit(sizeof(Parallel_Tree_Builder));
+  for (int i = 0; i < thread_count; i++)
+  {
+    arena_init(&parallel_builder_p->arenas[i]);
+    init_tree_builder(&parallel_builder_p->builders[i], &parallel_builder_p->arenas[i], options_p);
+    parallel_builder_p->builders[i].scope_p = scope_p;
+  }
+  parallel_builder_p->use_uring = options_p->use_uring;
+  atomic_init(&parallel_builder_p->pending_count, 0);
+  parallel_builder_p->set_p = NULL;
+  parallel_builder_p->is_read = false;
+  return parallel_builder_p;
+}
+
+/**
+ * @brief Merges the arenas of the workers into the arena of the base once the tree is read, and frees the context.
+ * @param base_p [in/out] The base of the tree.
+ * @param parallel_builder_p [in/out] The context of the tree, freed.
+ * @param thread_count [in] The number of worker threads the context was created for.
+ */
+static void merge_parallel_tree_builder(Base_Directory_Tree* base_p, 
+                                        Parallel_Tree_Builder* parallel_builder_p, 
+                                        int thread_count)
+{
+  for (int i = 0; i < thread_count; i++)
+  {
+    arena_merge(&base_p->arena, &parallel_builder_p->arenas[i]);
+    base_p->node_count += parallel_builder_p->builders[i].node_count;
+    free_tree_builder(&parallel_builder_p->builders[i]);
+  }
+
+  free(parallel_builder_p);
+}
+
+/**
+ * @brief Reads the children of the base directory, and all directories below it, using several threads.
+ * @param base_p [in/out] The base of the tree to create.
+ * @param options_p [in] How the tree is read, e.g. the number of threads to use.
+ * @param scope_p [in] The scope of the base, NULL if there is no filter.
+ */
+static void add_directory_tree_children_parallel(Base_Directory_Tree* base_p, 
+                                                Directory_Tree_Options* options_p, 
+                                                Ignore_Scope* scope_p)
+{
+  int thread_count = options_p->thread_count;
+  Parallel_Tree_Builder* parallel_builder_p = create_parallel_tree_builder(thread_count, options_p, scope_p);
+
+  Work_Pool* pool_p = work_pool_create(thread_count, NULL);
+  push_directory_task(pool_p, 0, parallel_builder_p, &base_p->node);
+  work_pool_wait(pool_p);
+  work_pool_destroy(pool_p);
+
+  merge_parallel_tree_builder(base_p, parallel_builder_p, thread_count);
+}
+
+/**
+ * @brief Allocates the base node of a tree, and the arena the rest of the tree is allocated from.
+ * @param base_path_string [in] The base path as a string.
+ * @param depth [in] How far down relative the base directory to create children directory tree nodes.
+ * @return The base node, without children.
+ */
+static Base_Directory_Tree* create_base_node(char* base_path_string, int depth)
+{
+  if (!path_exists(base_path_string))
+  {
+    printf("Could not find path: %s\n", base_path_string);
+    exit(1);
+  }
+
+  /* The base lives in its own arena, so the arena is moved into the base once it is allocated. */
+  Arena arena;
+  arena_init(&arena);
+  Base_Directory_Tree* base_p = (Base_Directory_Tree*) arena_allocate(&arena, sizeof(Base_Directory_Tree));
+  base_p->arena = arena;
+  base_p->node_count = 1;
+  base_p->lazy_builder_p = NULL;
+  base_p->lazy_scope_p = NULL;
+
+  Directory_Tree* dir_tree = &base_p->node;
+  dir_tree->depth = depth;
+  dir_tree->omitted_count = 0;
+  dir_tree->is_directory = is_directory(base_path_string);
+  dir_tree->is_base = true;
+  dir_tree->is_reference = false;
+  size_t base_path_length = strlen(base_path_string);
+  dir_tree->file_name = arena_allocate_string(&base_p->arena, base_path_length + 1);
+  strcpy(dir_tree->file_name, base_path_string);
+  if (dir_tree->is_directory && last_char(dir_tree->file_name) != '/') {
+    strcat(dir_tree->file_name, "/");
+  }
+  dir_tree->file_name_length = (int) strlen(dir_tree->file_name);
+  dir_tree->parent = NULL;
+  dir_tree->children = NULL;
+  dir_tree->children_count = 0;
+  dir_tree->stamp_p = NULL;
+  dir_tree->usage_p = NULL;
+  dir_tree->hash_p = NULL;
+
+  return base_p;
+}
+
+/**
+ * @brief Creates the base node of a tree with its usage and the scope of its filter, before anything below it is read.
+ * @param base_path_string [in] The base path as a string.
+ * @param options_p [in] How the tree is read.
+ * @param scope_pp [out] The scope of the base, NULL if there is no filter.
+ * @return The base node, without children.
+ */
+static Base_Directory_Tree* start_directory_tree(char* base_path_string, 
+                                                 Directory_Tree_Options* options_p, 
+                                                 Ignore_Scope** scope_pp)
+{
+  Base_Directory_Tree* base_p = create_base_node(base_path_string, options_p->depth);
+  Directory_Tree* dir_tree = &base_p->node;
+
+  if (options_p->record_usage)
+  {
+    /* The base is followed if it is a link, like du does with its arguments. */
+    struct stat file_info = {0};
+    dir_tree->usage_p = (Directory_Usage*) arena_allocate(&base_p->arena, sizeof(Directory_Usage));
+    memset(dir_tree->usage_p, 0, sizeof(Directory_Usage));
+    uint64_t stat_start_ns = walk_stats_start();
+    int result = stat(dir_tree->file_name, &file_info);
+    walk_stats_stop(WALK_STAT_LOOKUP, stat_start_ns, 1);
+    if (result == 0)
+    {
+      set_usage_from_stat(dir_tree->usage_p, &file_info);
+    }
+  }
+
+  *scope_pp = NULL;
+  if (options_p->filter_p != NULL)
+  {
+    *scope_pp = (Ignore_Scope*) arena_allocate(&base_p->arena, sizeof(Ignore_Scope));
+    ignore_scope_init_base(*scope_pp, dir_tree->file_name_length);
+  }
+
+  return base_p;
+}
+
+/**
+ * @brief Checks if anything below the base of a tree is read.
+ * @param dir_tree [in] The base node.
+ * @param options_p [in] How the tree is read.
+ * @return True if the base is a directory whose children are read, for the depth or for its usage or hash.
+ */
+static bool should_read_base(Directory_Tree* dir_tree, Directory_Tree_Options* options_p)
+{
+  return dir_tree->is_directory && (options_p->depth > 0 || options_p->record_usage || options_p->record_hashes);
+}
+
+/**
+ * @brief Sums up the usage and hashes the contents of a tree once everything below its base is read.
+ * @param base_p [in/out] The base of the tree.
+ * @param options_p [in] How the tree is read.
+ */
+static void finish_directory_tree(Base_Directory_Tree* base_p, Directory_Tree_Options* options_p)
+{
+  Directory_Tree* dir_tree = &base_p->node;
+  if (options_p->record_usage && has_children_usage(dir_tree))
+  {
+    Inode_Set inode_set;
+    inode_set_init(&inode_set);
+    bool sort_by_size = options_p->sort_order == SORT_SIZE;
+    if (options_p->thread_count > 1)
+    {
+      sum_directory_usage_parallel(dir_tree, options_p->thread_count, &inode_set, sort_by_size);
+    }
+    else
+    {
+      Node_Sorter sorter;
+      node_sorter_init(&sorter, SORT_SIZE);
+      sum_directory_usage(dir_tree, &inode_set, sort_by_size ? &sorter : NULL);
+      node_sorter_free(&sorter);
+    }
+    inode_set_free(&inode_set);
+  }
+
+  if (options_p->record_hashes)
+  {
+    hash_directory_tree(base_p, options_p->thread_count, options_p->follow_links);
+  }
+}
+
+/**
+ * @brief Completes a tree of a set once its last directory is read, while the trees of the others are still read.
+ * @param base_p [in/out] The base of the tree.
+ * @param parallel_builder_p [in/out] The context the tree was read with, freed. NULL if nothing below the base is read.
+ * @param thread_count [in] The number of worker threads of the pool.
+ * @param options_p [in] How the tree is read.
+ */
+static void finish_tree_in_set(Base_Directory_Tree* base_p, 
+                               Parallel_Tree_Builder* parallel_builder_p, 
+                               int thread_count, 
+                               Directory_Tree_Options* options_p)
+{
+  if (parallel_builder_p != NULL)
+  {
+    merge_parallel_tree_builder(base_p, parallel_builder_p, thread_count);
+  }
+  finish_directory_tree(base_p, options_p);
+}
+
+/**
+ * @brief Checks if the usage of a node includes the usage of its children.
+ * @param dir_tree [in] The node.
+ * @return True if the node is a directory with children, false otherwise.
+ */
+static bool has_children_usage(Directory_Tree* dir_tree)
+{
+  return dir_tree->is_directory && dir_tree->children_count > 0;
+}
+
+/**
+ * @brief Sorts the children of a directory by their disk usage, largest first.
+ * @param dir_tree [in/out] The node of the directory, the usage of its children must be summed up.
+ * @param sorter_p [in/out] The sorter.
+ */
+static void sort_children_by_usage(Directory_Tree* dir_tree, Node_Sorter* sorter_p)
+{
+  uint64_t* values = node_sorter_values(sorter_p, dir_tree->children_count);
+  for (int i = 0; i < dir_tree->children_count; i++)
+  {
+    values[i] = size_sort_value(dir_tree->children[i]->usage_p->allocated_size);
+  }
+  node_sorter_sort(sorter_p, dir_tree->children, dir_tree->children_count, values);
+}
+
+/**
+ * @brief Adds the usage of the children of a directory to its usage. The usage of child directories must already
+ *        include their children.
+ * @param dir_tree [in/out] The node of the directory.
+ * @param inode_set_p [in/out] The hard linked files counted so far. Each is only counted the first time it is seen.
+ *                    NULL to count every hard linked file.
+ * @param sorter_p [in/out] The sorter the children are sorted by size with afterwards, or NULL to keep their order.
+ */
+static void add_children_usage(Directory_Tree* dir_tree, Inode_Set* inode_set_p, Node_Sorter* sorter_p)
+{
+  Directory_Usage* usage_p = dir_tree->usage_p;
+  for (int i = 0; i < dir_tree->children_count; i++)
+  {
+    Directory_Tree* child = dir_tree->children[i];
+    /* A reference is counted where its directory is listed. */
+    if (child->is_reference)
+    {
+      continue;
+    }
+
+    Directory_Usage* child_usage_p = child->usage_p;
+    if (child_usage_p->is_hard_link && 
+        inode_set_p != NULL && 
+        !inode_set_insert(inode_set_p, child_usage_p->device, child_usage_p->inode))
+    {
+      continue;
+    }
+    usage_p->apparent_size += child_usage_p->apparent_size;
+    usage_p->allocated_size += child_usage_p->allocated_size;
+    usage_p->file_count += child_usage_p->file_count;
+  }
+
+  if (sorter_p != NULL)
+  {
+    sort_children_by_usage(dir_tree, sorter_p);
+  }
+}
+
+/**
+ * @brief Sums up the usage of a directory and everything below it, bottom up. The directories are visited from a
+ *        stack on the heap in the same order as a recursion would, so hard links are counted at the same place.
+ * @param dir_tree [in/out] The node of the directory.
+ * @param inode_set_p [in/out] The hard linked files counted so far, or NULL to count every hard linked file.
+ * @param sorter_p [in/out] The sorter the children of every directory are sorted by size with, or NULL to keep their
+ *                 order.
+ */
+static void sum_directory_usage(Directory_Tree* dir_tree, Inode_Set* inode_set_p, Node_Sorter* sorter_p)
+{
+  Frame_Stack frames;
+  frame_stack_init(&frames, sizeof(Usage_Frame));
+  Usage_Frame* frame_p = (Usage_Frame*) frame_stack_push(&frames);
+  frame_p->dir_tree = dir_tree;
+  frame_p->child_index = 0;
+
+  while (frames.count > 0)
+  {
+    frame_p = (Usage_Frame*) frame_stack_top(&frames);
+    Directory_Tree* parent = frame_p->dir_tree;
+    while (frame_p->child_index < parent->children_count && 
+           !has_children_usage(parent->children[frame_p->child_index]))
+    {
+      frame_p->child_index++;
+    }
+
+    if (frame_p->child_index == parent->children_count)
+    {
+      add_children_usage(parent, inode_set_p, sorter_p);
+      frame_stack_pop(&frames);
+      continue;
+    }
+
+    Directory_Tree* child = parent->children[frame_p->child_index];
+    frame_p->child_index++;
+    frame_p = (Usage_Frame*) frame_stack_push(&frames);
+    frame_p->dir_tree = child;
+    frame_p->child_index = 0;
+  }
+
+  frame_stack_free(&frames);
+}
+
+/**
+ * @brief Task summing up the usage of one subtree.
+ * @param pool_p [in/out] The pool running the task, its context is the shared Usage_Summer.
+ * @param worker_index [in] The index of the worker running the task.
+ * @param dir_tree_p [in/out] The node of the directory at the top of the subtree.
+ */
+static void sum_directory_usage_task(Work_Pool* pool_p, int worker_index, void* dir_tree_p)
+{
+  Usage_Summer* summer_p = (Usage_Summer*) work_pool_context(pool_p);
+  Node_Sorter* sorter_p = summer_p->sort_by_size ? &summer_p->sorters[worker_index] : NULL;
+  sum_directory_usage((Directory_Tree*) dir_tree_p, summer_p->inode_set_p, sorter_p);
+}
+
+/**
+ * @brief Sums up the usage of a tree using several threads. The tree is split breadth first until there are enough
+ *        independent subtrees to keep the threads busy. The subtrees are summed in parallel, then the levels above
+ *        them are summed deepest first.
+ * @param dir_tree [in/out] The base of the tree.
+ * @param thread_count [in] The number of threads.
+ * @param inode_set_p [in/out] The hard linked files counted so far.
+ * @param sort_by_size [in] True if the children of every directory are sorted by size once they are summed.
+ */
+static void sum_directory_usage_parallel(Directory_Tree* dir_tree, 
+                                         int thread_count, 
+                                         Inode_Set* inode_set_p, 
+                                         bool sort_by_size)
+{
+  int capacity = INITIAL_PENDING_CHILDREN_CAPACITY;
+  int count = 0;
+  Directory_Tree** directories = (Directory_Tree**) allocate_or_exit(capacity * sizeof(Directory_Tree*));
+  directories[count++] = dir_tree;
+
+  int level_start = 0;
+  int level_end = count;
+  while (level_end - level_start < USAGE_SUBTREES_PER_THREAD * thread_count)
+  {
+    for (int i = level_start; i < level_end; i++)
+    {
+      for (int j = 0; j < directories[i]->children_count; j++)
+      {
+        Directory_Tree* child = directories[i]->children[j];
+        if (!has_children_usage(child))
+        {
+          continue;
+        }
+        if (count == capacity)
+        {
+          capacity *= 2;
+          directories = (Directory_Tree**) realloc(directories, capacity * sizeof(Directory_Tree*));
+          if (directories == NULL)
+          {
+            printf("Could not allocate memory for the directory tree.\n");
+            exit(1);
+          }
+        }
+        directories[count++] = child;
+      }
+    }
+
+    if (count == level_end)
+    {
+      break;
+    }
+    level_start = level_end;
+    level_end = count;
+  }
+
+  Usage_Summer* summer_p = (Usage_Summer*) allocate_or_exit(sizeof(Usage_Summer));
+  summer_p->inode_set_p = inode_set_p;
+  summer_p->sort_by_size = sort_by_size;
+  for (int i = 0; i < thread_count; i++)
+  {
+    node_sorter_init(&summer_p->sorters[i], SORT_SIZE);
+  }
+
+  Work_Pool* pool_p = work_pool_create(thread_count, summer_p);
+  for (int i = level_start; i < level_end; i++)
+  {
+    work_pool_push(pool_p, 0, sum_directory_usage_task, directories[i]);
+  }
+  work_pool_wait(pool_p);
+  work_pool_destroy(pool_p);
+
+  Node_Sorter* sorter_p = sort_by_size ? &summer_p->sorters[0] : NULL;
+  for (int i = level_start - 1; i >= 0; i--)
+  {
+    add_children_usage(directories[i], inode_set_p, sorter_p);
+  }
+
+  for (int i = 0; i < thread_count; i++)
+  {
+    node_sorter_free(&summer_p->sorters[i]);
+  }
+  free(summer_p);
+  free(directories);
+}
+
+/**
+ * @brief Hashes the files in a range of the children of a directory. The directory is opened by its path, since
+ *        tasks of different directories run in any order. Directories are left for fold_directory_hash.
+ * @param hasher_p [in/out] The state shared by the threads hashing the tree.
+ * @param worker_index [in] The index of the worker hashing the files.
+ * @param hash_task_p [in] The children to hash.
+ */
+static void hash_task_files(Tree_Hasher* hasher_p, int worker_index, Hash_Task* hash_task_p)
+{
+  String_Buffer* path_p = &hasher_p->paths[worker_index];
+  string_buffer_truncate(path_p, 0);
+  append_directory_tree_path(hash_task_p->dir_tree, path_p);
+
+  /* A directory that can no longer be opened leaves its files without a hash, like files that cannot be read. */
+  int directory_fd = open_directory_fd(AT_FDCWD, path_p->string);
+  for (int i = hash_task_p->first_child; i < hash_task_p->end_child; i++)
+  {
+    Directory_Tree* child = hash_task_p->dir_tree->children[i];
+    if (child->is_directory)
+    {
+      continue;
+    }
+
+    uint64_t start_ns = walk_stats_start();
+    if (directory_fd < 0 || 
+        !content_hash_file(directory_fd, 
+                           child->file_name, 
+                           hasher_p->follow_links, 
+                           hasher_p->buffers[worker_index], 
+                           CONTENT_HASH_BUFFER_SIZE, 
+                           child->hash_p))
+    {
+      child->hash_p = NULL;
+    }
+    walk_stats_stop(WALK_STAT_HASH, start_ns, 1);
+  }
+  if (directory_fd >= 0)
+  {
+    close(directory_fd);
+  }
+}
+
+/**
+ * @brief Task hashing the files in a range of the children of a directory.
+ * @param pool_p [in/out] The pool running the task, its context is the shared Tree_Hasher.
+ * @param worker_index [in] The index of the worker running the task.
+ * @param task_p [in] The Hash_Task of the children to hash.
+ */
+static void hash_files_task(Work_Pool* pool_p, int worker_index, void* task_p)
+{
+  hash_task_files((Tree_Hasher*) work_pool_context(pool_p), worker_index, (Hash_Task*) task_p);
+}
+
+/**
+ * @brief Hashes a directory from the names and hashes of its children, which must be hashed already. The hashes of
+ *        the children are summed, so the hash does not depend on the order they were read or sorted in.
+ * @param dir_tree [in/out] The node of the directory, with hash_p allocated.
+ */
+static void fold_directory_hash(Directory_Tree* dir_tree)
+{
+  uint64_t sums[2] = {0, (uint64_t) dir_tree->children_count};
+  for (int i = 0; i < dir_tree->children_count; i++)
+  {
+    Directory_Tree* child = dir_tree->children[i];
+    uint64_t seed = child->is_reference ? HASH_ENTRY_REFERENCE_SEED : 
+                    child->hash_p == NULL ? HASH_ENTRY_UNREADABLE_SEED : 
+                    child->is_directory ? HASH_ENTRY_DIRECTORY_SEED ^ *child->hash_p : 
+                    HASH_ENTRY_FILE_SEED ^ *child->hash_p;
+    sums[0] += content_hash(child->file_name, child->file_name_length, seed);
+  }
+  *dir_tree->hash_p = content_hash(sums, sizeof(sums), HASH_DIRECTORY_SEED);
+}
+
+/**
+ * @brief Hashes every node of a tree. The files are hashed first, on several threads if asked to, then the
+ *        directories are hashed deepest first from the hashes of their children. The name of the base is not part of
+ *        any hash, so the same tree has the same hash wherever it is.
+ * @param base_p [in/out] The base of the tree, read down to its files.
+ * @param thread_count [in] The number of threads hashing files. At most 1 hashes them on the calling thread.
+ * @param follow_links [in] True if links are hashed by what they point to.
+ */
+static void hash_directory_tree(Base_Directory_Tree* base_p, int thread_count, bool follow_links)
+{
+  Directory_Tree* dir_tree = &base_p->node;
+  dir_tree->hash_p = (uint64_t*) arena_allocate(&base_p->arena, sizeof(uint64_t));
+  if (!dir_tree->is_directory)
+  {
+    /* The base is followed if it is a link, like its children are with follow_links. */
+    char* buffer = (char*) allocate_or_exit(CONTENT_HASH_BUFFER_SIZE);
+    uint64_t start_ns = walk_stats_start();
+    if (!content_hash_file(AT_FDCWD, dir_tree->file_name, true, buffer, CONTENT_HASH_BUFFER_SIZE, dir_tree->hash_p))
+    {
+      dir_tree->hash_p = NULL;
+    }
+    walk_stats_stop(WALK_STAT_HASH, start_ns, 1);
+    free(buffer);
+    return;
+  }
+
+  /* The directories are listed breadth first, so walking the list backwards folds children before their parents. The
+     hashes are allocated here, since the arena is not shared by the threads. */
+  int directory_capacity = INITIAL_PENDING_CHILDREN_CAPACITY;
+  int directory_count = 0;
+  Directory_Tree** directories = (Directory_Tree**) allocate_or_exit(directory_capacity * sizeof(Directory_Tree*));
+  int task_capacity = INITIAL_PENDING_CHILDREN_CAPACITY;
+  int task_count = 0;
+  Hash_Task* tasks = (Hash_Task*) allocate_or_exit(task_capacity * sizeof(Hash_Task));
+  directories[directory_count++] = dir_tree;
+  for (int i = 0; i < directory_count; i++)
+  {
+    Directory_Tree* parent = directories[i];
+    bool has_files = false;
+    for (int j = 0; j < parent->children_count; j++)
+    {
+      Directory_Tree* child = parent->children[j];
+      if (child->is_reference)
+      {
+        continue;
+      }
+      child->hash_p = (uint64_t*) arena_allocate(&base_p->arena, sizeof(uint64_t));
+      if (!child->is_directory)
+      {
+        has_files = true;
+        continue;
+      }
+      if (directory_count == directory_capacity)
+      {
+        directory_capacity *= 2;
+        directories = (Directory_Tree**) realloc(directories, directory_capacity * sizeof(Directory_Tree*));
+        if (directories == NULL)
+        {
+          printf("Could not allocate memory for the directory tree.\n");
+          exit(1);
+        }
+      }
+      directories[directory_count++] = child;
+    }
+
+    for (int first_child = 0; has_files && first_child < parent->children_count; first_child += HASH_TASK_CHILD_COUNT)
+    {
+      if (task_count == task_capacity)
+      {
+        task_capacity *= 2;
+        tasks = (Hash_Task*) realloc(tasks, task_capacity * sizeof(Hash_Task));
+        if (tasks == NULL)
+        {
+          printf("Could not allocate memory for the directory tree.\n");
+          exit(1);
+        }
+      }
+      tasks[task_count].dir_tree = parent;
+      tasks[task_count].first_child = first_child;
+      tasks[task_count].end_child = first_child + HASH_TASK_CHILD_COUNT < parent->children_count ? 
+                                    first_child + HASH_TASK_CHILD_COUNT : 
+                                    parent->children_count;
+      task_count++;
+    }
+  }
+
+  int worker_count = thread_count > 1 ? thread_count : 1;
+  Tree_Hasher* hasher_p = (Tree_Hasher*) allocate_or_exit(sizeof(Tree_Hasher));
+  hasher_p->follow_links = follow_links;
+  for (int i = 0; i < worker_count; i++)
+  {
+    string_buffer_init(&hasher_p->paths[i]);
+    hasher_p->buffers[i] = (char*) allocate_or_exit(CONTENT_HASH_BUFFER_SIZE);
+  }
+
+  if (thread_count > 1)
+  {
+    Work_Pool* pool_p = work_pool_create(thread_count, hasher_p);
+    for (int i = 0; i < task_count; i++)
+    {
+      work_pool_push(pool_p, 0, hash_files_task, &tasks[i]);
+    }
+    work_pool_wait(pool_p);
+    work_pool_destroy(pool_p);
+  }
+  else
+  {
+    for (int i = 0; i < task_count; i++)
+    {
+      hash_task_files(hasher_p, 0, &tasks[i]);
+    }
+  }
+
+  for (int i = directory_count - 1; i >= 0; i--)
+  {
+    fold_directory_hash(directories[i]);
+  }
+
+  for (int i = 0; i < worker_count; i++)
+  {
+    string_buffer_free(&hasher_p->paths[i]);
+    free(hasher_p->buffers[i]);
+  }
+  free(hasher_p);
+  free(tasks);
+  free(directories);
+}
+
+/**
+ * @brief Formats the disk usage of a node, printed after its name.
+ * @param dir_tree [in] The node, with usage.
+ * @param suffix [out] The formatted usage, USAGE_SUFFIX_CAPACITY long.
+ * @return The length of the formatted usage.
+ */
+static int format_usage(Directory_Tree* dir_tree, char* suffix)
+{
+  char allocated_size[FORMATTED_SIZE_CAPACITY];
+  char apparent_size[FORMATTED_SIZE_CAPACITY];
+  Directory_Usage* usage_p = dir_tree->usage_p;
+  format_size(usage_p->allocated_size, allocated_size);
+  format_size(usage_p->apparent_size, apparent_size);
+
+  if (!dir_tree->is_directory)
+  {
+    return snprintf(suffix, USAGE_SUFFIX_CAPACITY, "  %s (%s apparent)", allocated_size, apparent_size);
+  }
+  return snprintf(suffix, USAGE_SUFFIX_CAPACITY, "  %s (%s apparent, %llu file%s)", 
+                  allocated_size, 
+                  apparent_size, 
+                  (unsigned long long) usage_p->file_count,
+                  usage_p->file_count == 1 ? "" : "s");
+}
+
+/**
+ * @brief Initializes the state used for printing a tree.
+ * @param printer_p [out] The state to initialize.
+ * @param format [in] How the tree is printed.
+ * @param writer_p [in] The writer the lines are written to.
+ */
+static void init_tree_printer(Tree_Printer* printer_p, Output_Format format, Output_Writer* writer_p)
+{
+  printer_p->writer_p = writer_p;
+  printer_p->prefixes = NULL;
+  printer_p->format = format;
+  printer_p->needs_separator = false;
+  string_buffer_init(&printer_p->escaped_name);
+  frame_stack_init(&printer_p->frames, sizeof(Print_Frame));
+  set_printer_max_level(printer_p, INITIAL_PRINTER_MAX_LEVEL);
+}
+
+/**
+ * @brief Recomputes the line prefixes of a printer for a deeper maximum level.
+ * @param printer_p [in/out] The printer.
+ * @param max_level [in] The deepest level to compute the prefix of.
+ */
+static void set_printer_max_level(Tree_Printer* printer_p, int max_level)
+{
+  size_t indentation_length = 2 * (size_t) max_level;
+  free(printer_p->prefixes);
+  printer_p->prefixes = (char*) allocate_or_exit(indentation_length + 3);
+  memset(printer_p->prefixes, ' ', indentation_length);
+  memcpy(printer_p->prefixes + indentation_length, "|- ", 3);
+  printer_p->max_level = max_level;
+}
+
+/**
+ * @brief Frees the memory used for printing a tree.
+ * @param printer_p [in/out] The state to free.
+ */
+static void free_tree_printer(Tree_Printer* printer_p)
+{
+  /* A JSON document ends with the closing brace of the base, which is followed by the newline of the last line. */
+  if (printer_p->format == OUTPUT_JSON)
+  {
+    output_writer_write(printer_p->writer_p, "\n", 1);
+  }
+  free(printer_p->prefixes);
+  printer_p->prefixes = NULL;
+  string_buffer_free(&printer_p->escaped_name);
+  frame_stack_free(&printer_p->frames);
+}
+
+/**
+ * @brief Prints the line of one file or directory.
+ * @param printer_p [in/out] The printer.
+ * @param name [in] The file name, or the path if it is the base.
+ * @param name_length [in] The length of name.
+ * @param suffix [in] Printed after the name, e.g. the size of the file. May be NULL if suffix_length is 0.
+ * @param suffix_length [in] The length of suffix.
+ * @param level [in] The level of the line, 0 for the base. Each level is indented with two spaces.
+ * @param is_base [in] True if it is the top of the tree.
+ */
+static void print_line(Tree_Printer* printer_p, 
+                       char* name, 
+                       size_t name_length, 
+                       char* suffix, 
+                       size_t suffix_length, 
+                       int level, 
+                       bool is_base)
+{
+  if (is_base)
+  {
+    struct iovec parts[3] = {{name, name_length}, {suffix, suffix_length}, {"\n", 1}};
+    output_writer_write_parts(printer_p->writer_p, parts, 3);
+    return;
+  }
+
+  if (level > printer_p->max_level)
+  {
+    set_printer_max_level(printer_p, 2 * level);
+  }
+
+  size_t prefix_length = 2 * (size_t) level + 3;
+  char* prefix = printer_p->prefixes + 2 * (size_t) printer_p->max_level + 3 - prefix_length;
+  struct iovec parts[4] = {{prefix, prefix_length}, {name, name_length}, {suffix, suffix_length}, {"\n", 1}};
+  output_writer_write_parts(printer_p->writer_p, parts, 4);
+}
+
+/**
+ * @brief Formats the fields of a JSON record that follow the name, up to where the children of a directory start.
+ * @param printer_p [in] The printer.
+ * @param level [in] The level of the file, 0 for the base.
+ * @param is_directory [in] True if the file is a directory.
+ * @param has_children [in] True if the directory was read, so its children follow.
+ * @param is_reference [in] True if the directory was already listed, reached again through a link.
+ * @param usage_p [in] The disk usage of the file, or NULL if it was not looked up.
+ * @param hash_p [in] The hash of the contents of the file, or NULL if it was not hashed.
+ * @param omitted_count [in] The number of children of the directory left out by a limit, -1 if it was not read
+ *                      because a budget ran out.
+ * @param fields [out] The formatted fields, RECORD_FIELDS_CAPACITY long.
+ * @return The length of the formatted fields.
+ */
+static int format_record_fields(Tree_Printer* printer_p, 
+                                int level, 
+                                bool is_directory, 
+                                bool has_children, 
+                                bool is_reference, 
+                                Directory_Usage* usage_p, 
+                                uint64_t* hash_p, 
+                                int omitted_count, 
+                                char* fields)
+{
+  int length = 0;
+  if (printer_p->format == OUTPUT_NDJSON)
+  {
+    length += snprintf(fields, RECORD_FIELDS_CAPACITY, "\",\"depth\":%d", level);
+  }
+  else
+  {
+    fields[length++] = '"';
+  }
+  length += snprintf(fields + length, 
+                     RECORD_FIELDS_CAPACITY - length, 
+                     ",\"type\":\"%s\"", 
+                     is_directory ? "directory" : "file");
+  if (is_reference)
+  {
+    memcpy(fields + length, ",\"reference\":true", 17);
+    length += 17;
+  }
+
+  if (usage_p != NULL)
+  {
+    length += snprintf(fields + length, 
+                       RECORD_FIELDS_CAPACITY - length, 
+                       ",\"size\":%llu,\"disk_usage\":%llu,\"mtime_ns\":%lld", 
+                       (unsigned long long) usage_p->apparent_size, 
+                       (unsigned long long) usage_p->allocated_size, 
+                       (long long) usage_p->modification_time_ns);
+    if (is_directory)
+    {
+      length += snprintf(fields + length, 
+                         RECORD_FIELDS_CAPACITY - length, 
+                         ",\"file_count\":%llu", 
+                         (unsigned long long) usage_p->file_count);
+    }
+  }
+  if (hash_p != NULL)
+  {
+    length += snprintf(fields + length, 
+                       RECORD_FIELDS_CAPACITY - length, 
+                       ",\"hash\":\"%016llx\"", 
+                       (unsigned long long) *hash_p);
+  }
+  if (omitted_count > 0)
+  {
+    length += snprintf(fields + length, RECORD_FIELDS_CAPACITY - length, ",\"omitted\":%d", omitted_count);
+  }
+  else if (omitted_count < 0)
+  {
+    memcpy(fields + length, ",\"omitted\":null", 15);
+    length += 15;
+  }
+
+  if (printer_p->format == OUTPUT_NDJSON)
+  {
+    memcpy(fields + length, "}\n", 2);
+    return length + 2;
+  }
+  if (has_children)
+  {
+    memcpy(fields + length, ",\"children\":[", 13);
+    return length + 13;
+  }
+  fields[length] = '}';
+  return length + 1;
+}
+
+/**
+ * @brief Prints the JSON record of one file or directory. For OUTPUT_JSON, the record of a directory with children is
+ *        left open, and closed by print_record_end once its children are printed.
+ * @param printer_p [in/out] The printer.
+ * @param path [in] The path of the file, ending with '/' for directories.
+ * @param path_length [in] The length of path.
+ * @param name_offset [in] The offset of the name in path, 0 for the base. OUTPUT_NDJSON prints the whole path.
+ * @param level [in] The level of the file, 0 for the base.
+ * @param is_directory [in] True if the file is a directory.
+ * @param has_children [in] True if the directory was read, so its children follow.
+ * @param is_reference [in] True if the directory was already listed, reached again through a link.
+ * @param usage_p [in] The disk usage of the file, or NULL if it was not looked up.
+ * @param hash_p [in] The hash of the contents of the file, or NULL if it was not hashed.
+ * @param omitted_count [in] The number of children of the directory left out by a limit, -1 if it was not read
+ *                      because a budget ran out.
+ */
+static void print_record(Tree_Printer* printer_p, 
+                         char* path, 
+                         size_t path_length, 
+                         size_t name_offset, 
+                         int level, 
+                         bool is_directory, 
+                         bool has_children, 
+                         bool is_reference, 
+                         Directory_Usage* usage_p, 
+                         uint64_t* hash_p, 
+                         int omitted_count)
+{
+  /* The trailing '/' of directories is left out, since the type tells them apart, except for the root. */
+  if (is_directory && path_length > 1 && path[path_length - 1] == '/')
+  {
+    path_length--;
+  }
+
+  char* name = path;
+  size_t name_length = path_length;
+  if (printer_p->format == OUTPUT_JSON)
+  {
+    name += name_offset;
+    name_length -= name_offset;
+  }
+
+  /* Most names need no escaping, so they are written straight from the path without being copied. */
+  if (json_needs_escaping(name, name_length))
+  {
+    string_buffer_truncate(&printer_p->escaped_name, 0);
+    string_buffer_append_json(&printer_p->escaped_name, name, name_length);
+    name = printer_p->escaped_name.string;
+    name_length = printer_p->escaped_name.length;
+  }
+
+  char* opening = "{\"path\":\"";
+  if (printer_p->format == OUTPUT_JSON)
+  {
+    opening = level == 0 ? "{\"name\":\"" : printer_p->needs_separator ? ",\n{\"name\":\"" : "\n{\"name\":\"";
+    printer_p->needs_separator = !has_children;
+  }
+
+  char fields[RECORD_FIELDS_CAPACITY];
+  int fields_length = format_record_fields(printer_p, 
+                                           level, 
+                                           is_directory, 
+                                           has_children, 
+                                           is_reference, 
+                                           usage_p, 
+                                           hash_p, 
+                                           omitted_count, 
+                                           fields);
+  struct iovec parts[3] = {{opening, strlen(opening)}, {name, name_length}, {fields, (size_t) fields_length}};
+  output_writer_write_parts(printer_p->writer_p, parts, 3);
+}
+
+/**
+ * @brief Closes the JSON record of a directory once its children are printed.
+ * @param printer_p [in/out] The printer.
+ * @param has_children [in] True if the record of the directory was left open for its children.
+ */
+static void print_record_end(Tree_Printer* printer_p, bool has_children)
+{
+  if (printer_p->format == OUTPUT_JSON && has_children)
+  {
+    output_writer_write(printer_p->writer_p, "]}", 2);
+    printer_p->needs_separator = true;
+  }
+}
+
+/**
+ * @brief Prints the line after the children of a directory that shows how many of them were left out.
+ * @param printer_p [in/out] The printer.
+ * @param omitted_count [in] The number of children left out, -1 if the directory was not read.
+ * @param level [in] The level of the children.
+ */
+static void print_omitted_line(Tree_Printer* printer_p, int omitted_count, int level)
+{
+  char suffix[OMITTED_SUFFIX_CAPACITY];
+  int suffix_length = omitted_count < 0 ? 
+                      snprintf(suffix, sizeof(suffix), " (not read)") : 
+                      snprintf(suffix, sizeof(suffix), " (%d more)", omitted_count);
+  print_line(printer_p, OMITTED_NAME, strlen(OMITTED_NAME), suffix, suffix_length, level, false);
+}
+
+/**
+ * @brief Prints one node in a Directory_Tree.
+ * @param printer_p [in/out] The printer.
+ * @param dir_tree [in] The Directory_Tree node to print.
+ * @param path_p [in/out] The path of the parent directory, ending with '/'. Only used for OUTPUT_NDJSON, where the
+ *               name of the node is appended for its children, and the caller restores the path once they are
+ *               printed.
+ * @param level [in] The level of this node, it is indented with two spaces per level.
+ * @return True if the children of the node are printed, and its record is ended after them.
+ */
+static bool print_node(Tree_Printer* printer_p, Directory_Tree* dir_tree, String_Buffer* path_p, int level)
+{
+  bool has_children = dir_tree->is_directory && dir_tree->depth > 0;
+  bool has_slash = dir_tree->is_directory && !dir_tree->is_base;
+  size_t path_length = path_p->length;
+  if (printer_p->format == OUTPUT_TEXT)
+  {
+    /* Names of directories are stored without their '/', it is printed in front of the usage. */
+    char suffix[USAGE_SUFFIX_CAPACITY + HASH_SUFFIX_CAPACITY + sizeof(REFERENCE_SUFFIX)];
+    int suffix_length = 0;
+    if (has_slash)
+    {
+      suffix[suffix_length++] = '/';
+    }
+    if (dir_tree->usage_p != NULL)
+    {
+      suffix_length += format_usage(dir_tree, suffix + suffix_length);
+    }
+    if (dir_tree->hash_p != NULL)
+    {
+      suffix_length += snprintf(suffix + suffix_length, 
+                                HASH_SUFFIX_CAPACITY, 
+                                "  %016llx", 
+                                (unsigned long long) *dir_tree->hash_p);
+    }
+    if (dir_tree->is_reference)
+    {
+      memcpy(suffix + suffix_length, REFERENCE_SUFFIX, strlen(REFERENCE_SUFFIX));
+      suffix_length += strlen(REFERENCE_SUFFIX);
+    }
+    print_line(printer_p, 
+               dir_tree->file_name, 
+               dir_tree->file_name_length, 
+               suffix, 
+               suffix_length, 
+               level, 
+               dir_tree->is_base);
+  }
+  else if (printer_p->format == OUTPUT_JSON)
+  {
+    print_record(printer_p, 
+                 dir_tree->file_name, 
+                 dir_tree->file_name_length, 
+                 0, 
+                 level, 
+                 dir_tree->is_directory, 
+                 has_children, 
+                 dir_tree->is_reference, 
+                 dir_tree->usage_p, 
+                 dir_tree->hash_p, 
+                 dir_tree->omitted_count);
+  }
+  else
+  {
+    string_buffer_append(path_p, dir_tree->file_name, dir_tree->file_name_length);
+    if (has_slash)
+    {
+      string_buffer_append(path_p, "/", 1);
+    }
+    print_record(printer_p, 
+                 path_p->string, 
+                 path_p->length, 
+                 path_length, 
+                 level, 
+                 dir_tree->is_directory, 
+                 has_children, 
+                 dir_tree->is_reference, 
+                 dir_tree->usage_p, 
+                 dir_tree->hash_p, 
+                 dir_tree->omitted_count);
+  }
+  return has_children;
+}
+
+/**
+ * @brief Prints a node and the nodes below it, depth first from a stack on the heap so deep trees do not recurse.
+ * @param printer_p [in/out] The printer.
+ * @param dir_tree [in] The Directory_Tree node to print, at level 0.
+ * @param path_p [in/out] The path of the parent directory, see print_node. It is restored before returning.
+ */
+static void print_nodes(Tree_Printer* printer_p, Directory_Tree* dir_tree, String_Buffer* path_p)
+{
+  Frame_Stack* frames_p = &printer_p->frames;
+  size_t path_length = path_p->length;
+  if (!print_node(printer_p, dir_tree, path_p, 0))
+  {
+    print_record_end(printer_p, false);
+    string_buffer_truncate(path_p, path_length);
+    return;
+  }
+
+  Print_Frame* frame_p = (Print_Frame*) frame_stack_push(frames_p);
+  frame_p->dir_tree = dir_tree;
+  frame_p->child_index = 0;
+  frame_p->path_length = path_length;
+  while (frames_p->count > 0)
+  {
+    frame_p = (Print_Frame*) frame_stack_top(frames_p);
+    if (frame_p->child_index == frame_p->dir_tree->children_count)
+    {
+      if (frame_p->dir_tree->omitted_count != 0 && printer_p->format == OUTPUT_TEXT)
+      {
+        print_omitted_line(printer_p, frame_p->dir_tree->omitted_count, frames_p->count);
+      }
+      print_record_end(printer_p, true);
+      string_buffer_truncate(path_p, frame_p->path_length);
+      frame_stack_pop(frames_p);
+      continue;
+    }
+
+    Directory_Tree* child = frame_p->dir_tree->children[frame_p->child_index];
+    frame_p->child_index++;
+    path_length = path_p->length;
+    if (print_node(printer_p, child, path_p, frames_p->count))
+    {
+      frame_p = (Print_Frame*) frame_stack_push(frames_p);
+      frame_p->dir_tree = child;
+      frame_p->child_index = 0;
+      frame_p->path_length = path_length;
+    }
+    else
+    {
+      print_record_end(printer_p, false);
+      string_buffer_truncate(path_p, path_length);
+    }
+  }
+}
+
+/**
+ * @brief Prints one node of a snapshot, straight from the snapshot.
+ * @param printer_p [in/out] The printer.
+ * @param snapshot_p [in] The snapshot.
+ * @param path_p [in/out] The path of the parent directory, ending with '/', or the path of the node for level 0. The
+ *               name of the node is appended for its children, and the caller restores the path once they are
+ *               printed.
+ * @param node_index [in] The index of the node.
+ * @param depth [in] How far down from the node to print.
+ * @param level [in] The level of the node, 0 for the top of the printed tree.
+ * @return True if the children of the node are printed, and its record is ended after them.
+ */
+static bool print_snapshot_node(Tree_Printer* printer_p, 
+                                Snapshot* snapshot_p, 
+                                String_Buffer* path_p, 
+                                uint32_t node_index, 
+                                int depth, 
+                                int level)
+{
+  Snapshot_Node* node_p = &snapshot_p->nodes[node_index];
+  bool node_is_directory = (node_p->flags & SNAPSHOT_DIRECTORY) != 0;
+  size_t path_length = level == 0 ? 0 : path_p->length;
+  if (level > 0)
+  {
+    string_buffer_append(path_p, snapshot_node_name(snapshot_p, node_p), node_p->name_length);
+    if (node_is_directory)
+    {
+      string_buffer_append(path_p, "/", 1);
+    }
+  }
+
+  bool has_children = node_is_directory && node_p->depth > 0 && depth > 0;
+  bool is_reference = (node_p->flags & SNAPSHOT_REFERENCE) != 0;
+  if (printer_p->format == OUTPUT_TEXT)
+  {
+    print_line(printer_p, 
+               path_p->string + path_length, 
+               path_p->length - path_length, 
+               is_reference ? REFERENCE_SUFFIX : NULL, 
+               is_reference ? strlen(REFERENCE_SUFFIX) : 0, 
+               level, 
+               level == 0);
+  }
+  else
+  {
+    print_record(printer_p, 
+                 path_p->string, 
+                 path_p->length, 
+                 path_length, 
+                 level, 
+                 node_is_directory, 
+                 has_children, 
+                 is_reference, 
+                 NULL, 
+                 NULL, 
+                 0);
+  }
+  return has_children;
+}
+
+/**
+ * @brief Prints one node of a snapshot and the nodes below it, depth first from a stack on the heap so deep trees do
+ *        not recurse.
+ * @param printer_p [in/out] The printer.
+ * @param snapshot_p [in] The snapshot.
+ * @param path_p [in/out] The path of the node, see print_snapshot_node.
+ * @param node_index [in] The index of the node, printed at level 0.
+ * @param depth [in] How far down from the node to print.
+ */
+static void print_snapshot_nodes(Tree_Printer* printer_p, 
+                                 Snapshot* snapshot_p, 
+                                 String_Buffer* path_p, 
+                                 uint32_t node_index, 
+                                 int depth)
+{
+  Frame_Stack* frames_p = &printer_p->frames;
+  if (!print_snapshot_node(printer_p, snapshot_p, path_p, node_index, depth, 0))
+  {
+    print_record_end(printer_p, false);
+    return;
+  }
+
+  Print_Frame* frame_p = (Print_Frame*) frame_stack_push(frames_p);
+  frame_p->node_index = node_index;
+  frame_p->depth = depth;
+  frame_p->child_index = 0;
+  frame_p->path_length = path_p->length;
+  while (frames_p->count > 0)
+  {
+    frame_p = (Print_Frame*) frame_stack_top(frames_p);
+    if (frame_p->child_index == 0 && !snapshot_children_are_valid(snapshot_p, frame_p->node_index))
+    {
+      printf("The snapshot is corrupt.\n");
+      exit(1);
+    }
+
+    Snapshot_Node* node_p = &snapshot_p->nodes[frame_p->node_index];
+    if (node_p->first_child == SNAPSHOT_NO_INDEX || (uint32_t) frame_p->child_index == node_p->children_count)
+    {
+      print_record_end(printer_p, true);
+      string_buffer_truncate(path_p, frame_p->path_length);
+      frame_stack_pop(frames_p);
+      continue;
+    }
+
+    uint32_t child_index = node_p->first_child + (uint32_t) frame_p->child_index;
+    int child_depth = frame_p->depth - 1;
+    size_t path_length = path_p->length;
+    frame_p->child_index++;
+    if (print_snapshot_node(printer_p, snapshot_p, path_p, child_index, child_depth, frames_p->count))
+    {
+      frame_p = (Print_Frame*) frame_stack_push(frames_p);
+      frame_p->node_index = child_index;
+      frame_p->depth = child_depth;
+      frame_p->child_index = 0;
+      frame_p->path_length = path_length;
+    }
+    else
+    {
+      print_record_end(printer_p, false);
+      string_buffer_truncate(path_p, path_length);
+    }
+  }
+}
+
+/**
+ * @brief Prints an entry of a walked tree when it is entered. The callback of the visitor used for streaming a tree.
+ * @param entry_p [in] The entry.
+ * @param printer_p [in/out] The Tree_Printer the entry is printed with.
+ * @return VISIT_CONTINUE, every entry is printed.
+ */
+static Visit_Result print_visited_entry(Visited_Entry* entry_p, void* printer_p)
+{
+  if (((Tree_Printer*) printer_p)->format == OUTPUT_TEXT)
+  {
+    bool is_base = entry_p->level == 0;
+    print_line((Tree_Printer*) printer_p, 
+               entry_p->path + entry_p->name_offset, 
+               entry_p->path_length - entry_p->name_offset, 
+               entry_p->is_reference ? REFERENCE_SUFFIX : NULL, 
+               entry_p->is_reference ? strlen(REFERENCE_SUFFIX) : 0, 
+               entry_p->level, 
+               is_base);
+  }
+  else
+  {
+    print_record((Tree_Printer*) printer_p, 
+                 entry_p->path, 
+                 entry_p->path_length, 
+                 entry_p->name_offset, 
+                 entry_p->level, 
+                 entry_p->is_directory, 
+                 entry_p->has_children, 
+                 entry_p->is_reference, 
+                 NULL, 
+                 NULL, 
+                 0);
+  }
+  return VISIT_CONTINUE;
+}
+
+/**
+ * @brief Ends the record of an entry of a walked tree once its children were printed.
+ * @param entry_p [in] The entry.
+ * @param printer_p [in/out] The Tree_Printer the entry is printed with.
+ * @return VISIT_CONTINUE, every entry is printed.
+ */
+static Visit_Result print_visited_entry_end(Visited_Entry* entry_p, void* printer_p)
+{
+  print_record_end((Tree_Printer*) printer_p, entry_p->has_children);
+  return VISIT_CONTINUE;
+}
+
+/**
+ * @brief Prints the directories above a matching entry that were not printed yet, from the shallowest down.
+ * @param finder_p [in/out] The state of the tree being searched.
+ * @param path [in] The path of the matching entry, which starts with the paths of the directories above it.
+ */
+static void print_found_ancestors(Tree_Finder* finder_p, char* path)
+{
+  for (int i = finder_p->printed_count; i < finder_p->ancestors.count; i++)
+  {
+    Find_Frame* frame_p = (Find_Frame*) frame_stack_at(&finder_p->ancestors, i);
+    Visited_Entry ancestor;
+    ancestor.path = path;
+    ancestor.path_length = frame_p->path_length;
+    ancestor.name_offset = frame_p->name_offset;
+    ancestor.level = frame_p->level;
+    ancestor.is_directory = true;
+    ancestor.has_children = true;
+    ancestor.is_reference = false;
+    print_visited_entry(&ancestor, &finder_p->printer);
+  }
+  finder_p->printed_count = finder_p->ancestors.count;
+}
+
+/**
+ * @brief Matches the name of an entry of a walked tree when it is entered, and prints it with the directories above
+ *        it if it matches. The callback of the visitor used for --find. The base is always printed.
+ * @param entry_p [in] The entry.
+ * @param finder_p [in/out] The Tree_Finder of the tree being searched.
+ * @return VISIT_CONTINUE, the children of a directory can match whether or not it does.
+ */
+static Visit_Result find_visited_entry(Visited_Entry* entry_p, void* finder_p)
+{
+  Tree_Finder* tree_finder_p = (Tree_Finder*) finder_p;
+  size_t name_length = entry_p->path_length - entry_p->name_offset;
+  if (entry_p->is_directory && name_length > 0 && entry_p->path[entry_p->path_length - 1] == '/')
+  {
+    name_length--;
+  }
+
+  bool is_match = entry_p->level == 0 || 
+                  name_matcher_matches(tree_finder_p->matcher_p, entry_p->path + entry_p->name_offset, name_length);
+  if (is_match)
+  {
+    print_found_ancestors(tree_finder_p, entry_p->path);
+    print_visited_entry(entry_p, &tree_finder_p->printer);
+  }
+
+  if (entry_p->has_children)
+  {
+    Find_Frame* frame_p = (Find_Frame*) frame_stack_push(&tree_finder_p->ancestors);
+    frame_p->path_length = entry_p->path_length;
+    frame_p->name_offset = entry_p->name_offset;
+    frame_p->level = entry_p->level;
+    if (is_match)
+    {
+      tree_finder_p->printed_count = tree_finder_p->ancestors.count;
+    }
+  }
+  else
+  {
+    tree_finder_p->is_leaf_printed = is_match;
+  }
+  return VISIT_CONTINUE;
+}
+
+/**
+ * @brief Ends the record of an entry of a walked tree once its children were searched, if it was printed.
+ * @param entry_p [in] The entry.
+ * @param finder_p [in/out] The Tree_Finder of the tree being searched.
+ * @return VISIT_CONTINUE, the whole tree is searched.
+ */
+static Visit_Result find_visited_entry_end(Visited_Entry* entry_p, void* finder_p)
+{
+  Tree_Finder* tree_finder_p = (Tree_Finder*) finder_p;
+  bool is_printed = tree_finder_p->is_leaf_printed;
+  if (entry_p->has_children)
+  {
+    is_printed = tree_finder_p->printed_count == tree_finder_p->ancestors.count;
+    if (is_printed)
+    {
+      tree_finder_p->printed_count--;
+    }
+    frame_stack_pop(&tree_finder_p->ancestors);
+  }
+  tree_finder_p->is_leaf_printed = false;
+
+  if (is_printed)
+  {
+    print_visited_entry_end(entry_p, &tree_finder_p->printer);
+  }
+  return VISIT_CONTINUE;
+}
+
+/**
+ * @brief Gets a read buffer for a directory being opened, reusing one given back by a closed directory if there is.
+ * @param walker_p [in/out] The state of the tree being walked.
+ * @return The read buffer, DIRECTORY_READER_BUFFER_SIZE long. Given back to read_buffers once the directory is closed.
+ */
+static char* get_walk_read_buffer(Tree_Walker* walker_p)
+{
+  if (walker_p->read_buffer_count > 0)
+  {
+    walker_p->read_buffer_count--;
+    return walker_p->read_buffers[walker_p->read_buffer_count];
+  }
+  return (char*) allocate_or_exit(DIRECTORY_READER_BUFFER_SIZE);
+}
+
+/**
+ * @brief Passes an entry to the enter callback of the visitor.
+ * @param walker_p [in/out] The state of the tree being walked. The path of the entry is its path.
+ * @param entry_p [in/out] The entry. has_children is cleared if the visitor skips the children.
+ * @return The result of the callback.
+ */
+static Visit_Result enter_walk_entry(Tree_Walker* walker_p, Visited_Entry* entry_p)
+{
+  Directory_Visitor* visitor_p = walker_p->visitor_p;
+  Visit_Result result = VISIT_CONTINUE;
+  if (visitor_p->enter != NULL)
+  {
+    result = visitor_p->enter(entry_p, visitor_p->context_p);
+  }
+  if (result == VISIT_SKIP_CHILDREN)
+  {
+    entry_p->has_children = false;
+  }
+  return result;
+}
+
+/**
+ * @brief Passes an entry to the leave callback of the visitor once its children are done, and removes its name from
+ *        the path.
+ * @param walker_p [in/out] The state of the tree being walked. The path of the entry is its path.
+ * @param entry_p [in/out] The entry.
+ * @return False if the visitor stopped the walk.
+ */
+static bool leave_walk_entry(Tree_Walker* walker_p, Visited_Entry* entry_p)
+{
+  /* The path buffer may have grown while the children were walked. */
+  Directory_Visitor* visitor_p = walker_p->visitor_p;
+  entry_p->path = walker_p->path.string;
+  bool is_walking = visitor_p->leave == NULL || visitor_p->leave(entry_p, visitor_p->context_p) != VISIT_STOP;
+  string_buffer_truncate(&walker_p->path, entry_p->name_offset);
+  return is_walking;
+}
+
+/**
+ * @brief Pushes an entered directory onto the stack of the walker, so its children are walked next. If too many
+ *        directories are open, the shallowest open one is closed.
+ * @param walker_p [in/out] The state of the tree being walked. The path of the entry is its path.
+ * @param entry_p [in] The entry of the directory.
+ * @param directory_fd [in] The opened directory, it is closed when it has been read.
+ * @param scope_p [in] The scope of the parent directory, NULL if there is no filter.
+ * @param depth [in] The depth of the tree from the directory.
+ */
+static void push_walk_frame(Tree_Walker* walker_p, 
+                            Visited_Entry* entry_p, 
+                            int directory_fd, 
+                            Ignore_Scope* scope_p, 
+                            int depth)
+{
+  /* Entries are visited as they are read, so the .gitignore file has to be looked for before reading. */
+  if (walker_p->filter_p != NULL && walker_p->filter_p->use_gitignore)
+  {
+    scope_p = ignore_scope_load(&walker_p->scope_arena, scope_p, directory_fd, walker_p->path.length);
+  }
+
+  Walk_Frame* frame_p = (Walk_Frame*) frame_stack_push(&walker_p->frames);
+  frame_p->entry = *entry_p;
+  frame_p->scope_p = scope_p;
+  frame_p->depth = depth;
+  directory_reader_init(&frame_p->reader, directory_fd, get_walk_read_buffer(walker_p), DIRECTORY_READER_BUFFER_SIZE);
+
+  if (walker_p->frames.count - walker_p->first_open_frame > MAX_OPEN_DIRECTORY_FRAMES)
+  {
+    close_walk_frame(walker_p, (Walk_Frame*) frame_stack_at(&walker_p->frames, walker_p->first_open_frame));
+    walker_p->first_open_frame++;
+  }
+}
+
+/**
+ * @brief Closes the directory of a frame deep below the top of the stack, and gives back its read buffer. The
+ *        position after the last read entry is kept, so reading continues there when the frame is back on top.
+ * @param walker_p [in/out] The state of the tree being walked.
+ * @param frame_p [in/out] The frame of the open directory.
+ */
+static void close_walk_frame(Tree_Walker* walker_p, Walk_Frame* frame_p)
+{
+  get_directory_identity(frame_p->reader.fd, &frame_p->device, &frame_p->inode);
+  close(frame_p->reader.fd);
+  frame_p->reader.fd = -1;
+  walker_p->read_buffers[walker_p->read_buffer_count] = frame_p->reader.buffer;
+  walker_p->read_buffer_count++;
+  frame_p->reader.buffer = NULL;
+}
+
+/**
+ * @brief Opens the directory of a closed frame again once its last entered child directory is done, and continues
+ *        reading it after the last read entry.
+ * @param walker_p [in/out] The state of the tree being walked. Its path is the path of the directory.
+ * @param frame_p [in/out] The frame of the closed directory.
+ * @param child_fd [in] The open child directory that was walked last.
+ */
+static void reopen_walk_frame(Tree_Walker* walker_p, Walk_Frame* frame_p, int child_fd)
+{
+  /* Going up through ".." does not resolve the path again. A child reached through a link has another parent, then
+     the path is opened. */
+  char* path_string = walker_p->path.string;
+  int directory_fd = open_parent_directory(child_fd, frame_p->device, frame_p->inode);
+  if (directory_fd < 0)
+  {
+    directory_fd = open_directory_at(AT_FDCWD, path_string, path_string);
+  }
+
+  if (!directory_reader_reopen(&frame_p->reader, directory_fd, get_walk_read_buffer(walker_p)))
+  {
+    printf("Could not read the directory: %s\n", path_string);
+    exit(1);
+  }
+}
+
+/**
+ * @brief Records a directory about to be walked while links are followed, so every directory is only walked once.
+ * @param walker_p [in/out] The state of the tree being walked.
+ * @param directory_fd [in] The opened directory.
+ * @return True if the directory should be walked, false if it was already walked and is a reference.
+ */
+static bool visit_walk_directory(Tree_Walker* walker_p, int directory_fd)
+{
+  if (walker_p->visited_p == NULL)
+  {
+    return true;
+  }
+
+  struct stat file_info = {0};
+  uint64_t start_ns = walk_stats_start();
+  int result = fstat(directory_fd, &file_info);
+  walk_stats_stop(WALK_STAT_LOOKUP, start_ns, 1);
+  return result != 0 || inode_set_insert(walker_p->visited_p, file_info.st_dev, file_info.st_ino);
+}
 
-/*> Global Constant Definitions **************************************************************************************/
+/**
+ * @brief Walks an entry and the files and directories below it as they are read, without creating Directory_Tree
+ *        nodes. The directories are walked depth first from a stack on the heap, so deep trees neither recurse on the
+ *        C stack nor keep a directory open per level: only the MAX_OPEN_DIRECTORY_FRAMES deepest directories of the
+ *        stack are open, the ones above are closed and reopened when their children are done.
+ * @param walker_p [in/out] The state of the tree being walked. The path of the base is its path, the paths of the
+ *                 entries below are appended while they are visited.
+ * @param base_p [in/out] The entry of the base.
+ * @param scope_p [in] The scope of the base, NULL if there is no filter.
+ * @param depth [in] The depth of the tree from the base.
+ * @return False if the visitor stopped the walk.
+ */
+static bool walk_entries(Tree_Walker* walker_p, Visited_Entry* base_p, Ignore_Scope* scope_p, int depth)
+{
+  if (enter_walk_entry(walker_p, base_p) == VISIT_STOP)
+  {
+    return false;
+  }
+  if (!base_p->has_children)
+  {
+    return leave_walk_entry(walker_p, base_p);
+  }
 
-/*> Global Variable Definitions **************************************************************************************/
+  Frame_Stack* frames_p = &walker_p->frames;
+  String_Buffer* path_p = &walker_p->path;
+  int base_fd = open_directory_at(AT_FDCWD, path_p->string, path_p->string);
+  visit_walk_directory(walker_p, base_fd);
+  push_walk_frame(walker_p, base_p, base_fd, scope_p, depth);
 
-/*> Local Constant Definitions ***************************************************************************************/
+  /* The leave callback is called even if the walk was stopped below, so every enter has its leave. */
+  bool is_walking = true;
+  while (frames_p->count > 0)
+  {
+    Walk_Frame* frame_p = (Walk_Frame*) frame_stack_top(frames_p);
+    Directory_Entry entry;
+    if (!is_walking || !directory_reader_next(&frame_p->reader, &entry))
+    {
+      if (frame_p->reader.error != 0)
+      {
+        printf("Could not read the directory: %s\n", path_p->string);
+        exit(1);
+      }
 
-/*> Local Variable Definitions ***************************************************************************************/
+      frame_stack_pop(frames_p);
+      if (is_walking && frames_p->count > 0 && frames_p->count - 1 < walker_p->first_open_frame)
+      {
+        walker_p->first_open_frame = frames_p->count - 1;
+        string_buffer_truncate(path_p, frame_p->entry.name_offset);
+        reopen_walk_frame(walker_p, (Walk_Frame*) frame_stack_top(frames_p), frame_p->reader.fd);
+      }
+      if (frame_p->reader.fd >= 0)
+      {
+        close(frame_p->reader.fd);
+        walker_p->read_buffers[walker_p->read_buffer_count] = frame_p->reader.buffer;
+        walker_p->read_buffer_count++;
+      }
 
-/*> Local Function Declarations **************************************************************************************/
-static bool is_directory(char* path_string);
+      string_buffer_truncate(path_p, frame_p->entry.path_length);
+      if (!leave_walk_entry(walker_p, &frame_p->entry))
+      {
+        is_walking = false;
+      }
+      continue;
+    }
 
-static bool is_symbolic_link(char* path_string);
+    size_t path_length = path_p->length;
+    string_buffer_append(path_p, entry.name, strlen(entry.name));
+    walk_stats_count_entry(frame_p->entry.level + 1);
 
-static bool path_exists(char* path_string);
+    bool child_is_directory = is_directory_entry(frame_p->reader.fd, &entry, walker_p->follow_links);
+    if (child_is_directory)
+    {
+      string_buffer_append(path_p, "/", 1);
+    }
 
-static void add_directory_tree_child(char* file_name, Directory_Tree* parent);
+    if (walker_p->filter_p != NULL && 
+        path_filter_excludes(walker_p->filter_p, 
+                             frame_p->scope_p, 
+                             path_p->string, 
+                             path_length, 
+                             path_p->length, 
+                             child_is_directory))
+    {
+      string_buffer_truncate(path_p, path_length);
+      continue;
+    }
 
-static void print_node(Directory_Tree* dir_tree, int indentation);
+    Visited_Entry child;
+    child.path = path_p->string;
+    child.path_length = path_p->length;
+    child.name_offset = path_length;
+    child.level = frame_p->entry.level + 1;
+    child.is_directory = child_is_directory;
+    child.has_children = child_is_directory && frame_p->depth > 1;
+    child.is_reference = false;
 
-/*> Local Function Definitions ***************************************************************************************/
-/**
- * @brief Checks if path is to a directory.
- * @param path_string [in] Path to check.¨
- * @return True if path goes to a directory, false otherwise.
- */
-static bool is_directory(char* path_string)
-{
-  struct stat file_info = {0};
-  stat(path_string, &file_info);
-  return S_ISDIR(file_info.st_mode);
+    /* With links followed, a directory is opened before it is entered, so one that was already walked is entered as
+       a reference without children. */
+    int child_fd = -1;
+    if (child.has_children && walker_p->visited_p != NULL)
+    {
+      child_fd = open_directory_at(frame_p->reader.fd, entry.name, path_p->string);
+      if (!visit_walk_directory(walker_p, child_fd))
+      {
+        close(child_fd);
+        child_fd = -1;
+        child.is_reference = true;
+        child.has_children = false;
+      }
+    }
+
+    Visit_Result result = enter_walk_entry(walker_p, &child);
+    if (result == VISIT_STOP)
+    {
+      is_walking = false;
+      string_buffer_truncate(path_p, path_length);
+    }
+    else if (child.has_children)
+    {
+      if (child_fd < 0)
+      {
+        child_fd = open_directory_at(frame_p->reader.fd, entry.name, path_p->string);
+      }
+      push_walk_frame(walker_p, &child, child_fd, frame_p->scope_p, frame_p->depth - 1);
+      child_fd = -1;
+    }
+    else
+    {
+      is_walking = leave_walk_entry(walker_p, &child);
+    }
+    if (child_fd >= 0)
+    {
+      close(child_fd);
+    }
+  }
+  return is_walking;
 }
 
 /**
- * @brief Checks if path is a symbolic link.
- * @param path_string [in] Path to check.¨
- * @return True if path goes to a symbolic link, false otherwise.
+ * @brief Copies the stamp, usage and hash of a copied node into the arena of the copy.
+ * @param arena_p [in/out] The arena of the copy.
+ * @param dir_tree [in/out] The copied node, its records still point into the tree it was copied from.
  */
-static bool is_symbolic_link(char* path_string)
+static void copy_node_records(Arena* arena_p, Directory_Tree* dir_tree)
 {
-  struct stat file_info = {0};
-  stat(path_string, &file_info);
-  return S_ISLNK(file_info.st_mode);
+  if (dir_tree->stamp_p != NULL)
+  {
+    Directory_Stamp* stamp_p = (Directory_Stamp*) arena_allocate(arena_p, sizeof(Directory_Stamp));
+    *stamp_p = *dir_tree->stamp_p;
+    dir_tree->stamp_p = stamp_p;
+  }
+  if (dir_tree->usage_p != NULL)
+  {
+    Directory_Usage* usage_p = (Directory_Usage*) arena_allocate(arena_p, sizeof(Directory_Usage));
+    *usage_p = *dir_tree->usage_p;
+    dir_tree->usage_p = usage_p;
+  }
+  if (dir_tree->hash_p != NULL)
+  {
+    uint64_t* hash_p = (uint64_t*) arena_allocate(arena_p, sizeof(uint64_t));
+    *hash_p = *dir_tree->hash_p;
+    dir_tree->hash_p = hash_p;
+  }
 }
 
+/*> Global Function Definitions **************************************************************************************/
 /**
- * @brief Checks if the path leads to a real file or directory.
- * @param path_string [in] Path to check.
- * @return True if the path exists, false otherwise.
+ * @brief Creates the directory tree based on the base path provided.
+ * @param base_path_string [in] The base path as a string.
+ * @param options_p [in] How the tree is read, e.g. how far down relative the base directory to create children
+ *                  directory tree nodes.
+ * @return The pointer to the directory tree struct allocated.
  */
-static bool path_exists(char* path_string)
+Directory_Tree* create_directory_tree(char* base_path_string, Directory_Tree_Options* options_p)
 {
-  return access(path_string, F_OK) == 0;
+  uint64_t start_ns = walk_stats_start();
+  Ignore_Scope* scope_p = NULL;
+  Base_Directory_Tree* base_p = start_directory_tree(base_path_string, options_p, &scope_p);
+  Directory_Tree* dir_tree = &base_p->node;
+
+  /* Links are followed in the order the directories are read, so with links the tree is read on this thread, and
+     which path of a directory reached twice is the reference does not change between runs. */
+  Inode_Set visited;
+  Inode_Set* visited_p = NULL;
+  if (options_p->follow_links)
+  {
+    inode_set_init(&visited);
+    visited_p = &visited;
+  }
+  bool has_budget = options_p->max_entries > 0 || options_p->per_directory_limit > 0 || options_p->time_budget_ms > 0;
+  if (should_read_base(dir_tree, options_p))
+  {
+    if (has_budget)
+    {
+      /* A tree cut short by a budget has no trustworthy stamps, so budgets take precedence over them. */
+      Tree_Builder builder;
+      init_tree_builder(&builder, &base_p->arena, options_p);
+      builder.scope_p = scope_p;
+      builder.visited_p = visited_p;
+      add_directory_tree_children_budgeted(&builder, dir_tree, options_p);
+      base_p->node_count += builder.node_count;
+      free_tree_builder(&builder);
+    }
+    else if (options_p->record_stamps)
+    {
+      Tree_Builder builder;
+      init_tree_builder(&builder, &base_p->arena, options_p);
+      builder.scope_p = scope_p;
+      builder.visited_p = visited_p;
+      struct timespec start_time;
+      clock_gettime(CLOCK_REALTIME, &start_time);
+      builder.start_time_ns = get_time_ns(&start_time);
+
+      /* A snapshot of another base path has nothing in common with this tree, a snapshot has no sizes, the
+         children of unchanged directories would not be filtered, and the links below them would not be followed. */
+      uint32_t cached_index = SNAPSHOT_NO_INDEX;
+      Snapshot* snapshot_p = options_p->cached_snapshot_p;
+      if (snapshot_p != NULL && 
+          !options_p->record_usage && 
+          !options_p->record_hashes && 
+          options_p->filter_p == NULL && 
+          !options_p->follow_links && 
+          strings_are_equal(snapshot_node_name(snapshot_p, &snapshot_p->nodes[0]), 
+                                                  dir_tree->file_name))
+      {
+        builder.snapshot_p = snapshot_p;
+        cached_index = 0;
+      }
+
+      add_directory_tree_children_cached(&builder, dir_tree, cached_index);
+      base_p->node_count += builder.node_count;
+      free_tree_builder(&builder);
+    }
+    else if (options_p->thread_count > 1 && !options_p->follow_links)
+    {
+      add_directory_tree_children_parallel(base_p, options_p, scope_p);
+    }
+    else
+    {
+      int directory_fd = open_directory_at(AT_FDCWD, dir_tree->file_name, dir_tree->file_name);
+
+      Tree_Builder builder;
+      init_tree_builder(&builder, &base_p->arena, options_p);
+      builder.scope_p = scope_p;
+      builder.visited_p = visited_p;
+      add_directory_tree_children(&builder, dir_tree, directory_fd);
+      base_p->node_count += builder.node_count;
+      free_tree_builder(&builder);
+    }
+  }
+  if (visited_p != NULL)
+  {
+    inode_set_free(visited_p);
+  }
+
+  finish_directory_tree(base_p, options_p);
+  walk_stats_stop(WALK_STAT_CREATE_PHASE, start_ns, 1);
+  return dir_tree;
 }
 
 /**
- * @brief Creates and add a Directory Tree child to parent.
- * @param file_name [in] The name of the file in the parent directory.
- * @param parent [in/out] The Directory Tree node to add child to
+ * @brief Creates the trees of several base paths at the same time, with the directories of all of them read by one
+ *        pool of workers, so idle workers of a finished tree help with the others. Every tree is passed to a callback
+ *        on the calling thread as soon as it and the trees before it are created, in the order of the base paths.
+ * @param base_path_strings [in] The base paths as strings.
+ * @param tree_count [in] The number of base paths.
+ * @param options_p [in] How the trees are read. The pool has at least one worker per tree, so the trees are read at
+ *                  the same time even with a single thread. Trees with stamps, budgets or followed links are created
+ *                  one after another instead, since they are read on the calling thread.
+ * @param on_created [in] The callback receiving the trees.
+ * @param context_p [in] Passed to the callback.
  */
-static void add_directory_tree_child(char* file_name, Directory_Tree* parent)
+void create_directory_trees(char** base_path_strings, 
+                            int tree_count, 
+                            Directory_Tree_Options* options_p, 
+                            Directory_Tree_Function on_created, 
+                            void* context_p)
 {
-  int new_depth = parent->depth - 1;
-  char new_path_string[200];
-  strcpy(new_path_string, parent->path_string);
-  strcat(new_path_string, file_name);
+  bool has_budget = options_p->max_entries > 0 || options_p->per_directory_limit > 0 || options_p->time_budget_ms > 0;
+  if (options_p->record_stamps || options_p->follow_links || has_budget)
+  {
+    for (int i = 0; i < tree_count; i++)
+    {
+      on_created(i, create_directory_tree(base_path_strings[i], options_p), context_p);
+    }
+    return;
+  }
+
+  int thread_count = options_p->thread_count > tree_count ? options_p->thread_count : tree_count;
+  if (thread_count > MAX_WORKER_COUNT)
+  {
+    thread_count = MAX_WORKER_COUNT;
+  }
+  Directory_Tree_Options tree_options = *options_p;
+  tree_options.thread_count = thread_count;
 
-  if (new_depth >= 0 && path_exists(new_path_string))
+  Tree_Set_Builder set;
+  pthread_mutex_init(&set.mutex, NULL);
+  pthread_cond_init(&set.read_condition, NULL);
+  Base_Directory_Tree** bases = (Base_Directory_Tree**) allocate_or_exit(tree_count * sizeof(Base_Directory_Tree*));
+  Parallel_Tree_Builder** parallel_builders = 
+    (Parallel_Tree_Builder**) allocate_or_exit(tree_count * sizeof(Parallel_Tree_Builder*));
+  bool* is_finished = (bool*) allocate_or_exit(tree_count * sizeof(bool));
+
+  /* Every tree starts on the deque of its own worker, and the workers steal from each other from then on. */
+  uint64_t start_ns = walk_stats_start();
+  Work_Pool* pool_p = work_pool_create(thread_count, NULL);
+  for (int i = 0; i < tree_count; i++)
   {
-    Directory_Tree* new_dir_tree = (Directory_Tree*) malloc(sizeof(Directory_Tree));
-    new_dir_tree->depth = new_depth;
-    new_dir_tree->is_directory = is_directory(new_path_string); 
-    new_dir_tree->is_base = false;
-    strcpy(new_dir_tree->path_string, new_path_string);
-    strcpy(new_dir_tree->file_name, file_name);
-    if (new_dir_tree->is_directory)
+    Ignore_Scope* scope_p = NULL;
+    bases[i] = start_directory_tree(base_path_strings[i], &tree_options, &scope_p);
+    parallel_builders[i] = NULL;
+    is_finished[i] = false;
+    if (should_read_base(&bases[i]->node, &tree_options))
     {
-      strcat(new_dir_tree->path_string, "/");
-      strcat(new_dir_tree->file_name, "/");
+      parallel_builders[i] = create_parallel_tree_builder(thread_count, &tree_options, scope_p);
+      parallel_builders[i]->set_p = &set;
+      push_directory_task(pool_p, i % thread_count, parallel_builders[i], &bases[i]->node);
     }
-    new_dir_tree->children_count = 0;
+  }
 
-    if (new_dir_tree->is_directory && new_depth > 0)
+  /* Trees are finished in the order they are read, and passed on in the order of the base paths. */
+  int next_index = 0;
+  int finished_count = 0;
+  pthread_mutex_lock(&set.mutex);
+  while (next_index < tree_count)
+  {
+    int read_index = -1;
+    for (int i = next_index; i < tree_count && read_index < 0; i++)
     {
-      /* add children */
-      DIR* dir_stream_p = opendir(new_path_string);
-      if (dir_stream_p == NULL)
+      if (!is_finished[i] && (parallel_builders[i] == NULL || parallel_builders[i]->is_read))
       {
-        printf("Could not open the directory: %s\n", new_path_string);
-        exit(1);
+        read_index = i;
       }
+    }
 
-      struct dirent* directory_entry_p = readdir(dir_stream_p);
-      while (directory_entry_p != NULL)
+    if (read_index >= 0)
+    {
+      pthread_mutex_unlock(&set.mutex);
+      finish_tree_in_set(bases[read_index], parallel_builders[read_index], thread_count, &tree_options);
+      is_finished[read_index] = true;
+      finished_count++;
+      if (finished_count == tree_count)
       {
-        char* child_name = directory_entry_p->d_name;
-        if (!strings_are_equal(child_name, ".") && !strings_are_equal(child_name, ".."))
-        {
-          add_directory_tree_child(child_name, new_dir_tree);
-        }
-        directory_entry_p = readdir(dir_stream_p);
+        walk_stats_stop(WALK_STAT_CREATE_PHASE, start_ns, 1);
       }
-
-      closedir(dir_stream_p);
+      pthread_mutex_lock(&set.mutex);
+    }
+    else if (is_finished[next_index])
+    {
+      pthread_mutex_unlock(&set.mutex);
+      on_created(next_index, &bases[next_index]->node, context_p);
+      next_index++;
+      pthread_mutex_lock(&set.mutex);
+    }
+    else
+    {
+      pthread_cond_wait(&set.read_condition, &set.mutex);
     }
+  }
+  pthread_mutex_unlock(&set.mutex);
+
+  work_pool_wait(pool_p);
+  work_pool_destroy(pool_p);
+  free(is_finished);
+  free(parallel_builders);
+  free(bases);
+  pthread_cond_destroy(&set.read_condition);
+  pthread_mutex_destroy(&set.mutex);
+}
 
-    parent->children[parent->children_count] = new_dir_tree;
-    parent->children_count++;
+/**
+ * @brief Creates the tree of a base path without reading any directory. The children of a directory are read when
+ *        they are first asked for with get_directory_tree_children, so browsing a huge tree only reads the
+ *        directories that are opened.
+ * @param base_path_string [in] The base path as a string.
+ * @param options_p [in] How directories are read, i.e. the filter, the sort order and io_uring. Used whenever a
+ *                  directory is read, so it must stay valid as long as the tree. Only the .gitignore files of the
+ *                  base and of the directory being read are honored. Depth, threads, stamps, usage and budgets are not
+ *                  used. Followed links are read like any directory, without references, since only the opened
+ *                  directories are known.
+ * @return The base of the tree, a directory whose children are not read yet, or a file.
+ */
+Directory_Tree* create_lazy_directory_tree(char* base_path_string, Directory_Tree_Options* options_p)
+{
+  /* A depth of 0 marks a directory whose children are not read yet. */
+  Base_Directory_Tree* base_p = create_base_node(base_path_string, 0);
+  Tree_Builder* builder_p = (Tree_Builder*) arena_allocate(&base_p->arena, sizeof(Tree_Builder));
+  init_tree_builder(builder_p, &base_p->arena, options_p);
+  builder_p->record_usage = false;
+  builder_p->record_hashes = false;
+  base_p->lazy_builder_p = builder_p;
+
+  if (options_p->filter_p != NULL)
+  {
+    base_p->lazy_scope_p = (Ignore_Scope*) arena_allocate(&base_p->arena, sizeof(Ignore_Scope));
+    ignore_scope_init_base(base_p->lazy_scope_p, base_p->node.file_name_length);
   }
-  else
+  return &base_p->node;
+}
+
+/**
+ * @brief Gets the children of a node. For a lazy tree, the children of a directory are read the first time they are
+ *        asked for. Reading is not thread safe, so one lazy tree must only be used by one thread at a time.
+ * @param dir_tree [in/out] The node.
+ * @param count_p [out] The number of children.
+ * @return The children, count_p long. Exits the program if the directory could not be read.
+ */
+Directory_Tree** get_directory_tree_children(Directory_Tree* dir_tree, int* count_p)
+{
+  Directory_Tree* base = dir_tree;
+  while (base->parent != NULL)
   {
-    printf("Could not find path: %s\n", new_path_string);
-    exit(1);
+    base = base->parent;
+  }
+
+  Base_Directory_Tree* base_p = (Base_Directory_Tree*) base;
+  if (base_p->lazy_builder_p != NULL && dir_tree->is_directory && dir_tree->depth == 0)
+  {
+    /* The children get a depth one less, 0, so they are read lazily as well. */
+    Tree_Builder* builder_p = base_p->lazy_builder_p;
+    dir_tree->depth = 1;
+    builder_p->scope_p = base_p->lazy_scope_p;
+    builder_p->node_count = 0;
+    int directory_fd = open_node_directory(builder_p, AT_FDCWD, dir_tree);
+    add_directory_tree_children(builder_p, dir_tree, directory_fd);
+    base_p->node_count += builder_p->node_count;
   }
+
+  *count_p = dir_tree->children_count;
+  return dir_tree->children;
 }
 
 /**
- * @brief Prints one node in a Directory_Tree.
- * @param dir_tree [in] The Directory_Tree node to print.
- * @param indentation [in] The number of spaces this node will be printed.
+ * @brief Frees the allocated memory of the Directory_Tree and all its children.
+ * @param dir_tree [in] Pointer to the base of the Directory_Tree.
+ */
+void free_directory_tree(Directory_Tree* dir_tree)
+{
+  Base_Directory_Tree* base_p = (Base_Directory_Tree*) dir_tree;
+  if (base_p->lazy_builder_p != NULL)
+  {
+    free_tree_builder(base_p->lazy_builder_p);
+  }
+
+  /* The arena is stored inside its own memory, so copy it out before freeing. */
+  Arena arena = base_p->arena;
+  arena_free(&arena);
+}
+
+/**
+ * @brief Prints a directory tree.
+ * @param dir_tree [in] The Directory_Tree to print.
+ * @param format [in] How the tree is printed.
+ * @param writer_p [in/out] The writer the tree is printed to.
+ */
+void print_directory_tree(Directory_Tree* dir_tree, Output_Format format, Output_Writer* writer_p)
+{
+  uint64_t start_ns = walk_stats_start();
+  Tree_Printer printer;
+  init_tree_printer(&printer, format, writer_p);
+  String_Buffer path;
+  string_buffer_init(&path);
+  print_nodes(&printer, dir_tree, &path);
+  string_buffer_free(&path);
+  free_tree_printer(&printer);
+  walk_stats_stop(WALK_STAT_PRINT_PHASE, start_ns, 1);
+}
+
+/**
+ * @brief Prints a node of a snapshot and the nodes below it, without creating a tree. Gives the same output as
+ *        printing the tree the snapshot was saved from, starting at the node.
+ * @param snapshot_p [in] The snapshot.
+ * @param node_index [in] The index of the node to print from, 0 for the base.
+ * @param depth [in] How far down from the node to print.
+ * @param format [in] How the tree is printed.
+ * @param writer_p [in/out] The writer the tree is printed to.
+ */
+void print_snapshot_tree(Snapshot* snapshot_p, 
+                         uint32_t node_index, 
+                         int depth, 
+                         Output_Format format, 
+                         Output_Writer* writer_p)
+{
+  uint64_t start_ns = walk_stats_start();
+  Tree_Printer printer;
+  init_tree_printer(&printer, format, writer_p);
+  String_Buffer path;
+  string_buffer_init(&path);
+  append_snapshot_path(snapshot_p, node_index, &path);
+
+  print_snapshot_nodes(&printer, snapshot_p, &path, node_index, depth);
+
+  string_buffer_free(&path);
+  free_tree_printer(&printer);
+  walk_stats_stop(WALK_STAT_PRINT_PHASE, start_ns, 1);
+}
+
+/**
+ * @brief Prints the directory tree of the base path while it is read, without creating the tree. Gives the same output
+ *        as create_directory_tree followed by print_directory_tree, but only uses memory for the current path.
+ * @param base_path_string [in] The base path as a string.
+ * @param options_p [in] How the tree is read, e.g. how far down relative the base directory to print.
+ * @param writer_p [in/out] The writer the tree is printed to.
+ */
+void stream_directory_tree(char* base_path_string, Directory_Tree_Options* options_p, Output_Writer* writer_p)
+{
+  uint64_t start_ns = walk_stats_start();
+  Tree_Printer printer;
+  init_tree_printer(&printer, options_p->output_format, writer_p);
+  Directory_Visitor visitor = {print_visited_entry, print_visited_entry_end, &printer};
+  walk_directory_tree(base_path_string, options_p, &visitor);
+  free_tree_printer(&printer);
+  walk_stats_stop(WALK_STAT_STREAM_PHASE, start_ns, 1);
+}
+
+/**
+ * @brief Prints the entries of the directory tree of the base path whose names match a pattern, with the directories
+ *        above them, while the tree is read. No tree is created, so subtrees without a match cost no memory, and only
+ *        the matches and their directories are formatted and written.
+ * @param base_path_string [in] The base path as a string.
+ * @param options_p [in] How the tree is read, like for walk_directory_tree.
+ * @param matcher_p [in] The pattern the names are matched against.
+ * @param writer_p [in/out] The writer the matches are printed to.
+ */
+void find_in_directory_tree(char* base_path_string, 
+                            Directory_Tree_Options* options_p, 
+                            Name_Matcher* matcher_p, 
+                            Output_Writer* writer_p)
+{
+  uint64_t start_ns = walk_stats_start();
+  Tree_Finder finder;
+  init_tree_printer(&finder.printer, options_p->output_format, writer_p);
+  finder.matcher_p = matcher_p;
+  frame_stack_init(&finder.ancestors, sizeof(Find_Frame));
+  finder.printed_count = 0;
+  finder.is_leaf_printed = false;
+  Directory_Visitor visitor = {find_visited_entry, find_visited_entry_end, &finder};
+  walk_directory_tree(base_path_string, options_p, &visitor);
+  frame_stack_free(&finder.ancestors);
+  free_tree_printer(&finder.printer);
+  walk_stats_stop(WALK_STAT_STREAM_PHASE, start_ns, 1);
+}
+
+/**
+ * @brief Walks the directory tree of the base path while it is read, passing every entry to the callbacks of a visitor
+ *        before and after its children. Only the path of the current entry is kept in memory.
+ * @param base_path_string [in] The base path as a string.
+ * @param options_p [in] How the tree is read, i.e. how far down relative the base directory to walk, the filter and
+ *                  whether links are followed. Sorting, usage, threads and io_uring are not used, entries are visited
+ *                  in the order they are read.
+ * @param visitor_p [in] The callbacks the entries are passed to, the base first.
+ * @return False if the visitor stopped the walk, true if the whole tree was walked.
  */
-void print_node(Directory_Tree* dir_tree, int indentation)
+bool walk_directory_tree(char* base_path_string, Directory_Tree_Options* options_p, Directory_Visitor* visitor_p)
 {
-  for (int i = 0; i < indentation; i++)
+  if (!path_exists(base_path_string))
   {
-    printf(" ");
+    printf("Could not find path: %s\n", base_path_string);
+    exit(1);
   }
 
-  if (dir_tree->is_base)
+  Tree_Walker walker = {0};
+  walker.visitor_p = visitor_p;
+  walker.filter_p = options_p->filter_p;
+  walker.follow_links = options_p->follow_links;
+  arena_init(&walker.scope_arena);
+  Inode_Set visited;
+  if (walker.follow_links)
   {
-    printf("%s\n", dir_tree->path_string);
+    inode_set_init(&visited);
+    walker.visited_p = &visited;
   }
-  else
+  String_Buffer* path_p = &walker.path;
+  string_buffer_init(path_p);
+  string_buffer_append(path_p, base_path_string, strlen(base_path_string));
+
+  bool base_is_directory = is_directory(base_path_string);
+  if (base_is_directory && last_char(path_p->string) != '/')
   {
-    printf("|- %s\n", dir_tree->file_name);
+    string_buffer_append(path_p, "/", 1);
   }
 
-  if (dir_tree->depth > 0)
+  Ignore_Scope base_scope;
+  ignore_scope_init_base(&base_scope, path_p->length);
+  Visited_Entry base;
+  base.path = path_p->string;
+  base.path_length = path_p->length;
+  base.name_offset = 0;
+  base.level = 0;
+  base.is_directory = base_is_directory;
+  base.has_children = base_is_directory && options_p->depth > 0;
+  base.is_reference = false;
+  frame_stack_init(&walker.frames, sizeof(Walk_Frame));
+  bool is_complete = walk_entries(&walker, &base, walker.filter_p == NULL ? NULL : &base_scope, options_p->depth);
+
+  for (int i = 0; i < walker.read_buffer_count; i++)
   {
-    for (int i = 0; i < dir_tree->children_count; i++)
+    free(walker.read_buffers[i]);
+  }
+  frame_stack_free(&walker.frames);
+  string_buffer_free(path_p);
+  arena_free(&walker.scope_arena);
+  if (walker.visited_p != NULL)
+  {
+    inode_set_free(walker.visited_p);
+  }
+  return is_complete;
+}
+
+/**
+ * @brief Gets the memory used by a directory tree.
+ * @param dir_tree [in] Pointer to the base of the Directory_Tree.
+ * @param usage_p [out] The memory usage of the tree.
+ */
+void get_directory_tree_memory_usage(Directory_Tree* dir_tree, Directory_Tree_Memory_Usage* usage_p)
+{
+  Base_Directory_Tree* base_p = (Base_Directory_Tree*) dir_tree;
+  usage_p->node_count = base_p->node_count;
+  usage_p->bytes_used = base_p->arena.bytes_used;
+  usage_p->bytes_reserved = base_p->arena.bytes_reserved;
+}
+
+/**
+ * @brief Counts the directories and files below the base of a directory tree.
+ * @param dir_tree [in] Pointer to the base of the Directory_Tree.
+ * @param counts_p [out] The number of directories and files, the base left out.
+ */
+void get_directory_tree_counts(Directory_Tree* dir_tree, Directory_Tree_Counts* counts_p)
+{
+  counts_p->directory_count = 0;
+  counts_p->file_count = 0;
+
+  Frame_Stack nodes;
+  frame_stack_init(&nodes, sizeof(Directory_Tree*));
+  *(Directory_Tree**) frame_stack_push(&nodes) = dir_tree;
+  while (nodes.count > 0)
+  {
+    Directory_Tree* node = *(Directory_Tree**) frame_stack_pop(&nodes);
+    for (int i = 0; i < node->children_count; i++)
     {
-      print_node(dir_tree->children[i], indentation + 2);
+      Directory_Tree* child = node->children[i];
+      if (child->is_directory)
+      {
+        counts_p->directory_count++;
+        *(Directory_Tree**) frame_stack_push(&nodes) = child;
+      }
+      else
+      {
+        counts_p->file_count++;
+      }
     }
   }
+  frame_stack_free(&nodes);
 }
 
-/*> Global Function Definitions **************************************************************************************/
 /**
- * @brief Creates the directory tree based on the base path provided.
- * @param base_path_string [in] The base path as a string.
- * @param depth [in] How far down relative the base directory to create children directory tree nodes.
- * @return The pointer to the directory tree struct allocated.
+ * @brief Creates a node for a file added to a directory of an existing tree, and reads its children down to the depth
+ *        of the tree. The node is not added to the children of the parent.
+ * @param base [in/out] The base of the tree, the node is allocated from its arena.
+ * @param parent [in] The node of the directory the file was added to.
+ * @param file_name [in] The name of the file in the directory.
+ * @param options_p [in] How the tree was read.
+ * @return The new node, or NULL if the file no longer exists or is left out by the filter. Only the .gitignore files
+ *         of the new directory and below are honored.
  */
-Directory_Tree* create_directory_tree(char* base_path_string, int depth)
+Directory_Tree* create_directory_tree_child(Directory_Tree* base, 
+                                            Directory_Tree* parent, 
+                                            char* file_name, 
+                                            Directory_Tree_Options* options_p)
 {
-  if (path_exists(base_path_string))
+  Base_Directory_Tree* base_p = (Base_Directory_Tree*) base;
+  Tree_Builder builder;
+  init_tree_builder(&builder, &base_p->arena, options_p);
+
+  Directory_Tree* child = create_child_node(&builder, file_name, false, parent);
+  char* path_string = build_node_path(&builder, child);
+  size_t path_length = builder.path.length;
+  struct stat file_info = {0};
+  if ((options_p->follow_links ? stat(path_string, &file_info) : lstat(path_string, &file_info)) == 0)
   {
-    Directory_Tree* dir_tree = (Directory_Tree*) malloc(sizeof(Directory_Tree));
-    dir_tree->depth = depth;
-    dir_tree->is_directory = is_directory(base_path_string);
-    dir_tree->is_base = true;
-    strcpy(dir_tree->path_string, base_path_string);
-    strcpy(dir_tree->file_name, base_path_string);
-    if (dir_tree->is_directory && last_char(dir_tree->path_string) != '/') {
-      strcat(dir_tree->path_string, "/");
-      strcat(dir_tree->file_name, "/");
-    }
-    dir_tree->children_count = 0;
+    child->is_directory = S_ISDIR(file_info.st_mode);
+  }
+  else if (lstat(path_string, &file_info) != 0)
+  {
+    /* Gone again before it could be looked at. A broken link still exists, and is shown as a file. */
+    free_tree_builder(&builder);
+    return NULL;
+  }
 
-    if (dir_tree->is_directory && depth > 0)
+  Ignore_Scope base_scope;
+  if (options_p->filter_p != NULL)
+  {
+    ignore_scope_init_base(&base_scope, base->file_name_length);
+    builder.scope_p = &base_scope;
+    if (path_filter_excludes(options_p->filter_p, 
+                             &base_scope, 
+                             path_string, 
+                             path_length - child->file_name_length, 
+                             path_length, 
+                             child->is_directory))
     {
-      /* add children */
-      DIR* dir_stream_p = opendir(base_path_string);
-      if (dir_stream_p == NULL)
-      {
-        printf("Could not open the directory: %s\n", base_path_string);
-        exit(1);
-      }
+      free_tree_builder(&builder);
+      return NULL;
+    }
+  }
 
-      struct dirent* directory_entry_p = readdir(dir_stream_p);
-      while (directory_entry_p != NULL)
+  if (should_read_children(&builder, child))
+  {
+    /* The directories above the new one are already listed, so a link back to one of them is a reference. Links to
+       other directories of the tree are not known here, and are read again. */
+    Inode_Set visited;
+    if (options_p->follow_links)
+    {
+      inode_set_init(&visited);
+      builder.visited_p = &visited;
+      for (Directory_Tree* node = parent; node != NULL; node = node->parent)
       {
-        char* child_name = directory_entry_p->d_name;
-        if (!strings_are_equal(child_name, ".") && !strings_are_equal(child_name, ".."))
+        struct stat directory_info = {0};
+        if (stat(build_node_path(&builder, node), &directory_info) == 0)
         {
-          add_directory_tree_child(child_name, dir_tree);
+          inode_set_insert(&visited, directory_info.st_dev, directory_info.st_ino);
         }
-        directory_entry_p = readdir(dir_stream_p);
       }
+      path_string = build_node_path(&builder, child);
+    }
 
-      closedir(dir_stream_p);
+    int directory_fd = open_directory_at(AT_FDCWD, path_string, path_string);
+    add_directory_tree_children(&builder, child, directory_fd);
+    if (builder.visited_p != NULL)
+    {
+      inode_set_free(builder.visited_p);
     }
+  }
+
+  base_p->node_count += builder.node_count;
+  free_tree_builder(&builder);
+  return child;
+}
+
+/**
+ * @brief Allocates memory that lives as long as a tree, e.g. for a larger children array of a node.
+ * @param base [in/out] The base of the tree.
+ * @param size [in] The number of bytes to allocate.
+ * @return The allocated memory, aligned for pointers.
+ */
+void* allocate_directory_tree_memory(Directory_Tree* base, size_t size)
+{
+  return arena_allocate(&((Base_Directory_Tree*) base)->arena, size);
+}
 
+/**
+ * @brief Copies the nodes of a tree to a new arena and frees the old one, so the memory of nodes removed from the tree
+ *        and of outgrown children arrays, which an arena never gives back, is freed.
+ * @param dir_tree [in/out] The base of the tree, freed. A lazy tree is returned as it is.
+ * @return The base of the copy, with exactly sized children arrays. Pointers to nodes of the old tree are no longer
+ *         valid.
+ */
+Directory_Tree* compact_directory_tree(Directory_Tree* dir_tree)
+{
+  Base_Directory_Tree* old_base_p = (Base_Directory_Tree*) dir_tree;
+  if (old_base_p->lazy_builder_p != NULL)
+  {
     return dir_tree;
   }
-  else
+
+  Arena arena;
+  arena_init(&arena);
+  Base_Directory_Tree* base_p = (Base_Directory_Tree*) arena_allocate(&arena, sizeof(Base_Directory_Tree));
+  base_p->arena = arena;
+  base_p->node_count = 1;
+  base_p->lazy_builder_p = NULL;
+  base_p->lazy_scope_p = NULL;
+  base_p->node = *dir_tree;
+  base_p->node.file_name = arena_copy_string(&base_p->arena, dir_tree->file_name, dir_tree->file_name_length);
+  copy_node_records(&base_p->arena, &base_p->node);
+
+  /* The copied nodes on the stack still point to the children arrays of the old tree. */
+  String_Pool names;
+  string_pool_init(&names, &base_p->arena);
+  Frame_Stack pending;
+  frame_stack_init(&pending, sizeof(Directory_Tree*));
+  *(Directory_Tree**) frame_stack_push(&pending) = &base_p->node;
+  while (pending.count > 0)
   {
-    printf("Could not find path: %s\n", base_path_string);
-    exit(1);
+    Directory_Tree* node = *(Directory_Tree**) frame_stack_pop(&pending);
+    Directory_Tree** old_children = node->children;
+    node->children = (Directory_Tree**) arena_allocate(&base_p->arena, node->children_count * sizeof(Directory_Tree*));
+    for (int i = 0; i < node->children_count; i++)
+    {
+      Directory_Tree* child = (Directory_Tree*) arena_allocate(&base_p->arena, sizeof(Directory_Tree));
+      *child = *old_children[i];
+      child->parent = node;
+      child->file_name = string_pool_intern(&names, child->file_name, child->file_name_length);
+      copy_node_records(&base_p->arena, child);
+      node->children[i] = child;
+      *(Directory_Tree**) frame_stack_push(&pending) = child;
+    }
+    base_p->node_count += node->children_count;
   }
+  frame_stack_free(&pending);
+  string_pool_free(&names);
 
+  free_directory_tree(dir_tree);
+  return &base_p->node;
 }
 
 /**
- * @brief Frees the allocated memory of the Directory_Tree and all its children recursivly.
- * @param dir_tree [in] Pointer to the Directory_Tree.
+ * @brief Sorts the children of a directory of an existing tree, e.g. after a child was added to it.
+ * @param dir_tree [in/out] The node of the directory.
+ * @param options_p [in] How the tree was read, e.g. the order to sort in.
  */
-void free_directory_tree(Directory_Tree* dir_tree)
+void sort_directory_tree_children(Directory_Tree* dir_tree, Directory_Tree_Options* options_p)
 {
-  for (int i = 0; i < dir_tree->children_count; i++)
+  Node_Sorter sorter;
+  node_sorter_init(&sorter, options_p->sort_order);
+  if (options_p->sort_order == SORT_SIZE && options_p->record_usage && dir_tree->children_count > 1)
+  {
+    sort_children_by_usage(dir_tree, &sorter);
+  }
+  else
   {
-    free_directory_tree(dir_tree->children[i]);
+    sort_children(NULL, &sorter, AT_FDCWD, dir_tree->children, dir_tree->children_count);
   }
-  free(dir_tree);
+  node_sorter_free(&sorter);
 }
 
 /**
- * @brief Prints a directory tree.
- * @param dir_tree [in] The Directory_Tree to print.
+ * @brief Appends the path of a node, rebuilt from the names of the node and its parents. Directories other than the
+ *        base get a trailing '/'.
+ * @param dir_tree [in] The node.
+ * @param path_p [in/out] The buffer the path is appended to.
  */
-void print_directory_tree(Directory_Tree* dir_tree)
+void append_directory_tree_path(Directory_Tree* dir_tree, String_Buffer* path_p)
 {
-  print_node(dir_tree, 0);
-}
\ No newline at end of file
+  /* The length is summed up first, so the names are copied from the node up without recursing. */
+  size_t length = 0;
+  for (Directory_Tree* node = dir_tree; node != NULL; node = node->parent)
+  {
+    length += node->file_name_length + (node->is_directory && !node->is_base ? 1 : 0);
+  }
+
+  char* end = string_buffer_extend(path_p, length) + length;
+  for (Directory_Tree* node = dir_tree; node != NULL; node = node->parent)
+  {
+    if (node->is_directory && !node->is_base)
+    {
+      *--end = '/';
+    }
+    end -= node->file_name_length;
+    memcpy(end, node->file_name, node->file_name_length);
+  }
+}
@@ -0,0 +1,75 @@
+/*> Description ******************************************************************************************************/
+/**
+* @brief Defines the growable stack of frames.
+* @file frame_stack.c
+*/
+
+/*> Includes *********************************************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "frame_stack.h"
+
+/*> Defines **********************************************************************************************************/
+
+/*> Type Declarations ************************************************************************************************/
+
+/*> Global Constant Definitions **************************************************************************************/
+
+/*> Global Variable Definitions **************************************************************************************/
+
+/*> Local Constant Definitions ***************************************************************************************/
+
+/*> Local Variable Definitions ***************************************************************************************/
+
+/*> Local Function Declarations **************************************************************************************/
+
+/*> Local Function Definitions ***************************************************************************************/
+
+/*> Global Function Definitions **************************************************************************************/
+/**
+ * @brief Initializes an empty stack. No memory is allocated until a frame is pushed.
+ * @param stack_p [out] The stack to initialize.
+ * @param frame_size [in] The size of one frame.
+ */
+void frame_stack_init(Frame_Stack* stack_p, size_t frame_size)
+{
+  stack_p->frames = NULL;
+  stack_p->frame_size = frame_size;
+  stack_p->count = 0;
+  stack_p->capacity = 0;
+}
+
+/**
+ * @brief Pushes a frame onto a stack, doubling the stack if it is full.
+ * @param stack_p [in/out] The stack.
+ * @return The pushed frame, uninitialized.
+ */
+void* frame_stack_push(Frame_Stack* stack_p)
+{
+  if (stack_p->count == stack_p->capacity)
+  {
+    stack_p->capacity = stack_p->capacity == 0 ? INITIAL_FRAME_STACK_CAPACITY : 2 * stack_p->capacity;
+    stack_p->frames = (char*) realloc(stack_p->frames, (size_t) stack_p->capacity * stack_p->frame_size);
+    if (stack_p->frames == NULL)
+    {
+      printf("Could not allocate memory for the directory tree.\n");
+      exit(1);
+    }
+  }
+
+  stack_p->count++;
+  return frame_stack_top(stack_p);
+}
+
+/**
+ * @brief Frees the memory of a stack.
+ * @param stack_p [in/out] The stack to free.
+ */
+void frame_stack_free(Frame_Stack* stack_p)
+{
+  free(stack_p->frames);
+  stack_p->frames = NULL;
+  stack_p->count = 0;
+  stack_p->capacity = 0;
+}
@@ -0,0 +1,173 @@
+/*> Description ******************************************************************************************************/
+/**
+* @brief Defines the striped inode set used to count hard linked files once.
+* @file inode_set.c
+*/
+
+/*> Includes *********************************************************************************************************/
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "inode_set.h"
+
+/*> Defines **********************************************************************************************************/
+#define INITIAL_STRIPE_CAPACITY 16
+
+/*> Type Declarations ************************************************************************************************/
+
+/*> Global Constant Definitions **************************************************************************************/
+
+/*> Global Variable Definitions **************************************************************************************/
+
+/*> Local Constant Definitions ***************************************************************************************/
+
+/*> Local Variable Definitions ***************************************************************************************/
+
+/*> Local Function Declarations **************************************************************************************/
+static uint64_t hash_inode(uint64_t device, uint64_t inode);
+
+static Inode_Key* allocate_keys(size_t capacity);
+
+static bool insert_key(Inode_Key* keys, size_t capacity, uint64_t hash, uint64_t device, uint64_t inode);
+
+static void grow_stripe(Inode_Set_Stripe* stripe_p);
+
+/*> Local Function Definitions ***************************************************************************************/
+/**
+ * @brief Hashes an inode. The low bits select the stripe, the high bits the slot in it.
+ * @param device [in] The device of the inode.
+ * @param inode [in] The inode number.
+ * @return The hash of the inode.
+ */
+static uint64_t hash_inode(uint64_t device, uint64_t inode)
+{
+  uint64_t hash = inode * 0x9E3779B97F4A7C15ULL ^ device * 0xC2B2AE3D27D4EB4FULL;
+  return hash ^ (hash >> 29);
+}
+
+/**
+ * @brief Allocates the empty slots of a stripe.
+ * @param capacity [in] The number of slots.
+ * @return The slots.
+ */
+static Inode_Key* allocate_keys(size_t capacity)
+{
+  Inode_Key* keys = (Inode_Key*) calloc(capacity, sizeof(Inode_Key));
+  if (keys == NULL)
+  {
+    printf("Could not allocate memory for the inode set.\n");
+    exit(1);
+  }
+  return keys;
+}
+
+/**
+ * @brief Inserts an inode into the slots of a stripe, which must have a free slot.
+ * @param keys [in/out] The slots.
+ * @param capacity [in] The number of slots, a power of two.
+ * @param hash [in] The hash of the inode.
+ * @param device [in] The device of the inode.
+ * @param inode [in] The inode number, not 0.
+ * @return True if the inode was inserted, false if it already was in the slots.
+ */
+static bool insert_key(Inode_Key* keys, size_t capacity, uint64_t hash, uint64_t device, uint64_t inode)
+{
+  size_t mask = capacity - 1;
+  size_t slot = (hash / INODE_SET_STRIPE_COUNT) & mask;
+  while (keys[slot].inode != 0)
+  {
+    if (keys[slot].inode == inode && keys[slot].device == device)
+    {
+      return false;
+    }
+    slot = (slot + 1) & mask;
+  }
+
+  keys[slot].device = device;
+  keys[slot].inode = inode;
+  return true;
+}
+
+/**
+ * @brief Doubles the number of slots of a stripe, keeping it at most half full.
+ * @param stripe_p [in/out] The stripe, locked by the caller.
+ */
+static void grow_stripe(Inode_Set_Stripe* stripe_p)
+{
+  size_t capacity = stripe_p->capacity * 2;
+  Inode_Key* keys = allocate_keys(capacity);
+  for (size_t i = 0; i < stripe_p->capacity; i++)
+  {
+    Inode_Key* key_p = &stripe_p->keys[i];
+    if (key_p->inode != 0)
+    {
+      insert_key(keys, capacity, hash_inode(key_p->device, key_p->inode), key_p->device, key_p->inode);
+    }
+  }
+
+  free(stripe_p->keys);
+  stripe_p->keys = keys;
+  stripe_p->capacity = capacity;
+}
+
+/*> Global Function Definitions **************************************************************************************/
+/**
+ * @brief Initializes an empty inode set.
+ * @param set_p [out] The set to initialize.
+ */
+void inode_set_init(Inode_Set* set_p)
+{
+  for (int i = 0; i < INODE_SET_STRIPE_COUNT; i++)
+  {
+    Inode_Set_Stripe* stripe_p = &set_p->stripes[i];
+    pthread_mutex_init(&stripe_p->mutex, NULL);
+    stripe_p->capacity = INITIAL_STRIPE_CAPACITY;
+    stripe_p->keys = allocate_keys(stripe_p->capacity);
+    stripe_p->count = 0;
+  }
+}
+
+/**
+ * @brief Inserts an inode into the set. Safe to call from several threads.
+ * @param set_p [in/out] The set.
+ * @param device [in] The device of the inode.
+ * @param inode [in] The inode number, not 0.
+ * @return True if the inode was not in the set before, false if it was.
+ */
+bool inode_set_insert(Inode_Set* set_p, uint64_t device, uint64_t inode)
+{
+  uint64_t hash = hash_inode(device, inode);
+  Inode_Set_Stripe* stripe_p = &set_p->stripes[hash % INODE_SET_STRIPE_COUNT];
+
+  pthread_mutex_lock(&stripe_p->mutex);
+  if (2 * (stripe_p->count + 1) > stripe_p->capacity)
+  {
+    grow_stripe(stripe_p);
+  }
+  bool inserted = insert_key(stripe_p->keys, stripe_p->capacity, hash, device, inode);
+  if (inserted)
+  {
+    stripe_p->count++;
+  }
+  pthread_mutex_unlock(&stripe_p->mutex);
+
+  return inserted;
+}
+
+/**
+ * @brief Frees the memory of an inode set.
+ * @param set_p [in/out] The set to free.
+ */
+void inode_set_free(Inode_Set* set_p)
+{
+  for (int i = 0; i < INODE_SET_STRIPE_COUNT; i++)
+  {
+    pthread_mutex_destroy(&set_p->stripes[i].mutex);
+    free(set_p->stripes[i].keys);
+    set_p->stripes[i].keys = NULL;
+  }
+}
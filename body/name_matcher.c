@@ -0,0 +1,360 @@
+/*> Description ******************************************************************************************************/
+/**
+* @brief Defines the matcher of file names used by --find.
+* @file name_matcher.c
+*/
+
+/*> Includes *********************************************************************************************************/
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+#include "name_matcher.h"
+#include "path_filter.h"
+
+/*> Defines **********************************************************************************************************/
+#if defined(__SSE2__)
+#define NAME_MATCHER_HAS_SSE2
+#endif
+
+/* AVX2 is only used behind a check of the processor, so the program still runs where it is missing. */
+#if defined(__x86_64__) && defined(__GNUC__)
+#define NAME_MATCHER_HAS_AVX2
+#endif
+
+/* The widest vector loaded past the end of a padded text. */
+#define NAME_MATCHER_VECTOR_SIZE 32
+
+/*> Type Declarations ************************************************************************************************/
+
+/*> Global Constant Definitions **************************************************************************************/
+
+/*> Global Variable Definitions **************************************************************************************/
+
+/*> Local Constant Definitions ***************************************************************************************/
+
+/*> Local Variable Definitions ***************************************************************************************/
+
+/*> Local Function Declarations **************************************************************************************/
+static bool is_wildcard(char c);
+
+static bool has_wildcards(const char* text, size_t length);
+
+static void find_longest_literal(const char* pattern, size_t length, const char** literal_p, size_t* literal_length_p);
+
+static bool search_literal_scalar(const char* text, size_t text_length, const char* literal, size_t literal_length);
+
+#if defined(NAME_MATCHER_HAS_SSE2)
+static bool search_literal_sse2(const char* text, size_t text_length, const char* literal, size_t literal_length);
+#endif
+
+#if defined(NAME_MATCHER_HAS_AVX2)
+static bool search_literal_avx2(const char* text, size_t text_length, const char* literal, size_t literal_length);
+#endif
+
+static Literal_Search select_literal_search(void);
+
+static bool name_contains_literal(Name_Matcher* matcher_p, const char* name, size_t name_length);
+
+/*> Local Function Definitions ***************************************************************************************/
+/**
+ * @brief Checks if a character has a special meaning in a glob pattern.
+ * @param c [in] The character.
+ * @return True if the character is a wildcard, starts a character class or escapes, false otherwise.
+ */
+static bool is_wildcard(char c)
+{
+  return c == '*' || c == '?' || c == '[' || c == '\\';
+}
+
+/**
+ * @brief Checks if a pattern has characters with a special meaning.
+ * @param text [in] The pattern.
+ * @param length [in] The length of the pattern.
+ * @return True if the pattern has a wildcard, a character class or an escape, false otherwise.
+ */
+static bool has_wildcards(const char* text, size_t length)
+{
+  for (size_t i = 0; i < length; i++)
+  {
+    if (is_wildcard(text[i]))
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * @brief Finds the longest run of ordinary characters of a glob pattern, which every name matching the pattern
+ *        contains. The characters of a class and escaped characters end a run without being part of one.
+ * @param pattern [in] The pattern.
+ * @param length [in] The length of the pattern.
+ * @param literal_p [out] The start of the longest run.
+ * @param literal_length_p [out] The length of the longest run, 0 if the pattern has no ordinary characters.
+ */
+static void find_longest_literal(const char* pattern, size_t length, const char** literal_p, size_t* literal_length_p)
+{
+  *literal_p = pattern;
+  *literal_length_p = 0;
+
+  size_t run_start = 0;
+  size_t i = 0;
+  while (i <= length)
+  {
+    if (i < length && !is_wildcard(pattern[i]))
+    {
+      i++;
+      continue;
+    }
+
+    if (i - run_start > *literal_length_p)
+    {
+      *literal_p = pattern + run_start;
+      *literal_length_p = i - run_start;
+    }
+    if (i == length)
+    {
+      break;
+    }
+
+    if (pattern[i] == '\\')
+    {
+      i += 2;
+    }
+    else if (pattern[i] == '[')
+    {
+      /* The first character of a class, after a '!' or '^', never closes it. A class that is not closed is an
+         ordinary '[', which only ends the run. */
+      size_t class_end = i + 1;
+      if (class_end < length && (pattern[class_end] == '!' || pattern[class_end] == '^'))
+      {
+        class_end++;
+      }
+      class_end++;
+      while (class_end < length && pattern[class_end] != ']')
+      {
+        class_end += pattern[class_end] == '\\' ? 2 : 1;
+      }
+      i = class_end < length ? class_end + 1 : i + 1;
+    }
+    else
+    {
+      i++;
+    }
+    if (i > length)
+    {
+      i = length;
+    }
+    run_start = i;
+  }
+}
+
+/**
+ * @brief Searches a text for a literal a byte at a time, for processors without SSE2.
+ * @param text [in] The text.
+ * @param text_length [in] The length of the text.
+ * @param literal [in] The literal to search for.
+ * @param literal_length [in] The length of the literal, at least 1.
+ * @return True if the text contains the literal, false otherwise.
+ */
+static bool search_literal_scalar(const char* text, size_t text_length, const char* literal, size_t literal_length)
+{
+  const char* end = text + text_length - literal_length + 1;
+  const char* candidate = text;
+  while (candidate < end)
+  {
+    candidate = (const char*) memchr(candidate, literal[0], end - candidate);
+    if (candidate == NULL)
+    {
+      return false;
+    }
+    if (memcmp(candidate + 1, literal + 1, literal_length - 1) == 0)
+    {
+      return true;
+    }
+    candidate++;
+  }
+  return false;
+}
+
+#if defined(NAME_MATCHER_HAS_SSE2)
+/**
+ * @brief Searches a padded text for a literal 16 positions at a time. A position is a candidate when both the first
+ *        and the last character of the literal are at their place, so the rest of the literal is rarely compared.
+ *        Candidates running into the padding are rejected by the comparison, since the literal has no null character.
+ * @param text [in] The text, padded with zeros.
+ * @param text_length [in] The length of the text without the padding.
+ * @param literal [in] The literal to search for.
+ * @param literal_length [in] The length of the literal, at least 1.
+ * @return True if the text contains the literal, false otherwise.
+ */
+static bool search_literal_sse2(const char* text, size_t text_length, const char* literal, size_t literal_length)
+{
+  __m128i first = _mm_set1_epi8(literal[0]);
+  __m128i last = _mm_set1_epi8(literal[literal_length - 1]);
+  for (size_t i = 0; i < text_length; i += 16)
+  {
+    __m128i first_block = _mm_loadu_si128((const __m128i*) (text + i));
+    __m128i last_block = _mm_loadu_si128((const __m128i*) (text + i + literal_length - 1));
+    unsigned int mask = (unsigned int) _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(first, first_block),
+                                                                       _mm_cmpeq_epi8(last, last_block)));
+    while (mask != 0)
+    {
+      int position = __builtin_ctz(mask);
+      if (memcmp(text + i + position, literal, literal_length) == 0)
+      {
+        return true;
+      }
+      mask &= mask - 1;
+    }
+  }
+  return false;
+}
+#endif
+
+#if defined(NAME_MATCHER_HAS_AVX2)
+/**
+ * @brief Searches a padded text for a literal 32 positions at a time, like search_literal_sse2.
+ * @param text [in] The text, padded with zeros.
+ * @param text_length [in] The length of the text without the padding.
+ * @param literal [in] The literal to search for.
+ * @param literal_length [in] The length of the literal, at least 1.
+ * @return True if the text contains the literal, false otherwise.
+ */
+__attribute__((target("avx2")))
+static bool search_literal_avx2(const char* text, size_t text_length, const char* literal, size_t literal_length)
+{
+  __m256i first = _mm256_set1_epi8(literal[0]);
+  __m256i last = _mm256_set1_epi8(literal[literal_length - 1]);
+  for (size_t i = 0; i < text_length; i += 32)
+  {
+    __m256i first_block = _mm256_loadu_si256((const __m256i*) (text + i));
+    __m256i last_block = _mm256_loadu_si256((const __m256i*) (text + i + literal_length - 1));
+    unsigned int mask = (unsigned int) _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(first, first_block),
+                                                                             _mm256_cmpeq_epi8(last, last_block)));
+    while (mask != 0)
+    {
+      int position = __builtin_ctz(mask);
+      if (memcmp(text + i + position, literal, literal_length) == 0)
+      {
+        return true;
+      }
+      mask &= mask - 1;
+    }
+  }
+  return false;
+}
+#endif
+
+/**
+ * @brief Selects the fastest search for literals the processor supports.
+ * @return The search.
+ */
+static Literal_Search select_literal_search(void)
+{
+#if defined(NAME_MATCHER_HAS_AVX2)
+  if (__builtin_cpu_supports("avx2"))
+  {
+    return search_literal_avx2;
+  }
+#endif
+#if defined(NAME_MATCHER_HAS_SSE2)
+  return search_literal_sse2;
+#else
+  return search_literal_scalar;
+#endif
+}
+
+/**
+ * @brief Checks if a name contains the literal of a matcher. The name is copied to a buffer padded with zeros, so the
+ *        vectors loaded past its end stay inside the buffer, whatever the name was read into.
+ * @param matcher_p [in] The matcher, with a literal.
+ * @param name [in] The name, does not need to be null terminated.
+ * @param name_length [in] The length of name.
+ * @return True if the name contains the literal, false otherwise.
+ */
+static bool name_contains_literal(Name_Matcher* matcher_p, const char* name, size_t name_length)
+{
+  if (name_length < matcher_p->literal_length)
+  {
+    return false;
+  }
+  if (name_length + matcher_p->literal_length + NAME_MATCHER_VECTOR_SIZE > NAME_MATCHER_PADDED_CAPACITY)
+  {
+    return search_literal_scalar(name, name_length, matcher_p->literal, matcher_p->literal_length);
+  }
+
+  char padded_name[NAME_MATCHER_PADDED_CAPACITY];
+  memcpy(padded_name, name, name_length);
+  memset(padded_name + name_length, 0, matcher_p->literal_length + NAME_MATCHER_VECTOR_SIZE);
+  return matcher_p->search(padded_name, name_length, matcher_p->literal, matcher_p->literal_length);
+}
+
+/*> Global Function Definitions **************************************************************************************/
+/**
+ * @brief Compiles a pattern for matching file names. A pattern without wildcards matches names containing it, one
+ *        that is a literal followed by '*' names starting with the literal, and any other is a glob matching the
+ *        whole name.
+ * @param matcher_p [out] The compiled matcher.
+ * @param pattern [in] The null terminated pattern, it must live as long as the matcher.
+ * @return True if the pattern was compiled, false if it is empty.
+ */
+bool name_matcher_compile(Name_Matcher* matcher_p, const char* pattern)
+{
+  memset(matcher_p, 0, sizeof(Name_Matcher));
+  size_t length = strlen(pattern);
+  if (length == 0)
+  {
+    return false;
+  }
+
+  matcher_p->pattern = pattern;
+  matcher_p->pattern_length = length;
+  matcher_p->search = select_literal_search();
+  if (!has_wildcards(pattern, length))
+  {
+    matcher_p->kind = NAME_MATCH_SUBSTRING;
+    matcher_p->literal = pattern;
+    matcher_p->literal_length = length;
+  }
+  else if (length > 1 && pattern[length - 1] == '*' && !has_wildcards(pattern, length - 1))
+  {
+    matcher_p->kind = NAME_MATCH_PREFIX;
+    matcher_p->literal = pattern;
+    matcher_p->literal_length = length - 1;
+  }
+  else
+  {
+    matcher_p->kind = NAME_MATCH_GLOB;
+    find_longest_literal(pattern, length, &matcher_p->literal, &matcher_p->literal_length);
+  }
+  return true;
+}
+
+/**
+ * @brief Checks if a file name matches a compiled pattern.
+ * @param matcher_p [in] The matcher.
+ * @param name [in] The name, does not need to be null terminated.
+ * @param name_length [in] The length of name.
+ * @return True if the name matches, false otherwise.
+ */
+bool name_matcher_matches(Name_Matcher* matcher_p, const char* name, size_t name_length)
+{
+  switch (matcher_p->kind)
+  {
+    case NAME_MATCH_SUBSTRING:
+      return name_contains_literal(matcher_p, name, name_length);
+    case NAME_MATCH_PREFIX:
+      return name_length >= matcher_p->literal_length &&
+             memcmp(name, matcher_p->literal, matcher_p->literal_length) == 0;
+    case NAME_MATCH_GLOB:
+    default:
+      return (matcher_p->literal_length == 0 || name_contains_literal(matcher_p, name, name_length)) &&
+             glob_matches_name(matcher_p->pattern, matcher_p->pattern_length, name, name_length);
+  }
+}
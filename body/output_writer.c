@@ -0,0 +1,261 @@
+/*> Description ******************************************************************************************************/
+/**
+* @brief Defines the buffered writer. Small writes are copied into one large buffer, which is written with a single
+*        system call when full, and writes larger than the buffer are passed on directly with writev.
+* @file output_writer.c
+*/
+
+/*> Includes *********************************************************************************************************/
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "output_writer.h"
+#include "walk_stats.h"
+
+/*> Defines **********************************************************************************************************/
+#define MAX_WRITE_PARTS 8
+
+/*> Type Declarations ************************************************************************************************/
+
+/*> Global Constant Definitions **************************************************************************************/
+
+/*> Global Variable Definitions **************************************************************************************/
+
+/*> Local Constant Definitions ***************************************************************************************/
+
+/*> Local Variable Definitions ***************************************************************************************/
+/** The writer flushed when the program exits, so output buffered before an error exit is not lost. */
+static Output_Writer* exit_writer_p = NULL;
+
+/*> Local Function Declarations **************************************************************************************/
+static void write_all(Output_Writer* writer_p, struct iovec* parts, int part_count);
+
+static void flush_unlocked(Output_Writer* writer_p);
+
+static void flush_at_exit(void);
+
+/*> Local Function Definitions ***************************************************************************************/
+/**
+ * @brief Writes all parts to the file descriptor, retrying partial and interrupted writes.
+ * @param writer_p [in/out] The writer.
+ * @param parts [in/out] The parts to write, modified while written.
+ * @param part_count [in] The number of parts.
+ */
+static void write_all(Output_Writer* writer_p, struct iovec* parts, int part_count)
+{
+  while (part_count > 0 && !writer_p->failed)
+  {
+    uint64_t start_ns = walk_stats_start();
+    ssize_t written = writev(writer_p->fd, parts, part_count);
+    walk_stats_stop(WALK_STAT_WRITE, start_ns, 1);
+    if (written < 0)
+    {
+      if (errno != EINTR)
+      {
+        writer_p->failed = true;
+      }
+      continue;
+    }
+
+    while (part_count > 0 && (size_t) written >= parts[0].iov_len)
+    {
+      written -= parts[0].iov_len;
+      parts++;
+      part_count--;
+    }
+    if (part_count > 0)
+    {
+      parts[0].iov_base = (char*) parts[0].iov_base + written;
+      parts[0].iov_len -= written;
+    }
+  }
+}
+
+/**
+ * @brief Writes the buffered output, the caller holds the lock if one is used.
+ * @param writer_p [in/out] The writer.
+ */
+static void flush_unlocked(Output_Writer* writer_p)
+{
+  if (writer_p->length > 0)
+  {
+    struct iovec part = {writer_p->buffer, writer_p->length};
+    write_all(writer_p, &part, 1);
+    writer_p->length = 0;
+  }
+}
+
+/**
+ * @brief Flushes the writer registered for the exit of the program. Runs before stdio is flushed, so buffered tree
+ *        output comes before an error message printed with printf.
+ */
+static void flush_at_exit(void)
+{
+  if (exit_writer_p != NULL)
+  {
+    flush_unlocked(exit_writer_p);
+  }
+}
+
+/*> Global Function Definitions **************************************************************************************/
+/**
+ * @brief Initializes a writer. The writer is flushed if the program exits before it is freed.
+ * @param writer_p [out] The writer to initialize.
+ * @param fd [in] The file descriptor to write to.
+ * @param use_lock [in] True if several threads may write at the same time. A single writing thread can skip the
+ *                  locking.
+ */
+void output_writer_init(Output_Writer* writer_p, int fd, bool use_lock)
+{
+  writer_p->fd = fd;
+  writer_p->length = 0;
+  writer_p->use_lock = use_lock;
+  writer_p->failed = false;
+  writer_p->buffer = (char*) malloc(OUTPUT_BUFFER_SIZE);
+  if (writer_p->buffer == NULL)
+  {
+    printf("Could not allocate memory for the output.\n");
+    exit(1);
+  }
+  if (use_lock)
+  {
+    pthread_mutex_init(&writer_p->mutex, NULL);
+  }
+
+  /* Output printed with stdio before the writer was created must come first. */
+  fflush(stdout);
+
+  if (exit_writer_p == NULL)
+  {
+    static bool registered = false;
+    if (!registered)
+    {
+      atexit(flush_at_exit);
+      registered = true;
+    }
+    exit_writer_p = writer_p;
+  }
+}
+
+/**
+ * @brief Writes data through the writer.
+ * @param writer_p [in/out] The writer.
+ * @param data [in] The data to write.
+ * @param length [in] The number of bytes to write.
+ */
+void output_writer_write(Output_Writer* writer_p, const char* data, size_t length)
+{
+  struct iovec part = {(void*) data, length};
+  output_writer_write_parts(writer_p, &part, 1);
+}
+
+/**
+ * @brief Writes several pieces of data through the writer. They are kept together even if other threads write.
+ * @param writer_p [in/out] The writer.
+ * @param parts [in] The data to write, at most MAX_WRITE_PARTS parts.
+ * @param part_count [in] The number of parts.
+ */
+void output_writer_write_parts(Output_Writer* writer_p, const struct iovec* parts, int part_count)
+{
+  size_t total_length = 0;
+  for (int i = 0; i < part_count; i++)
+  {
+    total_length += parts[i].iov_len;
+  }
+
+  if (writer_p->use_lock)
+  {
+    pthread_mutex_lock(&writer_p->mutex);
+  }
+
+  if (writer_p->length + total_length > OUTPUT_BUFFER_SIZE)
+  {
+    if (total_length > OUTPUT_BUFFER_SIZE / 2 && part_count < MAX_WRITE_PARTS)
+    {
+      /* Too large to be worth copying, write the buffer and the parts with one writev. */
+      struct iovec all_parts[MAX_WRITE_PARTS];
+      all_parts[0].iov_base = writer_p->buffer;
+      all_parts[0].iov_len = writer_p->length;
+      memcpy(&all_parts[1], parts, part_count * sizeof(struct iovec));
+      write_all(writer_p, all_parts, part_count + 1);
+      writer_p->length = 0;
+      total_length = 0;
+      part_count = 0;
+    }
+    else
+    {
+      flush_unlocked(writer_p);
+    }
+  }
+
+  for (int i = 0; i < part_count; i++)
+  {
+    size_t part_length = parts[i].iov_len;
+    const char* part_data = (const char*) parts[i].iov_base;
+    while (part_length > 0)
+    {
+      size_t copy_length = OUTPUT_BUFFER_SIZE - writer_p->length;
+      if (copy_length > part_length)
+      {
+        copy_length = part_length;
+      }
+      memcpy(writer_p->buffer + writer_p->length, part_data, copy_length);
+      writer_p->length += copy_length;
+      part_data += copy_length;
+      part_length -= copy_length;
+      if (writer_p->length == OUTPUT_BUFFER_SIZE)
+      {
+        flush_unlocked(writer_p);
+      }
+    }
+  }
+
+  if (writer_p->use_lock)
+  {
+    pthread_mutex_unlock(&writer_p->mutex);
+  }
+}
+
+/**
+ * @brief Writes all buffered output to the file descriptor.
+ * @param writer_p [in/out] The writer.
+ */
+void output_writer_flush(Output_Writer* writer_p)
+{
+  if (writer_p->use_lock)
+  {
+    pthread_mutex_lock(&writer_p->mutex);
+  }
+
+  flush_unlocked(writer_p);
+
+  if (writer_p->use_lock)
+  {
+    pthread_mutex_unlock(&writer_p->mutex);
+  }
+}
+
+/**
+ * @brief Flushes and frees a writer.
+ * @param writer_p [in/out] The writer to free.
+ */
+void output_writer_free(Output_Writer* writer_p)
+{
+  output_writer_flush(writer_p);
+  if (exit_writer_p == writer_p)
+  {
+    exit_writer_p = NULL;
+  }
+  if (writer_p->use_lock)
+  {
+    pthread_mutex_destroy(&writer_p->mutex);
+  }
+  free(writer_p->buffer);
+  writer_p->buffer = NULL;
+}
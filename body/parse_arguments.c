@@ -10,8 +10,10 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "path_filter.h"
 #include "program_settings.h"
 #include "string_util.h"
+#include "work_pool.h"
 
 /*> Defines **********************************************************************************************************/
 
@@ -30,6 +32,15 @@ static void initatalize_settings(Program_Settings* settings_p);
 
 static bool check_for_help_argument(char* argument_array[], int* argument_index_p, Program_Settings* settings_p);
 
+static bool parse_sort_order(char* order_string, Sort_Order* order_p);
+
+static bool parse_output_format(char* format_string, Output_Format* format_p);
+
+static bool parse_option_argument(int argument_count, 
+                                  char* argument_array[], 
+                                  int* argument_index_p, 
+                                  Program_Settings* settings_p);
+
 static bool parse_option_arguments(int argument_count, 
                                    char* argument_array[], 
                                    int* argument_index_p, 
@@ -44,7 +55,77 @@ void initatalize_settings(Program_Settings* settings_p)
 {
   settings_p->depth = 1;
   settings_p->help = false;
-  strcpy(settings_p->path_str, "./");
+  settings_p->memory_usage = false;
+  settings_p->thread_count = 1;
+  settings_p->use_uring = false;
+  settings_p->lock_output = true;
+  settings_p->cache_path = NULL;
+  settings_p->save_path = NULL;
+  settings_p->load_path = NULL;
+  settings_p->count = false;
+  settings_p->diff = false;
+  settings_p->find_pattern = NULL;
+  settings_p->watch = false;
+  settings_p->watch_changes_only = false;
+  settings_p->follow_links = false;
+  settings_p->disk_usage = false;
+  settings_p->hash = false;
+  settings_p->summary = false;
+  settings_p->stats = false;
+  settings_p->stats_json = false;
+  settings_p->max_entries = 0;
+  settings_p->per_directory_limit = 0;
+  settings_p->time_budget_ms = 0;
+  settings_p->sort_order = SORT_NONE;
+  settings_p->output_format = OUTPUT_TEXT;
+  path_filter_init(&settings_p->filter);
+  settings_p->path_str = "./";
+  settings_p->path_strings = &settings_p->path_str;
+  settings_p->path_count = 1;
+}
+
+/**
+ * @brief Parses the value of the '--sort=' argument.
+ * @param order_string [in] The value, e.g. "name".
+ * @param order_p [out] The parsed sort order.
+ * @return True if the value is a known sort order, false otherwise.
+ */
+static bool parse_sort_order(char* order_string, Sort_Order* order_p)
+{
+  static char* ORDER_NAMES[] = {"none", "name", "natural", "size", "mtime"};
+  static const Sort_Order ORDERS[] = {SORT_NONE, SORT_NAME, SORT_NATURAL, SORT_SIZE, SORT_MODIFICATION_TIME};
+
+  for (size_t i = 0; i < sizeof(ORDERS) / sizeof(ORDERS[0]); i++)
+  {
+    if (strings_are_equal(order_string, ORDER_NAMES[i]))
+    {
+      *order_p = ORDERS[i];
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * @brief Parses the value of the '--output=' argument.
+ * @param format_string [in] The value, e.g. "json".
+ * @param format_p [out] The parsed output format.
+ * @return True if the value is a known output format, false otherwise.
+ */
+static bool parse_output_format(char* format_string, Output_Format* format_p)
+{
+  static char* FORMAT_NAMES[] = {"text", "json", "ndjson"};
+  static const Output_Format FORMATS[] = {OUTPUT_TEXT, OUTPUT_JSON, OUTPUT_NDJSON};
+
+  for (size_t i = 0; i < sizeof(FORMATS) / sizeof(FORMATS[0]); i++)
+  {
+    if (strings_are_equal(format_string, FORMAT_NAMES[i]))
+    {
+      *format_p = FORMATS[i];
+      return true;
+    }
+  }
+  return false;
 }
 
 /**
@@ -69,17 +150,17 @@ static bool check_for_help_argument(char* argument_array[], int* argument_index_
 }
 
 /**
- * @brief Parses the option arguments and sets the program settings accordingly.
+ * @brief Parses one option argument and sets the program settings accordingly.
  * @param argument_count [in] The number of arguments.
  * @param argument_array [in] The array containing the arguments.
  * @param argument_index_p [in/out] Pointer to the current argument index.
  * @param settings_p [out] Pointer to the settings structure for the execution of the program.
- * @return True if method successfully parses all option arguments, false otherwise.
+ * @return True if method successfully parses the option argument, false otherwise.
  */
-static bool parse_option_arguments(int argument_count, 
-                                   char* argument_array[], 
-                                   int* argument_index_p, 
-                                   Program_Settings* settings_p)
+static bool parse_option_argument(int argument_count, 
+                                  char* argument_array[], 
+                                  int* argument_index_p, 
+                                  Program_Settings* settings_p)
 {
   if (strings_are_equal(argument_array[*argument_index_p], "-d") ||
       strings_are_equal(argument_array[*argument_index_p], "--depth"))
@@ -97,6 +178,243 @@ static bool parse_option_arguments(int argument_count,
       return false;
     }
   }
+  else if (strings_are_equal(argument_array[*argument_index_p], "-j") ||
+           strings_are_equal(argument_array[*argument_index_p], "--jobs"))
+  {
+    (*argument_index_p)++;
+    if (*argument_index_p < argument_count && 
+        is_numeric_string(argument_array[*argument_index_p]))
+    {
+      int thread_count = atoi(argument_array[*argument_index_p]);
+      (*argument_index_p)++;
+      if (thread_count < 1 || thread_count > MAX_WORKER_COUNT)
+      {
+        return false;
+      }
+      settings_p->thread_count = thread_count;
+    }
+    else
+    {
+      return false;
+    }
+  }
+  else if (strings_are_equal(argument_array[*argument_index_p], "--max-entries") || 
+           strings_are_equal(argument_array[*argument_index_p], "--per-dir-limit") || 
+           strings_are_equal(argument_array[*argument_index_p], "--time-budget"))
+  {
+    char* option = argument_array[*argument_index_p];
+    (*argument_index_p)++;
+    if (*argument_index_p >= argument_count || !is_numeric_string(argument_array[*argument_index_p]))
+    {
+      return false;
+    }
+
+    int limit = atoi(argument_array[*argument_index_p]);
+    (*argument_index_p)++;
+    if (limit < 1)
+    {
+      return false;
+    }
+    if (strings_are_equal(option, "--max-entries"))
+    {
+      settings_p->max_entries = limit;
+    }
+    else if (strings_are_equal(option, "--per-dir-limit"))
+    {
+      settings_p->per_directory_limit = limit;
+    }
+    else
+    {
+      settings_p->time_budget_ms = limit;
+    }
+  }
+  else if (strings_are_equal(argument_array[*argument_index_p], "-m") ||
+           strings_are_equal(argument_array[*argument_index_p], "--memory-usage"))
+  {
+    (*argument_index_p)++;
+    settings_p->memory_usage = true;
+  }
+  else if (strings_are_equal(argument_array[*argument_index_p], "--uring"))
+  {
+    (*argument_index_p)++;
+    settings_p->use_uring = true;
+  }
+  else if (strings_are_equal(argument_array[*argument_index_p], "--no-lock"))
+  {
+    (*argument_index_p)++;
+    settings_p->lock_output = false;
+  }
+  else if (strings_are_equal(argument_array[*argument_index_p], "-L"))
+  {
+    (*argument_index_p)++;
+    settings_p->follow_links = true;
+  }
+  else if (strings_are_equal(argument_array[*argument_index_p], "-P"))
+  {
+    (*argument_index_p)++;
+    settings_p->follow_links = false;
+  }
+  else if (strings_are_equal(argument_array[*argument_index_p], "--du"))
+  {
+    (*argument_index_p)++;
+    settings_p->disk_usage = true;
+  }
+  else if (strings_are_equal(argument_array[*argument_index_p], "--hash"))
+  {
+    (*argument_index_p)++;
+    settings_p->hash = true;
+  }
+  else if (strings_are_equal(argument_array[*argument_index_p], "--watch"))
+  {
+    (*argument_index_p)++;
+    settings_p->watch = true;
+  }
+  else if (strings_are_equal(argument_array[*argument_index_p], "--watch=changes"))
+  {
+    (*argument_index_p)++;
+    settings_p->watch = true;
+    settings_p->watch_changes_only = true;
+  }
+  else if (strings_are_equal(argument_array[*argument_index_p], "--summary"))
+  {
+    (*argument_index_p)++;
+    settings_p->summary = true;
+  }
+  else if (strings_are_equal(argument_array[*argument_index_p], "--stats"))
+  {
+    (*argument_index_p)++;
+    settings_p->stats = true;
+  }
+  else if (strings_are_equal(argument_array[*argument_index_p], "--stats=json"))
+  {
+    (*argument_index_p)++;
+    settings_p->stats = true;
+    settings_p->stats_json = true;
+  }
+  else if (strings_are_equal(argument_array[*argument_index_p], "-I") || 
+           strings_are_equal(argument_array[*argument_index_p], "--exclude") ||
+           strings_are_equal(argument_array[*argument_index_p], "--include"))
+  {
+    bool is_include = strings_are_equal(argument_array[*argument_index_p], "--include");
+    (*argument_index_p)++;
+    if (*argument_index_p >= argument_count)
+    {
+      return false;
+    }
+
+    char* patterns = argument_array[*argument_index_p];
+    bool added_pattern = is_include ? path_filter_add_includes(&settings_p->filter, patterns) : 
+                                      path_filter_add_excludes(&settings_p->filter, patterns);
+    if (!added_pattern)
+    {
+      return false;
+    }
+    (*argument_index_p)++;
+  }
+  else if (strncmp(argument_array[*argument_index_p], "--sort=", strlen("--sort=")) == 0)
+  {
+    if (!parse_sort_order(argument_array[*argument_index_p] + strlen("--sort="), &settings_p->sort_order))
+    {
+      return false;
+    }
+    (*argument_index_p)++;
+  }
+  else if (strncmp(argument_array[*argument_index_p], "--output=", strlen("--output=")) == 0)
+  {
+    if (!parse_output_format(argument_array[*argument_index_p] + strlen("--output="), &settings_p->output_format))
+    {
+      return false;
+    }
+    (*argument_index_p)++;
+  }
+  else if (strings_are_equal(argument_array[*argument_index_p], "--gitignore"))
+  {
+    (*argument_index_p)++;
+    settings_p->filter.use_gitignore = true;
+  }
+  else if (strings_are_equal(argument_array[*argument_index_p], "--cache"))
+  {
+    (*argument_index_p)++;
+    if (*argument_index_p < argument_count)
+    {
+      settings_p->cache_path = argument_array[*argument_index_p];
+      (*argument_index_p)++;
+    }
+    else
+    {
+      return false;
+    }
+  }
+  else if (strings_are_equal(argument_array[*argument_index_p], "--save") || 
+           strings_are_equal(argument_array[*argument_index_p], "--load"))
+  {
+    bool is_load = strings_are_equal(argument_array[*argument_index_p], "--load");
+    (*argument_index_p)++;
+    if (*argument_index_p >= argument_count)
+    {
+      return false;
+    }
+
+    if (is_load)
+    {
+      settings_p->load_path = argument_array[*argument_index_p];
+    }
+    else
+    {
+      settings_p->save_path = argument_array[*argument_index_p];
+    }
+    (*argument_index_p)++;
+  }
+  else if (strings_are_equal(argument_array[*argument_index_p], "--diff"))
+  {
+    (*argument_index_p)++;
+    settings_p->diff = true;
+  }
+  else if (strings_are_equal(argument_array[*argument_index_p], "--find"))
+  {
+    (*argument_index_p)++;
+    if (*argument_index_p >= argument_count || argument_array[*argument_index_p][0] == '\0')
+    {
+      return false;
+    }
+    settings_p->find_pattern = argument_array[*argument_index_p];
+    (*argument_index_p)++;
+  }
+  else if (strings_are_equal(argument_array[*argument_index_p], "--count"))
+  {
+    (*argument_index_p)++;
+    settings_p->count = true;
+  }
+  else
+  {
+    /* Unknown option */
+    return false;
+  }
+
+  return true;
+}
+
+/**
+ * @brief Parses the option arguments and sets the program settings accordingly.
+ * @param argument_count [in] The number of arguments.
+ * @param argument_array [in] The array containing the arguments.
+ * @param argument_index_p [in/out] Pointer to the current argument index.
+ * @param settings_p [out] Pointer to the settings structure for the execution of the program.
+ * @return True if method successfully parses all option arguments, false otherwise.
+ */
+static bool parse_option_arguments(int argument_count, 
+                                   char* argument_array[], 
+                                   int* argument_index_p, 
+                                   Program_Settings* settings_p)
+{
+  /* Options all start with '-', the first argument that does not is the path. */
+  while (*argument_index_p < argument_count && argument_array[*argument_index_p][0] == '-')
+  {
+    if (!parse_option_argument(argument_count, argument_array, argument_index_p, settings_p))
+    {
+      return false;
+    }
+  }
 
   return true;
 }
@@ -149,21 +467,12 @@ bool parse_arguments(int argument_count, char* argument_array[], Program_Setting
     return true;
   }
 
-  /* check for path argument */
+  /* check for path arguments, every argument after the options is a path */
   if (argument_index < argument_count)
   {
-    stpcpy(settings_p->path_str, argument_array[argument_index]);
-    argument_index++;
-  }
-  else
-  {
-    return true;
-  }
-
-  if (argument_index < argument_count) 
-  {
-    /* More arguments than expected return false */
-    return false;
+    settings_p->path_strings = &argument_array[argument_index];
+    settings_p->path_count = argument_count - argument_index;
+    settings_p->path_str = settings_p->path_strings[0];
   }
 
   return true;
@@ -0,0 +1,671 @@
+/*> Description ******************************************************************************************************/
+/**
+* @brief Defines the glob patterns deciding which files are left out of a tree.
+* @file path_filter.c
+*/
+
+/*> Includes *********************************************************************************************************/
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "arena.h"
+#include "path_filter.h"
+
+/*> Defines **********************************************************************************************************/
+#define INITIAL_PATTERN_CAPACITY 8
+#define PATTERN_SEPARATOR '|'
+
+/*> Type Declarations ************************************************************************************************/
+
+/*> Global Constant Definitions **************************************************************************************/
+
+/*> Global Variable Definitions **************************************************************************************/
+
+/*> Local Constant Definitions ***************************************************************************************/
+
+/*> Local Variable Definitions ***************************************************************************************/
+
+/*> Local Function Declarations **************************************************************************************/
+static bool has_wildcards(const char* text, size_t length);
+
+static bool compile_pattern(const char* text, size_t length, bool allow_negation, Path_Pattern* pattern_p);
+
+static void add_pattern(Path_Pattern_List* list_p, Path_Pattern* pattern_p);
+
+static bool add_patterns(Path_Pattern_List* list_p, const char* patterns);
+
+static bool match_class(const char** pattern_p, const char* pattern_end, char c, bool* is_valid_p);
+
+static bool glob_match(const char* pattern_start,
+                       const char* pattern,
+                       const char* pattern_end,
+                       const char* text,
+                       const char* text_end,
+                       bool is_path);
+
+static bool pattern_matches(Path_Pattern* pattern_p,
+                            const char* relative_path,
+                            size_t relative_length,
+                            const char* name,
+                            size_t name_length,
+                            bool is_directory);
+
+static bool any_pattern_matches(Path_Pattern_List* list_p,
+                                const char* relative_path,
+                                size_t relative_length,
+                                const char* name,
+                                size_t name_length,
+                                bool is_directory);
+
+/*> Local Function Definitions ***************************************************************************************/
+/**
+ * @brief Checks if a pattern has characters with a special meaning.
+ * @param text [in] The pattern.
+ * @param length [in] The length of the pattern.
+ * @return True if the pattern has a wildcard, a character class or an escape, false otherwise.
+ */
+static bool has_wildcards(const char* text, size_t length)
+{
+  for (size_t i = 0; i < length; i++)
+  {
+    if (text[i] == '*' || text[i] == '?' || text[i] == '[' || text[i] == '\\')
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * @brief Compiles one pattern, with the syntax of a line of a .gitignore file.
+ * @param text [in] The pattern, it must live as long as the compiled pattern.
+ * @param length [in] The length of the pattern.
+ * @param allow_negation [in] True if a leading '!' negates the pattern.
+ * @param pattern_p [out] The compiled pattern.
+ * @return True if the text is a pattern, false if it is empty or a comment.
+ */
+static bool compile_pattern(const char* text, size_t length, bool allow_negation, Path_Pattern* pattern_p)
+{
+  /* Trailing spaces are ignored unless they are escaped. */
+  while (length > 0 && (text[length - 1] == '\r' || text[length - 1] == ' ') &&
+         !(length > 1 && text[length - 2] == '\\'))
+  {
+    length--;
+  }
+  if (length == 0 || text[0] == '#')
+  {
+    return false;
+  }
+
+  memset(pattern_p, 0, sizeof(Path_Pattern));
+  if (allow_negation && text[0] == '!')
+  {
+    pattern_p->is_negated = true;
+    text++;
+    length--;
+  }
+  else if (length > 1 && text[0] == '\\' && (text[1] == '!' || text[1] == '#'))
+  {
+    text++;
+    length--;
+  }
+
+  if (length > 0 && text[length - 1] == '/')
+  {
+    pattern_p->is_directory_only = true;
+    length--;
+  }
+  if (memchr(text, '/', length) != NULL)
+  {
+    pattern_p->is_anchored = true;
+  }
+  if (length > 0 && text[0] == '/')
+  {
+    text++;
+    length--;
+  }
+  if (length == 0)
+  {
+    return false;
+  }
+
+  /* Most patterns are a name or an extension, which are compared without the glob matcher. Wildcards of anchored
+     patterns do not match '/', so only unanchored patterns take the shortcuts. */
+  pattern_p->text = text;
+  pattern_p->length = length;
+  pattern_p->kind = PATTERN_GLOB;
+  if (!has_wildcards(text, length))
+  {
+    pattern_p->kind = PATTERN_LITERAL;
+  }
+  else if (!pattern_p->is_anchored && text[0] == '*' && !has_wildcards(text + 1, length - 1))
+  {
+    pattern_p->kind = PATTERN_SUFFIX;
+    pattern_p->text = text + 1;
+    pattern_p->length = length - 1;
+  }
+  else if (!pattern_p->is_anchored && text[length - 1] == '*' && !has_wildcards(text, length - 1))
+  {
+    pattern_p->kind = PATTERN_PREFIX;
+    pattern_p->length = length - 1;
+  }
+  return true;
+}
+
+/**
+ * @brief Appends a compiled pattern to a list.
+ * @param list_p [in/out] The list.
+ * @param pattern_p [in] The pattern.
+ */
+static void add_pattern(Path_Pattern_List* list_p, Path_Pattern* pattern_p)
+{
+  if (list_p->count == list_p->capacity)
+  {
+    list_p->capacity = list_p->capacity == 0 ? INITIAL_PATTERN_CAPACITY : 2 * list_p->capacity;
+    list_p->patterns = (Path_Pattern*) realloc(list_p->patterns, list_p->capacity * sizeof(Path_Pattern));
+    if (list_p->patterns == NULL)
+    {
+      printf("Could not allocate memory for the patterns.\n");
+      exit(1);
+    }
+  }
+  list_p->patterns[list_p->count] = *pattern_p;
+  list_p->count++;
+}
+
+/**
+ * @brief Compiles patterns given on the command line and appends them to a list.
+ * @param list_p [in/out] The list.
+ * @param patterns [in] The patterns separated by '|', e.g. "node_modules|*.o". Must live as long as the list.
+ * @return True if at least one pattern was added, false otherwise.
+ */
+static bool add_patterns(Path_Pattern_List* list_p, const char* patterns)
+{
+  int initial_count = list_p->count;
+  const char* start = patterns;
+  while (true)
+  {
+    const char* end = strchr(start, PATTERN_SEPARATOR);
+    size_t length = end == NULL ? strlen(start) : (size_t) (end - start);
+
+    Path_Pattern pattern;
+    if (compile_pattern(start, length, false, &pattern))
+    {
+      add_pattern(list_p, &pattern);
+    }
+
+    if (end == NULL)
+    {
+      break;
+    }
+    start = end + 1;
+  }
+  return list_p->count > initial_count;
+}
+
+/**
+ * @brief Matches a character against a character class, e.g. "[a-z]" or "[!0-9]".
+ * @param pattern_p [in/out] Points to the '[' of the class, and after the class on return.
+ * @param pattern_end [in] The end of the pattern.
+ * @param c [in] The character to match.
+ * @param is_valid_p [out] False if the class is not closed, so the '[' is an ordinary character.
+ * @return True if the character is in the class, false otherwise.
+ */
+static bool match_class(const char** pattern_p, const char* pattern_end, char c, bool* is_valid_p)
+{
+  const char* pattern = *pattern_p + 1;
+  bool is_negated = pattern < pattern_end && (*pattern == '!' || *pattern == '^');
+  if (is_negated)
+  {
+    pattern++;
+  }
+
+  bool is_match = false;
+  bool is_first = true;
+  while (pattern < pattern_end && (*pattern != ']' || is_first))
+  {
+    char low = *pattern;
+    if (low == '\\' && pattern + 1 < pattern_end)
+    {
+      pattern++;
+      low = *pattern;
+    }
+    char high = low;
+    if (pattern + 2 < pattern_end && pattern[1] == '-' && pattern[2] != ']')
+    {
+      pattern += 2;
+      high = *pattern;
+      if (high == '\\' && pattern + 1 < pattern_end)
+      {
+        pattern++;
+        high = *pattern;
+      }
+    }
+    if (low <= c && c <= high)
+    {
+      is_match = true;
+    }
+    pattern++;
+    is_first = false;
+  }
+
+  *is_valid_p = pattern < pattern_end;
+  if (*is_valid_p)
+  {
+    *pattern_p = pattern + 1;
+  }
+  return is_match != is_negated;
+}
+
+/**
+ * @brief Matches a text against a glob pattern with '*', '?', character classes and escapes. If the text is a path,
+ *        wildcards do not match '/', and "**" between slashes matches any number of directories.
+ * @param pattern_start [in] The start of the whole pattern, to know if "**" starts a path component.
+ * @param pattern [in] The rest of the pattern to match.
+ * @param pattern_end [in] The end of the pattern.
+ * @param text [in] The rest of the text to match.
+ * @param text_end [in] The end of the text.
+ * @param is_path [in] True if the text is a path.
+ * @return True if the whole text matches the rest of the pattern, false otherwise.
+ */
+static bool glob_match(const char* pattern_start,
+                       const char* pattern,
+                       const char* pattern_end,
+                       const char* text,
+                       const char* text_end,
+                       bool is_path)
+{
+  while (pattern < pattern_end)
+  {
+    char c = *pattern;
+    if (c == '*')
+    {
+      bool is_double_star = is_path &&
+                            pattern + 1 < pattern_end && pattern[1] == '*' &&
+                            (pattern == pattern_start || pattern[-1] == '/') &&
+                            (pattern + 2 == pattern_end || pattern[2] == '/');
+      if (is_double_star)
+      {
+        if (pattern + 2 == pattern_end)
+        {
+          return true;
+        }
+
+        /* "**" followed by '/' matches no directory, or everything up to any '/' of the text. */
+        const char* rest = text;
+        while (true)
+        {
+          if (glob_match(pattern_start, pattern + 3, pattern_end, rest, text_end, is_path))
+          {
+            return true;
+          }
+          rest = (const char*) memchr(rest, '/', text_end - rest);
+          if (rest == NULL)
+          {
+            return false;
+          }
+          rest++;
+        }
+      }
+
+      while (pattern < pattern_end && *pattern == '*')
+      {
+        pattern++;
+      }
+      if (pattern == pattern_end)
+      {
+        return !is_path || memchr(text, '/', text_end - text) == NULL;
+      }
+      for (const char* rest = text; rest <= text_end; rest++)
+      {
+        if (glob_match(pattern_start, pattern, pattern_end, rest, text_end, is_path))
+        {
+          return true;
+        }
+        if (rest < text_end && is_path && *rest == '/')
+        {
+          return false;
+        }
+      }
+      return false;
+    }
+
+    if (text == text_end)
+    {
+      return false;
+    }
+
+    if (c == '?')
+    {
+      if (is_path && *text == '/')
+      {
+        return false;
+      }
+      pattern++;
+    }
+    else if (c == '[')
+    {
+      const char* class_end = pattern;
+      bool is_valid = false;
+      bool is_match = match_class(&class_end, pattern_end, *text, &is_valid);
+      if (is_valid)
+      {
+        if (!is_match || (is_path && *text == '/'))
+        {
+          return false;
+        }
+        pattern = class_end;
+      }
+      else
+      {
+        if (*text != '[')
+        {
+          return false;
+        }
+        pattern++;
+      }
+    }
+    else
+    {
+      if (c == '\\' && pattern + 1 < pattern_end)
+      {
+        pattern++;
+        c = *pattern;
+      }
+      if (*text != c)
+      {
+        return false;
+      }
+      pattern++;
+    }
+    text++;
+  }
+  return text == text_end;
+}
+
+/**
+ * @brief Matches a file against a compiled pattern.
+ * @param pattern_p [in] The pattern.
+ * @param relative_path [in] The path of the file relative to the directory the pattern was given for.
+ * @param relative_length [in] The length of relative_path.
+ * @param name [in] The name of the file.
+ * @param name_length [in] The length of name.
+ * @param is_directory [in] True if the file is a directory.
+ * @return True if the pattern matches the file, false otherwise.
+ */
+static bool pattern_matches(Path_Pattern* pattern_p,
+                            const char* relative_path,
+                            size_t relative_length,
+                            const char* name,
+                            size_t name_length,
+                            bool is_directory)
+{
+  if (pattern_p->is_directory_only && !is_directory)
+  {
+    return false;
+  }
+
+  const char* text = pattern_p->is_anchored ? relative_path : name;
+  size_t length = pattern_p->is_anchored ? relative_length : name_length;
+  switch (pattern_p->kind)
+  {
+    case PATTERN_LITERAL:
+      return length == pattern_p->length && memcmp(text, pattern_p->text, length) == 0;
+    case PATTERN_SUFFIX:
+      return length >= pattern_p->length &&
+             memcmp(text + length - pattern_p->length, pattern_p->text, pattern_p->length) == 0;
+    case PATTERN_PREFIX:
+      return length >= pattern_p->length && memcmp(text, pattern_p->text, pattern_p->length) == 0;
+    default:
+      return glob_match(pattern_p->text,
+                        pattern_p->text,
+                        pattern_p->text + pattern_p->length,
+                        text,
+                        text + length,
+                        pattern_p->is_anchored);
+  }
+}
+
+/**
+ * @brief Matches a file against a list of patterns, ignoring negations.
+ * @param list_p [in] The patterns.
+ * @param relative_path [in] The path of the file relative to the base of the tree.
+ * @param relative_length [in] The length of relative_path.
+ * @param name [in] The name of the file.
+ * @param name_length [in] The length of name.
+ * @param is_directory [in] True if the file is a directory.
+ * @return True if one of the patterns matches the file, false otherwise.
+ */
+static bool any_pattern_matches(Path_Pattern_List* list_p,
+                                const char* relative_path,
+                                size_t relative_length,
+                                const char* name,
+                                size_t name_length,
+                                bool is_directory)
+{
+  for (int i = 0; i < list_p->count; i++)
+  {
+    if (pattern_matches(&list_p->patterns[i], relative_path, relative_length, name, name_length, is_directory))
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+/*> Global Function Definitions **************************************************************************************/
+/**
+ * @brief Initializes a filter that keeps every file.
+ * @param filter_p [out] The filter.
+ */
+void path_filter_init(Path_Filter* filter_p)
+{
+  memset(filter_p, 0, sizeof(Path_Filter));
+}
+
+/**
+ * @brief Adds patterns of files and directories to leave out.
+ * @param filter_p [in/out] The filter.
+ * @param patterns [in] The patterns separated by '|'. Must live as long as the filter.
+ * @return True if a pattern was added, false if there was none.
+ */
+bool path_filter_add_excludes(Path_Filter* filter_p, const char* patterns)
+{
+  return add_patterns(&filter_p->excludes, patterns);
+}
+
+/**
+ * @brief Adds patterns of files to keep. Once there is one, files matching none of them are left out.
+ * @param filter_p [in/out] The filter.
+ * @param patterns [in] The patterns separated by '|'. Must live as long as the filter.
+ * @return True if a pattern was added, false if there was none.
+ */
+bool path_filter_add_includes(Path_Filter* filter_p, const char* patterns)
+{
+  return add_patterns(&filter_p->includes, patterns);
+}
+
+/**
+ * @brief Checks if a filter can leave out any file.
+ * @param filter_p [in] The filter.
+ * @return True if the filter has patterns or honors .gitignore files, false otherwise.
+ */
+bool path_filter_is_active(Path_Filter* filter_p)
+{
+  return filter_p->excludes.count > 0 || filter_p->includes.count > 0 || filter_p->use_gitignore;
+}
+
+/**
+ * @brief Matches a file name against a glob pattern with '*', '?', character classes and escapes, like the patterns
+ *        of a filter that are not anchored.
+ * @param pattern [in] The pattern, does not need to be null terminated.
+ * @param pattern_length [in] The length of pattern.
+ * @param name [in] The name, does not need to be null terminated.
+ * @param name_length [in] The length of name.
+ * @return True if the whole name matches the pattern, false otherwise.
+ */
+bool glob_matches_name(const char* pattern, size_t pattern_length, const char* name, size_t name_length)
+{
+  return glob_match(pattern, pattern, pattern + pattern_length, name, name + name_length, false);
+}
+
+/**
+ * @brief Checks if a file is left out of the tree. Excludes from the command line are checked first, then the
+ *        .gitignore files from the directory of the file up to the base, where the last matching pattern of the
+ *        nearest file decides.
+ * @param filter_p [in] The filter.
+ * @param scope_p [in] The scope of the directory of the file, at least the scope of the base.
+ * @param path [in] The path of the file, a directory may end with '/'.
+ * @param name_offset [in] The offset of the name of the file in path.
+ * @param path_length [in] The length of path.
+ * @param is_directory [in] True if the file is a directory.
+ * @return True if the file is left out, false if it is kept.
+ */
+bool path_filter_excludes(Path_Filter* filter_p,
+                          Ignore_Scope* scope_p,
+                          const char* path,
+                          size_t name_offset,
+                          size_t path_length,
+                          bool is_directory)
+{
+  if (is_directory && path_length > name_offset + 1 && path[path_length - 1] == '/')
+  {
+    path_length--;
+  }
+  const char* name = path + name_offset;
+  size_t name_length = path_length - name_offset;
+
+  Ignore_Scope* base_scope_p = scope_p;
+  while (base_scope_p->parent_p != NULL)
+  {
+    base_scope_p = base_scope_p->parent_p;
+  }
+  const char* relative_path = path + base_scope_p->base_length;
+  size_t relative_length = path_length - base_scope_p->base_length;
+
+  if (any_pattern_matches(&filter_p->excludes, relative_path, relative_length, name, name_length, is_directory))
+  {
+    return true;
+  }
+  if (filter_p->includes.count > 0 &&
+      !is_directory &&
+      !any_pattern_matches(&filter_p->includes, relative_path, relative_length, name, name_length, false))
+  {
+    return true;
+  }
+
+  for (Ignore_Scope* current_p = scope_p; current_p != NULL; current_p = current_p->parent_p)
+  {
+    relative_path = path + current_p->base_length;
+    relative_length = path_length - current_p->base_length;
+    for (int i = current_p->rules.count - 1; i >= 0; i--)
+    {
+      Path_Pattern* pattern_p = &current_p->rules.patterns[i];
+      if (pattern_matches(pattern_p, relative_path, relative_length, name, name_length, is_directory))
+      {
+        return !pattern_p->is_negated;
+      }
+    }
+  }
+  return false;
+}
+
+/**
+ * @brief Initializes the scope of the base of a tree, without patterns.
+ * @param scope_p [out] The scope.
+ * @param base_length [in] The length of the path of the base, including its trailing '/'.
+ */
+void ignore_scope_init_base(Ignore_Scope* scope_p, size_t base_length)
+{
+  memset(scope_p, 0, sizeof(Ignore_Scope));
+  scope_p->base_length = base_length;
+}
+
+/**
+ * @brief Reads the .gitignore file of a directory into a new scope.
+ * @param arena_p [in/out] The arena of the tree, the scope and its patterns are allocated from it.
+ * @param parent_p [in] The scope of the parent directory.
+ * @param directory_fd [in] The open directory.
+ * @param base_length [in] The length of the path of the directory, including its trailing '/'.
+ * @return The new scope, or parent_p if the directory has no .gitignore file with patterns.
+ */
+Ignore_Scope* ignore_scope_load(Arena* arena_p, Ignore_Scope* parent_p, int directory_fd, size_t base_length)
+{
+  int fd = openat(directory_fd, GITIGNORE_FILE_NAME, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+  {
+    return parent_p;
+  }
+
+  struct stat file_info = {0};
+  if (fstat(fd, &file_info) != 0 || !S_ISREG(file_info.st_mode))
+  {
+    close(fd);
+    return parent_p;
+  }
+
+  /* The patterns point into the contents, so they stay in the arena with the tree. */
+  size_t size = (size_t) file_info.st_size;
+  char* contents = arena_allocate_string(arena_p, size);
+  size_t length = 0;
+  while (length < size)
+  {
+    ssize_t read_count = read(fd, contents + length, size - length);
+    if (read_count <= 0)
+    {
+      break;
+    }
+    length += (size_t) read_count;
+  }
+  close(fd);
+
+  Path_Pattern_List rules = {0};
+  const char* line = contents;
+  const char* contents_end = contents + length;
+  while (line < contents_end)
+  {
+    const char* line_end = (const char*) memchr(line, '\n', contents_end - line);
+    if (line_end == NULL)
+    {
+      line_end = contents_end;
+    }
+
+    Path_Pattern pattern;
+    if (compile_pattern(line, line_end - line, true, &pattern))
+    {
+      add_pattern(&rules, &pattern);
+    }
+    line = line_end + 1;
+  }
+
+  if (rules.count == 0)
+  {
+    return parent_p;
+  }
+
+  Ignore_Scope* scope_p = (Ignore_Scope*) arena_allocate(arena_p, sizeof(Ignore_Scope));
+  scope_p->parent_p = parent_p;
+  scope_p->base_length = base_length;
+  scope_p->rules.count = rules.count;
+  scope_p->rules.capacity = rules.count;
+  scope_p->rules.patterns = (Path_Pattern*) arena_allocate(arena_p, rules.count * sizeof(Path_Pattern));
+  memcpy(scope_p->rules.patterns, rules.patterns, rules.count * sizeof(Path_Pattern));
+  free(rules.patterns);
+  return scope_p;
+}
+
+/**
+ * @brief Frees the patterns of a filter.
+ * @param filter_p [in/out] The filter.
+ */
+void path_filter_free(Path_Filter* filter_p)
+{
+  free(filter_p->excludes.patterns);
+  free(filter_p->includes.patterns);
+  path_filter_init(filter_p);
+}
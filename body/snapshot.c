@@ -0,0 +1,561 @@
+/*> Description ******************************************************************************************************/
+/**
+* @brief Defines saving a Directory_Tree to a binary snapshot file and loading it back.
+* @file snapshot.c
+*/
+
+/*> Includes *********************************************************************************************************/
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "directory_tree.h"
+#include "snapshot.h"
+#include "string_util.h"
+
+/*> Defines **********************************************************************************************************/
+#define INITIAL_SNAPSHOT_NODE_CAPACITY 1024
+#define NANOSECONDS_PER_SECOND 1000000000LL
+
+/*> Type Declarations ************************************************************************************************/
+/**
+ * @brief State used while converting a tree to snapshot nodes.
+ * @param queue The tree nodes in breadth first order, the same order as nodes.
+ * @param nodes The snapshot nodes.
+ * @param count The number of nodes in queue and nodes.
+ * @param capacity The number of nodes queue and nodes have room for.
+ * @param strings The string blob.
+ * @param path The path of the directory whose files are looked up.
+ */
+typedef struct Snapshot_Writer
+{
+  Directory_Tree** queue;
+  Snapshot_Node* nodes;
+  size_t count;
+  size_t capacity;
+  String_Buffer strings;
+  String_Buffer path;
+} Snapshot_Writer;
+
+/*> Global Constant Definitions **************************************************************************************/
+
+/*> Global Variable Definitions **************************************************************************************/
+
+/*> Local Constant Definitions ***************************************************************************************/
+
+/*> Local Variable Definitions ***************************************************************************************/
+
+/*> Local Function Declarations **************************************************************************************/
+static size_t add_snapshot_node(Snapshot_Writer* writer_p, Directory_Tree* dir_tree, uint32_t parent_index);
+
+static bool write_snapshot_file(Snapshot_Writer* writer_p, char* file_path);
+
+static void set_node_size(Snapshot_Node* node_p, struct stat* file_info_p);
+
+static void add_snapshot_sizes(Snapshot_Writer* writer_p, size_t parent_index);
+
+static void count_snapshot_descendants(Snapshot_Writer* writer_p);
+
+static bool is_valid_node_name(Snapshot* snapshot_p, Snapshot_Node* node_p);
+
+static bool is_valid_snapshot(Snapshot* snapshot_p);
+
+static uint32_t find_snapshot_child(Snapshot* snapshot_p, uint32_t parent_index, const char* name, size_t length);
+
+/*> Local Function Definitions ***************************************************************************************/
+/**
+ * @brief Appends a tree node to the breadth first queue, creating its snapshot node with the name filled in.
+ * @param writer_p [in/out] The state of the conversion.
+ * @param dir_tree [in] The tree node.
+ * @param parent_index [in] The index of the parent snapshot node, SNAPSHOT_NO_INDEX for the base.
+ * @return The index of the new snapshot node.
+ */
+static size_t add_snapshot_node(Snapshot_Writer* writer_p, Directory_Tree* dir_tree, uint32_t parent_index)
+{
+  if (writer_p->count == writer_p->capacity)
+  {
+    writer_p->capacity *= 2;
+    writer_p->queue = (Directory_Tree**) realloc(writer_p->queue, writer_p->capacity * sizeof(Directory_Tree*));
+    writer_p->nodes = (Snapshot_Node*) realloc(writer_p->nodes, writer_p->capacity * sizeof(Snapshot_Node));
+    if (writer_p->queue == NULL || writer_p->nodes == NULL)
+    {
+      printf("Could not allocate memory for the snapshot.\n");
+      exit(1);
+    }
+  }
+
+  size_t index = writer_p->count;
+  writer_p->queue[index] = dir_tree;
+  writer_p->count++;
+
+  Snapshot_Node* node_p = &writer_p->nodes[index];
+  memset(node_p, 0, sizeof(Snapshot_Node));
+
+  /* The base keeps its whole path, other directories are stored without their trailing '/', like in the tree. */
+  size_t name_length = dir_tree->file_name_length;
+  node_p->name_offset = writer_p->strings.length;
+  node_p->name_length = (uint32_t) name_length;
+  string_buffer_append(&writer_p->strings, dir_tree->file_name, name_length);
+  string_buffer_append(&writer_p->strings, "", 1);
+
+  node_p->flags = dir_tree->is_directory ? SNAPSHOT_DIRECTORY : 0;
+  if (!dir_tree->is_directory && dir_tree->usage_p != NULL)
+  {
+    node_p->flags |= SNAPSHOT_HAS_SIZE;
+    node_p->size = dir_tree->usage_p->apparent_size;
+    node_p->modification_time_ns = dir_tree->usage_p->modification_time_ns;
+  }
+  if (dir_tree->is_reference)
+  {
+    node_p->flags |= SNAPSHOT_REFERENCE;
+  }
+  if (dir_tree->stamp_p != NULL)
+  {
+    node_p->flags |= SNAPSHOT_CHILDREN_READ;
+    node_p->stamp = *dir_tree->stamp_p;
+  }
+  node_p->parent = parent_index;
+  node_p->first_child = SNAPSHOT_NO_INDEX;
+  node_p->next_sibling = SNAPSHOT_NO_INDEX;
+  node_p->depth = dir_tree->depth;
+
+  return index;
+}
+
+/**
+ * @brief Records the size and modification time of a file in its snapshot node.
+ * @param node_p [in/out] The snapshot node of the file.
+ * @param file_info_p [in] The status of the file.
+ */
+static void set_node_size(Snapshot_Node* node_p, struct stat* file_info_p)
+{
+  node_p->flags |= SNAPSHOT_HAS_SIZE;
+  node_p->size = (uint64_t) file_info_p->st_size;
+  node_p->modification_time_ns = file_info_p->st_mtim.tv_sec * NANOSECONDS_PER_SECOND + file_info_p->st_mtim.tv_nsec;
+}
+
+/**
+ * @brief Looks up the size and modification time of the files of a directory that have no recorded usage. The
+ *        directory is opened once and its files are looked up relative to it, without following links. Files of a
+ *        directory that cannot be opened are left without a size.
+ * @param writer_p [in/out] The state of the conversion, the children of the directory are added.
+ * @param parent_index [in] The index of the snapshot node of the directory.
+ */
+static void add_snapshot_sizes(Snapshot_Writer* writer_p, size_t parent_index)
+{
+  Snapshot_Node* parent_p = &writer_p->nodes[parent_index];
+  int fd = -1;
+  for (uint32_t i = 0; i < parent_p->children_count; i++)
+  {
+    size_t child_index = parent_p->first_child + i;
+    if ((writer_p->nodes[child_index].flags & (SNAPSHOT_DIRECTORY | SNAPSHOT_HAS_SIZE)) != 0)
+    {
+      continue;
+    }
+
+    if (fd < 0)
+    {
+      string_buffer_truncate(&writer_p->path, 0);
+      append_directory_tree_path(writer_p->queue[parent_index], &writer_p->path);
+      fd = open(writer_p->path.string, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+      if (fd < 0)
+      {
+        return;
+      }
+    }
+
+    struct stat file_info = {0};
+    if (fstatat(fd, writer_p->queue[child_index]->file_name, &file_info, AT_SYMLINK_NOFOLLOW) == 0)
+    {
+      set_node_size(&writer_p->nodes[child_index], &file_info);
+    }
+  }
+
+  if (fd >= 0)
+  {
+    close(fd);
+  }
+}
+
+/**
+ * @brief Counts the nodes and directories below every snapshot node. Children are stored after their parent, so going
+ *        through the nodes backwards counts every child before it is added to its parent.
+ * @param writer_p [in/out] The converted snapshot.
+ */
+static void count_snapshot_descendants(Snapshot_Writer* writer_p)
+{
+  for (size_t i = writer_p->count - 1; i > 0; i--)
+  {
+    Snapshot_Node* node_p = &writer_p->nodes[i];
+    Snapshot_Node* parent_p = &writer_p->nodes[node_p->parent];
+    parent_p->descendant_count += 1 + node_p->descendant_count;
+    parent_p->directory_descendant_count += node_p->directory_descendant_count;
+    if ((node_p->flags & SNAPSHOT_DIRECTORY) != 0)
+    {
+      parent_p->directory_descendant_count++;
+    }
+  }
+}
+
+/**
+ * @brief Writes the converted snapshot to a temporary file and renames it over the file, so a reader never sees a
+ *        partly written snapshot.
+ * @param writer_p [in] The converted snapshot.
+ * @param file_path [in] The path of the snapshot file.
+ * @return True if the snapshot was written, false otherwise.
+ */
+static bool write_snapshot_file(Snapshot_Writer* writer_p, char* file_path)
+{
+  String_Buffer temporary_path;
+  string_buffer_init(&temporary_path);
+  string_buffer_append(&temporary_path, file_path, strlen(file_path));
+  string_buffer_append(&temporary_path, ".tmp", 4);
+
+  Snapshot_Header header = {0};
+  memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+  header.version = SNAPSHOT_VERSION;
+  header.node_size = sizeof(Snapshot_Node);
+  header.node_count = writer_p->count;
+  header.strings_size = writer_p->strings.length;
+
+  bool written = false;
+  FILE* file_p = fopen(temporary_path.string, "wb");
+  if (file_p != NULL)
+  {
+    written = fwrite(&header, sizeof(header), 1, file_p) == 1 &&
+              fwrite(writer_p->nodes, sizeof(Snapshot_Node), writer_p->count, file_p) == writer_p->count &&
+              fwrite(writer_p->strings.string, 1, writer_p->strings.length, file_p) == writer_p->strings.length;
+    written = fclose(file_p) == 0 && written;
+    written = written && rename(temporary_path.string, file_path) == 0;
+    if (!written)
+    {
+      unlink(temporary_path.string);
+    }
+  }
+
+  string_buffer_free(&temporary_path);
+  return written;
+}
+
+/**
+ * @brief Checks that the name of a snapshot node is inside the string blob and null terminated.
+ * @param snapshot_p [in] The snapshot.
+ * @param node_p [in] The node.
+ * @return True if the name can be used, false otherwise.
+ */
+static bool is_valid_node_name(Snapshot* snapshot_p, Snapshot_Node* node_p)
+{
+  uint64_t strings_size = snapshot_p->header_p->strings_size;
+  return node_p->name_offset < strings_size && 
+         node_p->name_length < strings_size - node_p->name_offset && 
+         snapshot_p->strings[node_p->name_offset + node_p->name_length] == '\0';
+}
+
+/**
+ * @brief Checks that a loaded snapshot is complete: the header, the sizes of the nodes and the string blob, and the
+ *        base. The other nodes are only checked when their parent's children are walked, see
+ *        snapshot_children_are_valid, so loading does not read the node table.
+ * @param snapshot_p [in] The loaded snapshot, with data and size set.
+ * @return True if the snapshot can be used, false otherwise.
+ */
+static bool is_valid_snapshot(Snapshot* snapshot_p)
+{
+  if (snapshot_p->size < sizeof(Snapshot_Header))
+  {
+    return false;
+  }
+
+  /* The node count is checked first, so the size of the nodes cannot wrap, and the sizes are subtracted from the
+     size of the file instead of added up, so a huge strings_size cannot wrap either. */
+  Snapshot_Header* header_p = (Snapshot_Header*) snapshot_p->data;
+  if (memcmp(header_p->magic, SNAPSHOT_MAGIC, sizeof(header_p->magic)) != 0 ||
+      header_p->version != SNAPSHOT_VERSION ||
+      header_p->node_size != sizeof(Snapshot_Node) ||
+      header_p->node_count == 0 ||
+      header_p->node_count >= SNAPSHOT_NO_INDEX ||
+      snapshot_p->size - sizeof(Snapshot_Header) < header_p->node_count * sizeof(Snapshot_Node) ||
+      header_p->strings_size != snapshot_p->size - sizeof(Snapshot_Header) - 
+                                header_p->node_count * sizeof(Snapshot_Node))
+  {
+    return false;
+  }
+
+  snapshot_p->header_p = header_p;
+  snapshot_p->nodes = (Snapshot_Node*) ((char*) snapshot_p->data + sizeof(Snapshot_Header));
+  snapshot_p->strings = (char*) (snapshot_p->nodes + header_p->node_count);
+  return is_valid_node_name(snapshot_p, &snapshot_p->nodes[0]) && snapshot_p->nodes[0].parent == SNAPSHOT_NO_INDEX;
+}
+
+/**
+ * @brief Finds a child of a snapshot node by name.
+ * @param snapshot_p [in] The snapshot.
+ * @param parent_index [in] The index of the node whose children are searched.
+ * @param name [in] The name, without a trailing '/', does not need to be null terminated.
+ * @param length [in] The length of name.
+ * @return The index of the child, or SNAPSHOT_NO_INDEX if the node has no child with the name, or its children are
+ *         corrupt.
+ */
+static uint32_t find_snapshot_child(Snapshot* snapshot_p, uint32_t parent_index, const char* name, size_t length)
+{
+  Snapshot_Node* parent_p = &snapshot_p->nodes[parent_index];
+  if (parent_p->first_child == SNAPSHOT_NO_INDEX || !snapshot_children_are_valid(snapshot_p, parent_index))
+  {
+    return SNAPSHOT_NO_INDEX;
+  }
+
+  for (uint32_t i = 0; i < parent_p->children_count; i++)
+  {
+    uint32_t child_index = parent_p->first_child + i;
+    Snapshot_Node* child_p = &snapshot_p->nodes[child_index];
+    if (child_p->name_length == length && memcmp(snapshot_node_name(snapshot_p, child_p), name, length) == 0)
+    {
+      return child_index;
+    }
+  }
+  return SNAPSHOT_NO_INDEX;
+}
+
+/*> Global Function Definitions **************************************************************************************/
+/**
+ * @brief Saves a directory tree to a snapshot file. Files get their size and modification time from their usage if the
+ *        tree has it, or else from looking them up if asked to, so --diff can tell changed files apart.
+ * @param dir_tree [in] The base of the tree to save.
+ * @param file_path [in] The path of the snapshot file, replaced if it exists.
+ * @param record_sizes [in] True if files without a usage are looked up for their size and modification time, a
+ *                     lookup per file. False for a cache, which is written on every run.
+ * @return True if the snapshot was saved, false otherwise.
+ */
+bool save_directory_tree_snapshot(Directory_Tree* dir_tree, char* file_path, bool record_sizes)
+{
+  Snapshot_Writer writer;
+  writer.count = 0;
+  writer.capacity = INITIAL_SNAPSHOT_NODE_CAPACITY;
+  writer.queue = (Directory_Tree**) malloc(writer.capacity * sizeof(Directory_Tree*));
+  writer.nodes = (Snapshot_Node*) malloc(writer.capacity * sizeof(Snapshot_Node));
+  if (writer.queue == NULL || writer.nodes == NULL)
+  {
+    printf("Could not allocate memory for the snapshot.\n");
+    exit(1);
+  }
+  string_buffer_init(&writer.strings);
+  string_buffer_init(&writer.path);
+
+  add_snapshot_node(&writer, dir_tree, SNAPSHOT_NO_INDEX);
+  struct stat file_info = {0};
+  if (record_sizes && !dir_tree->is_directory && dir_tree->usage_p == NULL &&
+      lstat(dir_tree->file_name, &file_info) == 0)
+  {
+    set_node_size(&writer.nodes[0], &file_info);
+  }
+  for (size_t i = 0; i < writer.count; i++)
+  {
+    Directory_Tree* node = writer.queue[i];
+    if (node->children_count == 0)
+    {
+      continue;
+    }
+
+    writer.nodes[i].first_child = (uint32_t) writer.count;
+    writer.nodes[i].children_count = (uint32_t) node->children_count;
+    for (int j = 0; j < node->children_count; j++)
+    {
+      size_t child_index = add_snapshot_node(&writer, node->children[j], (uint32_t) i);
+      if (j < node->children_count - 1)
+      {
+        writer.nodes[child_index].next_sibling = (uint32_t) child_index + 1;
+      }
+    }
+    if (record_sizes)
+    {
+      add_snapshot_sizes(&writer, i);
+    }
+  }
+
+  count_snapshot_descendants(&writer);
+  bool saved = write_snapshot_file(&writer, file_path);
+
+  free(writer.queue);
+  free(writer.nodes);
+  string_buffer_free(&writer.strings);
+  string_buffer_free(&writer.path);
+  return saved;
+}
+
+/**
+ * @brief Maps a snapshot file into memory. Nothing is copied or converted, the nodes are used where they are mapped.
+ * @param file_path [in] The path of the snapshot file.
+ * @return The snapshot, or NULL if the file does not exist or is not a valid snapshot.
+ */
+Snapshot* load_snapshot(char* file_path)
+{
+  int fd = open(file_path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+  {
+    return NULL;
+  }
+
+  struct stat file_info = {0};
+  Snapshot* snapshot_p = (Snapshot*) calloc(1, sizeof(Snapshot));
+  bool loaded = false;
+  if (snapshot_p != NULL && fstat(fd, &file_info) == 0 && file_info.st_size > 0)
+  {
+    snapshot_p->size = (size_t) file_info.st_size;
+    snapshot_p->data = mmap(NULL, snapshot_p->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (snapshot_p->data == MAP_FAILED)
+    {
+      snapshot_p->data = NULL;
+    }
+    loaded = snapshot_p->data != NULL && is_valid_snapshot(snapshot_p);
+  }
+
+  close(fd);
+  if (!loaded)
+  {
+    free_snapshot(snapshot_p);
+    return NULL;
+  }
+  return snapshot_p;
+}
+
+/**
+ * @brief Frees a loaded snapshot.
+ * @param snapshot_p [in/out] The snapshot to free, may be NULL.
+ */
+void free_snapshot(Snapshot* snapshot_p)
+{
+  if (snapshot_p != NULL)
+  {
+    if (snapshot_p->data != NULL)
+    {
+      munmap(snapshot_p->data, snapshot_p->size);
+    }
+    free(snapshot_p);
+  }
+}
+
+/**
+ * @brief Finds the node of a path in a snapshot. The path is either below the path of the base, or relative to the
+ *        base. Empty and "." components are skipped.
+ * @param snapshot_p [in] The snapshot.
+ * @param path [in] The path, e.g. "/home/user/src/lib" for a snapshot of "/home/user/", or "src/lib".
+ * @return The index of the node, or SNAPSHOT_NO_INDEX if the path is not in the snapshot, or the snapshot is corrupt
+ *         along it.
+ */
+uint32_t find_snapshot_path(Snapshot* snapshot_p, char* path)
+{
+  Snapshot_Node* base_p = &snapshot_p->nodes[0];
+  char* base_path = snapshot_node_name(snapshot_p, base_p);
+  size_t base_length = base_p->name_length;
+  size_t offset = 0;
+  if (strncmp(path, base_path, base_length) == 0)
+  {
+    offset = base_length;
+  }
+  else if (base_length > 1 && 
+           base_path[base_length - 1] == '/' && 
+           strlen(path) == base_length - 1 && 
+           strncmp(path, base_path, base_length - 1) == 0)
+  {
+    return 0;
+  }
+
+  uint32_t node_index = 0;
+  while (path[offset] != '\0')
+  {
+    char* component = path + offset;
+    size_t length = strcspn(component, "/");
+    offset += length;
+    while (path[offset] == '/')
+    {
+      offset++;
+    }
+
+    if (length == 0 || (length == 1 && component[0] == '.'))
+    {
+      continue;
+    }
+    node_index = find_snapshot_child(snapshot_p, node_index, component, length);
+    if (node_index == SNAPSHOT_NO_INDEX)
+    {
+      return SNAPSHOT_NO_INDEX;
+    }
+  }
+  return node_index;
+}
+
+/**
+ * @brief Appends the path of a snapshot node, the path of the base followed by the names of the nodes down to it.
+ *        Directories other than the base get a trailing '/', like in a Directory_Tree.
+ * @param snapshot_p [in] The snapshot.
+ * @param node_index [in] The index of the node.
+ * @param path_p [in/out] The buffer the path is appended to.
+ */
+void append_snapshot_path(Snapshot* snapshot_p, uint32_t node_index, String_Buffer* path_p)
+{
+  /* The length is summed up first, so the names are copied from the node up without recursing. */
+  size_t length = 0;
+  for (uint32_t index = node_index; index != SNAPSHOT_NO_INDEX; index = snapshot_p->nodes[index].parent)
+  {
+    Snapshot_Node* node_p = &snapshot_p->nodes[index];
+    bool has_slash = node_p->parent != SNAPSHOT_NO_INDEX && (node_p->flags & SNAPSHOT_DIRECTORY) != 0;
+    length += node_p->name_length + (has_slash ? 1 : 0);
+  }
+
+  char* end = string_buffer_extend(path_p, length) + length;
+  for (uint32_t index = node_index; index != SNAPSHOT_NO_INDEX; index = snapshot_p->nodes[index].parent)
+  {
+    Snapshot_Node* node_p = &snapshot_p->nodes[index];
+    if (node_p->parent != SNAPSHOT_NO_INDEX && (node_p->flags & SNAPSHOT_DIRECTORY) != 0)
+    {
+      *--end = '/';
+    }
+    end -= node_p->name_length;
+    memcpy(end, snapshot_node_name(snapshot_p, node_p), node_p->name_length);
+  }
+}
+
+/**
+ * @brief Checks the children of a snapshot node before they are walked: they come after the node inside the node
+ *        table, are linked to it and to their next sibling, and have names inside the string blob. Only the nodes that
+ *        are walked are checked, so a walk of a valid node reached from the base always ends, whether children are
+ *        walked by index or by next_sibling, and following parents from any of them ends at the base.
+ * @param snapshot_p [in] The snapshot.
+ * @param node_index [in] The index of the node, itself already checked.
+ * @return True if the children can be used, false if the snapshot is corrupt.
+ */
+bool snapshot_children_are_valid(Snapshot* snapshot_p, uint32_t node_index)
+{
+  Snapshot_Node* node_p = &snapshot_p->nodes[node_index];
+  if ((node_p->first_child == SNAPSHOT_NO_INDEX) != (node_p->children_count == 0))
+  {
+    return false;
+  }
+  if (node_p->children_count == 0)
+  {
+    return true;
+  }
+  if (node_p->first_child <= node_index || 
+      node_p->first_child + (uint64_t) node_p->children_count > snapshot_p->header_p->node_count)
+  {
+    return false;
+  }
+
+  for (uint32_t i = 0; i < node_p->children_count; i++)
+  {
+    Snapshot_Node* child_p = &snapshot_p->nodes[node_p->first_child + i];
+    uint32_t next_sibling = i + 1 < node_p->children_count ? node_p->first_child + i + 1 : SNAPSHOT_NO_INDEX;
+    if (child_p->parent != node_index || 
+        child_p->next_sibling != next_sibling || 
+        !is_valid_node_name(snapshot_p, child_p))
+    {
+      return false;
+    }
+  }
+  return true;
+}
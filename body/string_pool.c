@@ -0,0 +1,143 @@
+/*> Description ******************************************************************************************************/
+/**
+* @brief Defines the pool of interned strings.
+* @file string_pool.c
+*/
+
+/*> Includes *********************************************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "string_pool.h"
+#include "string_util.h"
+
+/*> Defines **********************************************************************************************************/
+
+/*> Type Declarations ************************************************************************************************/
+
+/*> Global Constant Definitions **************************************************************************************/
+
+/*> Global Variable Definitions **************************************************************************************/
+
+/*> Local Constant Definitions ***************************************************************************************/
+
+/*> Local Variable Definitions ***************************************************************************************/
+
+/*> Local Function Declarations **************************************************************************************/
+static char** allocate_slots(size_t slot_count);
+
+static void grow_pool(String_Pool* pool_p);
+
+/*> Local Function Definitions ***************************************************************************************/
+/**
+ * @brief Allocates an empty table.
+ * @param slot_count [in] The number of slots, a power of two.
+ * @return The slots, all NULL.
+ */
+static char** allocate_slots(size_t slot_count)
+{
+  char** slots = (char**) calloc(slot_count, sizeof(char*));
+  if (slots == NULL)
+  {
+    printf("Could not allocate memory for the string pool.\n");
+    exit(1);
+  }
+  return slots;
+}
+
+/**
+ * @brief Doubles the number of slots of a pool, moving every interned string to its slot in the larger table.
+ * @param pool_p [in/out] The pool.
+ */
+static void grow_pool(String_Pool* pool_p)
+{
+  size_t old_slot_count = pool_p->mask + 1;
+  size_t new_mask = 2 * old_slot_count - 1;
+  char** new_slots = allocate_slots(new_mask + 1);
+
+  for (size_t i = 0; i < old_slot_count; i++)
+  {
+    char* str = pool_p->slots[i];
+    if (str == NULL)
+    {
+      continue;
+    }
+
+    size_t slot = hash_string(str, strlen(str)) & new_mask;
+    while (new_slots[slot] != NULL)
+    {
+      slot = (slot + 1) & new_mask;
+    }
+    new_slots[slot] = str;
+  }
+
+  free(pool_p->slots);
+  pool_p->slots = new_slots;
+  pool_p->mask = new_mask;
+}
+
+/*> Global Function Definitions **************************************************************************************/
+/**
+ * @brief Initializes an empty pool. No memory is allocated until a string is interned.
+ * @param pool_p [out] The pool to initialize.
+ * @param arena_p [in] The arena the strings are copied to.
+ */
+void string_pool_init(String_Pool* pool_p, Arena* arena_p)
+{
+  pool_p->arena_p = arena_p;
+  pool_p->slots = NULL;
+  pool_p->mask = 0;
+  pool_p->count = 0;
+}
+
+/**
+ * @brief Gets the interned copy of a string, copying it into the arena if it is not in the pool yet.
+ * @param pool_p [in/out] The pool.
+ * @param str [in] The string, does not need to be null terminated.
+ * @param length [in] The length of str.
+ * @return The null terminated interned string. It is shared, so it must not be modified.
+ */
+char* string_pool_intern(String_Pool* pool_p, const char* str, size_t length)
+{
+  if (pool_p->slots == NULL)
+  {
+    pool_p->slots = allocate_slots(INITIAL_STRING_POOL_SLOT_COUNT);
+    pool_p->mask = INITIAL_STRING_POOL_SLOT_COUNT - 1;
+  }
+
+  size_t slot = hash_string(str, length) & pool_p->mask;
+  while (pool_p->slots[slot] != NULL)
+  {
+    char* interned = pool_p->slots[slot];
+    if (strncmp(interned, str, length) == 0 && interned[length] == '\0')
+    {
+      return interned;
+    }
+    slot = (slot + 1) & pool_p->mask;
+  }
+
+  char* interned = arena_copy_string(pool_p->arena_p, str, length);
+  pool_p->slots[slot] = interned;
+  pool_p->count++;
+
+  /* Keep the table at most half full, so probe sequences stay short. */
+  if (2 * pool_p->count > pool_p->mask + 1)
+  {
+    grow_pool(pool_p);
+  }
+  return interned;
+}
+
+/**
+ * @brief Frees the table of a pool. The interned strings stay in the arena.
+ * @param pool_p [in/out] The pool to free.
+ */
+void string_pool_free(String_Pool* pool_p)
+{
+  free(pool_p->slots);
+  pool_p->slots = NULL;
+  pool_p->mask = 0;
+  pool_p->count = 0;
+}
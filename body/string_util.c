@@ -6,8 +6,14 @@
 
 /*> Includes *********************************************************************************************************/
 #include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "string_util.h"
 
 /*> Defines **********************************************************************************************************/
+#define INITIAL_STRING_BUFFER_CAPACITY 256
 
 /*> Type Declarations ************************************************************************************************/
 
@@ -44,4 +50,200 @@ bool is_numeric_string(char* str)
   }
 
   return true;
-}
\ No newline at end of file
+}
+
+/**
+ * @brief Initializes a String_Buffer to the empty string.
+ * @param buffer_p [out] The buffer to initialize.
+ */
+void string_buffer_init(String_Buffer* buffer_p)
+{
+  buffer_p->capacity = INITIAL_STRING_BUFFER_CAPACITY;
+  buffer_p->length = 0;
+  buffer_p->string = (char*) malloc(buffer_p->capacity);
+  if (buffer_p->string == NULL)
+  {
+    printf("Could not allocate memory for a string.\n");
+    exit(1);
+  }
+  buffer_p->string[0] = '\0';
+}
+
+/**
+ * @brief Appends characters to the string of a String_Buffer, growing it if needed.
+ * @param buffer_p [in/out] The buffer.
+ * @param str [in] The characters to append, does not need to be null terminated.
+ * @param length [in] The number of characters to append.
+ */
+void string_buffer_append(String_Buffer* buffer_p, const char* str, size_t length)
+{
+  memcpy(string_buffer_extend(buffer_p, length), str, length);
+}
+
+/**
+ * @brief Lengthens the string of a String_Buffer by characters the caller fills in, growing it if needed. E.g. for a
+ *        path that is built from its end.
+ * @param buffer_p [in/out] The buffer.
+ * @param length [in] The number of characters to add.
+ * @return The added characters, uninitialized but followed by the terminating null.
+ */
+char* string_buffer_extend(String_Buffer* buffer_p, size_t length)
+{
+  size_t needed_capacity = buffer_p->length + length + 1;
+  if (needed_capacity > buffer_p->capacity)
+  {
+    while (buffer_p->capacity < needed_capacity)
+    {
+      buffer_p->capacity *= 2;
+    }
+    buffer_p->string = (char*) realloc(buffer_p->string, buffer_p->capacity);
+    if (buffer_p->string == NULL)
+    {
+      printf("Could not allocate memory for a string.\n");
+      exit(1);
+    }
+  }
+
+  char* added = buffer_p->string + buffer_p->length;
+  buffer_p->length += length;
+  buffer_p->string[buffer_p->length] = '\0';
+  return added;
+}
+
+/**
+ * @brief Frees the memory of a String_Buffer.
+ * @param buffer_p [in/out] The buffer to free.
+ */
+void string_buffer_free(String_Buffer* buffer_p)
+{
+  free(buffer_p->string);
+  buffer_p->string = NULL;
+  buffer_p->length = 0;
+  buffer_p->capacity = 0;
+}
+
+/**
+ * @brief Hashes a string with 64 bit FNV-1a, e.g. for looking up file names in a hash table.
+ * @param str [in] The string, does not need to be null terminated.
+ * @param length [in] The number of characters to hash.
+ * @return The hash of the string.
+ */
+uint64_t hash_string(const char* str, size_t length)
+{
+  uint64_t hash = 14695981039346656037ULL;
+  for (size_t i = 0; i < length; i++)
+  {
+    hash ^= (unsigned char) str[i];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+/**
+ * @brief Formats a number of bytes in human readable form, like du -h. Sizes are rounded up, and shown with one
+ *        decimal below 10 units, e.g. "512", "4.0K", "12M".
+ * @param size [in] The number of bytes.
+ * @param buffer [out] The formatted size, FORMATTED_SIZE_CAPACITY long.
+ * @return The length of the formatted size.
+ */
+int format_size(uint64_t size, char* buffer)
+{
+  const char* units = "KMGTPE";
+  if (size < 1024)
+  {
+    return snprintf(buffer, FORMATTED_SIZE_CAPACITY, "%llu", (unsigned long long) size);
+  }
+
+  int unit = -1;
+  double value = (double) size;
+  while (value >= 1024 && units[unit + 1] != '\0')
+  {
+    value /= 1024;
+    unit++;
+  }
+
+  uint64_t tenths = (uint64_t) (value * 10);
+  if ((double) tenths < value * 10)
+  {
+    tenths++;
+  }
+  if (tenths < 100)
+  {
+    return snprintf(buffer, FORMATTED_SIZE_CAPACITY, "%llu.%llu%c", 
+                    (unsigned long long) tenths / 10, 
+                    (unsigned long long) tenths % 10, 
+                    units[unit]);
+  }
+
+  uint64_t whole = (uint64_t) value;
+  if ((double) whole < value)
+  {
+    whole++;
+  }
+  return snprintf(buffer, FORMATTED_SIZE_CAPACITY, "%llu%c", (unsigned long long) whole, units[unit]);
+}
+
+/**
+ * @brief Checks if a string has to be escaped to be written inside a JSON string, i.e. if it contains a quote, a
+ *        backslash or a control character. Most file names do not, so they can be written as they are.
+ * @param str [in] The string, does not need to be null terminated.
+ * @param length [in] The length of str.
+ * @return True if the string has to be escaped, false otherwise.
+ */
+bool json_needs_escaping(const char* str, size_t length)
+{
+  for (size_t i = 0; i < length; i++)
+  {
+    unsigned char c = (unsigned char) str[i];
+    if (c < 0x20 || c == '"' || c == '\\')
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * @brief Appends a string escaped for the inside of a JSON string. Bytes that are not ASCII are kept as they are, so
+ *        UTF-8 names stay readable.
+ * @param buffer_p [in/out] The buffer.
+ * @param str [in] The string to escape, does not need to be null terminated.
+ * @param length [in] The length of str.
+ */
+void string_buffer_append_json(String_Buffer* buffer_p, const char* str, size_t length)
+{
+  static const char HEX_DIGITS[] = "0123456789abcdef";
+
+  size_t run_start = 0;
+  for (size_t i = 0; i < length; i++)
+  {
+    unsigned char c = (unsigned char) str[i];
+    if (c >= 0x20 && c != '"' && c != '\\')
+    {
+      continue;
+    }
+
+    /* Characters that need no escaping are copied in runs. */
+    string_buffer_append(buffer_p, str + run_start, i - run_start);
+    run_start = i + 1;
+    if (c == '"' || c == '\\')
+    {
+      char escaped[2] = {'\\', (char) c};
+      string_buffer_append(buffer_p, escaped, 2);
+    }
+    else if (c == '\n')
+    {
+      string_buffer_append(buffer_p, "\\n", 2);
+    }
+    else if (c == '\t')
+    {
+      string_buffer_append(buffer_p, "\\t", 2);
+    }
+    else
+    {
+      char escaped[6] = {'\\', 'u', '0', '0', HEX_DIGITS[c >> 4], HEX_DIGITS[c & 0xF]};
+      string_buffer_append(buffer_p, escaped, 6);
+    }
+  }
+  string_buffer_append(buffer_p, str + run_start, length - run_start);
+}
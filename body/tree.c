@@ -5,15 +5,41 @@
 */
 
 /*> Includes *********************************************************************************************************/
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "string_util.h"
 
 #include "directory_tree.h"
+#include "name_matcher.h"
+#include "output_writer.h"
 #include "parse_arguments.h"
+#include "path_filter.h"
 #include "program_settings.h"
+#include "snapshot.h"
+#include "walk_stats.h"
+#include "tree_diff.h"
+#include "watch.h"
 
 /*> Defines **********************************************************************************************************/
 
 /*> Type Declarations ************************************************************************************************/
+/**
+ * @brief State used while printing the trees of several paths, passed to create_directory_trees.
+ * @param settings_p The program settings for this run.
+ * @param writer_p The writer the trees are printed to.
+ * @param counts The number of directories and files below all paths printed so far, for --summary.
+ * @param allocated_size The bytes allocated on disk for all paths printed so far, for --summary with --du.
+ */
+typedef struct Tree_Set_Printer
+{
+  Program_Settings* settings_p;
+  Output_Writer* writer_p;
+  Directory_Tree_Counts counts;
+  uint64_t allocated_size;
+} Tree_Set_Printer;
 
 /*> Global Constant Definitions **************************************************************************************/
 
@@ -21,12 +47,66 @@
 
 /*> Local Constant Definitions ***************************************************************************************/
 const char* HELP_STRING = 
-  "usage: tree [--help] [<option> ...] [<path>]\n"
+  "usage: tree [--help] [<option> ...] [<path> ...]\n"
   "\n"
   "These are the available options:\n"
-  "  -d or --depth     The depth of the tree (default: 1). Useage: -d 2.\n"
+  "  -d or --depth         The depth of the tree (default: 1). Useage: -d 2.\n"
+  "  -j or --jobs          The number of threads reading directories (default: 1). Useage: -j 4.\n"
+  "  -m or --memory-usage  Print the memory used by the tree after the tree.\n"
+  "  --uring               Batch file lookups and directory opens through io_uring, if the kernel supports it.\n"
+  "  --no-lock             Do not lock the output, which is only written by one thread.\n"
+  "  -L                    Follow links to directories. A directory reached again, e.g. through a link to a\n"
+  "                        directory above it, is marked [already listed] instead of being read again. The tree\n"
+  "                        is then read on one thread and --cache is not used.\n"
+  "  -P                    Show links to directories as files, without following them (default).\n"
+  "  --max-entries         Print at most this many entries below the path. The tree is then read breadth first, so\n"
+  "                        the shallow levels come first, and a directory with entries left out ends with\n"
+  "                        '... (N more)'. Useage: --max-entries 1000.\n"
+  "  --per-dir-limit       Print at most this many children per directory. Useage: --per-dir-limit 20.\n"
+  "  --time-budget         Stop reading directories after this many milliseconds, directories not read by then end\n"
+  "                        with '... (not read)'. Useage: --time-budget 500.\n"
+  "                        The limits are not used with --cache, --save, --watch or --hash.\n"
+  "  --du                  Print the disk usage of every file, directories include everything below them.\n"
+  "  --hash                Print a hash of the contents of every file, hashed on the -j threads. The hash of a\n"
+  "                        directory covers the names and hashes of everything below it, so equal trees have\n"
+  "                        equal hashes. Not used with --load or --watch.\n"
+  "  --cache               Reuse a snapshot of an earlier run, only reading directories changed since.\n"
+  "                        The snapshot is updated after the run, and not used with a filter.\n"
+  "                        Useage: --cache tree.cache.\n"
+  "  --save                Save the tree to a snapshot file after printing it. Useage: --save tree.snap.\n"
+  "  --load                Print the tree from a snapshot file instead of reading it. The path is looked up in the\n"
+  "                        snapshot, below its base or relative to it. Useage: --load tree.snap -d 3 src/lib.\n"
+  "  --count               With --load, only print the number of directories and files below the path.\n"
+  "  --diff                Print the entries added (+), removed (-) or changed (~) between the two paths, the\n"
+  "                        old and the new tree, each a directory or a snapshot file. Directories unchanged since\n"
+  "                        a --cache snapshot are not read. A file changed if its size or modification time did,\n"
+  "                        or with --hash and two directories, its contents. Snapshots saved with --cache only\n"
+  "                        record file sizes with --du. Exits with 1 if the trees differ, 0 if they do not.\n"
+  "                        Useage: --diff old.snap ./ or --hash --diff staging/ production/.\n"
+  "  --find                Only print the entries whose name matches a pattern, with the directories above them.\n"
+  "                        A pattern without wildcards matches names containing it, 'test_*' names starting\n"
+  "                        with test_, and any other glob the whole name. The tree is read on one thread, and\n"
+  "                        --find is not used with options that need the whole tree. Useage: --find '*.rs'.\n"
+  "  --watch               Keep running, and print the tree again when files are added or removed.\n"
+  "  --watch=changes       Like --watch, but only print the added (+) and removed (-) paths.\n"
+  "  -I or --exclude       Leave out files and directories matching a pattern, without reading the directories.\n"
+  "                        Several patterns are separated by '|'. Useage: -I 'node_modules|*.o'.\n"
+  "  --include             Only show files matching a pattern, directories are still shown. Useage: --include '*.c'.\n"
+  "  --sort=<order>        Sort the children of every directory by name, natural (numbers by value), size\n"
+  "                        (largest first), mtime (newest first) or none (default, the order they are read in).\n"
+  "  --gitignore           Leave out files ignored by the .gitignore files in the tree.\n"
+  "  --output=<format>     Print the tree as text (default), json (one nested document) or ndjson (one object per\n"
+  "                        line with path, depth and type). With --du, records have size, disk_usage and mtime_ns.\n"
+  "                        With --hash, records have a hash.\n"
+  "  --summary             Print the number of directories and files below all paths after the trees.\n"
+  "                        With --output=json, it is the summary field of the document of the trees.\n"
+  "  --stats               Print the number and time of system calls and entries per level to stderr at exit.\n"
+  "  --stats=json          Like --stats, but print them as JSON.\n"
   "\n"
-  "If no path provided, \"./\" is used\n";
+  "If no path provided, \"./\" is used. Several paths are read at the same time on the -j threads, at least one\n"
+  "per path, and their trees are printed in the order the paths are given. With --output=json, the trees are\n"
+  "printed as one document, {\"trees\":[...]}. Several paths are not used with --cache, --save, --load or\n"
+  "--watch, and --diff takes exactly two.\n";
 
 const char* BAD_FORMAT_STRING =
   "The command was badly formatted, so arguments could not be parsed. Please use 'tree --help' for help.\n";
@@ -36,46 +116,423 @@ const char* BAD_FORMAT_STRING =
 /*> Local Function Declarations **************************************************************************************/
 int main(int argument_count, char* argument_array[]);
 
-void execute_program(Program_Settings* settings_p);
+int execute_program(Program_Settings* settings_p);
+
+bool needs_directory_tree(Program_Settings* settings_p);
+
+bool has_budget(Program_Settings* settings_p);
+
+bool conflicts_with_find(Program_Settings* settings_p);
+
+void print_loaded_snapshot(Program_Settings* settings_p, Output_Writer* writer_p);
+
+void print_directory_trees(Program_Settings* settings_p, Directory_Tree_Options* options_p, Output_Writer* writer_p);
+
+void print_created_tree(int tree_index, Directory_Tree* dir_tree, void* printer_p);
+
+void print_summary(Tree_Set_Printer* printer_p);
 
 /*> Local Function Definitions ***************************************************************************************/
 /**
 * @brief Main function for tree program.
 * @param argument_count [in] Number of input arguments.
 * @param argument_array [in] Array containing input arguments. 
-* @return The return code of the program. 0 means the program finished correctly.
+* @return The return code of the program. 0 means the program finished correctly, 1 that it failed or that the
+*         trees given to --diff differ.
 */
 int main(int argument_count, char* argument_array[])
 {
   Program_Settings settings = {0};
 
   bool successfully_parsed_arguments = parse_arguments(argument_count, argument_array, &settings);
-  if (!successfully_parsed_arguments)
+  if (!successfully_parsed_arguments || 
+      (settings.count && settings.load_path == NULL) || 
+      (settings.hash && (settings.load_path != NULL || settings.watch)) || 
+      (settings.diff && (settings.path_count != 2 || settings.load_path != NULL || settings.watch)) || 
+      (has_budget(&settings) && 
+       (settings.cache_path != NULL || settings.save_path != NULL || settings.watch || settings.hash)) || 
+      (settings.find_pattern != NULL && conflicts_with_find(&settings)) || 
+      (settings.summary && settings.diff) || 
+      ((settings.path_count > 1 || settings.summary) && 
+       (settings.cache_path != NULL || settings.save_path != NULL || settings.load_path != NULL || settings.watch)))
   {
     printf("%s", BAD_FORMAT_STRING);
     return 1;
   }
 
-  execute_program(&settings);
+  int return_code = execute_program(&settings);
+  path_filter_free(&settings.filter);
 
-  return 0;
+  return return_code;
 }
 
 /**
  * @brief Executes the tree program based on the program settings.
  * @param settings_p [in] Pointer to the program settings for this run.
+ * @return The return code of the program, 1 if the trees given to --diff differ, like diff(1), 0 otherwise.
  */
-void execute_program(Program_Settings* settings_p)
+int execute_program(Program_Settings* settings_p)
 {
   if (settings_p->help)
   {
     printf("%s", HELP_STRING);
-    return;
+    return 0;
+  }
+
+  if (settings_p->stats)
+  {
+    walk_stats_enable(settings_p->stats_json ? WALK_STATS_JSON : WALK_STATS_TEXT);
+  }
+
+  Directory_Tree_Options options = {0};
+  options.depth = settings_p->depth;
+  options.thread_count = settings_p->thread_count;
+  options.use_uring = settings_p->use_uring;
+  options.record_stamps = settings_p->cache_path != NULL;
+  options.record_usage = settings_p->disk_usage;
+  options.record_hashes = settings_p->hash;
+  options.max_entries = (size_t) settings_p->max_entries;
+  options.per_directory_limit = settings_p->per_directory_limit;
+  options.time_budget_ms = settings_p->time_budget_ms;
+  options.sort_order = settings_p->sort_order;
+  options.output_format = settings_p->output_format;
+  options.filter_p = path_filter_is_active(&settings_p->filter) ? &settings_p->filter : NULL;
+  options.follow_links = settings_p->follow_links;
+  if (options.record_stamps)
+  {
+    /* A missing or unreadable snapshot is not an error, the tree is then read from scratch. */
+    options.cached_snapshot_p = load_snapshot(settings_p->cache_path);
+  }
+
+  Output_Writer writer;
+  output_writer_init(&writer, STDOUT_FILENO, settings_p->lock_output);
+
+  if (settings_p->diff)
+  {
+    bool has_changes = diff_directory_trees(settings_p->path_strings[0], 
+                                            settings_p->path_strings[1], 
+                                            settings_p->hash, 
+                                            options.output_format, 
+                                            &writer);
+    output_writer_free(&writer);
+    return has_changes ? 1 : 0;
+  }
+
+  if (settings_p->load_path != NULL)
+  {
+    print_loaded_snapshot(settings_p, &writer);
+    output_writer_free(&writer);
+    return 0;
+  }
+
+  if (settings_p->find_pattern != NULL)
+  {
+    /* Matches are printed while they are read, so several paths are searched one after another. */
+    Name_Matcher matcher;
+    name_matcher_compile(&matcher, settings_p->find_pattern);
+    bool is_tree_set = options.output_format == OUTPUT_JSON && settings_p->path_count > 1;
+    if (is_tree_set)
+    {
+      output_writer_write(&writer, "{\"trees\":[\n", 11);
+    }
+    for (int i = 0; i < settings_p->path_count; i++)
+    {
+      if (is_tree_set && i > 0)
+      {
+        output_writer_write(&writer, ",", 1);
+      }
+      find_in_directory_tree(settings_p->path_strings[i], &options, &matcher, &writer);
+    }
+    if (is_tree_set)
+    {
+      output_writer_write(&writer, "]}\n", 3);
+    }
+    output_writer_free(&writer);
+    return 0;
+  }
+
+  if (settings_p->path_count > 1 || settings_p->summary)
+  {
+    print_directory_trees(settings_p, &options, &writer);
+    output_writer_free(&writer);
+    return 0;
+  }
+
+  if (!needs_directory_tree(settings_p))
+  {
+    stream_directory_tree(settings_p->path_str, &options, &writer);
+    output_writer_free(&writer);
+    return 0;
+  }
+
+  Directory_Tree* dir_tree = create_directory_tree(settings_p->path_str, &options);
+  print_directory_tree(dir_tree, options.output_format, &writer);
+  output_writer_free(&writer);
+
+  if (settings_p->cache_path != NULL)
+  {
+    free_snapshot(options.cached_snapshot_p);
+
+    /* A filtered tree would look like the left out files are gone to an unfiltered run, and a tree with followed
+       links like the directories behind them were moved into the tree. */
+    if (options.filter_p == NULL && 
+        !options.follow_links && 
+        !save_directory_tree_snapshot(dir_tree, settings_p->cache_path, false))
+    {
+      printf("Could not write the cache: %s\n", settings_p->cache_path);
+    }
+  }
+
+  if (settings_p->save_path != NULL && !save_directory_tree_snapshot(dir_tree, settings_p->save_path, true))
+  {
+    printf("Could not write the snapshot: %s\n", settings_p->save_path);
+  }
+
+  if (settings_p->memory_usage)
+  {
+    Directory_Tree_Memory_Usage usage = {0};
+    get_directory_tree_memory_usage(dir_tree, &usage);
+    printf("\n%zu nodes, %zu bytes used (%zu bytes reserved), %.1f bytes per node\n",
+           usage.node_count,
+           usage.bytes_used,
+           usage.bytes_reserved,
+           (double) usage.bytes_used / usage.node_count);
+  }
+
+  if (settings_p->watch)
+  {
+    /* Reinitializing the writer flushes the lines printed so far, so they come before the updates. */
+    output_writer_init(&writer, STDOUT_FILENO, settings_p->lock_output);
+    watch_directory_tree(settings_p->path_str, dir_tree, &options, &writer, settings_p->watch_changes_only);
+  }
+
+  free_directory_tree(dir_tree);
+
+  return 0;
+}
+
+/**
+ * @brief Checks if the settings need the whole tree in memory, or if the tree can be printed while it is read.
+ * @param settings_p [in] Pointer to the program settings for this run.
+ * @return True if the tree has to be created before it is printed, false otherwise.
+ */
+bool needs_directory_tree(Program_Settings* settings_p)
+{
+  /* Directories read in parallel finish out of order, and io_uring batches a whole directory at a time, so the tree
+     is created and printed once it is complete. A cache or snapshot needs the tree to save it, watching
+     needs it to apply changes to, and sizes and hashes of directories are only known once everything below them is
+     read. A directory can only be sorted once it is read completely, and budgets read the tree breadth first. */
+  return settings_p->memory_usage || 
+         settings_p->thread_count > 1 || 
+         settings_p->use_uring || 
+         settings_p->cache_path != NULL ||
+         settings_p->save_path != NULL ||
+         settings_p->watch ||
+         settings_p->disk_usage ||
+         settings_p->hash ||
+         has_budget(settings_p) ||
+         settings_p->sort_order != SORT_NONE;
+}
+
+/**
+ * @brief Checks if the tree is read within a budget of entries or time.
+ * @param settings_p [in] Pointer to the program settings for this run.
+ * @return True if any of --max-entries, --per-dir-limit or --time-budget is given.
+ */
+bool has_budget(Program_Settings* settings_p)
+{
+  return settings_p->max_entries > 0 || settings_p->per_directory_limit > 0 || settings_p->time_budget_ms > 0;
+}
+
+/**
+ * @brief Checks if the settings need something --find does not do. Matches are printed while the tree is read, so
+ *        nothing that needs the whole tree is used with it. Threads and io_uring are left out instead, since they
+ *        only change how fast the tree is read.
+ * @param settings_p [in] Pointer to the program settings for this run.
+ * @return True if --find can not be used with the settings, false otherwise.
+ */
+bool conflicts_with_find(Program_Settings* settings_p)
+{
+  return settings_p->memory_usage || 
+         settings_p->cache_path != NULL || 
+         settings_p->save_path != NULL || 
+         settings_p->load_path != NULL || 
+         settings_p->diff || 
+         settings_p->watch || 
+         settings_p->disk_usage || 
+         settings_p->hash || 
+         settings_p->summary || 
+         has_budget(settings_p) || 
+         settings_p->sort_order != SORT_NONE;
+}
+
+/**
+ * @brief Prints the tree below a path from a snapshot file, or the number of directories and files below it. The
+ *        snapshot is mapped and printed where it is, without reading the file system or creating a tree.
+ * @param settings_p [in] Pointer to the program settings for this run.
+ * @param writer_p [in/out] The writer the tree is printed to.
+ */
+void print_loaded_snapshot(Program_Settings* settings_p, Output_Writer* writer_p)
+{
+  Snapshot* snapshot_p = load_snapshot(settings_p->load_path);
+  if (snapshot_p == NULL)
+  {
+    printf("Could not load the snapshot: %s\n", settings_p->load_path);
+    exit(1);
+  }
+
+  uint32_t node_index = find_snapshot_path(snapshot_p, settings_p->path_str);
+  if (node_index == SNAPSHOT_NO_INDEX)
+  {
+    printf("Could not find path in the snapshot: %s\n", settings_p->path_str);
+    exit(1);
+  }
+
+  if (settings_p->count)
+  {
+    /* Every node knows the size of its subtree, so counting does not depend on the size of the tree. */
+    Snapshot_Node* node_p = &snapshot_p->nodes[node_index];
+    unsigned long long directory_count = node_p->directory_descendant_count;
+    unsigned long long file_count = node_p->descendant_count - node_p->directory_descendant_count;
+    char line[128];
+    int length = settings_p->output_format == OUTPUT_TEXT ? 
+                 snprintf(line, sizeof(line), "%llu directories, %llu files\n", directory_count, file_count) :
+                 snprintf(line, sizeof(line), "{\"directories\":%llu,\"files\":%llu}\n", directory_count, file_count);
+    output_writer_write(writer_p, line, (size_t) length);
+  }
+  else
+  {
+    print_snapshot_tree(snapshot_p, node_index, settings_p->depth, settings_p->output_format, writer_p);
+  }
+
+  free_snapshot(snapshot_p);
+}
+
+/**
+ * @brief Prints the trees of several paths, read at the same time, in the order the paths were given. Every tree is
+ *        printed as soon as it and the trees before it are read, followed by the summary if asked for. As JSON, the
+ *        trees and the summary are printed as one document, {"trees":[...],"summary":{...}}.
+ * @param settings_p [in] Pointer to the program settings for this run.
+ * @param options_p [in] How the trees are read.
+ * @param writer_p [in/out] The writer the trees are printed to.
+ */
+void print_directory_trees(Program_Settings* settings_p, Directory_Tree_Options* options_p, Output_Writer* writer_p)
+{
+  Tree_Set_Printer printer = {0};
+  printer.settings_p = settings_p;
+  printer.writer_p = writer_p;
+  if (settings_p->output_format == OUTPUT_JSON)
+  {
+    output_writer_write(writer_p, "{\"trees\":[\n", 11);
+  }
+  create_directory_trees(settings_p->path_strings, settings_p->path_count, options_p, print_created_tree, &printer);
+  if (settings_p->output_format == OUTPUT_JSON)
+  {
+    output_writer_write(writer_p, "]", 1);
+  }
+
+  if (settings_p->summary)
+  {
+    print_summary(&printer);
+  }
+  if (settings_p->output_format == OUTPUT_JSON)
+  {
+    output_writer_write(writer_p, "}\n", 2);
+  }
+}
+
+/**
+ * @brief Prints a tree once it is read, and frees it. The callback passed to create_directory_trees.
+ * @param tree_index [in] The index of the path of the tree, the trees after the first are separated by a comma in
+ *                   JSON.
+ * @param dir_tree [in/out] The tree, freed.
+ * @param printer_p [in/out] The Tree_Set_Printer of the trees.
+ */
+void print_created_tree(int tree_index, Directory_Tree* dir_tree, void* printer_p)
+{
+  Tree_Set_Printer* set_printer_p = (Tree_Set_Printer*) printer_p;
+  Program_Settings* settings_p = set_printer_p->settings_p;
+  if (settings_p->output_format == OUTPUT_JSON && tree_index > 0)
+  {
+    output_writer_write(set_printer_p->writer_p, ",", 1);
   }
+  print_directory_tree(dir_tree, settings_p->output_format, set_printer_p->writer_p);
 
-  Directory_Tree* dir_tree = create_directory_tree(settings_p->path_str, settings_p->depth);
-  print_directory_tree(dir_tree);
+  if (settings_p->summary)
+  {
+    Directory_Tree_Counts counts;
+    get_directory_tree_counts(dir_tree, &counts);
+    set_printer_p->counts.directory_count += counts.directory_count;
+    set_printer_p->counts.file_count += counts.file_count;
+    if (dir_tree->usage_p != NULL)
+    {
+      set_printer_p->allocated_size += dir_tree->usage_p->allocated_size;
+    }
+  }
+
+  /* Written through the writer, so the line comes after the tree it belongs to. */
+  if (settings_p->memory_usage)
+  {
+    Directory_Tree_Memory_Usage usage = {0};
+    get_directory_tree_memory_usage(dir_tree, &usage);
+    char line[160];
+    int length = snprintf(line, 
+                          sizeof(line), 
+                          "\n%zu nodes, %zu bytes used (%zu bytes reserved), %.1f bytes per node\n", 
+                          usage.node_count, 
+                          usage.bytes_used, 
+                          usage.bytes_reserved, 
+                          (double) usage.bytes_used / usage.node_count);
+    output_writer_write(set_printer_p->writer_p, line, (size_t) length);
+  }
+
+  /* Flushed, so a tree shows up while the trees after it are still read. */
+  output_writer_flush(set_printer_p->writer_p);
   free_directory_tree(dir_tree);
 }
 
+/**
+ * @brief Prints the number of directories and files below all paths, and their disk usage with --du. As JSON, it is
+ *        the summary field of the document of the trees, and as NDJSON an object on its own line.
+ * @param printer_p [in] The Tree_Set_Printer the trees were printed with.
+ */
+void print_summary(Tree_Set_Printer* printer_p)
+{
+  Program_Settings* settings_p = printer_p->settings_p;
+  unsigned long long directory_count = printer_p->counts.directory_count;
+  unsigned long long file_count = printer_p->counts.file_count;
+  char line[160];
+  int length = 0;
+  if (settings_p->output_format == OUTPUT_TEXT)
+  {
+    length = snprintf(line, sizeof(line), "\n%llu directories, %llu files", directory_count, file_count);
+    if (settings_p->disk_usage)
+    {
+      char size[FORMATTED_SIZE_CAPACITY];
+      format_size(printer_p->allocated_size, size);
+      length += snprintf(line + length, sizeof(line) - length, ", %s", size);
+    }
+    length += snprintf(line + length, sizeof(line) - length, "\n");
+  }
+  else
+  {
+    length = snprintf(line, 
+                      sizeof(line), 
+                      "%s{\"paths\":%d,\"directories\":%llu,\"files\":%llu", 
+                      settings_p->output_format == OUTPUT_JSON ? ",\"summary\":" : "", 
+                      settings_p->path_count, 
+                      directory_count, 
+                      file_count);
+    if (settings_p->disk_usage)
+    {
+      length += snprintf(line + length, 
+                         sizeof(line) - length, 
+                         ",\"disk_usage\":%llu", 
+                         (unsigned long long) printer_p->allocated_size);
+    }
+    length += snprintf(line + length, sizeof(line) - length, settings_p->output_format == OUTPUT_JSON ? "}" : "}\n");
+  }
+  output_writer_write(printer_p->writer_p, line, (size_t) length);
+}
+
 /*> Global Function Definitions **************************************************************************************/
@@ -0,0 +1,863 @@
+/*> Description ******************************************************************************************************/
+/**
+* @brief Defines the diff of two trees. Both trees are walked together a directory at a time, their entries matched
+*        by name with a sorted merge, and only the added, removed and changed entries are printed.
+* @file tree_diff.c
+*/
+
+/*> Includes *********************************************************************************************************/
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "content_hash.h"
+#include "directory_reader.h"
+#include "directory_tree.h"
+#include "frame_stack.h"
+#include "output_writer.h"
+#include "snapshot.h"
+#include "string_util.h"
+#include "tree_diff.h"
+#include "walk_stats.h"
+
+/*> Defines **********************************************************************************************************/
+#define NANOSECONDS_PER_SECOND 1000000000LL
+
+/*> Type Declarations ************************************************************************************************/
+/**
+ * @brief One entry of a directory being compared.
+ * @param name The name of the entry, without the '/' of directories. Not null terminated.
+ * @param name_length The length of name.
+ * @param is_directory True if the entry is a directory. Links are not followed, so a link is a file.
+ * @param has_children True if the children of the directory are known, so they can be compared. A directory of a
+ *                     snapshot below the depth it was read to, or a reference, has none.
+ * @param node_index The index of the node of the entry in the snapshot, SNAPSHOT_NO_INDEX for a directory on disk.
+ * @param is_paired True if the entry is a directory of the new tree found in the old tree as well, so they are
+ *                  compared once the directory they are in is done.
+ * @param old_node_index The node_index of the entry in the old tree, only set if is_paired.
+ * @param has_size True if size and modification_time_ns are set. A file on disk is only looked up once it is found
+ *                 in both trees, a file of a snapshot has them if they were recorded when it was saved.
+ * @param size The size of the file in bytes.
+ * @param modification_time_ns The last modification time of the file in nanoseconds.
+ */
+typedef struct Diff_Entry
+{
+  const char* name;
+  size_t name_length;
+  bool is_directory;
+  bool has_children;
+  uint32_t node_index;
+  bool is_paired;
+  uint32_t old_node_index;
+  bool has_size;
+  uint64_t size;
+  int64_t modification_time_ns;
+} Diff_Entry;
+
+/**
+ * @brief One of the two trees being compared.
+ * @param base_path The path of the base directory on disk, as it was given. Unused for a snapshot.
+ * @param base_length The length of the path of the base directory on disk, ending with '/', at the start of path.
+ *                    Unused for a snapshot.
+ * @param snapshot_p The snapshot the tree is taken from, or NULL if it is read from disk.
+ * @param path The path on disk of the directory being compared, the base path followed by the relative path. Only
+ *             printed in messages, the directory is looked up relative to its parent.
+ * @param fd The open directory being compared, -1 if it is not open.
+ * @param stamp The stamp of the directory being compared.
+ * @param has_stamp True if stamp is set. Directories of a snapshot only have one if it was saved with --cache.
+ * @param names The names of the entries of a directory on disk, the names of a snapshot are used where they are.
+ * @param entries The entries of the directory being compared, sorted by name.
+ * @param entry_count The number of entries.
+ * @param entry_capacity The number of entries the array has room for.
+ * @param read_buffer The buffer directories on disk are read into, DIRECTORY_READER_BUFFER_SIZE long.
+ */
+typedef struct Diff_Side
+{
+  char* base_path;
+  size_t base_length;
+  Snapshot* snapshot_p;
+  String_Buffer path;
+  int fd;
+  Directory_Stamp stamp;
+  bool has_stamp;
+  String_Buffer names;
+  Diff_Entry* entries;
+  int entry_count;
+  int entry_capacity;
+  char* read_buffer;
+} Diff_Side;
+
+/**
+ * @brief A pair of directories with the same path in both trees, waiting to be compared.
+ * @param old_index The index of the snapshot node of the directory in the old tree.
+ * @param new_index The index of the snapshot node of the directory in the new tree.
+ * @param path_offset The offset of the path of the directories in the pending paths.
+ * @param path_length The length of the path, relative to the bases and ending with '/'.
+ * @param name_length The length of the name of the directories, the last part of the path.
+ * @param parent_fds The open parent directories of the directories in the old and the new tree, -1 for a snapshot.
+ * @param closes_parents True if the pair is the last child of its parents to be compared, so it closes parent_fds.
+ */
+typedef struct Diff_Pair
+{
+  uint32_t old_index;
+  uint32_t new_index;
+  size_t path_offset;
+  size_t path_length;
+  size_t name_length;
+  int parent_fds[2];
+  bool closes_parents;
+} Diff_Pair;
+
+/**
+ * @brief State of a diff.
+ * @param sides The old and the new tree.
+ * @param compare_contents True if files found in both trees with the same size are compared by the hash of their
+ *                         contents instead of their modification time. Only used when both trees are read from disk.
+ * @param format How the changes are printed.
+ * @param writer_p The writer the changes are printed to.
+ * @param needs_separator True if a JSON object was printed, so the next one needs a comma.
+ * @param has_changes True if a change was printed.
+ * @param path The path of the directories being compared, relative to the bases.
+ * @param line The change being printed.
+ * @param pending_paths The paths of the pairs on the stack, each popped pair truncates it to its own path.
+ * @param pairs The stack of Diff_Pair of the directories waiting to be compared, depth first.
+ * @param hash_buffer The buffer files are read into when their contents are compared.
+ */
+typedef struct Tree_Diff
+{
+  Diff_Side sides[2];
+  bool compare_contents;
+  Output_Format format;
+  Output_Writer* writer_p;
+  bool needs_separator;
+  bool has_changes;
+  String_Buffer path;
+  String_Buffer line;
+  String_Buffer pending_paths;
+  Frame_Stack pairs;
+  char* hash_buffer;
+} Tree_Diff;
+
+/*> Global Constant Definitions **************************************************************************************/
+
+/*> Global Variable Definitions **************************************************************************************/
+
+/*> Local Constant Definitions ***************************************************************************************/
+
+/*> Local Variable Definitions ***************************************************************************************/
+
+/*> Local Function Declarations **************************************************************************************/
+static void* allocate_or_exit(size_t size);
+
+static void open_diff_side(Diff_Side* side_p, char* path_string);
+
+static void free_diff_side(Diff_Side* side_p);
+
+static Diff_Entry* push_diff_entry(Diff_Side* side_p);
+
+static int compare_diff_entries(const void* entry1_p, const void* entry2_p);
+
+static bool read_side_stamp(Diff_Side* side_p, uint32_t node_index, int parent_fd, char* name, String_Buffer* path_p);
+
+static void read_snapshot_entries(Diff_Side* side_p, uint32_t node_index);
+
+static void open_side_directory(Diff_Side* side_p, int parent_fd, char* name);
+
+static void read_directory_entries(Diff_Side* side_p, int parent_fd, char* name);
+
+static void close_side_directory(Diff_Side* side_p);
+
+static void print_change(Tree_Diff* diff_p, char sign, Diff_Entry* entry_p);
+
+static bool contents_are_equal(Tree_Diff* diff_p, Diff_Entry* entry_p);
+
+static bool read_entry_size(Diff_Side* side_p, Diff_Entry* entry_p);
+
+static bool files_are_equal(Tree_Diff* diff_p, Diff_Entry* old_entry_p, Diff_Entry* new_entry_p);
+
+static Diff_Pair* push_diff_pair(Tree_Diff* diff_p, uint32_t old_index, uint32_t new_index, Diff_Entry* entry_p);
+
+static void push_child_pairs(Tree_Diff* diff_p, Diff_Side* side_p);
+
+static void diff_directories(Tree_Diff* diff_p, Diff_Pair* pair_p);
+
+/*> Local Function Definitions ***************************************************************************************/
+/**
+ * @brief Allocates memory, exiting the program if there is none left.
+ * @param size [in] The number of bytes to allocate.
+ * @return The allocated memory.
+ */
+static void* allocate_or_exit(size_t size)
+{
+  void* memory = malloc(size);
+  if (memory == NULL)
+  {
+    printf("Could not allocate memory for the diff.\n");
+    exit(1);
+  }
+  return memory;
+}
+
+/**
+ * @brief Opens one of the trees of a diff. A directory is read from disk, any other file is loaded as a snapshot.
+ * @param side_p [out] The tree.
+ * @param path_string [in] The path of the directory or of the snapshot file.
+ */
+static void open_diff_side(Diff_Side* side_p, char* path_string)
+{
+  string_buffer_init(&side_p->path);
+  string_buffer_init(&side_p->names);
+  side_p->fd = -1;
+  side_p->has_stamp = false;
+  side_p->entry_count = 0;
+  side_p->entry_capacity = INITIAL_DIFF_ENTRY_CAPACITY;
+  side_p->entries = (Diff_Entry*) allocate_or_exit(side_p->entry_capacity * sizeof(Diff_Entry));
+  side_p->read_buffer = NULL;
+  side_p->snapshot_p = NULL;
+  side_p->base_path = NULL;
+
+  struct stat file_info = {0};
+  if (stat(path_string, &file_info) == 0 && S_ISDIR(file_info.st_mode))
+  {
+    side_p->base_path = path_string;
+    size_t length = strlen(path_string);
+    string_buffer_append(&side_p->path, path_string, length);
+    if (last_char(path_string) != '/')
+    {
+      string_buffer_append(&side_p->path, "/", 1);
+    }
+    side_p->base_length = side_p->path.length;
+    side_p->read_buffer = (char*) allocate_or_exit(DIRECTORY_READER_BUFFER_SIZE);
+    return;
+  }
+
+  side_p->snapshot_p = load_snapshot(path_string);
+  if (side_p->snapshot_p == NULL || !(side_p->snapshot_p->nodes[0].flags & SNAPSHOT_DIRECTORY))
+  {
+    printf("Could not find a directory or snapshot: %s\n", path_string);
+    exit(1);
+  }
+}
+
+/**
+ * @brief Frees one of the trees of a diff.
+ * @param side_p [in/out] The tree.
+ */
+static void free_diff_side(Diff_Side* side_p)
+{
+  if (side_p->snapshot_p != NULL)
+  {
+    free_snapshot(side_p->snapshot_p);
+  }
+  string_buffer_free(&side_p->path);
+  string_buffer_free(&side_p->names);
+  free(side_p->entries);
+  free(side_p->read_buffer);
+}
+
+/**
+ * @brief Adds an entry to the entries of the directory being compared.
+ * @param side_p [in/out] The tree.
+ * @return The new entry, to be filled in.
+ */
+static Diff_Entry* push_diff_entry(Diff_Side* side_p)
+{
+  if (side_p->entry_count == side_p->entry_capacity)
+  {
+    side_p->entry_capacity *= 2;
+    side_p->entries = (Diff_Entry*) realloc(side_p->entries, side_p->entry_capacity * sizeof(Diff_Entry));
+    if (side_p->entries == NULL)
+    {
+      printf("Could not allocate memory for the diff.\n");
+      exit(1);
+    }
+  }
+  return &side_p->entries[side_p->entry_count++];
+}
+
+/**
+ * @brief Compares two entries by name, byte by byte, so both trees are sorted the same whatever the locale.
+ * @param entry1_p [in] The first Diff_Entry.
+ * @param entry2_p [in] The second Diff_Entry.
+ * @return Less than, equal to or greater than 0 if the first name sorts before, with or after the second.
+ */
+static int compare_diff_entries(const void* entry1_p, const void* entry2_p)
+{
+  const Diff_Entry* entry1 = (const Diff_Entry*) entry1_p;
+  const Diff_Entry* entry2 = (const Diff_Entry*) entry2_p;
+  size_t length = entry1->name_length < entry2->name_length ? entry1->name_length : entry2->name_length;
+  int result = memcmp(entry1->name, entry2->name, length);
+  if (result != 0)
+  {
+    return result;
+  }
+  return (entry1->name_length > entry2->name_length) - (entry1->name_length < entry2->name_length);
+}
+
+/**
+ * @brief Reads the stamp of a directory being compared. A directory on disk is looked up without being opened, so it
+ *        is not read if its entries turn out to be unchanged.
+ * @param side_p [in/out] The tree, its stamp is set.
+ * @param node_index [in] The index of the snapshot node of the directory, unused for a directory on disk.
+ * @param parent_fd [in] The open parent of the directory on disk, AT_FDCWD for the base.
+ * @param name [in] The name of the directory on disk in its parent, the path of the base.
+ * @param path_p [in] The path of the directory relative to the base, kept for the messages.
+ * @return True if the directory has a stamp.
+ */
+static bool read_side_stamp(Diff_Side* side_p, uint32_t node_index, int parent_fd, char* name, String_Buffer* path_p)
+{
+  if (side_p->snapshot_p != NULL)
+  {
+    Snapshot_Node* node_p = &side_p->snapshot_p->nodes[node_index];
+    side_p->has_stamp = (node_p->flags & SNAPSHOT_CHILDREN_READ) != 0;
+    side_p->stamp = node_p->stamp;
+    return side_p->has_stamp;
+  }
+
+  string_buffer_truncate(&side_p->path, side_p->base_length);
+  string_buffer_append(&side_p->path, path_p->string, path_p->length);
+
+  struct stat file_info = {0};
+  uint64_t start_ns = walk_stats_start();
+  int result = fstatat(parent_fd, name, &file_info, 0);
+  walk_stats_stop(WALK_STAT_LOOKUP, start_ns, 1);
+  side_p->has_stamp = result == 0;
+  side_p->stamp.device = file_info.st_dev;
+  side_p->stamp.inode = file_info.st_ino;
+  side_p->stamp.modification_time_ns = file_info.st_mtim.tv_sec * NANOSECONDS_PER_SECOND + file_info.st_mtim.tv_nsec;
+  side_p->stamp.change_time_ns = file_info.st_ctim.tv_sec * NANOSECONDS_PER_SECOND + file_info.st_ctim.tv_nsec;
+  return side_p->has_stamp;
+}
+
+/**
+ * @brief Lists the children of a snapshot node, sorted by name. The names are used where they are in the snapshot.
+ * @param side_p [in/out] The tree, a snapshot.
+ * @param node_index [in] The index of the node of the directory.
+ */
+static void read_snapshot_entries(Diff_Side* side_p, uint32_t node_index)
+{
+  Snapshot* snapshot_p = side_p->snapshot_p;
+  if (!snapshot_children_are_valid(snapshot_p, node_index))
+  {
+    printf("A snapshot given to --diff is corrupt.\n");
+    exit(1);
+  }
+
+  side_p->entry_count = 0;
+  Snapshot_Node* node_p = &snapshot_p->nodes[node_index];
+  for (uint32_t i = 0; i < node_p->children_count; i++)
+  {
+    uint32_t child_index = node_p->first_child + i;
+    Snapshot_Node* child_p = &snapshot_p->nodes[child_index];
+    Diff_Entry* entry_p = push_diff_entry(side_p);
+    entry_p->name = snapshot_node_name(snapshot_p, child_p);
+    entry_p->name_length = child_p->name_length;
+    entry_p->is_directory = (child_p->flags & SNAPSHOT_DIRECTORY) != 0;
+    entry_p->has_children = entry_p->is_directory && 
+                            !(child_p->flags & SNAPSHOT_REFERENCE) && 
+                            (child_p->children_count > 0 || child_p->depth > 0);
+    entry_p->node_index = child_index;
+    entry_p->is_paired = false;
+    entry_p->has_size = (child_p->flags & SNAPSHOT_HAS_SIZE) != 0;
+    entry_p->size = child_p->size;
+    entry_p->modification_time_ns = child_p->modification_time_ns;
+  }
+  qsort(side_p->entries, side_p->entry_count, sizeof(Diff_Entry), compare_diff_entries);
+}
+
+/**
+ * @brief Opens the directory being compared of a tree on disk relative to its parent, so its path is never resolved
+ *        whole and may be longer than PATH_MAX.
+ * @param side_p [in/out] The tree, read from disk. Its path is the path of the directory.
+ * @param parent_fd [in] The open parent of the directory, AT_FDCWD for the base.
+ * @param name [in] The name of the directory in its parent, the path of the base.
+ */
+static void open_side_directory(Diff_Side* side_p, int parent_fd, char* name)
+{
+  uint64_t start_ns = walk_stats_start();
+  side_p->fd = openat(parent_fd, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  walk_stats_stop(WALK_STAT_OPEN, start_ns, 1);
+  if (side_p->fd < 0)
+  {
+    printf("Could not open the directory: %s\n", side_p->path.string);
+    exit(1);
+  }
+}
+
+/**
+ * @brief Reads the entries of the directory being compared of a tree on disk, sorted by name. The directory is left
+ *        open, so the contents of its files and its child directories can be opened relative to it.
+ * @param side_p [in/out] The tree, read from disk. Its path is the path of the directory.
+ * @param parent_fd [in] The open parent of the directory, AT_FDCWD for the base.
+ * @param name [in] The name of the directory in its parent, the path of the base.
+ */
+static void read_directory_entries(Diff_Side* side_p, int parent_fd, char* name)
+{
+  open_side_directory(side_p, parent_fd, name);
+
+  /* The names are copied into one buffer, which may move while it grows, so they are pointed to once all are read. */
+  side_p->entry_count = 0;
+  string_buffer_truncate(&side_p->names, 0);
+  Directory_Reader reader;
+  directory_reader_init(&reader, side_p->fd, side_p->read_buffer, DIRECTORY_READER_BUFFER_SIZE);
+  Directory_Entry entry;
+  while (directory_reader_next(&reader, &entry))
+  {
+    bool entry_is_directory = entry.type == DT_DIR;
+    if (entry.type == DT_UNKNOWN)
+    {
+      struct stat file_info = {0};
+      uint64_t start_ns = walk_stats_start();
+      fstatat(side_p->fd, entry.name, &file_info, AT_SYMLINK_NOFOLLOW);
+      walk_stats_stop(WALK_STAT_LOOKUP, start_ns, 1);
+      entry_is_directory = S_ISDIR(file_info.st_mode);
+    }
+
+    Diff_Entry* entry_p = push_diff_entry(side_p);
+    entry_p->name = (const char*) side_p->names.length;
+    entry_p->name_length = strlen(entry.name);
+    entry_p->is_directory = entry_is_directory;
+    entry_p->has_children = entry_is_directory;
+    entry_p->node_index = SNAPSHOT_NO_INDEX;
+    entry_p->is_paired = false;
+    entry_p->has_size = false;
+    string_buffer_append(&side_p->names, entry.name, entry_p->name_length);
+  }
+  if (reader.error != 0)
+  {
+    printf("Could not read the directory: %s\n", side_p->path.string);
+    exit(1);
+  }
+
+  for (int i = 0; i < side_p->entry_count; i++)
+  {
+    side_p->entries[i].name = side_p->names.string + (size_t) side_p->entries[i].name;
+  }
+  qsort(side_p->entries, side_p->entry_count, sizeof(Diff_Entry), compare_diff_entries);
+}
+
+/**
+ * @brief Closes the directory of a tree on disk once it is compared.
+ * @param side_p [in/out] The tree.
+ */
+static void close_side_directory(Diff_Side* side_p)
+{
+  if (side_p->fd >= 0)
+  {
+    close(side_p->fd);
+    side_p->fd = -1;
+  }
+}
+
+/**
+ * @brief Prints an added, removed or changed entry of the directories being compared.
+ * @param diff_p [in/out] The state of the diff.
+ * @param sign [in] '+' for an added entry, '-' for a removed one and '~' for a changed one.
+ * @param entry_p [in] The entry, from the new tree unless it was removed.
+ */
+static void print_change(Tree_Diff* diff_p, char sign, Diff_Entry* entry_p)
+{
+  String_Buffer* line_p = &diff_p->line;
+  string_buffer_truncate(line_p, 0);
+  diff_p->has_changes = true;
+  if (diff_p->format == OUTPUT_TEXT)
+  {
+    char prefix[2] = {sign, ' '};
+    string_buffer_append(line_p, prefix, 2);
+    string_buffer_append(line_p, diff_p->path.string, diff_p->path.length);
+    string_buffer_append(line_p, entry_p->name, entry_p->name_length);
+    string_buffer_append(line_p, entry_p->is_directory ? "/\n" : "\n", entry_p->is_directory ? 2 : 1);
+    output_writer_write(diff_p->writer_p, line_p->string, line_p->length);
+    return;
+  }
+
+  char* change = sign == '+' ? "added" : sign == '-' ? "removed" : "changed";
+  if (diff_p->format == OUTPUT_JSON)
+  {
+    string_buffer_append(line_p, diff_p->needs_separator ? ",\n" : "\n", diff_p->needs_separator ? 2 : 1);
+    diff_p->needs_separator = true;
+  }
+  string_buffer_append(line_p, "{\"change\":\"", 11);
+  string_buffer_append(line_p, change, strlen(change));
+  string_buffer_append(line_p, "\",\"path\":\"", 10);
+  string_buffer_append_json(line_p, diff_p->path.string, diff_p->path.length);
+  string_buffer_append_json(line_p, entry_p->name, entry_p->name_length);
+  string_buffer_append(line_p, "\",\"type\":\"", 10);
+  char* type = entry_p->is_directory ? "directory\"}" : "file\"}";
+  string_buffer_append(line_p, type, strlen(type));
+  if (diff_p->format == OUTPUT_NDJSON)
+  {
+    string_buffer_append(line_p, "\n", 1);
+  }
+  output_writer_write(diff_p->writer_p, line_p->string, line_p->length);
+}
+
+/**
+ * @brief Compares the contents of a file found in both trees on disk by their hashes. Files that cannot be read are
+ *        reported as changed.
+ * @param diff_p [in/out] The state of the diff, both directories are open.
+ * @param entry_p [in] The file, with the same name in both trees.
+ * @return True if both files could be hashed and their hashes are equal.
+ */
+static bool contents_are_equal(Tree_Diff* diff_p, Diff_Entry* entry_p)
+{
+  /* The names point into the names of the directory, which are not null terminated. */
+  char name[NAME_MAX + 1];
+  memcpy(name, entry_p->name, entry_p->name_length);
+  name[entry_p->name_length] = '\0';
+
+  uint64_t hashes[2];
+  for (int i = 0; i < 2; i++)
+  {
+    uint64_t start_ns = walk_stats_start();
+    bool is_hashed = content_hash_file(diff_p->sides[i].fd, 
+                                       name, 
+                                       false, 
+                                       diff_p->hash_buffer, 
+                                       CONTENT_HASH_BUFFER_SIZE, 
+                                       &hashes[i]);
+    walk_stats_stop(WALK_STAT_HASH, start_ns, 1);
+    if (!is_hashed)
+    {
+      return false;
+    }
+  }
+  return hashes[0] == hashes[1];
+}
+
+/**
+ * @brief Looks up the size and modification time of a file of a directory on disk, relative to the open directory,
+ *        without following links.
+ * @param side_p [in] The tree, read from disk, with the directory of the file open.
+ * @param entry_p [in/out] The file, its size is set.
+ * @return True if the file could be looked up.
+ */
+static bool read_entry_size(Diff_Side* side_p, Diff_Entry* entry_p)
+{
+  /* The names point into the names of the directory, which are not null terminated. */
+  char name[NAME_MAX + 1];
+  memcpy(name, entry_p->name, entry_p->name_length);
+  name[entry_p->name_length] = '\0';
+
+  struct stat file_info = {0};
+  uint64_t start_ns = walk_stats_start();
+  int result = fstatat(side_p->fd, name, &file_info, AT_SYMLINK_NOFOLLOW);
+  walk_stats_stop(WALK_STAT_LOOKUP, start_ns, 1);
+  entry_p->has_size = result == 0;
+  entry_p->size = (uint64_t) file_info.st_size;
+  entry_p->modification_time_ns = file_info.st_mtim.tv_sec * NANOSECONDS_PER_SECOND + file_info.st_mtim.tv_nsec;
+  return entry_p->has_size;
+}
+
+/**
+ * @brief Compares a file found in both trees. Files with a different size changed. Otherwise, with --hash and both
+ *        trees on disk, their contents are compared, and without, their modification times. A file of a snapshot
+ *        saved without sizes cannot be compared and is taken as unchanged, a file on disk that cannot be looked up
+ *        as changed.
+ * @param diff_p [in/out] The state of the diff, the directories of the trees on disk are open.
+ * @param old_entry_p [in/out] The file in the old tree, its size is looked up if it is on disk.
+ * @param new_entry_p [in/out] The file in the new tree, its size is looked up if it is on disk.
+ * @return True if the file is unchanged.
+ */
+static bool files_are_equal(Tree_Diff* diff_p, Diff_Entry* old_entry_p, Diff_Entry* new_entry_p)
+{
+  Diff_Entry* entries[2] = {old_entry_p, new_entry_p};
+  for (int i = 0; i < 2; i++)
+  {
+    if (diff_p->sides[i].snapshot_p == NULL && !read_entry_size(&diff_p->sides[i], entries[i]))
+    {
+      return false;
+    }
+  }
+
+  if (!old_entry_p->has_size || !new_entry_p->has_size)
+  {
+    return true;
+  }
+  if (old_entry_p->size != new_entry_p->size)
+  {
+    return false;
+  }
+  if (diff_p->compare_contents && diff_p->sides[0].snapshot_p == NULL && diff_p->sides[1].snapshot_p == NULL)
+  {
+    return contents_are_equal(diff_p, new_entry_p);
+  }
+  return old_entry_p->modification_time_ns == new_entry_p->modification_time_ns;
+}
+
+/**
+ * @brief Pushes a pair of directories found in both trees, to be compared later. The directories being compared are
+ *        their parents.
+ * @param diff_p [in/out] The state of the diff.
+ * @param old_index [in] The index of the snapshot node of the directory in the old tree.
+ * @param new_index [in] The index of the snapshot node of the directory in the new tree.
+ * @param entry_p [in] The entry of the directory in either tree.
+ * @return The pushed pair.
+ */
+static Diff_Pair* push_diff_pair(Tree_Diff* diff_p, uint32_t old_index, uint32_t new_index, Diff_Entry* entry_p)
+{
+  Diff_Pair* pair_p = (Diff_Pair*) frame_stack_push(&diff_p->pairs);
+  pair_p->old_index = old_index;
+  pair_p->new_index = new_index;
+  pair_p->path_offset = diff_p->pending_paths.length;
+  pair_p->path_length = diff_p->path.length + entry_p->name_length + 1;
+  pair_p->name_length = entry_p->name_length;
+  pair_p->parent_fds[0] = diff_p->sides[0].fd;
+  pair_p->parent_fds[1] = diff_p->sides[1].fd;
+  pair_p->closes_parents = false;
+  string_buffer_append(&diff_p->pending_paths, diff_p->path.string, diff_p->path.length);
+  string_buffer_append(&diff_p->pending_paths, entry_p->name, entry_p->name_length);
+  string_buffer_append(&diff_p->pending_paths, "/", 1);
+  return pair_p;
+}
+
+/**
+ * @brief Pushes the paired child directories of the directories being compared, last first, so they are popped in
+ *        order and the path of the pair on top is always the last of the pending paths. The open directories are
+ *        handed to the pairs, and closed by the one popped last, or closed now if no pair was pushed.
+ * @param diff_p [in/out] The state of the diff.
+ * @param side_p [in] The tree whose entries are paired, the new tree or the only one that was listed.
+ */
+static void push_child_pairs(Tree_Diff* diff_p, Diff_Side* side_p)
+{
+  bool has_pairs = false;
+  for (int i = side_p->entry_count - 1; i >= 0; i--)
+  {
+    Diff_Entry* entry_p = &side_p->entries[i];
+    if (entry_p->is_paired)
+    {
+      Diff_Pair* pair_p = push_diff_pair(diff_p, entry_p->old_node_index, entry_p->node_index, entry_p);
+      pair_p->closes_parents = !has_pairs;
+      has_pairs = true;
+    }
+  }
+
+  if (has_pairs)
+  {
+    diff_p->sides[0].fd = -1;
+    diff_p->sides[1].fd = -1;
+  }
+  else
+  {
+    close_side_directory(&diff_p->sides[0]);
+    close_side_directory(&diff_p->sides[1]);
+  }
+}
+
+/**
+ * @brief Compares a pair of directories with the same path in both trees. Their entries are merged by name, the
+ *        entries found in only one of them are printed and the child directories found in both are pushed.
+ * @param diff_p [in/out] The state of the diff, its path is the path of the directories.
+ * @param pair_p [in] The pair of directories.
+ */
+static void diff_directories(Tree_Diff* diff_p, Diff_Pair* pair_p)
+{
+  Diff_Side* old_p = &diff_p->sides[0];
+  Diff_Side* new_p = &diff_p->sides[1];
+
+  /* The bases are looked up by the paths they were given, the directories below them by name in their parents. */
+  char name[NAME_MAX + 1];
+  char* names[2] = {old_p->base_path, new_p->base_path};
+  if (pair_p->path_length > 0)
+  {
+    memcpy(name, diff_p->path.string + pair_p->path_length - pair_p->name_length - 1, pair_p->name_length);
+    name[pair_p->name_length] = '\0';
+    names[0] = name;
+    names[1] = name;
+  }
+
+  bool old_has_stamp = read_side_stamp(old_p, pair_p->old_index, pair_p->parent_fds[0], names[0], &diff_p->path);
+  bool new_has_stamp = read_side_stamp(new_p, pair_p->new_index, pair_p->parent_fds[1], names[1], &diff_p->path);
+  bool same_entries = old_has_stamp && 
+                      new_has_stamp && 
+                      old_p->stamp.device == new_p->stamp.device && 
+                      old_p->stamp.inode == new_p->stamp.inode && 
+                      old_p->stamp.modification_time_ns == new_p->stamp.modification_time_ns && 
+                      old_p->stamp.change_time_ns == new_p->stamp.change_time_ns;
+
+  if (same_entries && old_p->snapshot_p == NULL && new_p->snapshot_p == NULL)
+  {
+    /* Both paths are the same directory on disk, so everything below it is the same as well. */
+    return;
+  }
+  if (same_entries && (old_p->snapshot_p == NULL) != (new_p->snapshot_p == NULL))
+  {
+    /* The directory on disk has the same entries as when the snapshot was saved, so it is not read. Its child
+       directories are compared, and its files are looked up, since writing to a file does not change its directory.
+       The snapshot index is used for both trees, the one on disk ignores it. */
+    Diff_Side* snapshot_side_p = old_p->snapshot_p != NULL ? old_p : new_p;
+    read_snapshot_entries(snapshot_side_p, snapshot_side_p == old_p ? pair_p->old_index : pair_p->new_index);
+    bool needs_directory = false;
+    for (int i = 0; i < snapshot_side_p->entry_count; i++)
+    {
+      Diff_Entry* entry_p = &snapshot_side_p->entries[i];
+      entry_p->is_paired = entry_p->has_children;
+      entry_p->old_node_index = entry_p->node_index;
+      needs_directory = needs_directory || entry_p->is_paired || entry_p->has_size;
+    }
+
+    /* The directory on disk is only opened to be the parent of its files and child directories. */
+    if (needs_directory)
+    {
+      int disk_side = snapshot_side_p == old_p ? 1 : 0;
+      open_side_directory(&diff_p->sides[disk_side], pair_p->parent_fds[disk_side], names[disk_side]);
+      for (int i = 0; i < snapshot_side_p->entry_count; i++)
+      {
+        Diff_Entry* entry_p = &snapshot_side_p->entries[i];
+        Diff_Entry disk_entry = *entry_p;
+        bool is_equal = !entry_p->has_size || 
+                        (disk_side == 0 ? files_are_equal(diff_p, &disk_entry, entry_p) : 
+                                          files_are_equal(diff_p, entry_p, &disk_entry));
+        if (!is_equal)
+        {
+          print_change(diff_p, '~', entry_p);
+        }
+      }
+    }
+    push_child_pairs(diff_p, snapshot_side_p);
+    return;
+  }
+
+  for (int i = 0; i < 2; i++)
+  {
+    Diff_Side* side_p = &diff_p->sides[i];
+    if (side_p->snapshot_p != NULL)
+    {
+      read_snapshot_entries(side_p, i == 0 ? pair_p->old_index : pair_p->new_index);
+    }
+    else
+    {
+      read_directory_entries(side_p, pair_p->parent_fds[i], names[i]);
+    }
+  }
+
+  int old_index = 0;
+  int new_index = 0;
+  while (old_index < old_p->entry_count || new_index < new_p->entry_count)
+  {
+    Diff_Entry* old_entry_p = &old_p->entries[old_index];
+    Diff_Entry* new_entry_p = &new_p->entries[new_index];
+    int order = old_index == old_p->entry_count ? 1 : 
+                new_index == new_p->entry_count ? -1 : 
+                compare_diff_entries(old_entry_p, new_entry_p);
+    if (order < 0)
+    {
+      print_change(diff_p, '-', old_entry_p);
+      old_index++;
+      continue;
+    }
+    if (order > 0)
+    {
+      print_change(diff_p, '+', new_entry_p);
+      new_index++;
+      continue;
+    }
+
+    if (old_entry_p->is_directory != new_entry_p->is_directory)
+    {
+      print_change(diff_p, '~', new_entry_p);
+    }
+    else if (old_entry_p->is_directory)
+    {
+      new_entry_p->is_paired = old_entry_p->has_children && new_entry_p->has_children;
+      new_entry_p->old_node_index = old_entry_p->node_index;
+    }
+    else if (!files_are_equal(diff_p, old_entry_p, new_entry_p))
+    {
+      print_change(diff_p, '~', new_entry_p);
+    }
+    old_index++;
+    new_index++;
+  }
+  push_child_pairs(diff_p, new_p);
+}
+
+/*> Global Function Definitions **************************************************************************************/
+/**
+ * @brief Prints the differences between two trees: the entries only in the old tree as removed, the entries only in
+ *        the new tree as added, and the entries whose type changed, and the files whose size or modification time
+ *        changed, as changed. Asked to, files in two directories on disk are compared by contents instead of
+ *        modification time. A removed or added directory is printed once, without the entries below it. A tree is a
+ *        directory on disk, or a snapshot file saved with --save or --cache, only the first records the sizes of
+ *        files. Directories whose stamp shows they are unchanged are not read: a directory on disk unchanged since a
+ *        snapshot saved with --cache was taken, or the same directory given twice. Links are not followed.
+ * @param old_path_string [in] The path of the old tree.
+ * @param new_path_string [in] The path of the new tree.
+ * @param compare_contents [in] True if files found in both trees on disk with the same size are compared by the hash
+ *                         of their contents instead of their modification time.
+ * @param output_format [in] How the changes are printed, as lines prefixed with '+', '-' or '~', or as JSON objects
+ *                      with change, path and type.
+ * @param writer_p [in/out] The writer the changes are printed to.
+ * @return True if the trees differ, so a change was printed.
+ */
+bool diff_directory_trees(char* old_path_string, 
+                          char* new_path_string, 
+                          bool compare_contents, 
+                          Output_Format output_format, 
+                          Output_Writer* writer_p)
+{
+  Tree_Diff diff;
+  open_diff_side(&diff.sides[0], old_path_string);
+  open_diff_side(&diff.sides[1], new_path_string);
+  diff.compare_contents = compare_contents;
+  diff.format = output_format;
+  diff.writer_p = writer_p;
+  diff.needs_separator = false;
+  diff.has_changes = false;
+  string_buffer_init(&diff.path);
+  string_buffer_init(&diff.line);
+  string_buffer_init(&diff.pending_paths);
+  frame_stack_init(&diff.pairs, sizeof(Diff_Pair));
+  diff.hash_buffer = compare_contents ? (char*) allocate_or_exit(CONTENT_HASH_BUFFER_SIZE) : NULL;
+
+  if (output_format == OUTPUT_JSON)
+  {
+    output_writer_write(writer_p, "[", 1);
+  }
+
+  /* The bases are the pair with an empty path. */
+  Diff_Pair* pair_p = (Diff_Pair*) frame_stack_push(&diff.pairs);
+  pair_p->old_index = 0;
+  pair_p->new_index = 0;
+  pair_p->path_offset = 0;
+  pair_p->path_length = 0;
+  pair_p->name_length = 0;
+  pair_p->parent_fds[0] = AT_FDCWD;
+  pair_p->parent_fds[1] = AT_FDCWD;
+  pair_p->closes_parents = false;
+  while (diff.pairs.count > 0)
+  {
+    Diff_Pair pair = *(Diff_Pair*) frame_stack_pop(&diff.pairs);
+    string_buffer_truncate(&diff.path, 0);
+    string_buffer_append(&diff.path, diff.pending_paths.string + pair.path_offset, pair.path_length);
+    string_buffer_truncate(&diff.pending_paths, pair.path_offset);
+    diff_directories(&diff, &pair);
+    for (int i = 0; pair.closes_parents && i < 2; i++)
+    {
+      if (pair.parent_fds[i] >= 0)
+      {
+        close(pair.parent_fds[i]);
+      }
+    }
+  }
+
+  if (output_format == OUTPUT_JSON)
+  {
+    output_writer_write(writer_p, diff.needs_separator ? "\n]\n" : "]\n", diff.needs_separator ? 3 : 2);
+  }
+
+  free(diff.hash_buffer);
+  frame_stack_free(&diff.pairs);
+  string_buffer_free(&diff.pending_paths);
+  string_buffer_free(&diff.line);
+  string_buffer_free(&diff.path);
+  free_diff_side(&diff.sides[0]);
+  free_diff_side(&diff.sides[1]);
+  return diff.has_changes;
+}
@@ -0,0 +1,312 @@
+/*> Description ******************************************************************************************************/
+/**
+* @brief Defines a minimal io_uring backend, talking to the kernel through the raw system calls. A batch of requests
+*        is queued as far as the ring allows, and completions are consumed in whatever order the kernel finishes them.
+* @file uring.c
+*/
+
+/*> Includes *********************************************************************************************************/
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "uring.h"
+
+/*> Defines **********************************************************************************************************/
+#define PROBE_OPERATION_COUNT 256
+
+/*> Type Declarations ************************************************************************************************/
+/**
+ * @brief Fills the submission queue entry of one request of a batch.
+ * @param sqe_p The entry to fill, cleared before the call.
+ * @param index The index of the request in the batch.
+ * @param batch_p The data of the batch.
+ */
+typedef void (*Prepare_Request)(struct io_uring_sqe* sqe_p, int index, void* batch_p);
+
+/**
+ * @brief The data of a batch of statx or openat requests on the entries of one directory.
+ * @param directory_fd The directory the names are relative to.
+ * @param requests The requests.
+ * @param flags The open flags of an openat batch, or the AT_ flags of a statx batch.
+ */
+typedef struct Uring_Batch
+{
+  int directory_fd;
+  Uring_Request* requests;
+  int flags;
+} Uring_Batch;
+
+/*> Global Constant Definitions **************************************************************************************/
+
+/*> Global Variable Definitions **************************************************************************************/
+
+/*> Local Constant Definitions ***************************************************************************************/
+
+/*> Local Variable Definitions ***************************************************************************************/
+
+/*> Local Function Declarations **************************************************************************************/
+static bool supports_operations(int ring_fd);
+
+static void prepare_statx(struct io_uring_sqe* sqe_p, int index, void* batch_p);
+
+static void prepare_openat(struct io_uring_sqe* sqe_p, int index, void* batch_p);
+
+static void run_batch(Uring* uring_p, Uring_Request* requests, int count, Prepare_Request prepare, void* batch_p);
+
+/*> Local Function Definitions ***************************************************************************************/
+/**
+ * @brief Checks if the kernel supports the statx and openat operations.
+ * @param ring_fd [in] The fd of the io_uring instance.
+ * @return True if both operations are supported, false otherwise.
+ */
+static bool supports_operations(int ring_fd)
+{
+  size_t probe_size = sizeof(struct io_uring_probe) + PROBE_OPERATION_COUNT * sizeof(struct io_uring_probe_op);
+  struct io_uring_probe* probe_p = (struct io_uring_probe*) calloc(1, probe_size);
+  if (probe_p == NULL)
+  {
+    return false;
+  }
+
+  bool supported = false;
+  if (syscall(__NR_io_uring_register, ring_fd, IORING_REGISTER_PROBE, probe_p, PROBE_OPERATION_COUNT) == 0)
+  {
+    supported = probe_p->last_op >= IORING_OP_STATX && 
+                probe_p->last_op >= IORING_OP_OPENAT &&
+                (probe_p->ops[IORING_OP_STATX].flags & IO_URING_OP_SUPPORTED) &&
+                (probe_p->ops[IORING_OP_OPENAT].flags & IO_URING_OP_SUPPORTED);
+  }
+
+  free(probe_p);
+  return supported;
+}
+
+/**
+ * @brief Fills the entry of a statx request. Symbolic links are followed like stat does, unless the batch has
+ *        AT_SYMLINK_NOFOLLOW set.
+ * @param sqe_p [out] The entry to fill.
+ * @param index [in] The index of the entry in the batch.
+ * @param batch_p [in] The Uring_Batch.
+ */
+static void prepare_statx(struct io_uring_sqe* sqe_p, int index, void* batch_p)
+{
+  Uring_Batch* batch = (Uring_Batch*) batch_p;
+  sqe_p->opcode = IORING_OP_STATX;
+  sqe_p->fd = batch->directory_fd;
+  sqe_p->addr = (uint64_t) (uintptr_t) batch->requests[index].name;
+  sqe_p->len = STATX_BASIC_STATS;
+  sqe_p->off = (uint64_t) (uintptr_t) &batch->requests[index].info;
+  sqe_p->statx_flags = AT_STATX_SYNC_AS_STAT | batch->flags;
+}
+
+/**
+ * @brief Fills the entry of an openat request.
+ * @param sqe_p [out] The entry to fill.
+ * @param index [in] The index of the entry in the batch.
+ * @param batch_p [in] The Uring_Batch.
+ */
+static void prepare_openat(struct io_uring_sqe* sqe_p, int index, void* batch_p)
+{
+  Uring_Batch* batch = (Uring_Batch*) batch_p;
+  sqe_p->opcode = IORING_OP_OPENAT;
+  sqe_p->fd = batch->directory_fd;
+  sqe_p->addr = (uint64_t) (uintptr_t) batch->requests[index].name;
+  sqe_p->len = 0;
+  sqe_p->open_flags = batch->flags;
+}
+
+/**
+ * @brief Runs a batch of requests. Keeps the ring as full as possible and stores each result as it completes.
+ * @param uring_p [in/out] The io_uring instance.
+ * @param requests [out] The requests, their results are set as they complete.
+ * @param count [in] The number of requests.
+ * @param prepare [in] Fills the entry of a request.
+ * @param batch_p [in] The data passed to prepare.
+ */
+static void run_batch(Uring* uring_p, Uring_Request* requests, int count, Prepare_Request prepare, void* batch_p)
+{
+  int next_index = 0;
+  int completed_count = 0;
+  unsigned in_flight = 0;
+  unsigned unsubmitted = 0;
+
+  while (completed_count < count)
+  {
+    unsigned tail = *uring_p->sq_tail;
+    while (next_index < count && in_flight < uring_p->entries)
+    {
+      unsigned slot = tail & *uring_p->sq_ring_mask;
+      struct io_uring_sqe* sqe_p = &uring_p->sqes[slot];
+      memset(sqe_p, 0, sizeof(struct io_uring_sqe));
+      prepare(sqe_p, next_index, batch_p);
+      sqe_p->user_data = (uint64_t) next_index;
+      uring_p->sq_array[slot] = slot;
+      tail++;
+      next_index++;
+      in_flight++;
+      unsubmitted++;
+    }
+    __atomic_store_n(uring_p->sq_tail, tail, __ATOMIC_RELEASE);
+
+    int submitted = syscall(__NR_io_uring_enter, uring_p->ring_fd, unsubmitted, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+    if (submitted < 0)
+    {
+      if (errno == EINTR || errno == EAGAIN || errno == EBUSY)
+      {
+        continue;
+      }
+      printf("Could not submit requests to io_uring.\n");
+      exit(1);
+    }
+    unsubmitted -= (unsigned) submitted;
+
+    unsigned head = *uring_p->cq_head;
+    unsigned cq_tail = __atomic_load_n(uring_p->cq_tail, __ATOMIC_ACQUIRE);
+    while (head != cq_tail)
+    {
+      struct io_uring_cqe* cqe_p = &uring_p->cqes[head & *uring_p->cq_ring_mask];
+      requests[cqe_p->user_data].result = cqe_p->res;
+      head++;
+      in_flight--;
+      completed_count++;
+    }
+    __atomic_store_n(uring_p->cq_head, head, __ATOMIC_RELEASE);
+  }
+}
+
+/*> Global Function Definitions **************************************************************************************/
+/**
+ * @brief Sets up an io_uring instance with URING_ENTRIES entries.
+ * @param uring_p [out] The instance to set up.
+ * @return True if io_uring, statx and openat are supported by the kernel, false otherwise. Nothing needs to be freed
+ *         when false is returned.
+ */
+bool uring_init(Uring* uring_p)
+{
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  memset(uring_p, 0, sizeof(Uring));
+
+  uring_p->ring_fd = syscall(__NR_io_uring_setup, URING_ENTRIES, &params);
+  if (uring_p->ring_fd < 0)
+  {
+    return false;
+  }
+
+  if (!supports_operations(uring_p->ring_fd))
+  {
+    close(uring_p->ring_fd);
+    return false;
+  }
+
+  uring_p->entries = params.sq_entries;
+  uring_p->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  uring_p->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  bool single_mapping = params.features & IORING_FEAT_SINGLE_MMAP;
+  if (single_mapping && uring_p->cq_ring_size > uring_p->sq_ring_size)
+  {
+    uring_p->sq_ring_size = uring_p->cq_ring_size;
+  }
+
+  uring_p->sq_ring_p = mmap(NULL, uring_p->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                            uring_p->ring_fd, IORING_OFF_SQ_RING);
+  if (uring_p->sq_ring_p == MAP_FAILED)
+  {
+    close(uring_p->ring_fd);
+    return false;
+  }
+
+  uring_p->cq_ring_p = uring_p->sq_ring_p;
+  if (!single_mapping)
+  {
+    uring_p->cq_ring_p = mmap(NULL, uring_p->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                              uring_p->ring_fd, IORING_OFF_CQ_RING);
+    if (uring_p->cq_ring_p == MAP_FAILED)
+    {
+      munmap(uring_p->sq_ring_p, uring_p->sq_ring_size);
+      close(uring_p->ring_fd);
+      return false;
+    }
+  }
+
+  uring_p->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+  uring_p->sqes = (struct io_uring_sqe*) mmap(NULL, uring_p->sqes_size, PROT_READ | PROT_WRITE,
+                                              MAP_SHARED | MAP_POPULATE, uring_p->ring_fd, IORING_OFF_SQES);
+  if (uring_p->sqes == MAP_FAILED)
+  {
+    if (!single_mapping)
+    {
+      munmap(uring_p->cq_ring_p, uring_p->cq_ring_size);
+    }
+    munmap(uring_p->sq_ring_p, uring_p->sq_ring_size);
+    close(uring_p->ring_fd);
+    return false;
+  }
+
+  char* sq_ring = (char*) uring_p->sq_ring_p;
+  char* cq_ring = (char*) uring_p->cq_ring_p;
+  uring_p->sq_head = (unsigned*) (sq_ring + params.sq_off.head);
+  uring_p->sq_tail = (unsigned*) (sq_ring + params.sq_off.tail);
+  uring_p->sq_ring_mask = (unsigned*) (sq_ring + params.sq_off.ring_mask);
+  uring_p->sq_array = (unsigned*) (sq_ring + params.sq_off.array);
+  uring_p->cq_head = (unsigned*) (cq_ring + params.cq_off.head);
+  uring_p->cq_tail = (unsigned*) (cq_ring + params.cq_off.tail);
+  uring_p->cq_ring_mask = (unsigned*) (cq_ring + params.cq_off.ring_mask);
+  uring_p->cqes = (struct io_uring_cqe*) (cq_ring + params.cq_off.cqes);
+
+  return true;
+}
+
+/**
+ * @brief Unmaps the rings and closes an io_uring instance set up by uring_init.
+ * @param uring_p [in/out] The instance to free.
+ */
+void uring_free(Uring* uring_p)
+{
+  munmap(uring_p->sqes, uring_p->sqes_size);
+  if (uring_p->cq_ring_p != uring_p->sq_ring_p)
+  {
+    munmap(uring_p->cq_ring_p, uring_p->cq_ring_size);
+  }
+  munmap(uring_p->sq_ring_p, uring_p->sq_ring_size);
+  close(uring_p->ring_fd);
+}
+
+/**
+ * @brief Runs statx on entries of a directory in a batch.
+ * @param uring_p [in/out] The io_uring instance.
+ * @param directory_fd [in] The open directory the names are relative to.
+ * @param requests [in/out] The requests, count long. The result and info of each request are set.
+ * @param count [in] The number of requests.
+ * @param flags [in] AT_SYMLINK_NOFOLLOW to look up symbolic links themselves, 0 to follow them.
+ */
+void uring_statx_batch(Uring* uring_p, int directory_fd, Uring_Request* requests, int count, int flags)
+{
+  Uring_Batch batch = {directory_fd, requests, flags};
+  run_batch(uring_p, requests, count, prepare_statx, &batch);
+}
+
+/**
+ * @brief Opens entries of a directory in a batch.
+ * @param uring_p [in/out] The io_uring instance.
+ * @param directory_fd [in] The open directory the names are relative to.
+ * @param requests [in/out] The requests, count long. The result of each request is set to the opened fd.
+ * @param count [in] The number of requests.
+ * @param flags [in] The flags passed to openat.
+ */
+void uring_openat_batch(Uring* uring_p, int directory_fd, Uring_Request* requests, int count, int flags)
+{
+  Uring_Batch batch = {directory_fd, requests, flags};
+  run_batch(uring_p, requests, count, prepare_openat, &batch);
+}
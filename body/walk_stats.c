@@ -0,0 +1,190 @@
+/*> Description ******************************************************************************************************/
+/**
+* @brief Defines the counters and timers of --stats. Counters are shared by all threads and updated atomically, and
+*        printed to stderr when the program exits.
+* @file walk_stats.c
+*/
+
+/*> Includes *********************************************************************************************************/
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "walk_stats.h"
+
+/*> Defines **********************************************************************************************************/
+
+/*> Type Declarations ************************************************************************************************/
+/**
+ * @brief The counter and timer of one kind of call.
+ * @param count The number of calls.
+ * @param total_ns The total time of the calls in nanoseconds.
+ */
+typedef struct Walk_Stat
+{
+  atomic_uint_fast64_t count;
+  atomic_uint_fast64_t total_ns;
+} Walk_Stat;
+
+/*> Global Constant Definitions **************************************************************************************/
+
+/*> Global Variable Definitions **************************************************************************************/
+bool walk_stats_enabled = false;
+
+/*> Local Constant Definitions ***************************************************************************************/
+static const char* WALK_STAT_NAMES[WALK_STAT_KIND_COUNT] = 
+{
+  "open", "read", "lookup", "allocate", "write", "hash", "create", "print", "stream"
+};
+
+/*> Local Variable Definitions ***************************************************************************************/
+static Walk_Stat stats[WALK_STAT_KIND_COUNT];
+static atomic_uint_fast64_t level_entry_counts[WALK_STATS_MAX_LEVEL + 1];
+static Walk_Stats_Format stats_format = WALK_STATS_TEXT;
+
+/*> Local Function Declarations **************************************************************************************/
+static int get_deepest_level(void);
+
+static void print_text_stats(void);
+
+static void print_json_stats(void);
+
+static void print_stats(void);
+
+/*> Local Function Definitions ***************************************************************************************/
+/**
+ * @brief Gets the deepest level with entries.
+ * @return The deepest level, 0 if no entries were counted.
+ */
+static int get_deepest_level(void)
+{
+  int deepest_level = 0;
+  for (int level = 1; level <= WALK_STATS_MAX_LEVEL; level++)
+  {
+    if (atomic_load(&level_entry_counts[level]) > 0)
+    {
+      deepest_level = level;
+    }
+  }
+  return deepest_level;
+}
+
+/**
+ * @brief Prints the stats as a table.
+ */
+static void print_text_stats(void)
+{
+  fprintf(stderr, "\n%-10s %12s %12s %12s\n", "call", "count", "total ms", "average us");
+  for (int kind = 0; kind < WALK_STAT_KIND_COUNT; kind++)
+  {
+    uint64_t count = atomic_load(&stats[kind].count);
+    if (count == 0)
+    {
+      continue;
+    }
+    double total_ms = atomic_load(&stats[kind].total_ns) / 1e6;
+    fprintf(stderr, "%-10s %12llu %12.3f %12.3f\n", 
+            WALK_STAT_NAMES[kind], 
+            (unsigned long long) count, 
+            total_ms, 
+            total_ms * 1000 / count);
+  }
+
+  int deepest_level = get_deepest_level();
+  if (deepest_level > 0)
+  {
+    fprintf(stderr, "\n%-10s %12s\n", "level", "entries");
+    for (int level = 1; level <= deepest_level; level++)
+    {
+      fprintf(stderr, "%-3d%-7s %12llu\n", 
+              level, 
+              level == WALK_STATS_MAX_LEVEL ? "+" : "", 
+              (unsigned long long) atomic_load(&level_entry_counts[level]));
+    }
+  }
+}
+
+/**
+ * @brief Prints the stats as one JSON object.
+ */
+static void print_json_stats(void)
+{
+  fprintf(stderr, "{\"calls\": {");
+  for (int kind = 0; kind < WALK_STAT_KIND_COUNT; kind++)
+  {
+    fprintf(stderr, "%s\"%s\": {\"count\": %llu, \"seconds\": %.9f}", 
+            kind == 0 ? "" : ", ",
+            WALK_STAT_NAMES[kind], 
+            (unsigned long long) atomic_load(&stats[kind].count), 
+            atomic_load(&stats[kind].total_ns) / 1e9);
+  }
+
+  fprintf(stderr, "}, \"entries_per_level\": [");
+  int deepest_level = get_deepest_level();
+  for (int level = 1; level <= deepest_level; level++)
+  {
+    fprintf(stderr, "%s%llu", level == 1 ? "" : ", ", (unsigned long long) atomic_load(&level_entry_counts[level]));
+  }
+  fprintf(stderr, "]}\n");
+}
+
+/**
+ * @brief Prints the stats in the chosen format, run when the program exits.
+ */
+static void print_stats(void)
+{
+  if (stats_format == WALK_STATS_JSON)
+  {
+    print_json_stats();
+  }
+  else
+  {
+    print_text_stats();
+  }
+}
+
+/*> Global Function Definitions **************************************************************************************/
+/**
+ * @brief Turns on counting and timing, and prints the stats to stderr when the program exits.
+ * @param format [in] The format of the printed stats.
+ */
+void walk_stats_enable(Walk_Stats_Format format)
+{
+  stats_format = format;
+  walk_stats_enabled = true;
+  atexit(print_stats);
+}
+
+/**
+ * @brief Counts and times calls. Called through walk_stats_stop.
+ * @param kind [in] The kind of call.
+ * @param start_ns [in] The time returned by walk_stats_start.
+ * @param count [in] The number of calls.
+ */
+void walk_stats_add(Walk_Stat_Kind kind, uint64_t start_ns, uint64_t count)
+{
+  uint64_t stop_ns = walk_stats_start();
+  atomic_fetch_add_explicit(&stats[kind].count, count, memory_order_relaxed);
+  atomic_fetch_add_explicit(&stats[kind].total_ns, stop_ns - start_ns, memory_order_relaxed);
+}
+
+/**
+ * @brief Counts entries of a level. Called through walk_stats_count_entry.
+ * @param level [in] The level, 1 for the children of the base. Deeper levels than WALK_STATS_MAX_LEVEL are counted
+ *              together.
+ * @param count [in] The number of entries.
+ */
+void walk_stats_add_entries(int level, uint64_t count)
+{
+  if (level > WALK_STATS_MAX_LEVEL)
+  {
+    level = WALK_STATS_MAX_LEVEL;
+  }
+  if (level < 0)
+  {
+    level = 0;
+  }
+  atomic_fetch_add_explicit(&level_entry_counts[level], count, memory_order_relaxed);
+}
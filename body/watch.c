@@ -0,0 +1,641 @@
+/*> Description ******************************************************************************************************/
+/**
+* @brief Defines the watch mode. Every directory of the tree whose children are shown gets an inotify watch, and the
+*        events are applied to the nodes in memory, so the file system is only read for added files.
+* @file watch.c
+*/
+
+/*> Includes *********************************************************************************************************/
+#include <errno.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "directory_tree.h"
+#include "frame_stack.h"
+#include "output_writer.h"
+#include "string_util.h"
+#include "watch.h"
+
+/*> Defines **********************************************************************************************************/
+#define WATCH_EVENT_MASK (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | \
+                          IN_ONLYDIR | IN_EXCL_UNLINK)
+#define WATCH_EVENT_BUFFER_SIZE (64 * 1024)
+#define INITIAL_WATCH_CAPACITY 1024
+#define CLEAR_SCREEN "\033[H\033[2J"
+#define MILLISECONDS_PER_SECOND 1000LL
+#define NANOSECONDS_PER_MILLISECOND 1000000LL
+
+/*> Type Declarations ************************************************************************************************/
+/**
+ * @brief A watched directory of the tree.
+ * @param node The node of the directory, or NULL if the watch was removed.
+ * @param children_capacity The number of children the children array of node has room for. Arrays read with the tree
+ *                          are exactly sized, arrays grown by the watch have room to spare.
+ */
+typedef struct Watched_Directory
+{
+  Directory_Tree* node;
+  int children_capacity;
+} Watched_Directory;
+
+/**
+ * @brief State of the watch mode.
+ * @param base_path_string The base path the tree was created from.
+ * @param dir_tree The base of the watched tree.
+ * @param options_p How the tree is read.
+ * @param writer_p The writer the tree is printed to.
+ * @param print_changes_only True if only the added and removed paths are printed, false if the whole tree is.
+ * @param inotify_fd The inotify instance.
+ * @param watches The watched directories, indexed by watch descriptor.
+ * @param watch_capacity The number of watch descriptors watches has room for.
+ * @param changes The lines of the added and removed paths since the last print.
+ * @param path The path of a node, rebuilt from its parents when it is watched or printed as a change.
+ * @param tree_changed True if the tree changed since the last print.
+ * @param needs_rebuild True if events were lost, so the tree has to be read again.
+ * @param dead_bytes The bytes of the arena of the tree held by removed nodes and outgrown children arrays, freed when
+ *                   the tree is compacted.
+ */
+typedef struct Watch
+{
+  char* base_path_string;
+  Directory_Tree* dir_tree;
+  Directory_Tree_Options* options_p;
+  Output_Writer* writer_p;
+  bool print_changes_only;
+  int inotify_fd;
+  Watched_Directory* watches;
+  int watch_capacity;
+  String_Buffer changes;
+  String_Buffer path;
+  bool tree_changed;
+  bool needs_rebuild;
+  size_t dead_bytes;
+} Watch;
+
+/*> Global Constant Definitions **************************************************************************************/
+
+/*> Global Variable Definitions **************************************************************************************/
+
+/*> Local Constant Definitions ***************************************************************************************/
+
+/*> Local Variable Definitions ***************************************************************************************/
+
+/*> Local Function Declarations **************************************************************************************/
+static void start_watch(Watch* watch_p);
+
+static void stop_watch(Watch* watch_p);
+
+static void add_watch(Watch* watch_p, Directory_Tree* dir_tree);
+
+static void add_subtree_watches(Watch* watch_p, Directory_Tree* dir_tree);
+
+static void remove_subtree_watches(Watch* watch_p, Directory_Tree* dir_tree);
+
+static void add_change(Watch* watch_p, char sign, Directory_Tree* dir_tree);
+
+static int find_child(Directory_Tree* dir_tree, char* file_name);
+
+static void add_child(Watch* watch_p, Watched_Directory* watched_p, char* file_name, bool replace_existing);
+
+static void remove_child(Watch* watch_p, Watched_Directory* watched_p, char* file_name, bool was_moved);
+
+static size_t get_subtree_bytes(Directory_Tree* dir_tree);
+
+static void handle_event(Watch* watch_p, struct inotify_event* event_p);
+
+static void read_events(Watch* watch_p);
+
+static int64_t get_monotonic_time_ms(void);
+
+static void wait_for_changes(Watch* watch_p);
+
+static void rebuild_tree(Watch* watch_p);
+
+static void compact_watched_tree(Watch* watch_p);
+
+static void print_watched_tree(Watch* watch_p);
+
+/*> Local Function Definitions ***************************************************************************************/
+/**
+ * @brief Creates the inotify instance and watches every directory of the tree whose children are shown.
+ * @param watch_p [in/out] The state of the watch mode.
+ */
+static void start_watch(Watch* watch_p)
+{
+  watch_p->inotify_fd = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+  if (watch_p->inotify_fd < 0)
+  {
+    printf("Could not watch the directory tree.\n");
+    exit(1);
+  }
+  add_subtree_watches(watch_p, watch_p->dir_tree);
+}
+
+/**
+ * @brief Closes the inotify instance, which removes all its watches.
+ * @param watch_p [in/out] The state of the watch mode.
+ */
+static void stop_watch(Watch* watch_p)
+{
+  close(watch_p->inotify_fd);
+  memset(watch_p->watches, 0, watch_p->watch_capacity * sizeof(Watched_Directory));
+}
+
+/**
+ * @brief Watches one directory of the tree.
+ * @param watch_p [in/out] The state of the watch mode.
+ * @param dir_tree [in] The node of the directory.
+ */
+static void add_watch(Watch* watch_p, Directory_Tree* dir_tree)
+{
+  string_buffer_truncate(&watch_p->path, 0);
+  append_directory_tree_path(dir_tree, &watch_p->path);
+  int wd = inotify_add_watch(watch_p->inotify_fd, watch_p->path.string, WATCH_EVENT_MASK);
+  if (wd < 0)
+  {
+    if (errno == ENOSPC)
+    {
+      printf("Could not watch the directory: %s (raise fs.inotify.max_user_watches)\n", watch_p->path.string);
+      exit(1);
+    }
+
+    /* The directory was removed after it was read, its parent reports the removal. */
+    return;
+  }
+
+  if (wd >= watch_p->watch_capacity)
+  {
+    int old_capacity = watch_p->watch_capacity;
+    while (wd >= watch_p->watch_capacity)
+    {
+      watch_p->watch_capacity *= 2;
+    }
+    watch_p->watches = (Watched_Directory*) realloc(watch_p->watches, 
+                                                    watch_p->watch_capacity * sizeof(Watched_Directory));
+    if (watch_p->watches == NULL)
+    {
+      printf("Could not allocate memory for the directory tree.\n");
+      exit(1);
+    }
+    memset(&watch_p->watches[old_capacity], 0, (watch_p->watch_capacity - old_capacity) * sizeof(Watched_Directory));
+  }
+
+  watch_p->watches[wd].node = dir_tree;
+  watch_p->watches[wd].children_capacity = dir_tree->children_count;
+}
+
+/**
+ * @brief Watches a directory and all directories below it whose children are shown.
+ * @param watch_p [in/out] The state of the watch mode.
+ * @param dir_tree [in] The node of the directory.
+ */
+static void add_subtree_watches(Watch* watch_p, Directory_Tree* dir_tree)
+{
+  /* The directories left to watch are kept on a stack, so deep trees do not recurse. */
+  Frame_Stack pending;
+  frame_stack_init(&pending, sizeof(Directory_Tree*));
+  *(Directory_Tree**) frame_stack_push(&pending) = dir_tree;
+  while (pending.count > 0)
+  {
+    Directory_Tree* node = *(Directory_Tree**) frame_stack_pop(&pending);
+    if (!node->is_directory || node->depth <= 0)
+    {
+      continue;
+    }
+
+    add_watch(watch_p, node);
+    for (int i = 0; i < node->children_count; i++)
+    {
+      *(Directory_Tree**) frame_stack_push(&pending) = node->children[i];
+    }
+  }
+  frame_stack_free(&pending);
+}
+
+/**
+ * @brief Removes the watches of a directory moved out of its parent and of all directories below it. A moved
+ *        directory keeps its watches, so they would otherwise report events for nodes no longer in the tree.
+ * @param watch_p [in/out] The state of the watch mode.
+ * @param dir_tree [in] The node of the moved directory.
+ */
+static void remove_subtree_watches(Watch* watch_p, Directory_Tree* dir_tree)
+{
+  /* Moving a directory is rare, so the watched nodes are checked for being below it instead of keeping a map from
+     nodes to watches. */
+  for (int wd = 0; wd < watch_p->watch_capacity; wd++)
+  {
+    Directory_Tree* node = watch_p->watches[wd].node;
+    while (node != NULL && node != dir_tree)
+    {
+      node = node->parent;
+    }
+    if (node != NULL)
+    {
+      inotify_rm_watch(watch_p->inotify_fd, wd);
+      watch_p->watches[wd].node = NULL;
+    }
+  }
+}
+
+/**
+ * @brief Records an added or removed path, to be printed when only changes are printed.
+ * @param watch_p [in/out] The state of the watch mode.
+ * @param sign [in] '+' for an added path, '-' for a removed one.
+ * @param dir_tree [in] The node of the path.
+ */
+static void add_change(Watch* watch_p, char sign, Directory_Tree* dir_tree)
+{
+  watch_p->tree_changed = true;
+  if (watch_p->print_changes_only)
+  {
+    char prefix[2] = {sign, ' '};
+    string_buffer_append(&watch_p->changes, prefix, 2);
+    append_directory_tree_path(dir_tree, &watch_p->changes);
+    string_buffer_append(&watch_p->changes, "\n", 1);
+  }
+}
+
+/**
+ * @brief Finds a child of a directory by its name.
+ * @param dir_tree [in] The node of the directory.
+ * @param file_name [in] The name of the child, without '/'.
+ * @return The index of the child, or -1 if the directory has no such child.
+ */
+static int find_child(Directory_Tree* dir_tree, char* file_name)
+{
+  size_t name_length = strlen(file_name);
+  for (int i = 0; i < dir_tree->children_count; i++)
+  {
+    Directory_Tree* child = dir_tree->children[i];
+    if ((size_t) child->file_name_length == name_length && memcmp(child->file_name, file_name, name_length) == 0)
+    {
+      return i;
+    }
+  }
+  return -1;
+}
+
+/**
+ * @brief Adds a file created in or moved to a watched directory. Without a sort order, new entries are shown after
+ *        the existing ones.
+ * @param watch_p [in/out] The state of the watch mode.
+ * @param watched_p [in/out] The watched directory.
+ * @param file_name [in] The name of the file.
+ * @param replace_existing [in] True if a child of the same name is replaced, as by a rename over it. Otherwise the
+ *                         file is already in the tree if it was read before its event arrived.
+ */
+static void add_child(Watch* watch_p, Watched_Directory* watched_p, char* file_name, bool replace_existing)
+{
+  Directory_Tree* dir_tree = watched_p->node;
+  if (find_child(dir_tree, file_name) >= 0)
+  {
+    if (!replace_existing)
+    {
+      return;
+    }
+    remove_child(watch_p, watched_p, file_name, true);
+  }
+
+  Directory_Tree* child = create_directory_tree_child(watch_p->dir_tree, dir_tree, file_name, watch_p->options_p);
+  if (child == NULL)
+  {
+    return;
+  }
+
+  if (dir_tree->children_count == watched_p->children_capacity)
+  {
+    /* The old array stays in the arena of the tree until the tree is compacted. */
+    int capacity = watched_p->children_capacity < 4 ? 8 : 2 * watched_p->children_capacity;
+    watch_p->dead_bytes += watched_p->children_capacity * sizeof(Directory_Tree*);
+    Directory_Tree** children = (Directory_Tree**) allocate_directory_tree_memory(watch_p->dir_tree, 
+                                                                                  capacity * sizeof(Directory_Tree*));
+    memcpy(children, dir_tree->children, dir_tree->children_count * sizeof(Directory_Tree*));
+    dir_tree->children = children;
+    watched_p->children_capacity = capacity;
+  }
+  dir_tree->children[dir_tree->children_count] = child;
+  dir_tree->children_count++;
+  if (watch_p->options_p->sort_order != SORT_NONE)
+  {
+    sort_directory_tree_children(dir_tree, watch_p->options_p);
+  }
+
+  add_subtree_watches(watch_p, child);
+  add_change(watch_p, '+', child);
+}
+
+/**
+ * @brief Removes a file deleted from or moved out of a watched directory.
+ * @param watch_p [in/out] The state of the watch mode.
+ * @param watched_p [in/out] The watched directory.
+ * @param file_name [in] The name of the file.
+ * @param was_moved [in] True if the file was moved, so a directory still has watches below it.
+ */
+static void remove_child(Watch* watch_p, Watched_Directory* watched_p, char* file_name, bool was_moved)
+{
+  Directory_Tree* dir_tree = watched_p->node;
+  int index = find_child(dir_tree, file_name);
+  if (index < 0)
+  {
+    return;
+  }
+
+  Directory_Tree* child = dir_tree->children[index];
+  if (was_moved && child->is_directory)
+  {
+    remove_subtree_watches(watch_p, child);
+  }
+
+  /* The nodes stay in the arena of the tree until the tree is compacted. */
+  watch_p->dead_bytes += get_subtree_bytes(child);
+  memmove(&dir_tree->children[index], 
+          &dir_tree->children[index + 1], 
+          (dir_tree->children_count - index - 1) * sizeof(Directory_Tree*));
+  dir_tree->children_count--;
+
+  add_change(watch_p, '-', child);
+}
+
+/**
+ * @brief Estimates the bytes of the arena of the tree held by a node and everything below it. Names shared with other
+ *        nodes are counted as well.
+ * @param dir_tree [in] The node.
+ * @return The number of bytes.
+ */
+static size_t get_subtree_bytes(Directory_Tree* dir_tree)
+{
+  size_t byte_count = 0;
+  Frame_Stack pending;
+  frame_stack_init(&pending, sizeof(Directory_Tree*));
+  *(Directory_Tree**) frame_stack_push(&pending) = dir_tree;
+  while (pending.count > 0)
+  {
+    Directory_Tree* node = *(Directory_Tree**) frame_stack_pop(&pending);
+    byte_count += sizeof(Directory_Tree) + node->file_name_length + 1 + node->children_count * sizeof(Directory_Tree*);
+    for (int i = 0; i < node->children_count; i++)
+    {
+      *(Directory_Tree**) frame_stack_push(&pending) = node->children[i];
+    }
+  }
+  frame_stack_free(&pending);
+  return byte_count;
+}
+
+/**
+ * @brief Applies one inotify event to the tree.
+ * @param watch_p [in/out] The state of the watch mode.
+ * @param event_p [in] The event.
+ */
+static void handle_event(Watch* watch_p, struct inotify_event* event_p)
+{
+  if (event_p->mask & IN_Q_OVERFLOW)
+  {
+    watch_p->needs_rebuild = true;
+    return;
+  }
+
+  if (event_p->wd < 0 || event_p->wd >= watch_p->watch_capacity || watch_p->watches[event_p->wd].node == NULL)
+  {
+    return;
+  }
+
+  Watched_Directory* watched_p = &watch_p->watches[event_p->wd];
+  if (event_p->mask & IN_IGNORED)
+  {
+    watched_p->node = NULL;
+  }
+  else if (event_p->mask & (IN_DELETE_SELF | IN_MOVE_SELF))
+  {
+    /* The parent reports the removal, only the base has no watched parent. */
+    if (watched_p->node == watch_p->dir_tree)
+    {
+      printf("Could not find path: %s\n", watch_p->base_path_string);
+      exit(1);
+    }
+  }
+  else if (event_p->len > 0)
+  {
+    if (event_p->mask & IN_CREATE)
+    {
+      add_child(watch_p, watched_p, event_p->name, false);
+    }
+    else if (event_p->mask & IN_MOVED_TO)
+    {
+      add_child(watch_p, watched_p, event_p->name, true);
+    }
+    else if (event_p->mask & IN_DELETE)
+    {
+      remove_child(watch_p, watched_p, event_p->name, false);
+    }
+    else if (event_p->mask & IN_MOVED_FROM)
+    {
+      remove_child(watch_p, watched_p, event_p->name, true);
+    }
+  }
+}
+
+/**
+ * @brief Reads and applies all queued inotify events.
+ * @param watch_p [in/out] The state of the watch mode.
+ */
+static void read_events(Watch* watch_p)
+{
+  static char buffer[WATCH_EVENT_BUFFER_SIZE] __attribute__((aligned(__alignof__(struct inotify_event))));
+
+  while (true)
+  {
+    ssize_t length = read(watch_p->inotify_fd, buffer, sizeof(buffer));
+    if (length <= 0)
+    {
+      if (length < 0 && errno == EINTR)
+      {
+        continue;
+      }
+      return;
+    }
+
+    ssize_t position = 0;
+    while (position < length)
+    {
+      struct inotify_event* event_p = (struct inotify_event*) (buffer + position);
+      handle_event(watch_p, event_p);
+      position += sizeof(struct inotify_event) + event_p->len;
+    }
+  }
+}
+
+/**
+ * @brief Reads a clock that is not changed with the system time, so delays can be measured with it.
+ * @return The time in milliseconds since an unspecified point.
+ */
+static int64_t get_monotonic_time_ms(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * MILLISECONDS_PER_SECOND + now.tv_nsec / NANOSECONDS_PER_MILLISECOND;
+}
+
+/**
+ * @brief Blocks until the tree changes, then keeps applying events until none arrived for WATCH_DEBOUNCE_MS, so a
+ *        burst of changes is printed once. Prints at the latest WATCH_MAX_DELAY_MS after the first event, however
+ *        long reading the events takes.
+ * @param watch_p [in/out] The state of the watch mode.
+ */
+static void wait_for_changes(Watch* watch_p)
+{
+  struct pollfd poll_fd = {watch_p->inotify_fd, POLLIN, 0};
+
+  while (!watch_p->tree_changed && !watch_p->needs_rebuild)
+  {
+    if (poll(&poll_fd, 1, -1) > 0)
+    {
+      read_events(watch_p);
+    }
+  }
+
+  int64_t deadline_ms = get_monotonic_time_ms() + WATCH_MAX_DELAY_MS;
+  while (true)
+  {
+    int64_t remaining_ms = deadline_ms - get_monotonic_time_ms();
+    if (remaining_ms <= 0)
+    {
+      break;
+    }
+
+    int timeout_ms = remaining_ms < WATCH_DEBOUNCE_MS ? (int) remaining_ms : WATCH_DEBOUNCE_MS;
+    int result = poll(&poll_fd, 1, timeout_ms);
+    if (result == 0 || (result < 0 && errno != EINTR))
+    {
+      break;
+    }
+    if (result > 0)
+    {
+      read_events(watch_p);
+    }
+  }
+}
+
+/**
+ * @brief Reads the whole tree again, after inotify dropped events.
+ * @param watch_p [in/out] The state of the watch mode.
+ */
+static void rebuild_tree(Watch* watch_p)
+{
+  stop_watch(watch_p);
+  free_directory_tree(watch_p->dir_tree);
+  watch_p->dir_tree = create_directory_tree(watch_p->base_path_string, watch_p->options_p);
+  start_watch(watch_p);
+  watch_p->needs_rebuild = false;
+  watch_p->dead_bytes = 0;
+}
+
+/**
+ * @brief Copies the tree to a new arena once the removed nodes and outgrown children arrays use more of the arena
+ *        than the tree itself, so a long watch does not grow without bound. The copy costs as much as the memory it
+ *        frees.
+ * @param watch_p [in/out] The state of the watch mode.
+ */
+static void compact_watched_tree(Watch* watch_p)
+{
+  Directory_Tree_Memory_Usage usage = {0};
+  get_directory_tree_memory_usage(watch_p->dir_tree, &usage);
+  if (2 * watch_p->dead_bytes <= usage.bytes_used)
+  {
+    return;
+  }
+
+  /* Watching a directory again gives back the watch it already has, so the watches are pointed at the copied nodes
+     without losing the events queued for them. */
+  for (int wd = 0; wd < watch_p->watch_capacity; wd++)
+  {
+    watch_p->watches[wd].node = NULL;
+  }
+  watch_p->dir_tree = compact_directory_tree(watch_p->dir_tree);
+  add_subtree_watches(watch_p, watch_p->dir_tree);
+  watch_p->dead_bytes = 0;
+}
+
+/**
+ * @brief Prints the changes since the last print, or the whole tree.
+ * @param watch_p [in/out] The state of the watch mode.
+ */
+static void print_watched_tree(Watch* watch_p)
+{
+  if (watch_p->print_changes_only)
+  {
+    output_writer_write(watch_p->writer_p, watch_p->changes.string, watch_p->changes.length);
+    string_buffer_truncate(&watch_p->changes, 0);
+  }
+  else
+  {
+    /* A terminal shows the current tree in place, other outputs get the trees separated by an empty line. */
+    if (isatty(watch_p->writer_p->fd))
+    {
+      output_writer_write(watch_p->writer_p, CLEAR_SCREEN, strlen(CLEAR_SCREEN));
+    }
+    else
+    {
+      output_writer_write(watch_p->writer_p, "\n", 1);
+    }
+    print_directory_tree(watch_p->dir_tree, watch_p->options_p->output_format, watch_p->writer_p);
+  }
+
+  output_writer_flush(watch_p->writer_p);
+  watch_p->tree_changed = false;
+}
+
+/*> Global Function Definitions **************************************************************************************/
+/**
+ * @brief Keeps a printed tree up to date, printing it again whenever files are added or removed. Never returns.
+ * @param base_path_string [in] The base path the tree was created from.
+ * @param dir_tree [in/out] The printed tree. It is updated in place, and read again if events were lost.
+ * @param options_p [in] How the tree was read.
+ * @param writer_p [in/out] The writer the tree is printed to.
+ * @param print_changes_only [in] True if only the added and removed paths are printed, prefixed with '+' or '-'.
+ */
+void watch_directory_tree(char* base_path_string, 
+                          Directory_Tree* dir_tree, 
+                          Directory_Tree_Options* options_p, 
+                          Output_Writer* writer_p, 
+                          bool print_changes_only)
+{
+  Watch watch = {0};
+  watch.base_path_string = base_path_string;
+  watch.dir_tree = dir_tree;
+  watch.options_p = options_p;
+  watch.writer_p = writer_p;
+  watch.print_changes_only = print_changes_only;
+  watch.watch_capacity = INITIAL_WATCH_CAPACITY;
+  watch.watches = (Watched_Directory*) calloc(watch.watch_capacity, sizeof(Watched_Directory));
+  if (watch.watches == NULL)
+  {
+    printf("Could not allocate memory for the directory tree.\n");
+    exit(1);
+  }
+  string_buffer_init(&watch.changes);
+  string_buffer_init(&watch.path);
+
+  output_writer_flush(writer_p);
+  start_watch(&watch);
+
+  while (true)
+  {
+    wait_for_changes(&watch);
+    if (watch.needs_rebuild)
+    {
+      /* The changes are unknown, so the whole tree is printed once. */
+      rebuild_tree(&watch);
+      string_buffer_truncate(&watch.changes, 0);
+      watch.print_changes_only = false;
+    }
+    print_watched_tree(&watch);
+    watch.print_changes_only = print_changes_only;
+    compact_watched_tree(&watch);
+  }
+}
@@ -0,0 +1,397 @@
+/*> Description ******************************************************************************************************/
+/**
+* @brief Defines a work-stealing thread pool. Workers push and pop tasks at the bottom of their own deque, which walks
+*        a tree depth first, and idle workers steal from the top of the other deques, which takes the largest
+*        remaining pieces of work.
+* @file work_pool.c
+*/
+
+/*> Includes *********************************************************************************************************/
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "work_pool.h"
+
+/*> Defines **********************************************************************************************************/
+#define INITIAL_DEQUE_CAPACITY 64
+
+/*> Type Declarations ************************************************************************************************/
+/**
+ * @brief A task waiting to be run.
+ * @param function The function to run.
+ * @param argument_p The argument passed to the function.
+ */
+typedef struct Work_Task
+{
+  Work_Function function;
+  void* argument_p;
+} Work_Task;
+
+/**
+ * @brief A double ended queue of tasks stored in a circular buffer.
+ * @param mutex Protects all other members.
+ * @param tasks The circular buffer, capacity long.
+ * @param capacity The number of tasks that fit in the buffer, a power of two.
+ * @param top The index of the oldest task, where tasks are stolen.
+ * @param bottom The index after the newest task, where the owner pushes and pops.
+ */
+typedef struct Work_Deque
+{
+  pthread_mutex_t mutex;
+  Work_Task* tasks;
+  size_t capacity;
+  size_t top;
+  size_t bottom;
+} Work_Deque;
+
+/**
+ * @brief A thread of the pool.
+ * @param pool_p The pool the worker belongs to.
+ * @param index The index of the worker.
+ * @param thread The thread running the worker.
+ * @param deque The tasks pushed by this worker.
+ */
+typedef struct Work_Worker
+{
+  Work_Pool* pool_p;
+  int index;
+  pthread_t thread;
+  Work_Deque deque;
+} Work_Worker;
+
+/**
+ * @brief A work-stealing thread pool.
+ * @param context_p Data shared by all tasks.
+ * @param thread_count The number of workers.
+ * @param workers The workers, thread_count long.
+ * @param mutex Protects stop and is held while waiting on the conditions.
+ * @param work_condition Signaled when a task is pushed while workers are idle, or when the pool stops.
+ * @param done_condition Signaled when the last pending task finishes.
+ * @param queued_count The number of tasks in the deques.
+ * @param pending_count The number of tasks in the deques or running.
+ * @param idle_count The number of workers waiting for work.
+ * @param stop True when the workers should exit.
+ */
+struct Work_Pool
+{
+  void* context_p;
+  int thread_count;
+  Work_Worker* workers;
+  pthread_mutex_t mutex;
+  pthread_cond_t work_condition;
+  pthread_cond_t done_condition;
+  atomic_size_t queued_count;
+  atomic_size_t pending_count;
+  atomic_int idle_count;
+  bool stop;
+};
+
+/*> Global Constant Definitions **************************************************************************************/
+
+/*> Global Variable Definitions **************************************************************************************/
+
+/*> Local Constant Definitions ***************************************************************************************/
+
+/*> Local Variable Definitions ***************************************************************************************/
+
+/*> Local Function Declarations **************************************************************************************/
+static void* allocate_or_exit(size_t size);
+
+static void push_bottom(Work_Deque* deque_p, Work_Task task);
+
+static bool pop_bottom(Work_Deque* deque_p, Work_Task* task_p);
+
+static bool steal_top(Work_Deque* deque_p, Work_Task* task_p);
+
+static bool take_task(Work_Pool* pool_p, int worker_index, Work_Task* task_p);
+
+static void* run_worker(void* worker_p);
+
+/*> Local Function Definitions ***************************************************************************************/
+/**
+ * @brief Allocates memory, exiting the program if it fails.
+ * @param size [in] The number of bytes to allocate.
+ * @return The allocated memory.
+ */
+static void* allocate_or_exit(size_t size)
+{
+  void* memory_p = malloc(size);
+  if (memory_p == NULL)
+  {
+    printf("Could not allocate memory for the thread pool.\n");
+    exit(1);
+  }
+  return memory_p;
+}
+
+/**
+ * @brief Pushes a task at the bottom of a deque, growing it if needed.
+ * @param deque_p [in/out] The deque.
+ * @param task [in] The task to push.
+ */
+static void push_bottom(Work_Deque* deque_p, Work_Task task)
+{
+  pthread_mutex_lock(&deque_p->mutex);
+
+  if (deque_p->bottom - deque_p->top == deque_p->capacity)
+  {
+    Work_Task* tasks = (Work_Task*) allocate_or_exit(2 * deque_p->capacity * sizeof(Work_Task));
+    for (size_t i = deque_p->top; i < deque_p->bottom; i++)
+    {
+      tasks[i & (2 * deque_p->capacity - 1)] = deque_p->tasks[i & (deque_p->capacity - 1)];
+    }
+    free(deque_p->tasks);
+    deque_p->tasks = tasks;
+    deque_p->capacity *= 2;
+  }
+
+  deque_p->tasks[deque_p->bottom & (deque_p->capacity - 1)] = task;
+  deque_p->bottom++;
+
+  pthread_mutex_unlock(&deque_p->mutex);
+}
+
+/**
+ * @brief Pops the newest task from the bottom of a deque.
+ * @param deque_p [in/out] The deque.
+ * @param task_p [out] The popped task.
+ * @return True if a task was popped, false if the deque was empty.
+ */
+static bool pop_bottom(Work_Deque* deque_p, Work_Task* task_p)
+{
+  bool found = false;
+  pthread_mutex_lock(&deque_p->mutex);
+  if (deque_p->bottom != deque_p->top)
+  {
+    deque_p->bottom--;
+    *task_p = deque_p->tasks[deque_p->bottom & (deque_p->capacity - 1)];
+    found = true;
+  }
+  pthread_mutex_unlock(&deque_p->mutex);
+  return found;
+}
+
+/**
+ * @brief Steals the oldest task from the top of a deque.
+ * @param deque_p [in/out] The deque.
+ * @param task_p [out] The stolen task.
+ * @return True if a task was stolen, false if the deque was empty.
+ */
+static bool steal_top(Work_Deque* deque_p, Work_Task* task_p)
+{
+  bool found = false;
+  pthread_mutex_lock(&deque_p->mutex);
+  if (deque_p->bottom != deque_p->top)
+  {
+    *task_p = deque_p->tasks[deque_p->top & (deque_p->capacity - 1)];
+    deque_p->top++;
+    found = true;
+  }
+  pthread_mutex_unlock(&deque_p->mutex);
+  return found;
+}
+
+/**
+ * @brief Takes a task from the worker's own deque, or steals one from another worker.
+ * @param pool_p [in/out] The pool.
+ * @param worker_index [in] The index of the worker looking for work.
+ * @param task_p [out] The task taken.
+ * @return True if a task was taken, false if all deques were empty.
+ */
+static bool take_task(Work_Pool* pool_p, int worker_index, Work_Task* task_p)
+{
+  if (pop_bottom(&pool_p->workers[worker_index].deque, task_p))
+  {
+    return true;
+  }
+
+  for (int i = 1; i < pool_p->thread_count; i++)
+  {
+    int victim_index = (worker_index + i) % pool_p->thread_count;
+    if (steal_top(&pool_p->workers[victim_index].deque, task_p))
+    {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+/**
+ * @brief The main loop of a worker thread. Runs tasks until the pool is stopped.
+ * @param worker_p [in] The Work_Worker of this thread.
+ * @return Always NULL.
+ */
+static void* run_worker(void* worker_p)
+{
+  Work_Worker* self_p = (Work_Worker*) worker_p;
+  Work_Pool* pool_p = self_p->pool_p;
+
+  while (true)
+  {
+    Work_Task task;
+    if (take_task(pool_p, self_p->index, &task))
+    {
+      atomic_fetch_sub(&pool_p->queued_count, 1);
+      task.function(pool_p, self_p->index, task.argument_p);
+
+      if (atomic_fetch_sub(&pool_p->pending_count, 1) == 1)
+      {
+        pthread_mutex_lock(&pool_p->mutex);
+        pthread_cond_broadcast(&pool_p->done_condition);
+        pthread_mutex_unlock(&pool_p->mutex);
+      }
+      continue;
+    }
+
+    /* Idle is announced before queued_count is checked, so a push either is seen here or sees this worker idle. */
+    pthread_mutex_lock(&pool_p->mutex);
+    atomic_fetch_add(&pool_p->idle_count, 1);
+    while (atomic_load(&pool_p->queued_count) == 0 && !pool_p->stop)
+    {
+      pthread_cond_wait(&pool_p->work_condition, &pool_p->mutex);
+    }
+    atomic_fetch_sub(&pool_p->idle_count, 1);
+    bool stop = pool_p->stop;
+    pthread_mutex_unlock(&pool_p->mutex);
+
+    if (stop)
+    {
+      return NULL;
+    }
+  }
+}
+
+/*> Global Function Definitions **************************************************************************************/
+/**
+ * @brief Creates a pool and starts its worker threads.
+ * @param thread_count [in] The number of worker threads, at most MAX_WORKER_COUNT.
+ * @param context_p [in] Data shared by all tasks, returned by work_pool_context.
+ * @return The pool. Exits the program if it could not be created.
+ */
+Work_Pool* work_pool_create(int thread_count, void* context_p)
+{
+  Work_Pool* pool_p = (Work_Pool*) allocate_or_exit(sizeof(Work_Pool));
+  pool_p->context_p = context_p;
+  pool_p->thread_count = thread_count;
+  pool_p->workers = (Work_Worker*) allocate_or_exit(thread_count * sizeof(Work_Worker));
+  pthread_mutex_init(&pool_p->mutex, NULL);
+  pthread_cond_init(&pool_p->work_condition, NULL);
+  pthread_cond_init(&pool_p->done_condition, NULL);
+  atomic_init(&pool_p->queued_count, 0);
+  atomic_init(&pool_p->pending_count, 0);
+  atomic_init(&pool_p->idle_count, 0);
+  pool_p->stop = false;
+
+  for (int i = 0; i < thread_count; i++)
+  {
+    Work_Worker* worker_p = &pool_p->workers[i];
+    worker_p->pool_p = pool_p;
+    worker_p->index = i;
+    pthread_mutex_init(&worker_p->deque.mutex, NULL);
+    worker_p->deque.capacity = INITIAL_DEQUE_CAPACITY;
+    worker_p->deque.tasks = (Work_Task*) allocate_or_exit(INITIAL_DEQUE_CAPACITY * sizeof(Work_Task));
+    worker_p->deque.top = 0;
+    worker_p->deque.bottom = 0;
+  }
+
+  for (int i = 0; i < thread_count; i++)
+  {
+    if (pthread_create(&pool_p->workers[i].thread, NULL, run_worker, &pool_p->workers[i]) != 0)
+    {
+      printf("Could not start the worker threads.\n");
+      exit(1);
+    }
+  }
+
+  return pool_p;
+}
+
+/**
+ * @brief Gets the context the pool was created with.
+ * @param pool_p [in] The pool.
+ * @return The context.
+ */
+void* work_pool_context(Work_Pool* pool_p)
+{
+  return pool_p->context_p;
+}
+
+/**
+ * @brief Gets the number of worker threads of the pool.
+ * @param pool_p [in] The pool.
+ * @return The number of workers.
+ */
+int work_pool_thread_count(Work_Pool* pool_p)
+{
+  return pool_p->thread_count;
+}
+
+/**
+ * @brief Pushes a task on the deque of a worker. Workers push to their own deque, other threads may push to any.
+ * @param pool_p [in/out] The pool.
+ * @param worker_index [in] The index of the worker whose deque the task is pushed to.
+ * @param function [in] The function to run.
+ * @param argument_p [in] The argument passed to the function.
+ */
+void work_pool_push(Work_Pool* pool_p, int worker_index, Work_Function function, void* argument_p)
+{
+  Work_Task task = {function, argument_p};
+
+  atomic_fetch_add(&pool_p->pending_count, 1);
+  push_bottom(&pool_p->workers[worker_index].deque, task);
+  atomic_fetch_add(&pool_p->queued_count, 1);
+
+  if (atomic_load(&pool_p->idle_count) > 0)
+  {
+    pthread_mutex_lock(&pool_p->mutex);
+    pthread_cond_signal(&pool_p->work_condition);
+    pthread_mutex_unlock(&pool_p->mutex);
+  }
+}
+
+/**
+ * @brief Waits until all pushed tasks, and the tasks they pushed, have finished.
+ * @param pool_p [in/out] The pool.
+ */
+void work_pool_wait(Work_Pool* pool_p)
+{
+  pthread_mutex_lock(&pool_p->mutex);
+  while (atomic_load(&pool_p->pending_count) > 0)
+  {
+    pthread_cond_wait(&pool_p->done_condition, &pool_p->mutex);
+  }
+  pthread_mutex_unlock(&pool_p->mutex);
+}
+
+/**
+ * @brief Stops the worker threads and frees the pool. Tasks still queued are not run.
+ * @param pool_p [in/out] The pool to destroy.
+ */
+void work_pool_destroy(Work_Pool* pool_p)
+{
+  pthread_mutex_lock(&pool_p->mutex);
+  pool_p->stop = true;
+  pthread_cond_broadcast(&pool_p->work_condition);
+  pthread_mutex_unlock(&pool_p->mutex);
+
+  /* Workers still running may be stealing from any deque, so no deque is freed before every worker has exited. */
+  for (int i = 0; i < pool_p->thread_count; i++)
+  {
+    pthread_join(pool_p->workers[i].thread, NULL);
+  }
+  for (int i = 0; i < pool_p->thread_count; i++)
+  {
+    pthread_mutex_destroy(&pool_p->workers[i].deque.mutex);
+    free(pool_p->workers[i].deque.tasks);
+  }
+
+  pthread_mutex_destroy(&pool_p->mutex);
+  pthread_cond_destroy(&pool_p->work_condition);
+  pthread_cond_destroy(&pool_p->done_condition);
+  free(pool_p->workers);
+  free(pool_p);
+}
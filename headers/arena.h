@@ -0,0 +1,64 @@
+/*> Description ******************************************************************************************************/
+/**
+ * @brief Declares a bump allocator used to store Directory_Tree nodes and their strings.
+ * @file arena.h
+ */
+
+/*> Multiple Inclusion Protection ************************************************************************************/
+#ifndef ARENA_H
+#define ARENA_H
+
+/*> Includes *********************************************************************************************************/
+#include <stddef.h>
+
+/*> Defines **********************************************************************************************************/
+#define ARENA_BLOCK_SIZE (64 * 1024)
+
+/*> Type Declarations ************************************************************************************************/
+/**
+ * @brief A block of memory handed out by an Arena.
+ * @param next The previously filled block, or NULL if this is the first block.
+ * @param size The number of usable bytes in data.
+ * @param used The number of bytes of data already handed out.
+ * @param data The memory handed out by the arena.
+ */
+typedef struct Arena_Block
+{
+  struct Arena_Block* next;
+  size_t size;
+  size_t used;
+  char data[];
+} Arena_Block;
+
+/**
+ * @brief A bump allocator. Memory is only released all at once by arena_free.
+ * @param head The block allocations are currently made from.
+ * @param bytes_used The total number of bytes handed out.
+ * @param bytes_reserved The total number of bytes allocated from the system, including block headers.
+ */
+typedef struct Arena
+{
+  Arena_Block* head;
+  size_t bytes_used;
+  size_t bytes_reserved;
+} Arena;
+
+/*> Constant Declarations ********************************************************************************************/
+
+/*> Variable Declarations ********************************************************************************************/
+
+/*> Function Declarations ********************************************************************************************/
+void arena_init(Arena* arena_p);
+
+void* arena_allocate(Arena* arena_p, size_t size);
+
+char* arena_allocate_string(Arena* arena_p, size_t length);
+
+char* arena_copy_string(Arena* arena_p, const char* str, size_t length);
+
+void arena_merge(Arena* destination_p, Arena* source_p);
+
+void arena_free(Arena* arena_p);
+
+/*> End of Multiple Inclusion Protection *****************************************************************************/
+#endif
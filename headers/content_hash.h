@@ -0,0 +1,64 @@
+/*> Description ******************************************************************************************************/
+/**
+ * @brief Declares the fast non-cryptographic hash of file contents used by --hash, the 64 bit XXH64 hash, so the
+ *        hashes of a tree can be compared with those of the same tree on another host.
+ * @file content_hash.h
+ */
+
+/*> Multiple Inclusion Protection ************************************************************************************/
+#ifndef CONTENT_HASH_H
+#define CONTENT_HASH_H
+
+/*> Includes *********************************************************************************************************/
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*> Defines **********************************************************************************************************/
+#define CONTENT_HASH_STRIPE_SIZE 32
+#define CONTENT_HASH_BUFFER_SIZE (64 * 1024)
+#define CONTENT_HASH_FILE_SEED 0x0ULL
+#define CONTENT_HASH_LINK_SEED 0x6C696E6BULL
+#define CONTENT_HASH_SPECIAL_SEED 0x73706563ULL
+
+/*> Type Declarations ************************************************************************************************/
+/**
+ * @brief The state of a hash computed from data given in parts, e.g. a file read a buffer at a time. Gives the same
+ *        hash as content_hash of all the parts at once.
+ * @param accumulators The four lanes the stripes of the data are mixed into.
+ * @param seed The seed the hash was started with.
+ * @param total_length The number of bytes hashed so far.
+ * @param stripe The bytes of the last part that did not fill a whole stripe.
+ * @param stripe_length The number of bytes in stripe.
+ */
+typedef struct Content_Hasher
+{
+  uint64_t accumulators[4];
+  uint64_t seed;
+  uint64_t total_length;
+  unsigned char stripe[CONTENT_HASH_STRIPE_SIZE];
+  size_t stripe_length;
+} Content_Hasher;
+
+/*> Constant Declarations ********************************************************************************************/
+
+/*> Variable Declarations ********************************************************************************************/
+
+/*> Function Declarations ********************************************************************************************/
+void content_hasher_init(Content_Hasher* hasher_p, uint64_t seed);
+
+void content_hasher_update(Content_Hasher* hasher_p, const void* data, size_t length);
+
+uint64_t content_hasher_digest(Content_Hasher* hasher_p);
+
+uint64_t content_hash(const void* data, size_t length, uint64_t seed);
+
+bool content_hash_file(int directory_fd, 
+                       const char* name, 
+                       bool follow_links, 
+                       char* buffer, 
+                       size_t buffer_size, 
+                       uint64_t* hash_p);
+
+/*> End of Multiple Inclusion Protection *****************************************************************************/
+#endif
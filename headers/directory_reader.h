@@ -0,0 +1,66 @@
+/*> Description ******************************************************************************************************/
+/**
+ * @brief Declares a directory reader that reads many entries per system call into a buffer owned by the caller.
+ * @file directory_reader.h
+ */
+
+/*> Multiple Inclusion Protection ************************************************************************************/
+#ifndef DIRECTORY_READER_H
+#define DIRECTORY_READER_H
+
+/*> Includes *********************************************************************************************************/
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*> Defines **********************************************************************************************************/
+#define DIRECTORY_READER_BUFFER_SIZE (256 * 1024)
+
+/*> Type Declarations ************************************************************************************************/
+/**
+ * @brief One entry of a directory. The name points into the buffer of the reader, and is only valid until the next
+ *        entry is read.
+ * @param name The null terminated name of the entry.
+ * @param type The type of the entry as a DT_* value, DT_UNKNOWN if the file system does not report it.
+ */
+typedef struct Directory_Entry
+{
+  char* name;
+  unsigned char type;
+} Directory_Entry;
+
+/**
+ * @brief Reads the entries of an open directory with getdents64, parsing the records in place in the buffer.
+ * @param fd The open directory.
+ * @param buffer The buffer the records are read into.
+ * @param buffer_size The size of buffer.
+ * @param position The offset in buffer of the next record to parse.
+ * @param length The number of bytes of records in buffer.
+ * @param error The errno of a failed read, 0 if no read has failed.
+ * @param offset The position in the directory after the last parsed record, where reading continues once the
+ *               directory was closed and reopened.
+ */
+typedef struct Directory_Reader
+{
+  int fd;
+  char* buffer;
+  size_t buffer_size;
+  size_t position;
+  size_t length;
+  int error;
+  int64_t offset;
+} Directory_Reader;
+
+/*> Constant Declarations ********************************************************************************************/
+
+/*> Variable Declarations ********************************************************************************************/
+
+/*> Function Declarations ********************************************************************************************/
+void directory_reader_init(Directory_Reader* reader_p, int fd, char* buffer, size_t buffer_size);
+
+bool directory_reader_next(Directory_Reader* reader_p, Directory_Entry* entry_p);
+
+bool directory_reader_reopen(Directory_Reader* reader_p, int fd, char* buffer);
+
+/*> End of Multiple Inclusion Protection *****************************************************************************/
+#endif
@@ -0,0 +1,65 @@
+/*> Description ******************************************************************************************************/
+/**
+ * @brief Declares the sorting of the children of a directory by a compact key per node.
+ * @file directory_sort.h
+ */
+
+/*> Multiple Inclusion Protection ************************************************************************************/
+#ifndef DIRECTORY_SORT_H
+#define DIRECTORY_SORT_H
+
+/*> Includes *********************************************************************************************************/
+#include <stdint.h>
+
+#include "directory_tree.h"
+
+/*> Defines **********************************************************************************************************/
+
+/*> Type Declarations ************************************************************************************************/
+/**
+ * @brief The key of one node while its directory is sorted.
+ * @param key The value compared first. The first bytes of the name for name orders, so most comparisons are one
+ *            integer comparison, or a value for the order where smaller comes first.
+ * @param node The node.
+ */
+typedef struct Sort_Key
+{
+  uint64_t key;
+  Directory_Tree* node;
+} Sort_Key;
+
+/**
+ * @brief Sorts the children of directories. The buffers are reused for every directory, so sorting does not allocate
+ *        once they are large enough for the largest directory.
+ * @param order The order to sort in.
+ * @param keys The keys of the nodes being sorted.
+ * @param values The values of the nodes being sorted, filled in by the caller for size and time orders.
+ * @param capacity The number of nodes keys and values have room for.
+ */
+typedef struct Node_Sorter
+{
+  Sort_Order order;
+  Sort_Key* keys;
+  uint64_t* values;
+  int capacity;
+} Node_Sorter;
+
+/*> Constant Declarations ********************************************************************************************/
+
+/*> Variable Declarations ********************************************************************************************/
+
+/*> Function Declarations ********************************************************************************************/
+void node_sorter_init(Node_Sorter* sorter_p, Sort_Order order);
+
+uint64_t* node_sorter_values(Node_Sorter* sorter_p, int count);
+
+void node_sorter_sort(Node_Sorter* sorter_p, Directory_Tree** nodes, int count, uint64_t* values);
+
+void node_sorter_free(Node_Sorter* sorter_p);
+
+uint64_t size_sort_value(uint64_t size);
+
+uint64_t time_sort_value(int64_t time_ns);
+
+/*> End of Multiple Inclusion Protection *****************************************************************************/
+#endif
@@ -10,43 +10,322 @@
 
 /*> Includes *********************************************************************************************************/
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "name_matcher.h"
+#include "output_writer.h"
+#include "string_util.h"
 
 /*> Defines **********************************************************************************************************/
-#define MAX_NUMBER_CHILDREN 1000
 
 /*> Type Declarations ************************************************************************************************/
+struct Path_Filter;
+struct Snapshot;
+
+/**
+ * @brief The order the children of a directory are printed in.
+ * @param SORT_NONE The order the directory was read in, which depends on the file system.
+ * @param SORT_NAME By name, byte by byte.
+ * @param SORT_NATURAL By name, with numbers in names compared by value, so "file2" comes before "file10".
+ * @param SORT_SIZE Largest first. With disk usage, directories are sorted by the size of everything below them.
+ * @param SORT_MODIFICATION_TIME Most recently modified first.
+ */
+typedef enum Sort_Order
+{
+  SORT_NONE,
+  SORT_NAME,
+  SORT_NATURAL,
+  SORT_SIZE,
+  SORT_MODIFICATION_TIME
+} Sort_Order;
+
+/**
+ * @brief How a tree is printed.
+ * @param OUTPUT_TEXT One indented line per file, for people.
+ * @param OUTPUT_JSON One JSON document with a nested object per file. Directories that were read have a "children"
+ *                    array, so an empty directory can be told apart from one below the depth.
+ * @param OUTPUT_NDJSON One JSON object per line and file, with its path and level, so each line can be handled on its
+ *                      own.
+ */
+typedef enum Output_Format
+{
+  OUTPUT_TEXT,
+  OUTPUT_JSON,
+  OUTPUT_NDJSON
+} Output_Format;
+
+/**
+ * @brief The identity and change times of a directory when its children were read. If they are unchanged, the
+ *        directory still has the same entries.
+ * @param device The device of the directory.
+ * @param inode The inode of the directory.
+ * @param modification_time_ns The last modification time in nanoseconds, changed when entries are added or removed.
+ * @param change_time_ns The last status change time in nanoseconds.
+ */
+typedef struct Directory_Stamp
+{
+  uint64_t device;
+  uint64_t inode;
+  int64_t modification_time_ns;
+  int64_t change_time_ns;
+} Directory_Stamp;
+
+/**
+ * @brief The disk usage of a file, or of a directory and everything below it.
+ * @param apparent_size The size in bytes, as shown by ls.
+ * @param allocated_size The number of bytes allocated on disk.
+ * @param file_count The number of files that are not directories, 1 for a file.
+ * @param device The device of the file.
+ * @param inode The inode of the file.
+ * @param modification_time_ns The last modification time of the file itself in nanoseconds.
+ * @param is_hard_link True if the file has more than one link, so it is only counted once.
+ * @param is_symbolic_link True if the file is a symbolic link that is not followed, so the usage is that of the link.
+ *                         A followed link has the usage of the file or directory it points to.
+ */
+typedef struct Directory_Usage
+{
+  uint64_t apparent_size;
+  uint64_t allocated_size;
+  uint64_t file_count;
+  uint64_t device;
+  uint64_t inode;
+  int64_t modification_time_ns;
+  bool is_hard_link;
+  bool is_symbolic_link;
+} Directory_Usage;
+
 /**
- * @brief A stucture repesenting a directory tree. Each node is either a directory or a file.
+ * @brief A stucture repesenting a directory tree. Each node is either a directory or a file. All nodes, strings and
+ *        children arrays of a tree are allocated from an arena owned by the base node. Nodes only store their name,
+ *        the path of a node is rebuilt from the names of its parents with append_directory_tree_path when needed.
+ * @param children An array of pointers to the children nodes of this node, children_count long.
+ * @param parent The node of the parent directory, NULL for the base.
+ * @param file_name The name of file this Directory_Tree represents, without the '/' of directories. Names are
+ *                  interned, so nodes with the same name share it and it must not be modified. The base stores its
+ *                  whole path instead, ending with '/' if it is a directory.
+ * @param file_name_length The length of file_name.
+ * @param children_count The number of children this node has, i.e. number of files/ directories this directory 
+ *                       contains.
  * @param depth The depth of the tree from the current node.
+ * @param omitted_count The number of entries of a directory left out by a limit on the number of entries, -1 if the
+ *                      directory was not read because a budget ran out, 0 otherwise.
  * @param is_directory Indication whether path is a direcory. If false, it is a file.
  * @param is_base True if it is the top node of the tree.
- * @param path_string The string of the path to the directory/file.
- * @param file_name The name of file this Directory_Tree represents.
- * @param children_count The number of children this node has, i.e. number of files/ directories this directory 
- *                       contains.
- * @param children An array of pointers to the children nodes of this node.
+ * @param is_reference True if the node is a directory reached again through a link while links are followed, e.g. a
+ *                     link to a directory above it. Its children are not read, and its depth is 0.
+ * @param stamp_p The stamp of a directory when its children were read, NULL unless the tree records stamps and the
+ *                stamp can be trusted.
+ * @param usage_p The disk usage of the node, NULL unless the tree records usage.
+ * @param hash_p The hash of the contents of the node, NULL unless the tree records hashes. Files that could not be
+ *               read and references have none.
  */
 typedef struct Directory_Tree
 {
+  struct Directory_Tree** children;
+  struct Directory_Tree* parent;
+  char* file_name;
+  int file_name_length;
+  int children_count;
   int depth;
+  int omitted_count;
   bool is_directory;
   bool is_base;
-  char path_string[200];
-  char file_name[50];
-  int children_count;
-  struct Directory_Tree* children[MAX_NUMBER_CHILDREN];
+  bool is_reference;
+  Directory_Stamp* stamp_p;
+  Directory_Usage* usage_p;
+  uint64_t* hash_p;
 } Directory_Tree;
 
+/**
+ * @brief The memory used by a directory tree.
+ * @param node_count The number of nodes in the tree.
+ * @param bytes_used The number of bytes used by nodes, strings and children arrays.
+ * @param bytes_reserved The number of bytes allocated from the system for the tree.
+ */
+typedef struct Directory_Tree_Memory_Usage
+{
+  size_t node_count;
+  size_t bytes_used;
+  size_t bytes_reserved;
+} Directory_Tree_Memory_Usage;
+
+/**
+ * @brief The number of entries below the base of a directory tree.
+ * @param directory_count The number of directories, including the ones reached again through links.
+ * @param file_count The number of entries that are not directories.
+ */
+typedef struct Directory_Tree_Counts
+{
+  size_t directory_count;
+  size_t file_count;
+} Directory_Tree_Counts;
+
+/**
+ * @brief Options controlling how a directory tree is read.
+ * @param depth How far down relative the base directory to read.
+ * @param thread_count The number of threads reading directories. At most 1 reads the tree on the calling thread.
+ * @param use_uring True if the lookups and opens of a directory's entries should be batched through io_uring. Falls
+ *                  back to synchronous calls if the kernel does not support it. Only used when creating a tree.
+ * @param record_stamps True if the stamp of every read directory should be recorded, so the tree can be saved as a
+ *                      snapshot for later runs. The tree is then read on the calling thread.
+ * @param cached_snapshot_p A snapshot of an earlier run, or NULL. Directories whose stamp is unchanged since the
+ *                          snapshot are taken from it instead of being read. Only used if record_stamps, and not
+ *                          used if record_usage, since the snapshot has no sizes.
+ * @param record_usage True if every node gets its disk usage, with directories summing up everything below them.
+ * @param filter_p The filter of the files left out, or NULL to keep every file. Left out directories are never
+ *                 opened. A snapshot is not used with a filter.
+ * @param follow_links True if symbolic links to directories are read like directories, false if they are files.
+ *                     Every directory is only read once, a directory reached again is a reference. The tree is then
+ *                     read on the calling thread and a snapshot is not used.
+ * @param record_hashes True if every node gets the hash of its contents. Files are hashed on thread_count threads once
+ *                      the tree is read, and directories hash the names and hashes of their children, so equal trees
+ *                      have equal hashes wherever they are. A snapshot is not used.
+ * @param max_entries The most entries the tree keeps, 0 for no limit. The tree is then read breadth first, so the
+ *                    shallow levels are filled first, on the calling thread, and no directory is read once the
+ *                    limit is reached.
+ * @param per_directory_limit The most children a directory keeps, 0 for no limit. The tree is then read breadth first.
+ * @param time_budget_ms How long the tree is read for in milliseconds, 0 for no limit. The tree is then read breadth
+ *                       first, and no directory is read once the time is up. The base is always read.
+ * @param sort_order The order children are sorted in, each directory is sorted once it is read.
+ * @param output_format How the tree is printed.
+ */
+typedef struct Directory_Tree_Options
+{
+  int depth;
+  int thread_count;
+  bool use_uring;
+  bool record_stamps;
+  struct Snapshot* cached_snapshot_p;
+  bool record_usage;
+  struct Path_Filter* filter_p;
+  bool follow_links;
+  bool record_hashes;
+  size_t max_entries;
+  int per_directory_limit;
+  int64_t time_budget_ms;
+  Sort_Order sort_order;
+  Output_Format output_format;
+} Directory_Tree_Options;
+
+/**
+ * @brief What a walk does after a visitor callback returns.
+ * @param VISIT_CONTINUE Keep walking, into the children of a directory that has them.
+ * @param VISIT_SKIP_CHILDREN Keep walking, but leave out the children of the entry. Only used when entering.
+ * @param VISIT_STOP Stop the walk. The entries that were entered are still left.
+ */
+typedef enum Visit_Result
+{
+  VISIT_CONTINUE,
+  VISIT_SKIP_CHILDREN,
+  VISIT_STOP
+} Visit_Result;
+
+/**
+ * @brief An entry passed to the callbacks of a walk. Only valid during the callback.
+ * @param path The path of the entry, directories end with '/'. Must not be modified.
+ * @param path_length The length of path.
+ * @param name_offset Where the name of the entry starts in path, 0 for the base.
+ * @param level The level of the entry, 0 for the base.
+ * @param is_directory True if the entry is a directory.
+ * @param has_children True if the entry is a directory above the depth of the walk, so its children are walked.
+ *                     Cleared when the children are skipped.
+ * @param is_reference True if the entry is a directory that was already walked, reached again through a link while
+ *                     links are followed. Its children are not walked.
+ */
+typedef struct Visited_Entry
+{
+  char* path;
+  size_t path_length;
+  size_t name_offset;
+  int level;
+  bool is_directory;
+  bool has_children;
+  bool is_reference;
+} Visited_Entry;
+
+/**
+ * @brief A callback of a walk.
+ * @param entry_p The entry.
+ * @param context_p The context of the visitor.
+ * @return What the walk does next.
+ */
+typedef Visit_Result (*Visit_Function)(Visited_Entry* entry_p, void* context_p);
+
+/**
+ * @brief The callbacks of a walk.
+ * @param enter Called for an entry before its children, NULL to not be called.
+ * @param leave Called for an entry after its children, NULL to not be called. Only returning VISIT_STOP has an
+ *              effect.
+ * @param context_p Passed to the callbacks.
+ */
+typedef struct Directory_Visitor
+{
+  Visit_Function enter;
+  Visit_Function leave;
+  void* context_p;
+} Directory_Visitor;
+
+/**
+ * @brief A callback receiving a tree created by create_directory_trees.
+ * @param tree_index The index of the base path of the tree.
+ * @param dir_tree The tree, owned by the callback from then on.
+ * @param context_p The context passed to create_directory_trees.
+ */
+typedef void (*Directory_Tree_Function)(int tree_index, Directory_Tree* dir_tree, void* context_p);
+
 /*> Constant Declarations ********************************************************************************************/
 
 /*> Variable Declarations ********************************************************************************************/
 
 /*> Function Declarations ********************************************************************************************/
-Directory_Tree* create_directory_tree(char* base_path_string, int depth);
+Directory_Tree* create_directory_tree(char* base_path_string, Directory_Tree_Options* options_p);
+
+void create_directory_trees(char** base_path_strings, 
+                            int tree_count, 
+                            Directory_Tree_Options* options_p, 
+                            Directory_Tree_Function on_created, 
+                            void* context_p);
+
+Directory_Tree* create_lazy_directory_tree(char* base_path_string, Directory_Tree_Options* options_p);
+
+Directory_Tree** get_directory_tree_children(Directory_Tree* dir_tree, int* count_p);
 
 void free_directory_tree(Directory_Tree* dir_tree);
 
-void print_directory_tree(Directory_Tree* dir_tree);
+void print_directory_tree(Directory_Tree* dir_tree, Output_Format format, Output_Writer* writer_p);
+
+void print_snapshot_tree(struct Snapshot* snapshot_p, 
+                         uint32_t node_index, 
+                         int depth, 
+                         Output_Format format, 
+                         Output_Writer* writer_p);
+
+void stream_directory_tree(char* base_path_string, Directory_Tree_Options* options_p, Output_Writer* writer_p);
+
+void find_in_directory_tree(char* base_path_string, 
+                            Directory_Tree_Options* options_p, 
+                            Name_Matcher* matcher_p, 
+                            Output_Writer* writer_p);
+
+bool walk_directory_tree(char* base_path_string, Directory_Tree_Options* options_p, Directory_Visitor* visitor_p);
+
+void get_directory_tree_memory_usage(Directory_Tree* dir_tree, Directory_Tree_Memory_Usage* usage_p);
+
+void get_directory_tree_counts(Directory_Tree* dir_tree, Directory_Tree_Counts* counts_p);
+
+Directory_Tree* create_directory_tree_child(Directory_Tree* base, 
+                                            Directory_Tree* parent, 
+                                            char* file_name, 
+                                            Directory_Tree_Options* options_p);
+
+void* allocate_directory_tree_memory(Directory_Tree* base, size_t size);
+
+Directory_Tree* compact_directory_tree(Directory_Tree* dir_tree);
+
+void sort_directory_tree_children(Directory_Tree* dir_tree, Directory_Tree_Options* options_p);
+
+void append_directory_tree_path(Directory_Tree* dir_tree, String_Buffer* path_p);
 
 /*> End of Multiple Inclusion Protection *****************************************************************************/
 #endif 
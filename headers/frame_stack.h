@@ -0,0 +1,78 @@
+/*> Description ******************************************************************************************************/
+/**
+ * @brief Declares a growable stack of fixed size frames, used to walk trees depth first without recursion.
+ * @file frame_stack.h
+ */
+
+/*> Multiple Inclusion Protection ************************************************************************************/
+#ifndef FRAME_STACK_H
+#define FRAME_STACK_H
+
+/*> Includes *********************************************************************************************************/
+#include <stddef.h>
+
+/*> Defines **********************************************************************************************************/
+#define INITIAL_FRAME_STACK_CAPACITY 64
+
+/*> Type Declarations ************************************************************************************************/
+/**
+ * @brief A stack of frames on the heap. Deep trees only grow the stack, instead of overflowing the C stack.
+ * @param frames The frames, frame_size bytes each. Allocated when the first frame is pushed.
+ * @param frame_size The size of one frame.
+ * @param count The number of frames on the stack.
+ * @param capacity The number of frames the stack has room for.
+ */
+typedef struct Frame_Stack
+{
+  char* frames;
+  size_t frame_size;
+  int count;
+  int capacity;
+} Frame_Stack;
+
+/*> Constant Declarations ********************************************************************************************/
+
+/*> Variable Declarations ********************************************************************************************/
+
+/*> Function Declarations ********************************************************************************************/
+void frame_stack_init(Frame_Stack* stack_p, size_t frame_size);
+
+void* frame_stack_push(Frame_Stack* stack_p);
+
+void frame_stack_free(Frame_Stack* stack_p);
+
+/*> Inline Function Definitions **************************************************************************************/
+/**
+ * @brief Gets a frame of a stack. Pointers to frames are only valid until the next push, which may move the frames.
+ * @param stack_p [in] The stack.
+ * @param index [in] The index of the frame, 0 for the bottom of the stack.
+ * @return The frame.
+ */
+static inline void* frame_stack_at(Frame_Stack* stack_p, int index)
+{
+  return stack_p->frames + (size_t) index * stack_p->frame_size;
+}
+
+/**
+ * @brief Gets the top frame of a non empty stack.
+ * @param stack_p [in] The stack.
+ * @return The top frame.
+ */
+static inline void* frame_stack_top(Frame_Stack* stack_p)
+{
+  return frame_stack_at(stack_p, stack_p->count - 1);
+}
+
+/**
+ * @brief Removes the top frame of a non empty stack.
+ * @param stack_p [in/out] The stack.
+ * @return The removed frame, still valid until the next push.
+ */
+static inline void* frame_stack_pop(Frame_Stack* stack_p)
+{
+  stack_p->count--;
+  return frame_stack_at(stack_p, stack_p->count);
+}
+
+/*> End of Multiple Inclusion Protection *****************************************************************************/
+#endif
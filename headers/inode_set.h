@@ -0,0 +1,69 @@
+/*> Description ******************************************************************************************************/
+/**
+ * @brief Declares a set of inodes that several threads can insert into, used to count hard linked files once.
+ * @file inode_set.h
+ */
+
+/*> Multiple Inclusion Protection ************************************************************************************/
+#ifndef INODE_SET_H
+#define INODE_SET_H
+
+/*> Includes *********************************************************************************************************/
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*> Defines **********************************************************************************************************/
+#define INODE_SET_STRIPE_COUNT 64
+
+/*> Type Declarations ************************************************************************************************/
+/**
+ * @brief An inode in an Inode_Set.
+ * @param device The device of the inode.
+ * @param inode The inode number, 0 for an empty slot.
+ */
+typedef struct Inode_Key
+{
+  uint64_t device;
+  uint64_t inode;
+} Inode_Key;
+
+/**
+ * @brief One stripe of an Inode_Set, an open addressing hash table with its own lock.
+ * @param mutex Protects the stripe.
+ * @param keys The slots of the table.
+ * @param count The number of inodes in the stripe.
+ * @param capacity The number of slots, a power of two.
+ */
+typedef struct Inode_Set_Stripe
+{
+  pthread_mutex_t mutex;
+  Inode_Key* keys;
+  size_t count;
+  size_t capacity;
+} Inode_Set_Stripe;
+
+/**
+ * @brief A set of inodes. Inodes are spread over stripes by hash, so threads inserting different inodes rarely wait
+ *        for each other.
+ * @param stripes The stripes of the set.
+ */
+typedef struct Inode_Set
+{
+  Inode_Set_Stripe stripes[INODE_SET_STRIPE_COUNT];
+} Inode_Set;
+
+/*> Constant Declarations ********************************************************************************************/
+
+/*> Variable Declarations ********************************************************************************************/
+
+/*> Function Declarations ********************************************************************************************/
+void inode_set_init(Inode_Set* set_p);
+
+bool inode_set_insert(Inode_Set* set_p, uint64_t device, uint64_t inode);
+
+void inode_set_free(Inode_Set* set_p);
+
+/*> End of Multiple Inclusion Protection *****************************************************************************/
+#endif
@@ -0,0 +1,74 @@
+/*> Description ******************************************************************************************************/
+/**
+ * @brief Declares the matcher of file names used by --find, which searches names for a literal with SSE2 or AVX2
+ *        where the processor has them.
+ * @file name_matcher.h
+ */
+
+/*> Multiple Inclusion Protection ************************************************************************************/
+#ifndef NAME_MATCHER_H
+#define NAME_MATCHER_H
+
+/*> Includes *********************************************************************************************************/
+#include <stdbool.h>
+#include <stddef.h>
+
+/*> Defines **********************************************************************************************************/
+#define NAME_MATCHER_PADDED_CAPACITY 1024
+
+/*> Type Declarations ************************************************************************************************/
+/**
+ * @brief How a pattern is matched, decided once when the pattern is compiled.
+ * @param NAME_MATCH_SUBSTRING The pattern has no wildcards, and matches names containing it anywhere.
+ * @param NAME_MATCH_PREFIX The pattern is a literal followed by '*', e.g. "test_*", and matches names starting with it.
+ * @param NAME_MATCH_GLOB Any other pattern, matched against the whole name with wildcards and character classes.
+ */
+typedef enum Name_Match_Kind
+{
+  NAME_MATCH_SUBSTRING,
+  NAME_MATCH_PREFIX,
+  NAME_MATCH_GLOB
+} Name_Match_Kind;
+
+/**
+ * @brief Searches a text for a literal.
+ * @param text The text, padded with zeros up to NAME_MATCHER_PADDED_CAPACITY so it can be loaded in whole vectors.
+ * @param text_length The length of the text without the padding.
+ * @param literal The literal to search for, it must not contain a null character.
+ * @param literal_length The length of the literal, at least 1.
+ * @return True if the text contains the literal, false otherwise.
+ */
+typedef bool (*Literal_Search)(const char* text, size_t text_length, const char* literal, size_t literal_length);
+
+/**
+ * @brief A compiled pattern.
+ * @param pattern The pattern. Points into the string the pattern was compiled from.
+ * @param pattern_length The length of pattern.
+ * @param kind How the pattern is matched.
+ * @param literal A literal every matching name contains, the whole pattern for a substring, and the longest run
+ *                of ordinary characters of a glob, so most names are rejected without the glob matcher. Points into
+ *                pattern.
+ * @param literal_length The length of literal, 0 if a glob has no ordinary characters.
+ * @param search The search for literal, the fastest one the processor supports.
+ */
+typedef struct Name_Matcher
+{
+  const char* pattern;
+  size_t pattern_length;
+  Name_Match_Kind kind;
+  const char* literal;
+  size_t literal_length;
+  Literal_Search search;
+} Name_Matcher;
+
+/*> Constant Declarations ********************************************************************************************/
+
+/*> Variable Declarations ********************************************************************************************/
+
+/*> Function Declarations ********************************************************************************************/
+bool name_matcher_compile(Name_Matcher* matcher_p, const char* pattern);
+
+bool name_matcher_matches(Name_Matcher* matcher_p, const char* name, size_t name_length);
+
+/*> End of Multiple Inclusion Protection *****************************************************************************/
+#endif
@@ -0,0 +1,56 @@
+/*> Description ******************************************************************************************************/
+/**
+ * @brief Declares a buffered writer that sends output to a file descriptor in large chunks.
+ * @file output_writer.h
+ */
+
+/*> Multiple Inclusion Protection ************************************************************************************/
+#ifndef OUTPUT_WRITER_H
+#define OUTPUT_WRITER_H
+
+/*> Includes *********************************************************************************************************/
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/uio.h>
+
+/*> Defines **********************************************************************************************************/
+#define OUTPUT_BUFFER_SIZE (1024 * 1024)
+
+/*> Type Declarations ************************************************************************************************/
+/**
+ * @brief A buffered writer. Output is collected in a large buffer and written with write/writev when it is full.
+ * @param fd The file descriptor written to.
+ * @param buffer The buffered output, OUTPUT_BUFFER_SIZE long.
+ * @param length The number of bytes in buffer.
+ * @param use_lock True if writes are protected by mutex, so several threads can share the writer.
+ * @param mutex Protects buffer and length when use_lock is true.
+ * @param failed True if a write to fd failed, e.g. because the reader of a pipe exited. Later output is dropped.
+ */
+typedef struct Output_Writer
+{
+  int fd;
+  char* buffer;
+  size_t length;
+  bool use_lock;
+  pthread_mutex_t mutex;
+  bool failed;
+} Output_Writer;
+
+/*> Constant Declarations ********************************************************************************************/
+
+/*> Variable Declarations ********************************************************************************************/
+
+/*> Function Declarations ********************************************************************************************/
+void output_writer_init(Output_Writer* writer_p, int fd, bool use_lock);
+
+void output_writer_write(Output_Writer* writer_p, const char* data, size_t length);
+
+void output_writer_write_parts(Output_Writer* writer_p, const struct iovec* parts, int part_count);
+
+void output_writer_flush(Output_Writer* writer_p);
+
+void output_writer_free(Output_Writer* writer_p);
+
+/*> End of Multiple Inclusion Protection *****************************************************************************/
+#endif
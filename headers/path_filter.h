@@ -0,0 +1,128 @@
+/*> Description ******************************************************************************************************/
+/**
+ * @brief Declares the glob patterns deciding which files are left out of a tree, from the command line and from
+ *        .gitignore files.
+ * @file path_filter.h
+ */
+
+/*> Multiple Inclusion Protection ************************************************************************************/
+#ifndef PATH_FILTER_H
+#define PATH_FILTER_H
+
+/*> Includes *********************************************************************************************************/
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "arena.h"
+
+/*> Defines **********************************************************************************************************/
+#define GITIGNORE_FILE_NAME ".gitignore"
+
+/*> Type Declarations ************************************************************************************************/
+/**
+ * @brief How a pattern is matched, decided once when the pattern is compiled.
+ * @param PATTERN_LITERAL The pattern has no wildcards or escapes and is compared as is.
+ * @param PATTERN_SUFFIX The pattern is '*' followed by a literal, e.g. "*.o".
+ * @param PATTERN_PREFIX The pattern is a literal followed by '*', e.g. "build*".
+ * @param PATTERN_GLOB Any other pattern, matched with wildcards, character classes and "**".
+ */
+typedef enum Pattern_Kind
+{
+  PATTERN_LITERAL,
+  PATTERN_SUFFIX,
+  PATTERN_PREFIX,
+  PATTERN_GLOB
+} Pattern_Kind;
+
+/**
+ * @brief A compiled pattern.
+ * @param text The pattern without the leading '!', leading '/' and trailing '/', and without the '*' of suffix and
+ *             prefix patterns. Points into the string the pattern was compiled from, so it is not null terminated.
+ * @param length The length of text.
+ * @param kind How the pattern is matched.
+ * @param is_negated True if the pattern started with '!', so it includes files an earlier pattern excluded.
+ * @param is_directory_only True if the pattern ended with '/', so it only matches directories.
+ * @param is_anchored True if the pattern contains a '/', so it is matched against the path relative to the directory
+ *                    it was given for instead of against the name.
+ */
+typedef struct Path_Pattern
+{
+  const char* text;
+  size_t length;
+  Pattern_Kind kind;
+  bool is_negated;
+  bool is_directory_only;
+  bool is_anchored;
+} Path_Pattern;
+
+/**
+ * @brief A list of compiled patterns. For .gitignore files, the last matching pattern decides.
+ * @param patterns The patterns.
+ * @param count The number of patterns.
+ * @param capacity The number of patterns the array has room for.
+ */
+typedef struct Path_Pattern_List
+{
+  Path_Pattern* patterns;
+  int count;
+  int capacity;
+} Path_Pattern_List;
+
+/**
+ * @brief The patterns of the .gitignore files of a directory and the directories above it, down to the base of the
+ *        tree. Scopes are allocated from the arena of the tree, and shared by every directory below them.
+ * @param parent_p The scope of the directories above, NULL for the scope of the base.
+ * @param rules The patterns of the .gitignore file of the directory, empty for the base without a .gitignore file.
+ * @param base_length The length of the path of the directory, including its trailing '/'. Anchored patterns are
+ *                    matched against the path after it.
+ */
+typedef struct Ignore_Scope
+{
+  struct Ignore_Scope* parent_p;
+  Path_Pattern_List rules;
+  size_t base_length;
+} Ignore_Scope;
+
+/**
+ * @brief The filter given on the command line.
+ * @param excludes Files and directories matching one of these are left out, and directories are not read.
+ * @param includes If not empty, only files matching one of these are kept. Directories are always kept.
+ * @param use_gitignore True if the .gitignore files found in the tree are honored.
+ */
+typedef struct Path_Filter
+{
+  Path_Pattern_List excludes;
+  Path_Pattern_List includes;
+  bool use_gitignore;
+} Path_Filter;
+
+/*> Constant Declarations ********************************************************************************************/
+
+/*> Variable Declarations ********************************************************************************************/
+
+/*> Function Declarations ********************************************************************************************/
+void path_filter_init(Path_Filter* filter_p);
+
+bool path_filter_add_excludes(Path_Filter* filter_p, const char* patterns);
+
+bool path_filter_add_includes(Path_Filter* filter_p, const char* patterns);
+
+bool path_filter_is_active(Path_Filter* filter_p);
+
+bool glob_matches_name(const char* pattern, size_t pattern_length, const char* name, size_t name_length);
+
+bool path_filter_excludes(Path_Filter* filter_p,
+                          Ignore_Scope* scope_p,
+                          const char* path,
+                          size_t name_offset,
+                          size_t path_length,
+                          bool is_directory);
+
+void ignore_scope_init_base(Ignore_Scope* scope_p, size_t base_length);
+
+Ignore_Scope* ignore_scope_load(Arena* arena_p, Ignore_Scope* parent_p, int directory_fd, size_t base_length);
+
+void path_filter_free(Path_Filter* filter_p);
+
+/*> End of Multiple Inclusion Protection *****************************************************************************/
+#endif
@@ -11,20 +11,79 @@
 /*> Includes *********************************************************************************************************/
 #include <stdbool.h>
 
+#include "directory_tree.h"
+#include "path_filter.h"
+
 /*> Defines **********************************************************************************************************/
 
 /*> Type Declarations ************************************************************************************************/
 /**
  * @brief Structure containing the settings of the program execution set by the input arguments.
- * @param path_str The string of the path to open.
+ * @param path_str The string of the path to open, the first one if several are given.
+ * @param path_strings The strings of all paths to open, in the order they were given.
+ * @param path_count The number of paths in path_strings, at least 1.
  * @param depth The depth of the tree.
  * @param help Boolean value whether help information should be printed or not.
+ * @param memory_usage Boolean value whether the memory used by the tree should be printed or not.
+ * @param thread_count The number of threads reading directories.
+ * @param use_uring Boolean value whether directories should be read through io_uring or not.
+ * @param lock_output Boolean value whether the output is locked for several writing threads or not.
+ * @param cache_path The path of the snapshot file reused and updated by this run, or NULL if no cache is used.
+ * @param save_path The path the tree is saved to as a snapshot after it is printed, or NULL.
+ * @param load_path The path of a snapshot printed instead of reading the file system, or NULL. The path to print is
+ *                  then looked up in the snapshot.
+ * @param count Boolean value whether only the number of directories and files below the path in the loaded snapshot
+ *              is printed or not.
+ * @param diff Boolean value whether the differences between the two paths, the old and the new tree, are printed
+ *             instead of a tree or not.
+ * @param find_pattern The pattern of the names printed with the directories above them, or NULL to print every entry.
+ * @param watch Boolean value whether the tree is kept up to date and printed again when it changes or not.
+ * @param watch_changes_only Boolean value whether only the changed paths are printed when watching or not.
+ * @param follow_links Boolean value whether symbolic links to directories are followed or shown as files.
+ * @param disk_usage Boolean value whether the disk usage of every file and directory is printed or not.
+ * @param hash Boolean value whether the hash of the contents of every file and directory is printed or not.
+ * @param summary Boolean value whether the number of directories and files below all paths is printed after the trees
+ *                or not.
+ * @param stats Boolean value whether counters and timings of the walk are printed to stderr at exit or not.
+ * @param stats_json Boolean value whether the stats are printed as JSON instead of a table or not.
+ * @param max_entries The most entries printed below the path, 0 for no limit.
+ * @param per_directory_limit The most children printed per directory, 0 for no limit.
+ * @param time_budget_ms How long directories are read for in milliseconds, 0 for no limit.
+ * @param sort_order The order the children of a directory are printed in.
+ * @param output_format How the tree is printed.
+ * @param filter The patterns of the files left out of the tree, and whether .gitignore files are honored.
  */
 typedef struct Program_Settings
 {
-  char path_str[200];
+  char* path_str;
+  char** path_strings;
+  int path_count;
   int depth;
   bool help;
+  bool memory_usage;
+  int thread_count;
+  bool use_uring;
+  bool lock_output;
+  char* cache_path;
+  char* save_path;
+  char* load_path;
+  bool count;
+  bool diff;
+  char* find_pattern;
+  bool watch;
+  bool watch_changes_only;
+  bool follow_links;
+  bool disk_usage;
+  bool hash;
+  bool summary;
+  bool stats;
+  bool stats_json;
+  int max_entries;
+  int per_directory_limit;
+  int time_budget_ms;
+  Sort_Order sort_order;
+  Output_Format output_format;
+  Path_Filter filter;
 } Program_Settings;
 
 /*> Constant Declarations ********************************************************************************************/
@@ -0,0 +1,135 @@
+/*> Description ******************************************************************************************************/
+/**
+ * @brief Declares the binary snapshot format a Directory_Tree is saved in, and functions to save and load it.
+ * @file snapshot.h
+ */
+
+/*> Multiple Inclusion Protection ************************************************************************************/
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+/*> Includes *********************************************************************************************************/
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "directory_tree.h"
+#include "string_util.h"
+
+/*> Defines **********************************************************************************************************/
+#define SNAPSHOT_MAGIC "TREESNAP"
+#define SNAPSHOT_VERSION 3
+#define SNAPSHOT_NO_INDEX UINT32_MAX
+
+#define SNAPSHOT_DIRECTORY 0x1
+#define SNAPSHOT_CHILDREN_READ 0x2
+#define SNAPSHOT_REFERENCE 0x4
+#define SNAPSHOT_HAS_SIZE 0x8
+
+/*> Type Declarations ************************************************************************************************/
+/**
+ * @brief The header at the start of a snapshot file. It is followed by node_count nodes and then the string blob.
+ * @param magic SNAPSHOT_MAGIC, not null terminated.
+ * @param version SNAPSHOT_VERSION.
+ * @param node_size The size of a Snapshot_Node, to reject files written by an incompatible build.
+ * @param node_count The number of nodes.
+ * @param strings_size The number of bytes of the string blob.
+ */
+typedef struct Snapshot_Header
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t node_size;
+  uint64_t node_count;
+  uint64_t strings_size;
+} Snapshot_Header;
+
+/**
+ * @brief One node of a snapshot. Nodes are stored breadth first, so the children of a node are stored next to each
+ *        other, and node 0 is the base. Nodes refer to each other by index, so the file can be used where it is loaded.
+ * @param name_offset The offset of the name in the string blob. The base stores its path, other nodes their name
+ *                    without the '/' of directories. Names are null terminated.
+ * @param name_length The length of the name.
+ * @param flags SNAPSHOT_DIRECTORY if the node is a directory, SNAPSHOT_CHILDREN_READ if its children were read,
+ *              SNAPSHOT_REFERENCE if it is a directory reached again through a link, whose children are listed
+ *              elsewhere, SNAPSHOT_HAS_SIZE if it is a file whose size and modification time are recorded.
+ * @param parent The index of the parent, SNAPSHOT_NO_INDEX for the base.
+ * @param first_child The index of the first child, SNAPSHOT_NO_INDEX if the node has no children.
+ * @param next_sibling The index of the next child of the same parent, SNAPSHOT_NO_INDEX for the last child.
+ * @param children_count The number of children.
+ * @param depth The depth of the tree from the node when it was read.
+ * @param descendant_count The number of nodes below the node, so a subtree can be counted without visiting it.
+ * @param directory_descendant_count The number of directories below the node.
+ * @param reserved Padding, always 0.
+ * @param stamp The identity and change times of a directory whose children were read.
+ * @param size The size of a file in bytes, only set with SNAPSHOT_HAS_SIZE.
+ * @param modification_time_ns The last modification time of a file in nanoseconds, only set with SNAPSHOT_HAS_SIZE.
+ */
+typedef struct Snapshot_Node
+{
+  uint64_t name_offset;
+  uint32_t name_length;
+  uint32_t flags;
+  uint32_t parent;
+  uint32_t first_child;
+  uint32_t next_sibling;
+  uint32_t children_count;
+  int32_t depth;
+  uint32_t descendant_count;
+  uint32_t directory_descendant_count;
+  uint32_t reserved;
+  Directory_Stamp stamp;
+  uint64_t size;
+  int64_t modification_time_ns;
+} Snapshot_Node;
+
+/**
+ * @brief A snapshot mapped into memory. Nodes and names are used where they are in the file, and only checked when
+ *        they are walked, so loading does not depend on the number of nodes and pages are only read when they are
+ *        used.
+ * @param data The contents of the file, mapped read only.
+ * @param size The size of the file.
+ * @param header_p The header, at the start of data.
+ * @param nodes The nodes, header_p->node_count long.
+ * @param strings The string blob.
+ */
+typedef struct Snapshot
+{
+  void* data;
+  size_t size;
+  Snapshot_Header* header_p;
+  Snapshot_Node* nodes;
+  char* strings;
+} Snapshot;
+
+/*> Constant Declarations ********************************************************************************************/
+
+/*> Variable Declarations ********************************************************************************************/
+
+/*> Function Declarations ********************************************************************************************/
+bool save_directory_tree_snapshot(Directory_Tree* dir_tree, char* file_path, bool record_sizes);
+
+Snapshot* load_snapshot(char* file_path);
+
+void free_snapshot(Snapshot* snapshot_p);
+
+uint32_t find_snapshot_path(Snapshot* snapshot_p, char* path);
+
+void append_snapshot_path(Snapshot* snapshot_p, uint32_t node_index, String_Buffer* path_p);
+
+bool snapshot_children_are_valid(Snapshot* snapshot_p, uint32_t node_index);
+
+/*> Inline Function Definitions **************************************************************************************/
+/**
+ * @brief Gets the name of a snapshot node.
+ * @param snapshot_p [in] The snapshot.
+ * @param node_p [in] The node.
+ * @return The null terminated name.
+ */
+static inline char* snapshot_node_name(Snapshot* snapshot_p, Snapshot_Node* node_p)
+{
+  return snapshot_p->strings + node_p->name_offset;
+}
+
+/*> End of Multiple Inclusion Protection *****************************************************************************/
+#endif
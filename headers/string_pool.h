@@ -0,0 +1,49 @@
+/*> Description ******************************************************************************************************/
+/**
+ * @brief Declares a pool of interned strings, so equal file names are stored once per tree.
+ * @file string_pool.h
+ */
+
+/*> Multiple Inclusion Protection ************************************************************************************/
+#ifndef STRING_POOL_H
+#define STRING_POOL_H
+
+/*> Includes *********************************************************************************************************/
+#include <stddef.h>
+
+#include "arena.h"
+
+/*> Defines **********************************************************************************************************/
+#define INITIAL_STRING_POOL_SLOT_COUNT 256
+
+/*> Type Declarations ************************************************************************************************/
+/**
+ * @brief Interns strings into an arena. The strings live as long as the arena, the table finding them is only needed
+ *        while strings are added and can be freed before the arena.
+ * @param arena_p The arena the strings are copied to.
+ * @param slots An open addressing hash table of the interned strings, NULL for empty slots. Allocated when the first
+ *              string is interned.
+ * @param mask The number of slots minus one.
+ * @param count The number of interned strings.
+ */
+typedef struct String_Pool
+{
+  Arena* arena_p;
+  char** slots;
+  size_t mask;
+  size_t count;
+} String_Pool;
+
+/*> Constant Declarations ********************************************************************************************/
+
+/*> Variable Declarations ********************************************************************************************/
+
+/*> Function Declarations ********************************************************************************************/
+void string_pool_init(String_Pool* pool_p, Arena* arena_p);
+
+char* string_pool_intern(String_Pool* pool_p, const char* str, size_t length);
+
+void string_pool_free(String_Pool* pool_p);
+
+/*> End of Multiple Inclusion Protection *****************************************************************************/
+#endif
@@ -10,10 +10,26 @@
 
 /*> Includes *********************************************************************************************************/
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
 
 /*> Defines **********************************************************************************************************/
+#define FORMATTED_SIZE_CAPACITY 24
 
 /*> Type Declarations ************************************************************************************************/
+/**
+ * @brief A growable, null terminated string that is reused to avoid allocations, e.g. for building paths.
+ * @param string The null terminated string.
+ * @param length The length of string.
+ * @param capacity The number of bytes allocated for string.
+ */
+typedef struct String_Buffer
+{
+  char* string;
+  size_t length;
+  size_t capacity;
+} String_Buffer;
 
 /*> Constant Declarations ********************************************************************************************/
 
@@ -22,6 +38,22 @@
 /*> Function Declarations ********************************************************************************************/
 bool is_numeric_string(char* str);
 
+void string_buffer_init(String_Buffer* buffer_p);
+
+void string_buffer_append(String_Buffer* buffer_p, const char* str, size_t length);
+
+char* string_buffer_extend(String_Buffer* buffer_p, size_t length);
+
+void string_buffer_free(String_Buffer* buffer_p);
+
+uint64_t hash_string(const char* str, size_t length);
+
+int format_size(uint64_t size, char* buffer);
+
+bool json_needs_escaping(const char* str, size_t length);
+
+void string_buffer_append_json(String_Buffer* buffer_p, const char* str, size_t length);
+
 /*> Inline Function Definitions **************************************************************************************/
 /**
  * @brief Gets the last char of a string.
@@ -44,5 +76,16 @@ static inline bool strings_are_equal(char* str1, char* str2)
   return strcmp(str1, str2) == 0;
 }
 
+/**
+ * @brief Shortens the string of a String_Buffer without releasing any memory.
+ * @param buffer_p [in/out] The buffer.
+ * @param length [in] The new length, must not be longer than the current length.
+ */
+static inline void string_buffer_truncate(String_Buffer* buffer_p, size_t length)
+{
+  buffer_p->length = length;
+  buffer_p->string[length] = '\0';
+}
+
 /*> End of Multiple Inclusion Protection *****************************************************************************/
 #endif 
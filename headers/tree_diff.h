@@ -0,0 +1,34 @@
+/*> Description ******************************************************************************************************/
+/**
+ * @brief Declares the diff of two trees, each either a directory on disk or a saved snapshot.
+ * @file tree_diff.h
+ */
+
+/*> Multiple Inclusion Protection ************************************************************************************/
+#ifndef TREE_DIFF_H
+#define TREE_DIFF_H
+
+/*> Includes *********************************************************************************************************/
+#include <stdbool.h>
+
+#include "directory_tree.h"
+#include "output_writer.h"
+
+/*> Defines **********************************************************************************************************/
+#define INITIAL_DIFF_ENTRY_CAPACITY 256
+
+/*> Type Declarations ************************************************************************************************/
+
+/*> Constant Declarations ********************************************************************************************/
+
+/*> Variable Declarations ********************************************************************************************/
+
+/*> Function Declarations ********************************************************************************************/
+bool diff_directory_trees(char* old_path_string, 
+                          char* new_path_string, 
+                          bool compare_contents, 
+                          Output_Format output_format, 
+                          Output_Writer* writer_p);
+
+/*> End of Multiple Inclusion Protection *****************************************************************************/
+#endif
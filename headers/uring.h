@@ -0,0 +1,89 @@
+/*> Description ******************************************************************************************************/
+/**
+ * @brief Declares a minimal io_uring backend used to run the metadata lookups and opens of a directory in batches.
+ * @file uring.h
+ */
+
+/*> Multiple Inclusion Protection ************************************************************************************/
+#ifndef URING_H
+#define URING_H
+
+/*> Includes *********************************************************************************************************/
+#include <linux/io_uring.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <linux/stat.h>
+
+/*> Defines **********************************************************************************************************/
+#define URING_ENTRIES 256
+
+/*> Type Declarations ************************************************************************************************/
+/**
+ * @brief One request of a batch, on an entry of a directory.
+ * @param name The name of the entry, relative to the directory. Must stay valid until the batch is done.
+ * @param data_p Data of the caller, not used by the batch.
+ * @param result The result of the request: 0 or an opened fd if it succeeded, a negative errno otherwise.
+ * @param info The result of a statx request.
+ */
+typedef struct Uring_Request
+{
+  char* name;
+  void* data_p;
+  int result;
+  struct statx info;
+} Uring_Request;
+
+/**
+ * @brief An io_uring instance with its submission and completion rings mapped.
+ * @param ring_fd The fd of the io_uring instance.
+ * @param entries The number of entries of the submission ring.
+ * @param sq_head The head of the submission ring, advanced by the kernel.
+ * @param sq_tail The tail of the submission ring, advanced when requests are queued.
+ * @param sq_ring_mask The mask for indexes into the submission ring.
+ * @param sq_array The submission ring, holding indexes into sqes.
+ * @param sqes The submission queue entries.
+ * @param cq_head The head of the completion ring, advanced when completions are consumed.
+ * @param cq_tail The tail of the completion ring, advanced by the kernel.
+ * @param cq_ring_mask The mask for indexes into the completion ring.
+ * @param cqes The completion queue entries.
+ * @param sq_ring_p The mapping of the submission ring.
+ * @param sq_ring_size The size of the mapping of the submission ring.
+ * @param cq_ring_p The mapping of the completion ring, the same as sq_ring_p if the kernel maps both at once.
+ * @param cq_ring_size The size of the mapping of the completion ring.
+ * @param sqes_size The size of the mapping of sqes.
+ */
+typedef struct Uring
+{
+  int ring_fd;
+  unsigned entries;
+  unsigned* sq_head;
+  unsigned* sq_tail;
+  unsigned* sq_ring_mask;
+  unsigned* sq_array;
+  struct io_uring_sqe* sqes;
+  unsigned* cq_head;
+  unsigned* cq_tail;
+  unsigned* cq_ring_mask;
+  struct io_uring_cqe* cqes;
+  void* sq_ring_p;
+  size_t sq_ring_size;
+  void* cq_ring_p;
+  size_t cq_ring_size;
+  size_t sqes_size;
+} Uring;
+
+/*> Constant Declarations ********************************************************************************************/
+
+/*> Variable Declarations ********************************************************************************************/
+
+/*> Function Declarations ********************************************************************************************/
+bool uring_init(Uring* uring_p);
+
+void uring_free(Uring* uring_p);
+
+void uring_statx_batch(Uring* uring_p, int directory_fd, Uring_Request* requests, int count, int flags);
+
+void uring_openat_batch(Uring* uring_p, int directory_fd, Uring_Request* requests, int count, int flags);
+
+/*> End of Multiple Inclusion Protection *****************************************************************************/
+#endif
@@ -0,0 +1,109 @@
+/*> Description ******************************************************************************************************/
+/**
+ * @brief Declares the counters and timers of --stats. Each kind of call made while walking and printing a tree is
+ *        counted and timed, and the entries of every level are counted. When stats are off, every function returns
+ *        after one well predicted branch. Defining WALK_STATS_DISABLED compiles them out completely.
+ * @file walk_stats.h
+ */
+
+/*> Multiple Inclusion Protection ************************************************************************************/
+#ifndef WALK_STATS_H
+#define WALK_STATS_H
+
+/*> Includes *********************************************************************************************************/
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+/*> Defines **********************************************************************************************************/
+#define WALK_STATS_MAX_LEVEL 64
+
+/*> Type Declarations ************************************************************************************************/
+/**
+ * @brief The kinds of calls that are counted and timed. The last kinds are whole phases, each counted once.
+ */
+typedef enum Walk_Stat_Kind
+{
+  WALK_STAT_OPEN,
+  WALK_STAT_READ,
+  WALK_STAT_LOOKUP,
+  WALK_STAT_ALLOCATE,
+  WALK_STAT_WRITE,
+  WALK_STAT_HASH,
+  WALK_STAT_CREATE_PHASE,
+  WALK_STAT_PRINT_PHASE,
+  WALK_STAT_STREAM_PHASE,
+  WALK_STAT_KIND_COUNT
+} Walk_Stat_Kind;
+
+/**
+ * @brief The formats the stats can be printed in.
+ */
+typedef enum Walk_Stats_Format
+{
+  WALK_STATS_TEXT,
+  WALK_STATS_JSON
+} Walk_Stats_Format;
+
+/*> Constant Declarations ********************************************************************************************/
+
+/*> Variable Declarations ********************************************************************************************/
+extern bool walk_stats_enabled;
+
+/*> Function Declarations ********************************************************************************************/
+void walk_stats_enable(Walk_Stats_Format format);
+
+void walk_stats_add(Walk_Stat_Kind kind, uint64_t start_ns, uint64_t count);
+
+void walk_stats_add_entries(int level, uint64_t count);
+
+/*> Inline Function Definitions **************************************************************************************/
+/**
+ * @brief Starts timing a call.
+ * @return The current time in nanoseconds, or 0 if stats are off.
+ */
+static inline uint64_t walk_stats_start(void)
+{
+#ifndef WALK_STATS_DISABLED
+  if (walk_stats_enabled)
+  {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (uint64_t) time.tv_sec * 1000000000ULL + (uint64_t) time.tv_nsec;
+  }
+#endif
+  return 0;
+}
+
+/**
+ * @brief Stops timing a call, and counts it.
+ * @param kind [in] The kind of call.
+ * @param start_ns [in] The time returned by walk_stats_start.
+ * @param count [in] The number of calls, e.g. the number of lookups of a batch.
+ */
+static inline void walk_stats_stop(Walk_Stat_Kind kind, uint64_t start_ns, uint64_t count)
+{
+#ifndef WALK_STATS_DISABLED
+  if (walk_stats_enabled)
+  {
+    walk_stats_add(kind, start_ns, count);
+  }
+#endif
+}
+
+/**
+ * @brief Counts an entry found at a level of the tree.
+ * @param level [in] The level of the entry, 1 for the children of the base.
+ */
+static inline void walk_stats_count_entry(int level)
+{
+#ifndef WALK_STATS_DISABLED
+  if (walk_stats_enabled)
+  {
+    walk_stats_add_entries(level, 1);
+  }
+#endif
+}
+
+/*> End of Multiple Inclusion Protection *****************************************************************************/
+#endif
@@ -0,0 +1,35 @@
+/*> Description ******************************************************************************************************/
+/**
+ * @brief Declares the watch mode, which keeps a Directory_Tree up to date with inotify and prints it when it changes.
+ * @file watch.h
+ */
+
+/*> Multiple Inclusion Protection ************************************************************************************/
+#ifndef WATCH_H
+#define WATCH_H
+
+/*> Includes *********************************************************************************************************/
+#include <stdbool.h>
+
+#include "directory_tree.h"
+#include "output_writer.h"
+
+/*> Defines **********************************************************************************************************/
+#define WATCH_DEBOUNCE_MS 100
+#define WATCH_MAX_DELAY_MS 1000
+
+/*> Type Declarations ************************************************************************************************/
+
+/*> Constant Declarations ********************************************************************************************/
+
+/*> Variable Declarations ********************************************************************************************/
+
+/*> Function Declarations ********************************************************************************************/
+void watch_directory_tree(char* base_path_string, 
+                          Directory_Tree* dir_tree, 
+                          Directory_Tree_Options* options_p, 
+                          Output_Writer* writer_p, 
+                          bool print_changes_only);
+
+/*> End of Multiple Inclusion Protection *****************************************************************************/
+#endif
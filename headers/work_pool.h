@@ -0,0 +1,45 @@
+/*> Description ******************************************************************************************************/
+/**
+ * @brief Declares a thread pool where every worker has its own deque of tasks and steals from the others when idle.
+ * @file work_pool.h
+ */
+
+/*> Multiple Inclusion Protection ************************************************************************************/
+#ifndef WORK_POOL_H
+#define WORK_POOL_H
+
+/*> Includes *********************************************************************************************************/
+
+/*> Defines **********************************************************************************************************/
+#define MAX_WORKER_COUNT 256
+
+/*> Type Declarations ************************************************************************************************/
+typedef struct Work_Pool Work_Pool;
+
+/**
+ * @brief A function run by a worker of a Work_Pool.
+ * @param pool_p The pool running the task, new tasks can be pushed to it.
+ * @param worker_index The index of the worker running the task, in the range [0, thread count).
+ * @param argument_p The argument the task was pushed with.
+ */
+typedef void (*Work_Function)(Work_Pool* pool_p, int worker_index, void* argument_p);
+
+/*> Constant Declarations ********************************************************************************************/
+
+/*> Variable Declarations ********************************************************************************************/
+
+/*> Function Declarations ********************************************************************************************/
+Work_Pool* work_pool_create(int thread_count, void* context_p);
+
+void* work_pool_context(Work_Pool* pool_p);
+
+int work_pool_thread_count(Work_Pool* pool_p);
+
+void work_pool_push(Work_Pool* pool_p, int worker_index, Work_Function function, void* argument_p);
+
+void work_pool_wait(Work_Pool* pool_p);
+
+void work_pool_destroy(Work_Pool* pool_p);
+
+/*> End of Multiple Inclusion Protection *****************************************************************************/
+#endif